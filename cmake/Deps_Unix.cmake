@@ -92,6 +92,14 @@ if (WITH_ZIM)
 
     pkg_check_modules(ZIM REQUIRED IMPORTED_TARGET libzim)
     target_link_libraries(${GOLDENDICT} PRIVATE PkgConfig::ZIM)
+
+    # cache size control appeared in libzim 8.2, the cluster cache became process-wide in libzim 9
+    if (ZIM_VERSION VERSION_GREATER_EQUAL 8.2)
+        target_compile_definitions(${GOLDENDICT} PRIVATE ZIM_CACHE_CONTROL)
+    endif ()
+    if (ZIM_VERSION VERSION_GREATER_EQUAL 9.0)
+        target_compile_definitions(${GOLDENDICT} PRIVATE ZIM_GLOBAL_CLUSTER_CACHE)
+    endif ()
 endif ()
 
 if (USE_SYSTEM_FMT)
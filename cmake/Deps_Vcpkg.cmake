@@ -24,6 +24,11 @@ target_link_libraries(${GOLDENDICT}
         ZLIB::ZLIB
 )
 
+# vcpkg ships libzim 9, see Deps_Unix.cmake
+if (PKGCONFIG_DEPS_libzim_VERSION VERSION_GREATER_EQUAL 9.0)
+    target_compile_definitions(${GOLDENDICT} PRIVATE ZIM_CACHE_CONTROL ZIM_GLOBAL_CLUSTER_CACHE)
+endif ()
+
 if (WITH_VCPKG_BREAKPAD)
     find_package(unofficial-breakpad REQUIRED)
     target_link_libraries(${GOLDENDICT} PRIVATE unofficial::breakpad::libbreakpad_client)
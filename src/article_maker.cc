@@ -11,6 +11,7 @@
 #include "utils.hh"
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QTextDocumentFragment>
 #include <QUrl>
 #include <QStyleHints>
@@ -23,11 +24,40 @@ using std::string;
 using std::set;
 using std::list;
 
+namespace {
+
+/// How many compounds of a phrase not found are looked up at once
+int const MaxCompoundLookups = 8;
+
+} // namespace
+
 inline bool ankiConnectEnabled()
 {
   return GlobalBroadcaster::instance()->getPreference()->ankiConnectServer.enabled;
 }
 
+void CollapsedBodies::put( QString const & url, std::string body )
+{
+  QMutexLocker _( &mutex );
+
+  qsizetype const cost = std::max< qsizetype >( body.size(), 1 );
+  bodies.insert( url, new std::string( std::move( body ) ), cost );
+}
+
+bool CollapsedBodies::get( QString const & url, std::string & body )
+{
+  QMutexLocker _( &mutex );
+
+  std::string const * const found = bodies.object( url );
+
+  if ( !found ) {
+    return false;
+  }
+
+  body = *found;
+  return true;
+}
+
 ArticleMaker::ArticleMaker( vector< sptr< Dictionary::Class > > const & dictionaries_,
                             vector< Instances::Group > const & groups_,
                             const Config::Preferences & cfg_ ):
@@ -35,12 +65,75 @@ ArticleMaker::ArticleMaker( vector< sptr< Dictionary::Class > > const & dictiona
   groups( groups_ ),
   cfg( cfg_ )
 {
+  auto const dropHeaders = [ this ]() {
+    QMutexLocker _( &htmlHeadersMutex );
+    htmlHeaders.clear();
+  };
+
+  connect( &styleWatcher, &QFileSystemWatcher::fileChanged, this, dropHeaders );
+  connect( &styleWatcher, &QFileSystemWatcher::directoryChanged, this, dropHeaders );
 }
 
 
 std::string ArticleMaker::makeHtmlHeader( QString const & word, QString const & icon, bool expandOptionalParts ) const
 {
-  string result = R"(<!DOCTYPE html>
+  /// Handling Dark reader mode.
+
+  bool darkReaderModeEnabled = false;
+
+  if ( GlobalBroadcaster::instance()->getPreference()->darkReaderMode == Config::Dark::On ) {
+    darkReaderModeEnabled = true;
+  }
+
+#if QT_VERSION >= QT_VERSION_CHECK( 6, 5, 0 )
+  if ( GlobalBroadcaster::instance()->getPreference()->darkReaderMode == Config::Dark::Auto
+  #if !defined( Q_OS_WINDOWS )
+       // For macOS & Linux, uses "System's style hint". There is no darkMode setting in GD for them.
+       && QGuiApplication::styleHints()->colorScheme() == Qt::ColorScheme::Dark
+  #else
+       // For Windows, uses the setting in GD
+       && GlobalBroadcaster::instance()->getPreference()->darkMode == Config::Dark::On
+  #endif
+  ) {
+    darkReaderModeEnabled = true;
+  }
+#endif
+
+  QString const key = QString( "%1|%2|%3|%4" )
+                        .arg( cfg.displayStyle, cfg.addonStyle )
+                        .arg( int( expandOptionalParts ) )
+                        .arg( int( darkReaderModeEnabled ) );
+
+  QMutexLocker _( &htmlHeadersMutex );
+
+  auto header = htmlHeaders.constFind( key );
+
+  if ( header == htmlHeaders.constEnd() ) {
+    header = htmlHeaders.insert( key, makeHtmlHeaderParts( expandOptionalParts, darkReaderModeEnabled ) );
+  }
+
+  string result = header->head;
+
+  result += "<title>" + Html::escape( word.toStdString() ) + "</title>";
+
+  // This doesn't seem to be much of influence right now, but we'll keep
+  // it anyway.
+  if ( icon.size() ) {
+    result +=
+      R"(<link rel="icon" type="image/png" href="qrc:///flags/)" + Html::escape( icon.toUtf8().data() ) + "\" >\n";
+  }
+
+  result += header->tail;
+
+  return result;
+}
+
+ArticleMaker::HtmlHeader ArticleMaker::makeHtmlHeaderParts( bool expandOptionalParts, bool darkReaderModeEnabled ) const
+{
+  HtmlHeader header;
+  string & result = header.head;
+
+  result = R"(<!DOCTYPE html>
 <html><head>
 <meta charset="utf-8">
 )";
@@ -92,12 +185,12 @@ std::string ArticleMaker::makeHtmlHeader( QString const & word, QString const &
         cfg.displayStyle.toStdString() );
     }
 
-    result += readCssFile( Config::getUserCssFileName(), "all" );
+    result += linkCssFile( Config::getUserCssFileName(), "all" );
 
     if ( !cfg.addonStyle.isEmpty() ) {
       QString name = Config::getStylesDir() + cfg.addonStyle + QDir::separator() + "article-style.css";
 
-      result += readCssFile( name, "all" );
+      result += linkCssFile( name, "all" );
     }
 
     // Turn on/off expanding of article optional parts
@@ -116,56 +209,28 @@ std::string ArticleMaker::makeHtmlHeader( QString const & word, QString const &
   {
     result += R"(<link href="qrc:///article-style-print.css"  media="print" rel="stylesheet" type="text/css">)";
 
-    result += readCssFile( Config::getUserCssPrintFileName(), "print" );
+    result += linkCssFile( Config::getUserCssPrintFileName(), "print" );
 
     if ( !cfg.addonStyle.isEmpty() ) {
       QString name = Config::getStylesDir() + cfg.addonStyle + QDir::separator() + "article-style-print.css";
-      result += readCssFile( name, "print" );
+      result += linkCssFile( name, "print" );
     }
   }
 
-  result += "<title>" + Html::escape( word.toStdString() ) + "</title>";
-
-  // This doesn't seem to be much of influence right now, but we'll keep
-  // it anyway.
-  if ( icon.size() ) {
-    result +=
-      R"(<link rel="icon" type="image/png" href="qrc:///flags/)" + Html::escape( icon.toUtf8().data() ) + "\" >\n";
-  }
-
-  result += R"(<script src="qrc:///scripts/gd-builtin.js"></script>)";
-  result += R"(<script src="qrc:///scripts/mark.min.js"></script>)";
-
-  /// Handling Dark reader mode.
-
-  bool darkReaderModeEnabled = false;
+  // What follows the title and the icon
+  string & tail = header.tail;
 
-  if ( GlobalBroadcaster::instance()->getPreference()->darkReaderMode == Config::Dark::On ) {
-    darkReaderModeEnabled = true;
-  }
-
-#if QT_VERSION >= QT_VERSION_CHECK( 6, 5, 0 )
-  if ( GlobalBroadcaster::instance()->getPreference()->darkReaderMode == Config::Dark::Auto
-  #if !defined( Q_OS_WINDOWS )
-       // For macOS & Linux, uses "System's style hint". There is no darkMode setting in GD for them.
-       && QGuiApplication::styleHints()->colorScheme() == Qt::ColorScheme::Dark
-  #else
-       // For Windows, uses the setting in GD
-       && GlobalBroadcaster::instance()->getPreference()->darkMode == Config::Dark::On
-  #endif
-  ) {
-    darkReaderModeEnabled = true;
-  }
-#endif
+  tail += R"(<script src="qrc:///scripts/gd-builtin.js"></script>)";
+  tail += R"(<script src="qrc:///scripts/mark.min.js"></script>)";
 
   if ( darkReaderModeEnabled ) {
     //only enable this darkmode on modern style.
     if ( cfg.displayStyle == "modern" ) {
-      result += R"(<link href="qrc:///article-style-darkmode.css"  media="all" rel="stylesheet" type="text/css">)";
+      tail += R"(<link href="qrc:///article-style-darkmode.css"  media="all" rel="stylesheet" type="text/css">)";
     }
 
     // #242525 because Darkreader will invert pure white to this value
-    result += R"(
+    tail += R"(
 <script src="qrc:///scripts/darkreader.js"></script>
 <style>
 .gdarticlebody img{
@@ -211,30 +276,46 @@ std::string ArticleMaker::makeHtmlHeader( QString const & word, QString const &
 )";
   }
 
-  // load the `article-style.js` in user's config folder
+  // load the `article-style.js` in user's config folder. It's in the same
+  // directory as the user's stylesheet, which is watched for it showing up
   if ( auto userJsFile = Config::getUserJsFileName(); userJsFile.has_value() ) {
-    result += fmt::format( FMT_COMPILE( R"(<script src="file://{}" defer></script>)" ), userJsFile.value() );
+    tail += fmt::format( FMT_COMPILE( R"(<script src="file://{}" defer></script>)" ), userJsFile.value() );
   }
 
-  result += "</head><body>";
+  tail += "</head><body>";
 
-  return result;
+  return header;
 }
 
-std::string ArticleMaker::readCssFile( QString const & fileName, std::string media ) const
+std::string ArticleMaker::linkCssFile( QString const & fileName, std::string const & media ) const
 {
-  QFile addonCss( fileName );
-  std::string result;
-  if ( addonCss.open( QFile::ReadOnly ) ) {
-    QByteArray css = addonCss.readAll();
-    if ( !css.isEmpty() ) {
-      result += "<!-- Addon style css -->\n";
-      result += R"(<style type="text/css" media=")" + media + "\">\n";
-      result += css.data();
-      result += "</style>\n";
-    }
+  watchStyleFile( fileName );
+
+  QFileInfo const info( fileName );
+
+  if ( !info.isFile() || !info.size() ) {
+    return {};
+  }
+
+  // The modification time tells the copies of the file apart
+  return fmt::format( FMT_COMPILE( R"(<link href="{}?{}" media="{}" rel="stylesheet" type="text/css">)" ),
+                      Html::escape( QUrl::fromLocalFile( fileName ).toString( QUrl::FullyEncoded ).toStdString() ),
+                      info.lastModified().toMSecsSinceEpoch(),
+                      media );
+}
+
+void ArticleMaker::watchStyleFile( QString const & fileName ) const
+{
+  QFileInfo const info( fileName );
+
+  // A file is only watched while it's there, its directory tells when it shows up again
+  if ( info.isFile() && !styleWatcher.files().contains( info.absoluteFilePath() ) ) {
+    styleWatcher.addPath( info.absoluteFilePath() );
+  }
+
+  if ( info.absoluteDir().exists() && !styleWatcher.directories().contains( info.absolutePath() ) ) {
+    styleWatcher.addPath( info.absolutePath() );
   }
-  return result;
 }
 
 std::string ArticleMaker::makeNotFoundBody( QString const & word, QString const & group )
@@ -371,7 +452,8 @@ sptr< Dictionary::DataRequest > ArticleMaker::makeDefinitionFor( QString const &
       header,
       cfg.collapseBigArticles ? cfg.articleSizeLimit : -1,
       cfg.alwaysExpandOptionalParts,
-      ignoreDiacritics );
+      ignoreDiacritics,
+      cfg.lazyCollapsedArticles ? collapsedBodies : nullptr );
   }
   else {
     return std::make_shared< ArticleRequest >(
@@ -382,10 +464,42 @@ sptr< Dictionary::DataRequest > ArticleMaker::makeDefinitionFor( QString const &
       header,
       cfg.collapseBigArticles ? cfg.articleSizeLimit : -1,
       cfg.alwaysExpandOptionalParts,
-      ignoreDiacritics );
+      ignoreDiacritics,
+      cfg.lazyCollapsedArticles ? collapsedBodies : nullptr );
   }
 }
 
+sptr< Dictionary::DataRequest > ArticleMaker::makeArticleBodyFor( QString const & url,
+                                                                  QString const & dictId,
+                                                                  QString const & word,
+                                                                  vector< std::u32string > const & alts,
+                                                                  QString const & context,
+                                                                  bool ignoreDiacritics ) const
+{
+  if ( string body; collapsedBodies->get( url, body ) ) {
+    auto r = std::make_shared< Dictionary::DataRequestInstant >( true );
+    r->appendString( body );
+    return r;
+  }
+
+  for ( const auto & dictionary : dictionaries ) {
+    if ( dictId == QString::fromStdString( dictionary->getId() ) ) {
+      try {
+        return dictionary->getArticle( word.toStdU32String(),
+                                       alts,
+                                       Text::removeTrailingZero( context ),
+                                       ignoreDiacritics );
+      }
+      catch ( std::exception & e ) {
+        qWarning( "getArticle request error (%s) in \"%s\"", e.what(), dictionary->getName().c_str() );
+        break;
+      }
+    }
+  }
+
+  return std::make_shared< Dictionary::DataRequestInstant >( false );
+}
+
 sptr< Dictionary::DataRequest > ArticleMaker::makeNotFoundTextFor( QString const & word, QString const & group ) const
 {
   string result = makeHtmlHeader( word, QString(), true ) + makeNotFoundBody( word, group ) + "</body></html>";
@@ -450,14 +564,16 @@ ArticleRequest::ArticleRequest( QString const & word,
                                 string const & header,
                                 int sizeLimit,
                                 bool needExpandOptionalParts_,
-                                bool ignoreDiacritics_ ):
+                                bool ignoreDiacritics_,
+                                sptr< CollapsedBodies > collapsedBodies_ ):
   word( word ),
   group( group_ ),
   contexts( contexts_ ),
   activeDicts( activeDicts_ ),
   articleSizeLimit( sizeLimit ),
   needExpandOptionalParts( needExpandOptionalParts_ ),
-  ignoreDiacritics( ignoreDiacritics_ )
+  ignoreDiacritics( ignoreDiacritics_ ),
+  collapsedBodies( std::move( collapsedBodies_ ) )
 {
   // No need to lock dataMutex on construction
 
@@ -507,7 +623,7 @@ void ArticleRequest::altSearchFinished()
 
     altsDone = true; // So any pending signals in queued mode won't mess us up
 
-    vector< std::u32string > altsVector( alts.begin(), alts.end() );
+    altsVector.assign( alts.begin(), alts.end() );
 
     std::u32string wordStd = word.toStdU32String();
 
@@ -600,6 +716,32 @@ bool ArticleRequest::isCollapsable( Dictionary::DataRequest & req, QString const
   return collapse;
 }
 
+QUrl ArticleRequest::makeArticleBodyUrl( string const & dictId ) const
+{
+  QUrl url;
+  url.setScheme( "gdlookup" );
+  url.setHost( "localhost" );
+
+  Utils::Url::addQueryItem( url, "articlebody", QString::fromStdString( dictId ) );
+  Utils::Url::addQueryItem( url, "word", word );
+
+  for ( auto const & alt : altsVector ) {
+    Utils::Url::addQueryItem( url, "alt", QString::fromStdU32String( alt ) );
+  }
+
+  QString const context = contexts.value( QString::fromStdString( dictId ) );
+
+  if ( !context.isEmpty() ) {
+    Utils::Url::addQueryItem( url, "context", context );
+  }
+
+  if ( ignoreDiacritics ) {
+    Utils::Url::addQueryItem( url, "ignore_diacritics", "1" );
+  }
+
+  return url;
+}
+
 void ArticleRequest::bodyFinished()
 {
   if ( bodyDone ) {
@@ -682,14 +824,39 @@ void ArticleRequest::bodyFinished()
           head += link.arg( Html::escape( dictId ).c_str(), tr( "Make a new Anki note" ) ).toStdString();
         }
 
+        // The body of a collapsed article is left out, and loaded from this url
+        // by gdExpandArticle() if it ever gets expanded. It's kept until then.
+        bool const lazy = collapse && collapsedBodies && !errorString.size();
+
+        string lazyUrl;
+
+        if ( lazy ) {
+          QString const url = makeArticleBodyUrl( dictId ).toString( QUrl::FullyEncoded );
+
+          try {
+            vector< char > const & body = req.getFullData();
+            collapsedBodies->put( url, string( body.begin(), body.end() ) );
+          }
+          catch ( std::exception & e ) {
+            qWarning( "getFullData error: %s", e.what() );
+          }
+
+          lazyUrl = R"( data-gdlazy=")" + Html::escape( url.toStdString() ) + R"(")";
+        }
+
         fmt::format_to(
           std::back_inserter( head ),
           FMT_COMPILE(
-            R"(<div class="gdarticlebody gdlangfrom-{}" lang="{}" style="display:{}" id="gdarticlefrom-{}">)" ),
+            R"(<div class="gdarticlebody gdlangfrom-{}" lang="{}" style="display:{}" id="gdarticlefrom-{}"{}>)" ),
           LangCoder::intToCode2( activeDict->getLangFrom() ).toStdString(),
           LangCoder::intToCode2( activeDict->getLangTo() ).toStdString(),
           collapse ? "none" : "inline",
-          dictId );
+          dictId,
+          lazyUrl );
+
+        if ( lazy ) {
+          head += R"(<div class="gdarticlestub"></div>)";
+        }
 
         if ( errorString.size() ) {
           head += "<div class=\"gderrordesc\">"
@@ -699,7 +866,7 @@ void ArticleRequest::bodyFinished()
         appendString( head );
 
         try {
-          if ( req.dataSize() > 0 ) {
+          if ( req.dataSize() > 0 && !lazy ) {
             auto d = bodyRequests.front()->getFullData();
             appendDataSlice( &d.front(), d.size() );
           }
@@ -830,21 +997,17 @@ void ArticleRequest::stemmedSearchFinished()
 
   if ( splittedWords.first.size() > 1 ) // Contains more than one word
   {
-    disconnect( stemmedWordFinder.get(), &WordFinder::finished, this, &ArticleRequest::stemmedSearchFinished );
+    // Every word but the last starts a search for the longest compound made
+    // from it. They all go at once, starting with the two-word compounds.
+    compoundStarts.clear();
 
-    connect( stemmedWordFinder.get(),
-             &WordFinder::finished,
-             this,
-             &ArticleRequest::individualWordFinished,
-             Qt::QueuedConnection );
-
-    currentSplittedWordStart = -1;
-    currentSplittedWordEnd   = currentSplittedWordStart;
+    for ( int x = 0; x < splittedWords.first.size() - 1; ++x ) {
+      compoundStarts.push_back( CompoundStart{ x + 1, QString() } );
+    }
 
+    compoundStartsEmitted = 0;
     firstCompoundWasFound = false;
 
-    compoundSearchNextStep( false );
-
     continueMatching = true;
   }
 
@@ -856,177 +1019,228 @@ void ArticleRequest::stemmedSearchFinished()
 
   if ( continueMatching ) {
     update();
+
+    for ( int x = 0; x < int( compoundStarts.size() ); ++x ) {
+      lookUpCompound( x );
+    }
+
+    startCompoundLookups();
   }
   else {
     finish();
   }
 }
 
-void ArticleRequest::compoundSearchNextStep( bool lastSearchSucceeded )
+void ArticleRequest::lookUpCompound( int start )
 {
-  if ( !lastSearchSucceeded ) {
-    // Last search was unsuccessful. First, emit what we had.
+  QString const compound = makeSplittedWordCompound( start, compoundStarts[ start ].end );
 
-    string footer;
+  auto i = compoundMatches.constFind( compound );
 
-    if ( lastGoodCompoundResult.size() ) // We have something to append
-    {
-      if ( !firstCompoundWasFound ) {
-        // Append the beginning
-        footer += R"(<div class="gdstemmedsuggestion"><span class="gdstemmedsuggestion_head">)"
-          + Html::escape( tr( "Compound expressions: " ).toUtf8().data() )
-          + "</span><span class=\"gdstemmedsuggestion_body\">";
+  if ( i == compoundMatches.constEnd() ) {
+    compoundMatches.insert( compound, CompoundMatch::Pending );
+    queuedCompounds.push_back( compound );
+  }
+  else if ( *i != CompoundMatch::Pending ) {
+    // The same words were already looked up from another start
+    advanceCompoundStart( start, *i );
+  }
+}
 
-        firstCompoundWasFound = true;
-      }
-      else {
-        // Append the separator
-        footer += " / ";
+void ArticleRequest::startCompoundLookups()
+{
+  while ( !queuedCompounds.empty() && compoundLookups.size() < MaxCompoundLookups ) {
+    sptr< WordFinder > finder;
+
+    for ( auto const & f : compoundFinders ) {
+      if ( !compoundLookups.contains( f.get() ) ) {
+        finder = f;
+        break;
       }
+    }
 
-      footer += linkWord( lastGoodCompoundResult );
+    if ( !finder ) {
+      finder = std::make_shared< WordFinder >( this );
 
-      lastGoodCompoundResult.clear();
+      connect(
+        finder.get(),
+        &WordFinder::finished,
+        this,
+        [ this, f = finder.get() ]() {
+          individualWordFinished( f );
+        },
+        Qt::QueuedConnection );
+
+      compoundFinders.push_back( finder );
     }
 
-    // Then, start a new search for the next word, if possible
+    compoundLookups.insert( finder.get(), queuedCompounds.front() );
 
-    if ( currentSplittedWordStart >= splittedWords.first.size() - 2 ) {
-      // The last word was the last possible to start from
+    //  qDebug( "Looking up %s", qPrintable( queuedCompounds.front() ) );
 
-      if ( firstCompoundWasFound ) {
-        footer += "</span>";
-      }
+    finder->expressionMatch( queuedCompounds.front(),
+                             activeDicts,
+                             40, // Would one be enough? Leave 40 to be safe.
+                             Dictionary::SuitableForCompoundSearching );
 
-      // Now add links to all the individual words. They conclude the result.
+    queuedCompounds.pop_front();
+  }
+}
 
-      footer += R"(<div class="gdstemmedsuggestion"><span class="gdstemmedsuggestion_head">)"
-        + Html::escape( tr( "Individual words: " ).toUtf8().data() )
-        + "</span><span class=\"gdstemmedsuggestion_body\"";
-      if ( splittedWords.first[ 0 ].isRightToLeft() ) {
-        footer += " dir=\"rtl\"";
-      }
-      footer += ">";
+void ArticleRequest::individualWordFinished( WordFinder * finder )
+{
+  if ( isFinished() || !compoundLookups.contains( finder ) ) {
+    return;
+  }
 
-      footer += escapeSpacing( splittedWords.second[ 0 ] );
+  QString const compound = compoundLookups.take( finder );
 
-      for ( int x = 0; x < splittedWords.first.size(); ++x ) {
-        footer += linkWord( splittedWords.first[ x ] );
-        footer += escapeSpacing( splittedWords.second[ x + 1 ] );
-      }
+  CompoundMatch match = CompoundMatch::None;
 
-      footer += "</span>";
+  WordFinder::SearchResults const & results = finder->getResults();
 
-      footer += "</body></html>";
+  if ( results.size() ) {
+    std::u32string source = Folding::applySimpleCaseOnly( compound );
 
-      appendString( footer );
+    for ( unsigned x = 0; x < results.size(); ++x ) {
+      if ( results[ x ].second ) {
+        // Spelling suggestion match found. No need to continue.
+        match = CompoundMatch::Exact;
+        break;
+      }
 
-      finish();
+      // Prefix match found. Check if the aliases are acceptable.
 
-      return;
-    }
+      std::u32string result( Folding::applySimpleCaseOnly( results[ x ].first ) );
 
-    if ( footer.size() ) {
-      appendString( footer );
-      update();
-    }
+      if ( source.size() <= result.size() && result.compare( 0, source.size(), source ) == 0 ) {
+        // The resulting string begins with the source one
 
-    // Advance to the next word and start from looking up two words
-    ++currentSplittedWordStart;
-    currentSplittedWordEnd = currentSplittedWordStart + 1;
-  }
-  else {
-    // Last lookup succeeded -- see if we can try the larger sequence
+        match = CompoundMatch::Prefix;
 
-    if ( currentSplittedWordEnd < splittedWords.first.size() - 1 ) {
-      // We can, indeed.
-      ++currentSplittedWordEnd;
+        if ( source.size() == result.size() ) {
+          // Got the match. No need to continue.
+          match = CompoundMatch::Exact;
+          break;
+        }
+      }
     }
-    else {
-      // We can't. Emit what we have and start over.
-
-      ++currentSplittedWordEnd; // So we could use the same code for result
-                                // emitting
+  }
 
-      // Initiate new lookup
-      compoundSearchNextStep( false );
+  compoundMatches[ compound ] = match;
 
-      return;
+  // Move on every start which waited for these words
+  for ( int x = 0; x < int( compoundStarts.size() ); ++x ) {
+    if ( !compoundStarts[ x ].done && makeSplittedWordCompound( x, compoundStarts[ x ].end ) == compound ) {
+      advanceCompoundStart( x, match );
     }
   }
 
-  // Build the compound sequence
+  startCompoundLookups();
 
-  currentSplittedWordCompound = makeSplittedWordCompound();
+  emitCompoundResults();
+}
 
-  // Look it up
+void ArticleRequest::advanceCompoundStart( int start, CompoundMatch match )
+{
+  CompoundStart & s = compoundStarts[ start ];
 
-  //  qDebug( "Looking up %s", qPrintable( currentSplittedWordCompound ) );
+  if ( match == CompoundMatch::Exact ) {
+    s.lastGoodResult = makeSplittedWordCompound( start, s.end );
+  }
 
-  stemmedWordFinder->expressionMatch( currentSplittedWordCompound,
-                                      activeDicts,
-                                      40, // Would one be enough? Leave 40 to be safe.
-                                      Dictionary::SuitableForCompoundSearching );
+  if ( match != CompoundMatch::None && s.end < splittedWords.first.size() - 1 ) {
+    // Try the larger sequence
+    ++s.end;
+    lookUpCompound( start );
+  }
+  else {
+    s.done = true;
+  }
 }
 
-QString ArticleRequest::makeSplittedWordCompound()
+void ArticleRequest::emitCompoundResults()
 {
-  QString result;
+  string footer;
 
-  result.clear();
+  // The results go in the order of their starts, so only the ones before
+  // the first start still being searched can be emitted
+  for ( ; compoundStartsEmitted < int( compoundStarts.size() ) && compoundStarts[ compoundStartsEmitted ].done;
+        ++compoundStartsEmitted ) {
+    QString const & lastGoodCompoundResult = compoundStarts[ compoundStartsEmitted ].lastGoodResult;
 
-  for ( int x = currentSplittedWordStart; x <= currentSplittedWordEnd; ++x ) {
-    result.append( splittedWords.first[ x ] );
+    if ( lastGoodCompoundResult.size() ) // We have something to append
+    {
+      if ( !firstCompoundWasFound ) {
+        // Append the beginning
+        footer += R"(<div class="gdstemmedsuggestion"><span class="gdstemmedsuggestion_head">)"
+          + Html::escape( tr( "Compound expressions: " ).toUtf8().data() )
+          + "</span><span class=\"gdstemmedsuggestion_body\">";
 
-    if ( x < currentSplittedWordEnd ) {
-      result.append( splittedWords.second[ x + 1 ].simplified() );
+        firstCompoundWasFound = true;
+      }
+      else {
+        // Append the separator
+        footer += " / ";
+      }
+
+      footer += linkWord( lastGoodCompoundResult );
     }
   }
 
-  return result;
-}
+  if ( compoundStartsEmitted < int( compoundStarts.size() ) ) {
+    if ( footer.size() ) {
+      appendString( footer );
+      update();
+    }
 
-void ArticleRequest::individualWordFinished()
-{
-  WordFinder::SearchResults const & results = stemmedWordFinder->getResults();
+    return;
+  }
 
-  if ( results.size() ) {
-    std::u32string source = Folding::applySimpleCaseOnly( currentSplittedWordCompound );
+  // The last word was the last possible to start from
 
-    bool hadSomething = false;
+  if ( firstCompoundWasFound ) {
+    footer += "</span>";
+  }
 
-    for ( unsigned x = 0; x < results.size(); ++x ) {
-      if ( results[ x ].second ) {
-        // Spelling suggestion match found. No need to continue.
-        hadSomething           = true;
-        lastGoodCompoundResult = currentSplittedWordCompound;
-        break;
-      }
+  // Now add links to all the individual words. They conclude the result.
 
-      // Prefix match found. Check if the aliases are acceptable.
+  footer += R"(<div class="gdstemmedsuggestion"><span class="gdstemmedsuggestion_head">)"
+    + Html::escape( tr( "Individual words: " ).toUtf8().data() ) + "</span><span class=\"gdstemmedsuggestion_body\"";
+  if ( splittedWords.first[ 0 ].isRightToLeft() ) {
+    footer += " dir=\"rtl\"";
+  }
+  footer += ">";
 
-      std::u32string result( Folding::applySimpleCaseOnly( results[ x ].first ) );
+  footer += escapeSpacing( splittedWords.second[ 0 ] );
 
-      if ( source.size() <= result.size() && result.compare( 0, source.size(), source ) == 0 ) {
-        // The resulting string begins with the source one
+  for ( int x = 0; x < splittedWords.first.size(); ++x ) {
+    footer += linkWord( splittedWords.first[ x ] );
+    footer += escapeSpacing( splittedWords.second[ x + 1 ] );
+  }
 
-        hadSomething = true;
+  footer += "</span>";
 
-        if ( source.size() == result.size() ) {
-          // Got the match. No need to continue.
-          lastGoodCompoundResult = currentSplittedWordCompound;
-          break;
-        }
-      }
-    }
+  footer += "</body></html>";
+
+  appendString( footer );
+
+  finish();
+}
 
-    if ( hadSomething ) {
-      compoundSearchNextStep( true );
-      return;
+QString ArticleRequest::makeSplittedWordCompound( int start, int end )
+{
+  QString result;
+
+  for ( int x = start; x <= end; ++x ) {
+    result.append( splittedWords.first[ x ] );
+
+    if ( x < end ) {
+      result.append( splittedWords.second[ x + 1 ].simplified() );
     }
   }
 
-  compoundSearchNextStep( false );
+  return result;
 }
 
 std::pair< ArticleRequest::Words, ArticleRequest::Spacings > ArticleRequest::splitIntoWords( QString const & input )
@@ -1102,5 +1316,8 @@ void ArticleRequest::cancel()
   if ( stemmedWordFinder.get() ) {
     stemmedWordFinder->cancel();
   }
+  for ( auto const & finder : compoundFinders ) {
+    finder->cancel();
+  }
   finish();
 }
@@ -4,7 +4,11 @@
 #pragma once
 
 #include <QObject>
+#include <QCache>
+#include <QFileSystemWatcher>
+#include <QHash>
 #include <QMap>
+#include <QMutex>
 #include <set>
 #include <list>
 #include "config.hh"
@@ -12,6 +16,25 @@
 #include "instances.hh"
 #include "wordfinder.hh"
 
+/// The bodies of the articles collapsed without them, by the urls they get
+/// loaded from. They're kept for when the articles get expanded, so that the
+/// dictionaries aren't asked for them a second time.
+class CollapsedBodies
+{
+public:
+
+  void put( QString const & url, std::string body );
+
+  /// Returns false if the body isn't there, e.g. as it was dropped to make
+  /// room for the newer ones.
+  bool get( QString const & url, std::string & body );
+
+private:
+
+  QMutex mutex;
+  QCache< QString, std::string > bodies{ 32 * 1024 * 1024 }; // The cost is in bytes
+};
+
 /// This class generates the article's body for the given lookup request
 class ArticleMaker: public QObject
 {
@@ -22,6 +45,21 @@ class ArticleMaker: public QObject
   std::vector< Instances::Group > const & groups;
   const Config::Preferences & cfg;
 
+  /// The parts of the page header before and after its title and icon
+  struct HtmlHeader
+  {
+    std::string head;
+    std::string tail;
+  };
+
+  /// The headers made so far, by the settings they were made for. They're
+  /// dropped once the style files change.
+  mutable QHash< QString, HtmlHeader > htmlHeaders;
+  mutable QMutex htmlHeadersMutex;
+  mutable QFileSystemWatcher styleWatcher;
+
+  sptr< CollapsedBodies > collapsedBodies = std::make_shared< CollapsedBodies >();
+
 public:
 
   /// On construction, a reference to all dictionaries and a reference all
@@ -48,6 +86,17 @@ public:
                                                      QStringList const & dictIDs        = QStringList(),
                                                      bool ignoreDiacritics              = false ) const;
 
+  /// Gives the body of a single dictionary's article, which makeDefinitionFor()
+  /// collapsed without it, from the given url. It's the body kept back then,
+  /// or if it's gone, the body looked up again. Returns an empty failed request
+  /// if there's no such dictionary.
+  sptr< Dictionary::DataRequest > makeArticleBodyFor( QString const & url,
+                                                      QString const & dictId,
+                                                      QString const & word,
+                                                      std::vector< std::u32string > const & alts,
+                                                      QString const & context,
+                                                      bool ignoreDiacritics ) const;
+
   /// Makes up a text which states that no translation for the given word
   /// was found. Sometimes it's better to call this directly when it's already
   /// known that there's no translation.
@@ -67,10 +116,20 @@ public:
   string makeBlankHtml() const;
 
 private:
-  std::string readCssFile( QString const & fileName, std::string type ) const;
+  /// Makes a link to the given user's stylesheet, or nothing if there's no
+  /// such file. The link changes whenever the file does, so the page never
+  /// gets a stale copy of it.
+  std::string linkCssFile( QString const & fileName, std::string const & media ) const;
+
+  /// Watches the file, and the directory it would be created in, for changes.
+  void watchStyleFile( QString const & fileName ) const;
+
   /// Makes everything up to and including the opening body tag.
   std::string makeHtmlHeader( QString const & word, QString const & icon, bool expandOptionalParts ) const;
 
+  /// Makes the parts of makeHtmlHeader() which don't depend on the page.
+  HtmlHeader makeHtmlHeaderParts( bool expandOptionalParts, bool darkReaderModeEnabled ) const;
+
   /// Makes the html body for makeNotFoundTextFor()
   static std::string makeNotFoundBody( QString const & word, QString const & group );
 
@@ -89,6 +148,7 @@ class ArticleRequest: public Dictionary::DataRequest
   std::vector< sptr< Dictionary::Class > > activeDicts;
 
   std::set< std::u32string, std::less<> > alts; // Accumulated main forms
+  std::vector< std::u32string > altsVector;     // The same, as passed to the dictionaries
   std::list< sptr< Dictionary::WordSearchRequest > > altSearches;
   std::list< sptr< Dictionary::DataRequest > > bodyRequests;
   bool altsDone{ false };
@@ -107,14 +167,34 @@ class ArticleRequest: public Dictionary::DataRequest
   std::pair< Words, Spacings > splitIntoWords( QString const & );
 
   std::pair< Words, Spacings > splittedWords;
-  int currentSplittedWordStart;
-  int currentSplittedWordEnd;
-  QString currentSplittedWordCompound;
-  QString lastGoodCompoundResult;
+
+  /// How a compound of the splitted words was found in the dictionaries
+  enum class CompoundMatch {
+    Pending, // Being looked up
+    None,    // Not there, and no longer compound starts with it either
+    Prefix,  // Longer compounds start with it
+    Exact
+  };
+
+  /// The search of the longest compound starting from one of the words
+  struct CompoundStart
+  {
+    int end;                // The last word of the compound being looked up
+    QString lastGoodResult; // The longest compound found so far
+    bool done = false;
+  };
+
+  std::vector< CompoundStart > compoundStarts; // One for every word but the last
+  int compoundStartsEmitted;                   // The starts whose results are in the page
+  QHash< QString, CompoundMatch > compoundMatches;
+  std::list< QString > queuedCompounds; // To look up once a finder is free
+  std::list< sptr< WordFinder > > compoundFinders;
+  QHash< WordFinder *, QString > compoundLookups; // The finders' current compounds
   bool firstCompoundWasFound;
   int articleSizeLimit;
   bool needExpandOptionalParts;
   bool ignoreDiacritics;
+  sptr< CollapsedBodies > collapsedBodies; // If set, the bodies of the collapsed articles are left out, kept there
 
 public:
 
@@ -125,7 +205,8 @@ public:
                   std::string const & header,
                   int sizeLimit,
                   bool needExpandOptionalParts_,
-                  bool ignoreDiacritics = false );
+                  bool ignoreDiacritics                   = false,
+                  sptr< CollapsedBodies > collapsedBodies = nullptr );
 
   virtual void cancel();
   //  { finish(); } // Add our own requests cancellation here
@@ -135,17 +216,30 @@ private slots:
   void altSearchFinished();
   void bodyFinished();
   void stemmedSearchFinished();
-  void individualWordFinished();
 
 private:
   int htmlTextSize( QString html );
 
-  /// Uses stemmedWordFinder to perform the next step of looking up word
-  /// combinations.
-  void compoundSearchNextStep( bool lastSearchSucceeded );
+  /// Looks up the current compound of the given start, unless it's already
+  /// known or being looked up.
+  void lookUpCompound( int start );
+
+  /// Starts the queued compound lookups, as many at once as allowed.
+  void startCompoundLookups();
+
+  /// Takes the finished compound lookup into account, moving on the starts
+  /// which waited for it.
+  void individualWordFinished( WordFinder * );
 
-  /// Creates a single word out of the [currentSplittedWordStart..End] range.
-  QString makeSplittedWordCompound();
+  /// Moves the start on to the next longer compound, or marks it done.
+  void advanceCompoundStart( int start, CompoundMatch );
+
+  /// Appends the results of the starts done so far, in order, and finishes
+  /// the request once they're all done.
+  void emitCompoundResults();
+
+  /// Creates a single word out of the [start..end] range.
+  QString makeSplittedWordCompound( int start, int end );
 
   /// Makes an html link to the given word.
   std::string linkWord( QString const & );
@@ -156,4 +250,8 @@ private:
   /// Find end of corresponding </div> tag
   int findEndOfCloseDiv( QString const &, int pos );
   bool isCollapsable( Dictionary::DataRequest & req, QString const & dictId );
+
+  /// Makes the url the body of a collapsed article gets loaded from once it's
+  /// expanded.
+  QUrl makeArticleBodyUrl( std::string const & dictId ) const;
 };
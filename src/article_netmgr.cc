@@ -179,6 +179,22 @@ sptr< Dictionary::DataRequest > ArticleNetworkAccessManager::getResource( QUrl c
       return articleMaker.makeEmptyPage();
     }
 
+    QString const articleBodyOf = Utils::Url::queryItemValue( url, "articlebody" );
+    if ( !articleBodyOf.isEmpty() ) {
+      // The body of an article which was collapsed without it
+      std::vector< std::u32string > alts;
+      for ( auto const & alt : QUrlQuery( url ).allQueryItemValues( "alt", QUrl::FullyDecoded ) ) {
+        alts.push_back( alt.toStdU32String() );
+      }
+
+      return articleMaker.makeArticleBodyFor( url.toString( QUrl::FullyEncoded ),
+                                              articleBodyOf,
+                                              Utils::Url::queryItemValue( url, "word" ),
+                                              alts,
+                                              Utils::Url::queryItemValue( url, "context" ),
+                                              Utils::Url::queryItemValue( url, "ignore_diacritics" ) == "1" );
+    }
+
     QString word = Utils::Url::queryItemValue( url, "word" ).trimmed();
 
     bool groupIsValid = false;
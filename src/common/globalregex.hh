@@ -48,6 +48,8 @@ public:
 namespace Zim {
 //leading dot slash namespace
 const static QRegularExpression leadingDotSlash( R"(^\.{0,2}\/)" );
+//src attribute of <img> tags, used to prefetch the article images
+const static QRegularExpression imgSrc( R"(<\s*img\s+[^>]*src="([^"]*)")" );
 } // namespace Zim
 
 class Epwing
@@ -135,6 +135,13 @@ std::u32string Iconv::toWstring( char const * fromEncoding, void const * fromDat
   return outStr.toStdU32String();
 }
 
+void Iconv::toWstring( Text::Encoding encoding, void const * fromData, size_t dataSize, std::u32string & out )
+{
+  if ( !Text::decodeToUtf32( encoding, static_cast< char const * >( fromData ), dataSize, out ) ) {
+    out = toWstring( Text::getEncodingNameFor( encoding ), fromData, dataSize );
+  }
+}
+
 std::string Iconv::toUtf8( char const * fromEncoding, void const * fromData, size_t dataSize )
 
 {
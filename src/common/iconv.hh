@@ -29,6 +29,9 @@ public:
 
   // Converts a given block of data from the given encoding to a wide string.
   static std::u32string toWstring( char const * fromEncoding, void const * fromData, size_t dataSize );
+  // Same as above, but decodes natively whatever Text::decodeToUtf32() supports
+  // and only falls back to iconv for the rest. The storage of `out` is reused.
+  static void toWstring( Text::Encoding, void const * fromData, size_t dataSize, std::u32string & out );
 
   // Converts a given block of data from the given encoding to an utf8-encoded
   // string.
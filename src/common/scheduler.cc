@@ -0,0 +1,186 @@
+/* Licensed under GPLv3 or later, see the LICENSE file */
+
+#include "scheduler.hh"
+#include <QDeadlineTimer>
+#include <QMutex>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <QtConcurrentRun>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace Scheduler {
+
+namespace {
+
+int const ClassCount = int( Priority::Background ) + 1;
+
+/// How long a background job waits for the queued interactive work at most at
+/// a time, so it still gets somewhere under a steady stream of lookups
+int const MaxYieldMs = 200;
+
+bool isInteractive( int c )
+{
+  return c == int( Priority::Lookup ) || c == int( Priority::Resource );
+}
+
+struct Classes
+{
+  QThreadPool pools[ ClassCount ];
+  QAtomicInt queued[ ClassCount ];
+
+  QMutex idleMutex;
+  QWaitCondition interactiveIdle;
+
+  Classes()
+  {
+    int const ideal = QThread::idealThreadCount();
+
+    pools[ int( Priority::Lookup ) ].setMaxThreadCount( std::max( ideal, 4 ) );
+    pools[ int( Priority::Resource ) ].setMaxThreadCount( std::max( ideal / 2, 2 ) );
+    pools[ int( Priority::Prefetch ) ].setMaxThreadCount( 2 );
+    pools[ int( Priority::Background ) ].setMaxThreadCount( std::max( ideal / 2, 2 ) );
+
+#if QT_VERSION >= QT_VERSION_CHECK( 6, 2, 0 )
+    pools[ int( Priority::Background ) ].setThreadPriority( QThread::LowPriority );
+    pools[ int( Priority::Prefetch ) ].setThreadPriority( QThread::LowPriority );
+#endif
+  }
+
+  /// Whether there's interactive work waiting for a thread. The work already
+  /// running has threads of its own, so it isn't waited for.
+  bool interactiveQueued() const
+  {
+    for ( int c = 0; c < ClassCount; ++c ) {
+      if ( isInteractive( c ) && queued[ c ].loadAcquire() ) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  /// Takes a task of the class off the queue
+  void dequeued( int c )
+  {
+    queued[ c ].deref();
+
+    if ( isInteractive( c ) && !interactiveQueued() ) {
+      QMutexLocker _( &idleMutex );
+      interactiveIdle.wakeAll();
+    }
+  }
+};
+
+Classes & classes()
+{
+  static Classes instance;
+  return instance;
+}
+
+/// Counts the function as queued until it runs
+std::function< void() > tracked( Priority p, std::function< void() > f )
+{
+  int const c = int( p );
+
+  classes().queued[ c ].ref();
+
+  return [ c, f = std::move( f ) ]() {
+    classes().dequeued( c );
+    f();
+  };
+}
+
+} // namespace
+
+QFuture< void > run( Priority p, std::function< void() > f )
+{
+  return QtConcurrent::run( &classes().pools[ int( p ) ], tracked( p, std::move( f ) ) );
+}
+
+void start( Priority p, QRunnable * runnable )
+{
+  classes().pools[ int( p ) ].start( tracked( p, [ runnable ]() {
+    bool const autoDelete = runnable->autoDelete();
+
+    runnable->run();
+
+    if ( autoDelete ) {
+      delete runnable;
+    }
+  } ) );
+}
+
+void runParallel( Priority p, int extraThreads, std::function< void() > const & f )
+{
+  QThreadPool & pool = classes().pools[ int( p ) ];
+  QSemaphore done;
+
+  // The pool never deletes these, so they can be taken back if still queued
+  std::vector< std::unique_ptr< QRunnable > > helpers;
+
+  for ( int x = std::min( extraThreads, pool.maxThreadCount() ); x-- > 0; ) {
+    helpers.emplace_back( QRunnable::create( [ task = tracked( p, f ), &done ]() {
+      QSemaphoreReleaser const _( done );
+      task();
+    } ) );
+    helpers.back()->setAutoDelete( false );
+    pool.start( helpers.back().get() );
+  }
+
+  auto const join = [ & ]() {
+    int started = 0;
+
+    for ( auto const & helper : helpers ) {
+      if ( pool.tryTake( helper.get() ) ) {
+        classes().dequeued( int( p ) );
+      }
+      else {
+        ++started;
+      }
+    }
+
+    done.acquire( started );
+  };
+
+  try {
+    f();
+  }
+  catch ( ... ) {
+    join();
+    throw;
+  }
+
+  join();
+}
+
+void yieldToInteractive()
+{
+  Classes & s = classes();
+
+  if ( !s.interactiveQueued() ) {
+    return;
+  }
+
+  QDeadlineTimer const deadline( MaxYieldMs );
+  QMutexLocker _( &s.idleMutex );
+
+  while ( s.interactiveQueued() && !deadline.hasExpired() ) {
+    s.interactiveIdle.wait( &s.idleMutex, deadline );
+  }
+}
+
+int maxThreadCount( Priority p )
+{
+  return classes().pools[ int( p ) ].maxThreadCount();
+}
+
+int queueDepth( Priority p )
+{
+  return classes().queued[ int( p ) ].loadAcquire();
+}
+
+} // namespace Scheduler
@@ -0,0 +1,49 @@
+/* Licensed under GPLv3 or later, see the LICENSE file */
+
+#pragma once
+
+#include <QFuture>
+#include <QRunnable>
+#include <functional>
+
+/// Runs the background work of the application. The work is split into
+/// classes by how urgent it is, and each class has its own threads, so that
+/// a lookup never waits behind indexing or deferred dictionary
+/// initialization, however many of those are queued.
+namespace Scheduler {
+
+/// The classes of work, from the most to the least urgent
+enum class Priority {
+  Lookup,     // Word searches and articles, which the user waits for
+  Resource,   // Images, sounds and other files the articles refer to
+  Prefetch,   // Speculative work which may never be needed
+  Background, // Indexing, deferred initialization and the like
+};
+
+/// Runs the function on one of the threads of the given class
+QFuture< void > run( Priority, std::function< void() > );
+
+/// Runs the runnable on one of the threads of the given class. Like
+/// QThreadPool::start(), deletes the runnable afterwards if autoDelete() is set.
+void start( Priority, QRunnable * );
+
+/// Runs the function on the current thread and on up to extraThreads threads
+/// of the given class at once, e.g. for the workers taking chunks of a common
+/// job. Only the copies which have started by the time the current thread's
+/// copy is done are waited for, the rest are dropped, so this never waits on
+/// a busy pool.
+void runParallel( Priority, int extraThreads, std::function< void() > const & );
+
+/// To be called by the long-running background jobs between their units of
+/// work. Returns at once unless there's lookup or resource work waiting for a
+/// thread, in which case waits for it a little, leaving the cores to it.
+void yieldToInteractive();
+
+/// Returns how many tasks of the given class may run at once
+int maxThreadCount( Priority );
+
+/// Returns how many tasks of the given class are waiting for a thread. It may
+/// change as soon as it's read, so it's only good for diagnostics.
+int queueDepth( Priority );
+
+} // namespace Scheduler
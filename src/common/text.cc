@@ -3,6 +3,8 @@
 
 #include "text.hh"
 #include <vector>
+#include <cstdint>
+#include <cstring>
 #include <algorithm>
 #include <QByteArray>
 #include <QString>
@@ -208,6 +210,14 @@ std::string toUtf8( std::u32string const & in ) noexcept
   return { &buffer.front(), encode( in.data(), in.size(), &buffer.front() ) };
 }
 
+void appendUtf8( std::string & out, std::u32string_view in )
+{
+  size_t const size = out.size();
+
+  out.resize( size + in.size() * 4 );
+  out.resize( size + encode( in.data(), in.size(), &out[ size ] ) );
+}
+
 std::u32string toUtf32( std::string const & in )
 {
   if ( in.empty() ) {
@@ -225,6 +235,288 @@ std::u32string toUtf32( std::string const & in )
   return std::u32string( &buffer.front(), result );
 }
 
+namespace {
+
+/// The upper halves of the Windows code pages, 0x80..0xFF. Bytes that have no
+/// mapping are 0, and make the native decoder give up the same way iconv does.
+char16_t const windows1250[ 128 ] = {
+  0x20AC, 0x0000, 0x201A, 0x0000, 0x201E, 0x2026, 0x2020, 0x2021, 0x0000, 0x2030, 0x0160, 0x2039, 0x015A,
+  0x0164, 0x017D, 0x0179, 0x0000, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x0000, 0x2122,
+  0x0161, 0x203A, 0x015B, 0x0165, 0x017E, 0x017A, 0x00A0, 0x02C7, 0x02D8, 0x0141, 0x00A4, 0x0104, 0x00A6,
+  0x00A7, 0x00A8, 0x00A9, 0x015E, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x017B, 0x00B0, 0x00B1, 0x02DB, 0x0142,
+  0x00B4, 0x00B5, 0x00B6, 0x00B7, 0x00B8, 0x0105, 0x015F, 0x00BB, 0x013D, 0x02DD, 0x013E, 0x017C, 0x0154,
+  0x00C1, 0x00C2, 0x0102, 0x00C4, 0x0139, 0x0106, 0x00C7, 0x010C, 0x00C9, 0x0118, 0x00CB, 0x011A, 0x00CD,
+  0x00CE, 0x010E, 0x0110, 0x0143, 0x0147, 0x00D3, 0x00D4, 0x0150, 0x00D6, 0x00D7, 0x0158, 0x016E, 0x00DA,
+  0x0170, 0x00DC, 0x00DD, 0x0162, 0x00DF, 0x0155, 0x00E1, 0x00E2, 0x0103, 0x00E4, 0x013A, 0x0107, 0x00E7,
+  0x010D, 0x00E9, 0x0119, 0x00EB, 0x011B, 0x00ED, 0x00EE, 0x010F, 0x0111, 0x0144, 0x0148, 0x00F3, 0x00F4,
+  0x0151, 0x00F6, 0x00F7, 0x0159, 0x016F, 0x00FA, 0x0171, 0x00FC, 0x00FD, 0x0163, 0x02D9,
+};
+
+char16_t const windows1251[ 128 ] = {
+  0x0402, 0x0403, 0x201A, 0x0453, 0x201E, 0x2026, 0x2020, 0x2021, 0x20AC, 0x2030, 0x0409, 0x2039, 0x040A,
+  0x040C, 0x040B, 0x040F, 0x0452, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x0000, 0x2122,
+  0x0459, 0x203A, 0x045A, 0x045C, 0x045B, 0x045F, 0x00A0, 0x040E, 0x045E, 0x0408, 0x00A4, 0x0490, 0x00A6,
+  0x00A7, 0x0401, 0x00A9, 0x0404, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x0407, 0x00B0, 0x00B1, 0x0406, 0x0456,
+  0x0491, 0x00B5, 0x00B6, 0x00B7, 0x0451, 0x2116, 0x0454, 0x00BB, 0x0458, 0x0405, 0x0455, 0x0457, 0x0410,
+  0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417, 0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D,
+  0x041E, 0x041F, 0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427, 0x0428, 0x0429, 0x042A,
+  0x042B, 0x042C, 0x042D, 0x042E, 0x042F, 0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+  0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F, 0x0440, 0x0441, 0x0442, 0x0443, 0x0444,
+  0x0445, 0x0446, 0x0447, 0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F,
+};
+
+char16_t const windows1252[ 128 ] = {
+  0x20AC, 0x0000, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152,
+  0x0000, 0x017D, 0x0000, 0x0000, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122,
+  0x0161, 0x203A, 0x0153, 0x0000, 0x017E, 0x0178, 0x00A0, 0x00A1, 0x00A2, 0x00A3, 0x00A4, 0x00A5, 0x00A6,
+  0x00A7, 0x00A8, 0x00A9, 0x00AA, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x00AF, 0x00B0, 0x00B1, 0x00B2, 0x00B3,
+  0x00B4, 0x00B5, 0x00B6, 0x00B7, 0x00B8, 0x00B9, 0x00BA, 0x00BB, 0x00BC, 0x00BD, 0x00BE, 0x00BF, 0x00C0,
+  0x00C1, 0x00C2, 0x00C3, 0x00C4, 0x00C5, 0x00C6, 0x00C7, 0x00C8, 0x00C9, 0x00CA, 0x00CB, 0x00CC, 0x00CD,
+  0x00CE, 0x00CF, 0x00D0, 0x00D1, 0x00D2, 0x00D3, 0x00D4, 0x00D5, 0x00D6, 0x00D7, 0x00D8, 0x00D9, 0x00DA,
+  0x00DB, 0x00DC, 0x00DD, 0x00DE, 0x00DF, 0x00E0, 0x00E1, 0x00E2, 0x00E3, 0x00E4, 0x00E5, 0x00E6, 0x00E7,
+  0x00E8, 0x00E9, 0x00EA, 0x00EB, 0x00EC, 0x00ED, 0x00EE, 0x00EF, 0x00F0, 0x00F1, 0x00F2, 0x00F3, 0x00F4,
+  0x00F5, 0x00F6, 0x00F7, 0x00F8, 0x00F9, 0x00FA, 0x00FB, 0x00FC, 0x00FD, 0x00FE, 0x00FF,
+};
+
+/// Returns the number of leading bytes below 0x80. Eight bytes are tested at
+/// once, which covers the long runs of markup and Latin text dictionaries have.
+size_t asciiPrefixLength( unsigned char const * in, size_t size )
+{
+  size_t n = 0;
+
+  for ( ; n + sizeof( uint64_t ) <= size; n += sizeof( uint64_t ) ) {
+    uint64_t chunk;
+    memcpy( &chunk, in + n, sizeof( chunk ) );
+    if ( chunk & 0x8080808080808080ULL ) {
+      break;
+    }
+  }
+
+  while ( n < size && in[ n ] < 0x80 ) {
+    ++n;
+  }
+
+  return n;
+}
+
+/// Widens a run of plain ASCII bytes. Kept as a trivial loop so that the
+/// compiler can vectorize it.
+void widenAscii( unsigned char const * in, size_t size, char32_t * out )
+{
+  for ( size_t x = 0; x < size; ++x ) {
+    out[ x ] = in[ x ];
+  }
+}
+
+bool isValidCodePoint( char32_t ch )
+{
+  return ch <= 0x10FFFF && ( ch < 0xD800 || ch > 0xDFFF );
+}
+
+/// Unlike decode() above, this one is strict: overlong forms, surrogates and
+/// truncated sequences are all rejected, just as iconv would reject them.
+bool decodeUtf8( unsigned char const * in, size_t size, char32_t * out, size_t & outSize )
+{
+  size_t x = 0, o = 0;
+
+  while ( x < size ) {
+    size_t const ascii = asciiPrefixLength( in + x, size - x );
+    widenAscii( in + x, ascii, out + o );
+    x += ascii;
+    o += ascii;
+
+    if ( x == size ) {
+      break;
+    }
+
+    unsigned char const lead = in[ x ];
+    size_t length;
+    char32_t ch, minimum;
+
+    if ( lead >= 0xC2 && lead <= 0xDF ) {
+      length  = 2;
+      ch      = lead & 0x1F;
+      minimum = 0x80;
+    }
+    else if ( ( lead & 0xF0 ) == 0xE0 ) {
+      length  = 3;
+      ch      = lead & 0x0F;
+      minimum = 0x800;
+    }
+    else if ( lead >= 0xF0 && lead <= 0xF4 ) {
+      length  = 4;
+      ch      = lead & 0x07;
+      minimum = 0x10000;
+    }
+    else {
+      return false;
+    }
+
+    if ( size - x < length ) {
+      return false;
+    }
+
+    for ( size_t k = 1; k < length; ++k ) {
+      unsigned char const c = in[ x + k ];
+      if ( ( c & 0xC0 ) != 0x80 ) {
+        return false;
+      }
+      ch = ( ch << 6 ) | ( c & 0x3F );
+    }
+
+    if ( ch < minimum || !isValidCodePoint( ch ) ) {
+      return false;
+    }
+
+    out[ o++ ] = ch;
+    x += length;
+  }
+
+  outSize = o;
+  return true;
+}
+
+template< bool bigEndian >
+char32_t readUnit16( unsigned char const * in )
+{
+  return bigEndian ? ( char32_t( in[ 0 ] ) << 8 ) | in[ 1 ] : ( char32_t( in[ 1 ] ) << 8 ) | in[ 0 ];
+}
+
+/// A dangling odd byte at the end is dropped, which is what Iconv::convert()
+/// ends up doing as well.
+template< bool bigEndian >
+bool decodeUtf16( unsigned char const * in, size_t size, char32_t * out, size_t & outSize )
+{
+  size_t const units = size / 2;
+  size_t o           = 0;
+
+  for ( size_t x = 0; x < units; ++x ) {
+    char32_t const unit = readUnit16< bigEndian >( in + x * 2 );
+
+    if ( unit < 0xD800 || unit > 0xDFFF ) {
+      out[ o++ ] = unit;
+      continue;
+    }
+
+    if ( unit > 0xDBFF || x + 1 == units ) {
+      return false;
+    }
+
+    char32_t const low = readUnit16< bigEndian >( in + ++x * 2 );
+
+    if ( low < 0xDC00 || low > 0xDFFF ) {
+      return false;
+    }
+
+    out[ o++ ] = 0x10000 + ( ( unit - 0xD800 ) << 10 ) + ( low - 0xDC00 );
+  }
+
+  outSize = o;
+  return true;
+}
+
+template< bool bigEndian >
+bool decodeUtf32( unsigned char const * in, size_t size, char32_t * out, size_t & outSize )
+{
+  size_t const units = size / 4;
+
+  for ( size_t x = 0; x < units; ++x ) {
+    unsigned char const * p = in + x * 4;
+    char32_t const ch       = bigEndian ?
+            ( char32_t( p[ 0 ] ) << 24 ) | ( char32_t( p[ 1 ] ) << 16 ) | ( char32_t( p[ 2 ] ) << 8 ) | p[ 3 ] :
+            ( char32_t( p[ 3 ] ) << 24 ) | ( char32_t( p[ 2 ] ) << 16 ) | ( char32_t( p[ 1 ] ) << 8 ) | p[ 0 ];
+
+    if ( !isValidCodePoint( ch ) ) {
+      return false;
+    }
+
+    out[ x ] = ch;
+  }
+
+  outSize = units;
+  return true;
+}
+
+bool decodeSingleByte( char16_t const * upperHalf,
+                       unsigned char const * in,
+                       size_t size,
+                       char32_t * out,
+                       size_t & outSize )
+{
+  size_t x = 0;
+
+  while ( x < size ) {
+    size_t const ascii = asciiPrefixLength( in + x, size - x );
+    widenAscii( in + x, ascii, out + x );
+    x += ascii;
+
+    for ( ; x < size && in[ x ] >= 0x80; ++x ) {
+      char16_t const ch = upperHalf[ in[ x ] - 0x80 ];
+      if ( !ch ) {
+        return false;
+      }
+      out[ x ] = ch;
+    }
+  }
+
+  outSize = size;
+  return true;
+}
+
+} // namespace
+
+bool decodeToUtf32( Encoding encoding, char const * data, size_t size, std::u32string & out )
+{
+  // None of the supported encodings produces more than one character per byte
+  out.resize( size );
+
+  if ( !size ) {
+    return true;
+  }
+
+  auto const in = reinterpret_cast< unsigned char const * >( data );
+  size_t outSize;
+  bool decoded;
+
+  switch ( encoding ) {
+    case Encoding::Utf8:
+      decoded = decodeUtf8( in, size, out.data(), outSize );
+      break;
+    case Encoding::Utf16LE:
+      decoded = decodeUtf16< false >( in, size, out.data(), outSize );
+      break;
+    case Encoding::Utf16BE:
+      decoded = decodeUtf16< true >( in, size, out.data(), outSize );
+      break;
+    case Encoding::Utf32LE:
+      decoded = decodeUtf32< false >( in, size, out.data(), outSize );
+      break;
+    case Encoding::Utf32BE:
+      decoded = decodeUtf32< true >( in, size, out.data(), outSize );
+      break;
+    case Encoding::Windows1250:
+      decoded = decodeSingleByte( windows1250, in, size, out.data(), outSize );
+      break;
+    case Encoding::Windows1251:
+      decoded = decodeSingleByte( windows1251, in, size, out.data(), outSize );
+      break;
+    case Encoding::Windows1252:
+      decoded = decodeSingleByte( windows1252, in, size, out.data(), outSize );
+      break;
+    default:
+      // The byte order of plain "UTF-32" depends on a BOM, leave that to iconv
+      decoded = false;
+  }
+
+  if ( !decoded ) {
+    out.clear();
+    return false;
+  }
+
+  out.resize( outSize );
+  return true;
+}
+
 bool isspace( int c )
 {
   switch ( c ) {
@@ -5,6 +5,7 @@
 #include "ex.hh"
 #include <QByteArray>
 #include <string>
+#include <string_view>
 
 /// Facilities to process Text, focusing on Unicode
 namespace Text {
@@ -41,6 +42,16 @@ Encoding getEncodingForName( const QByteArray & name );
 std::string toUtf8( std::u32string const & ) noexcept;
 /// utf8 -> utf32
 std::u32string toUtf32( std::string const & );
+/// utf32 -> utf8, appended to the given string
+void appendUtf8( std::string & out, std::u32string_view );
+
+/// Decodes a whole buffer straight into utf32 without going through iconv.
+/// Only the encodings .dsl and .gls files may use are supported: utf8, utf16
+/// and utf32 with an explicit byte order, and the Windows-125x code pages.
+/// The storage of `out` is reused, so decoding line after line into the same
+/// string does not allocate. Returns false if the encoding isn't supported or
+/// the data is malformed, leaving the caller to fall back to iconv.
+bool decodeToUtf32( Encoding, char const * data, size_t size, std::u32string & out );
 
 /// Since the standard isspace() is locale-specific, we need something
 /// that would never mess up our utf8 input. The stock one worked fine under
@@ -40,6 +40,14 @@ inline QString rstrip( const QString & str )
   return {};
 }
 
+/// Same as above, but strips the string in place.
+inline void rstrip( std::u32string & str )
+{
+  while ( !str.empty() && QChar::isSpace( str.back() ) ) {
+    str.pop_back();
+  }
+}
+
 inline uint32_t leadingSpaceCount( const QString & str )
 {
   for ( int i = 0; i < str.size(); i++ ) {
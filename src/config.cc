@@ -706,6 +706,7 @@ Class load()
       p.enabled      = ( pr.attribute( "enabled" ) == "1" );
       p.type         = ( Program::Type )( pr.attribute( "type" ).toInt() );
       p.iconFilename = pr.attribute( "icon" );
+      p.server       = ( pr.attribute( "server" ) == "1" );
 
       c.programs.push_back( p );
     }
@@ -998,6 +999,10 @@ Class load()
         ( preferences.namedItem( "clearNetworkCacheOnExit" ).toElement().text() == "1" );
     }
 
+    if ( !preferences.namedItem( "dictionaryCacheTtl" ).isNull() ) {
+      c.preferences.dictionaryCacheTtl = preferences.namedItem( "dictionaryCacheTtl" ).toElement().text().toInt();
+    }
+
 
     if ( !preferences.namedItem( "removeInvalidIndexOnExit" ).isNull() ) {
       c.preferences.removeInvalidIndexOnExit =
@@ -1009,6 +1014,11 @@ Class load()
         ( preferences.namedItem( "enableApplicationLog" ).toElement().text() == "1" );
     }
 
+    if ( !preferences.namedItem( "globalHeadwordIndex" ).isNull() ) {
+      c.preferences.globalHeadwordIndex =
+        ( preferences.namedItem( "globalHeadwordIndex" ).toElement().text() == "1" );
+    }
+
     if ( !preferences.namedItem( "maxStringsInHistory" ).isNull() ) {
       c.preferences.maxStringsInHistory = preferences.namedItem( "maxStringsInHistory" ).toElement().text().toUInt();
     }
@@ -1048,6 +1058,11 @@ Class load()
       c.preferences.articleSizeLimit = preferences.namedItem( "articleSizeLimit" ).toElement().text().toInt();
     }
 
+    if ( !preferences.namedItem( "lazyCollapsedArticles" ).isNull() ) {
+      c.preferences.lazyCollapsedArticles =
+        ( preferences.namedItem( "lazyCollapsedArticles" ).toElement().text() == "1" );
+    }
+
     if ( !preferences.namedItem( "limitInputPhraseLength" ).isNull() ) {
       c.preferences.limitInputPhraseLength =
         ( preferences.namedItem( "limitInputPhraseLength" ).toElement().text() == "1" );
@@ -1664,6 +1679,10 @@ void save( Class const & c )
       QDomAttr icon = dd.createAttribute( "icon" );
       icon.setValue( program.iconFilename );
       p.setAttributeNode( icon );
+
+      QDomAttr server = dd.createAttribute( "server" );
+      server.setValue( program.server ? "1" : "0" );
+      p.setAttributeNode( server );
     }
   }
 #ifdef TTS_SUPPORT
@@ -2018,6 +2037,10 @@ void save( Class const & c )
     opt.appendChild( dd.createTextNode( c.preferences.clearNetworkCacheOnExit ? "1" : "0" ) );
     preferences.appendChild( opt );
 
+    opt = dd.createElement( "dictionaryCacheTtl" );
+    opt.appendChild( dd.createTextNode( QString::number( c.preferences.dictionaryCacheTtl ) ) );
+    preferences.appendChild( opt );
+
     opt = dd.createElement( "removeInvalidIndexOnExit" );
     opt.appendChild( dd.createTextNode( c.preferences.removeInvalidIndexOnExit ? "1" : "0" ) );
     preferences.appendChild( opt );
@@ -2026,6 +2049,10 @@ void save( Class const & c )
     opt.appendChild( dd.createTextNode( c.preferences.enableApplicationLog ? "1" : "0" ) );
     preferences.appendChild( opt );
 
+    opt = dd.createElement( "globalHeadwordIndex" );
+    opt.appendChild( dd.createTextNode( c.preferences.globalHeadwordIndex ? "1" : "0" ) );
+    preferences.appendChild( opt );
+
     opt = dd.createElement( "maxStringsInHistory" );
     opt.appendChild( dd.createTextNode( QString::number( c.preferences.maxStringsInHistory ) ) );
     preferences.appendChild( opt );
@@ -2050,6 +2077,10 @@ void save( Class const & c )
     opt.appendChild( dd.createTextNode( QString::number( c.preferences.articleSizeLimit ) ) );
     preferences.appendChild( opt );
 
+    opt = dd.createElement( "lazyCollapsedArticles" );
+    opt.appendChild( dd.createTextNode( c.preferences.lazyCollapsedArticles ? "1" : "0" ) );
+    preferences.appendChild( opt );
+
     opt = dd.createElement( "limitInputPhraseLength" );
     opt.appendChild( dd.createTextNode( c.preferences.limitInputPhraseLength ? "1" : "0" ) );
     preferences.appendChild( opt );
@@ -340,8 +340,10 @@ struct Preferences
   bool hideGoldenDictHeader;
   int maxNetworkCacheSize;
   bool clearNetworkCacheOnExit;
+  int dictionaryCacheTtl = 0; // Minutes to keep online dictionaries' responses for, 0 to follow the servers
   bool removeInvalidIndexOnExit = false;
   bool enableApplicationLog     = false;
+  bool globalHeadwordIndex      = false;
 
   qreal zoomFactor;
   qreal helpZoomFactor;
@@ -357,6 +359,8 @@ struct Preferences
 
   bool collapseBigArticles;
   int articleSizeLimit;
+  /// Collapsed articles get only their header, their body is loaded once expanded
+  bool lazyCollapsedArticles = false;
 
   bool limitInputPhraseLength;
   int inputPhraseLengthLimit;
@@ -687,6 +691,7 @@ struct Program
   Type type = Invalid;
   QString id, name, commandLine;
   QString iconFilename;
+  bool server = false; // Kept running and asked for each word, see Programs::ProgramServer
 
   Program():
     enabled( false )
@@ -711,7 +716,7 @@ struct Program
   bool operator==( Program const & other ) const
   {
     return enabled == other.enabled && type == other.type && name == other.name && commandLine == other.commandLine
-      && iconFilename == other.iconFilename;
+      && iconFilename == other.iconFilename && server == other.server;
   }
 
   bool operator!=( Program const & other ) const
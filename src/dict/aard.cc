@@ -21,6 +21,7 @@
 #include <QtEndian>
 #include <QRegularExpression>
 #include "utils.hh"
+#include "scheduler.hh"
 
 namespace Aard {
 
@@ -588,11 +589,13 @@ void AardDictionary::getArticleText( uint32_t articleAddress, QString & headword
 sptr< Dictionary::DataRequest >
 AardDictionary::getSearchResults( QString const & searchString, int searchMode, bool matchCase, bool ignoreDiacritics )
 {
-  return std::make_shared< FtsHelpers::FTSResultsRequest >( *this,
-                                                            searchString,
-                                                            searchMode,
-                                                            matchCase,
-                                                            ignoreDiacritics );
+  return Dictionary::runRequest< FtsHelpers::FTSResultsRequest >( Scheduler::Priority::Lookup,
+                                                                  this,
+                                                                  *this,
+                                                                  searchString,
+                                                                  searchMode,
+                                                                  matchCase,
+                                                                  ignoreDiacritics );
 }
 
 /// AardDictionary::getArticle()
@@ -605,7 +608,6 @@ class AardArticleRequest: public Dictionary::DataRequest
   bool ignoreDiacritics;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -618,9 +620,6 @@ public:
     dict( dict_ ),
     ignoreDiacritics( ignoreDiacritics_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -629,12 +628,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~AardArticleRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void AardArticleRequest::run()
@@ -741,7 +734,16 @@ sptr< Dictionary::DataRequest > AardDictionary::getArticle( std::u32string const
                                                             bool ignoreDiacritics )
 
 {
-  return std::make_shared< AardArticleRequest >( word, alts, *this, ignoreDiacritics );
+  if ( !mayContainAny( word, alts ) ) {
+    return std::make_shared< Dictionary::DataRequestInstant >( false ); // No such word
+  }
+
+  return Dictionary::runRequest< AardArticleRequest >( Scheduler::Priority::Lookup,
+                                                       this,
+                                                       word,
+                                                       alts,
+                                                       *this,
+                                                       ignoreDiacritics );
 }
 
 } // anonymous namespace
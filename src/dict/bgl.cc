@@ -13,6 +13,7 @@
 #include "language.hh"
 #include "text.hh"
 #include "utils.hh"
+#include "scheduler.hh"
 #include <ctype.h>
 #include <list>
 #include <map>
@@ -438,7 +439,6 @@ class BglHeadwordsRequest: public Dictionary::WordSearchRequest
   BglDictionary & dict;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -446,9 +446,6 @@ public:
     str( word_ ),
     dict( dict_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -457,12 +454,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~BglHeadwordsRequest() override
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void BglHeadwordsRequest::run()
@@ -508,8 +499,11 @@ void BglHeadwordsRequest::run()
 sptr< Dictionary::WordSearchRequest > BglDictionary::findHeadwordsForSynonym( std::u32string const & word )
 
 {
-  return synonymSearchEnabled ? std::make_shared< BglHeadwordsRequest >( word, *this ) :
-                                Class::findHeadwordsForSynonym( word );
+  if ( !synonymSearchEnabled ) {
+    return Class::findHeadwordsForSynonym( word );
+  }
+
+  return Dictionary::runRequest< BglHeadwordsRequest >( Scheduler::Priority::Lookup, this, word, *this );
 }
 
 // Converts a $1$-like postfix to a <sup>1</sup> one
@@ -551,7 +545,6 @@ class BglArticleRequest: public Dictionary::DataRequest
 
   QAtomicInt isCancelled;
   bool ignoreDiacritics;
-  QFuture< void > f;
 
 public:
 
@@ -564,9 +557,6 @@ public:
     dict( dict_ ),
     ignoreDiacritics( ignoreDiacritics_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -578,12 +568,6 @@ public:
 
   void fixHebString( string & hebStr );      // Hebrew support
   void fixHebArticle( string & hebArticle ); // Hebrew support
-
-  ~BglArticleRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void BglArticleRequest::fixHebString( string & hebStr ) // Hebrew support - convert non-unicode to unicode
@@ -806,7 +790,16 @@ sptr< Dictionary::DataRequest > BglDictionary::getArticle( std::u32string const
                                                            bool ignoreDiacritics )
 
 {
-  return std::make_shared< BglArticleRequest >( word, alts, *this, ignoreDiacritics );
+  if ( !mayContainAny( word, alts ) ) {
+    return std::make_shared< Dictionary::DataRequestInstant >( false ); // No such word
+  }
+
+  return Dictionary::runRequest< BglArticleRequest >( Scheduler::Priority::Lookup,
+                                                      this,
+                                                      word,
+                                                      alts,
+                                                      *this,
+                                                      ignoreDiacritics );
 }
 
 
@@ -821,7 +814,6 @@ class BglResourceRequest: public Dictionary::DataRequest
   string name;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -836,9 +828,6 @@ public:
     resourcesCount( resourcesCount_ ),
     name( name_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -847,12 +836,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~BglResourceRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void BglResourceRequest::run()
@@ -923,8 +906,13 @@ void BglResourceRequest::run()
 sptr< Dictionary::DataRequest > BglDictionary::getResource( string const & name )
 
 {
-  return std::shared_ptr< BglResourceRequest >(
-    new BglResourceRequest( idxMutex, idx, idxHeader.resourceListOffset, idxHeader.resourcesCount, name ) );
+  return Dictionary::runRequest< BglResourceRequest >( Scheduler::Priority::Resource,
+                                                       this,
+                                                       idxMutex,
+                                                       idx,
+                                                       idxHeader.resourceListOffset,
+                                                       idxHeader.resourcesCount,
+                                                       name );
 }
 
 /// Replaces <CHARSET c="t">1234;</CHARSET> occurrences with &#x1234;
@@ -1010,11 +998,13 @@ sptr< Dictionary::DataRequest > BglDictionary::getSearchResults( QString const &
 
                                                                  bool ignoreDiacritics )
 {
-  return std::make_shared< FtsHelpers::FTSResultsRequest >( *this,
-                                                            searchString,
-                                                            searchMode,
-                                                            matchCase,
-                                                            ignoreDiacritics );
+  return Dictionary::runRequest< FtsHelpers::FTSResultsRequest >( Scheduler::Priority::Lookup,
+                                                                  this,
+                                                                  *this,
+                                                                  searchString,
+                                                                  searchMode,
+                                                                  matchCase,
+                                                                  ignoreDiacritics );
 }
 
 
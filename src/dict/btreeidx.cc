@@ -8,13 +8,17 @@
 #include <string.h>
 #include <stdlib.h>
 #include "utils.hh"
+#include "scheduler.hh"
 
 #include <QRegularExpression>
 #include "wildcard.hh"
 #include "globalbroadcaster.hh"
 
-#include <QtConcurrentRun>
 #include <zlib.h>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <unordered_map>
 
 namespace BtreeIndexing {
 
@@ -25,6 +29,703 @@ enum {
   BtreeMaxElements = 8192
 };
 
+class KeyFilter
+{
+public:
+
+  enum : uint32_t {
+    Signature  = 0x5246424b, // KBFR on little-endian, RFBK on big-endian
+    HashCount  = 7,
+    BitsPerKey = 10, // Gives about 1% of false positives
+    MaxWords   = 1 << 20 // 8 MiB. Huge indexes get more false positives instead
+  };
+
+  /// Creates an empty filter sized for the given number of keys
+  explicit KeyFilter( size_t keyCount ):
+    hashCount( HashCount ),
+    bits( std::clamp< size_t >( ( keyCount * BitsPerKey + 63 ) / 64, 1, MaxWords ) )
+  {
+  }
+
+  void add( string const & key )
+  {
+    forEachBit( key, [ this ]( uint64_t bit ) {
+      bits[ bit / 64 ] |= uint64_t( 1 ) << ( bit % 64 );
+      return true;
+    } );
+  }
+
+  bool mayContain( string const & key ) const
+  {
+    return forEachBit( key, [ this ]( uint64_t bit ) {
+      return ( bits[ bit / 64 ] >> ( bit % 64 ) ) & 1;
+    } );
+  }
+
+  void save( File::Index & file ) const
+  {
+    file.write< uint32_t >( Signature );
+    file.write< uint32_t >( hashCount );
+    file.write< uint32_t >( bits.size() );
+    file.write( bits.data(), bits.size() * sizeof( uint64_t ) );
+  }
+
+  /// Loads the filter stored after the root node at the given offset. Returns
+  /// nullptr if there's none, which is the case for indices built before the
+  /// filters were introduced.
+  static std::shared_ptr< KeyFilter const > load( File::Index & file, uint32_t rootOffset )
+  {
+    file.seek( rootOffset );
+    file.read< uint32_t >(); // Uncompressed size
+    uint32_t compressedSize = file.read< uint32_t >();
+    file.seek( (qint64)rootOffset + 2 * sizeof( uint32_t ) + compressedSize );
+
+    uint32_t signature = file.read< uint32_t >();
+
+    if ( !signature ) {
+      // The root is a leaf, and that was its (always empty) link to the next one
+      signature = file.read< uint32_t >();
+    }
+
+    if ( signature != Signature ) {
+      return {};
+    }
+
+    uint32_t hashCount = file.read< uint32_t >();
+    uint32_t wordCount = file.read< uint32_t >();
+
+    if ( !hashCount || hashCount > 32 || !wordCount || wordCount > MaxWords ) {
+      return {};
+    }
+
+    auto filter = std::make_shared< KeyFilter >( 0 );
+
+    filter->hashCount = hashCount;
+    filter->bits.resize( wordCount );
+    file.read( filter->bits.data(), wordCount * sizeof( uint64_t ) );
+
+    return filter;
+  }
+
+private:
+
+  /// Calls f() for each of the key's bits until it returns false. The bits are
+  /// derived from two hashes as h1 + x * h2, which is as good as using
+  /// independent hash functions. The hashes are stored on disk, so they must
+  /// never depend on the platform or on Qt's seeding.
+  template< typename F >
+  bool forEachBit( string const & key, F && f ) const
+  {
+    uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a
+
+    for ( unsigned char c : key ) {
+      hash ^= c;
+      hash *= 0x100000001b3ULL;
+    }
+
+    uint64_t const h1       = mix( hash );
+    uint64_t const h2       = mix( hash ^ 0x9e3779b97f4a7c15ULL ) | 1;
+    uint64_t const bitCount = bits.size() * 64;
+
+    for ( uint32_t x = 0; x < hashCount; ++x ) {
+      if ( !f( ( h1 + x * h2 ) % bitCount ) ) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  /// The splitmix64 finalizer, to spread FNV's weak low bits
+  static uint64_t mix( uint64_t v )
+  {
+    v = ( v ^ ( v >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    v = ( v ^ ( v >> 27 ) ) * 0x94d049bb133111ebULL;
+    return v ^ ( v >> 31 );
+  }
+
+  uint32_t hashCount;
+  vector< uint64_t > bits;
+};
+
+class HeadwordTable
+{
+public:
+
+  enum : uint32_t {
+    Signature = 0x5748464f // OFHW on little-endian, WHFO on big-endian
+  };
+
+  /// Saves the headword of each article found in the chains. For the articles
+  /// having several, the first one in the order of keys is taken.
+  static void save( File::Index & file, IndexedWords::const_iterator begin, IndexedWords::const_iterator end )
+  {
+    vector< WordArticleLink const * > links;
+
+    for ( auto i = begin; i != end; ++i ) {
+      for ( auto const & link : i->second ) {
+        links.push_back( &link );
+      }
+    }
+
+    std::stable_sort( links.begin(), links.end(), []( WordArticleLink const * a, WordArticleLink const * b ) {
+      return a->articleOffset < b->articleOffset;
+    } );
+
+    links.erase( std::unique( links.begin(),
+                              links.end(),
+                              []( WordArticleLink const * a, WordArticleLink const * b ) {
+                                return a->articleOffset == b->articleOffset;
+                              } ),
+                 links.end() );
+
+    vector< Entry > entries;
+    string data;
+
+    entries.reserve( links.size() );
+
+    for ( auto const * link : links ) {
+      entries.push_back( { link->articleOffset, (uint32_t)data.size() } );
+      data += link->prefix;
+      data += link->word;
+    }
+
+    file.write< uint32_t >( Signature );
+    file.write< uint32_t >( entries.size() );
+    file.write< uint32_t >( data.size() );
+    file.write( entries.data(), entries.size() * sizeof( Entry ) );
+    file.write( data.data(), data.size() );
+  }
+
+  /// Returns the size of the table stored at the given offset, or 0 if there's
+  /// none there
+  static qint64 sizeAt( File::Index & file, qint64 offset )
+  {
+    file.seek( offset );
+
+    if ( file.read< uint32_t >() != Signature ) {
+      return 0;
+    }
+
+    uint32_t count    = file.read< uint32_t >();
+    uint32_t dataSize = file.read< uint32_t >();
+
+    return 3 * sizeof( uint32_t ) + (qint64)count * sizeof( Entry ) + dataSize;
+  }
+
+  static std::shared_ptr< HeadwordTable const > load( File::Index & file, qint64 offset )
+  {
+    file.seek( offset );
+
+    if ( file.read< uint32_t >() != Signature ) {
+      return {};
+    }
+
+    auto table = std::make_shared< HeadwordTable >();
+
+    table->entries.resize( file.read< uint32_t >() );
+    table->dataSize = file.read< uint32_t >();
+    file.read( table->entries.data(), table->entries.size() * sizeof( Entry ) );
+    table->dataOffset = file.tell();
+
+    return table;
+  }
+
+  /// Reads the headword of the article at the given offset. Returns false if
+  /// there's no such article. The file's mutex must be held.
+  bool find( File::Index & file, uint32_t articleOffset, string & headword ) const
+  {
+    auto i = std::lower_bound( entries.begin(), entries.end(), articleOffset, []( Entry const & entry, uint32_t value ) {
+      return entry.articleOffset < value;
+    } );
+
+    if ( i == entries.end() || i->articleOffset != articleOffset ) {
+      return false;
+    }
+
+    uint32_t const end = i + 1 != entries.end() ? ( i + 1 )->headword : dataSize;
+
+    if ( end < i->headword ) {
+      throw exCorruptedChainData();
+    }
+
+    headword.resize( end - i->headword );
+    file.seek( dataOffset + i->headword );
+    file.read( headword.data(), headword.size() );
+
+    return true;
+  }
+
+  /// Appends the offsets of all the articles, in ascending order
+  void appendOffsets( QList< uint32_t > & offsets ) const
+  {
+    offsets.reserve( offsets.size() + entries.size() );
+
+    for ( auto const & entry : entries ) {
+      offsets.append( entry.articleOffset );
+    }
+  }
+
+private:
+
+  struct Entry
+  {
+    uint32_t articleOffset;
+    uint32_t headword; // Where it begins, relative to the start of the data
+  };
+
+  vector< Entry > entries; // Sorted by the article offsets
+  qint64 dataOffset = 0;
+  uint32_t dataSize = 0;
+};
+
+class NgramIndex
+{
+public:
+
+  enum : uint32_t {
+    Signature   = 0x4d52474e, // NGRM on little-endian, MRGN on big-endian
+    MaxPostings = 1 << 24,    // Huge indexes go without one, to keep the indexing memory in check
+    MaxLists    = 3           // The rarest n-grams narrow things down enough, the regexp does the rest
+  };
+
+  /// A leaf of the btree and the ordinal of its first chain
+  struct Leaf
+  {
+    uint32_t offset, firstChain;
+  };
+
+  /// Accumulates the postings while the index is being built
+  class Builder
+  {
+  public:
+
+    /// The chains must be added in the order of their keys
+    void addChain( vector< WordArticleLink > const & chain )
+    {
+      if ( !overflown ) {
+        ngrams.clear();
+
+        for ( auto const & link : chain ) {
+          collect( fold( Text::toUtf32( link.prefix + link.word ) ), ngrams );
+        }
+
+        std::sort( ngrams.begin(), ngrams.end() );
+        ngrams.erase( std::unique( ngrams.begin(), ngrams.end() ), ngrams.end() );
+
+        for ( uint64_t ngram : ngrams ) {
+          postings[ ngram ].push_back( chainCount );
+        }
+
+        postingCount += ngrams.size();
+
+        if ( postingCount > MaxPostings ) {
+          overflown = true;
+          postings.clear();
+        }
+      }
+
+      ++chainCount;
+    }
+
+    /// Saves the index, unless it got too large. The leaves are the offsets
+    /// of all the btree's leaves and the numbers of their chains, in order.
+    void save( File::Index & file, vector< pair< uint32_t, uint32_t > > const & leafSizes ) const
+    {
+      if ( overflown ) {
+        return;
+      }
+
+      vector< Leaf > leaves;
+      uint32_t firstChain = 0;
+
+      for ( auto const & leaf : leafSizes ) {
+        leaves.push_back( { leaf.first, firstChain } );
+        firstChain += leaf.second;
+      }
+
+      vector< Entry > table;
+      string data;
+
+      table.reserve( postings.size() );
+
+      for ( auto const & i : postings ) {
+        table.push_back( { i.first, 0, (uint32_t)i.second.size() } );
+      }
+
+      std::sort( table.begin(), table.end(), []( Entry const & a, Entry const & b ) {
+        return a.ngram < b.ngram;
+      } );
+
+      for ( auto & entry : table ) {
+        entry.offset = data.size();
+
+        uint32_t previous = 0;
+
+        for ( uint32_t chain : postings.find( entry.ngram )->second ) {
+          putNumber( data, chain - previous );
+          previous = chain;
+        }
+      }
+
+      file.write< uint32_t >( Signature );
+      file.write< uint32_t >( leaves.size() );
+      file.write< uint32_t >( table.size() );
+      file.write< uint32_t >( data.size() );
+      file.write( leaves.data(), leaves.size() * sizeof( Leaf ) );
+      file.write( table.data(), table.size() * sizeof( Entry ) );
+      file.write( data.data(), data.size() );
+    }
+
+  private:
+
+    std::unordered_map< uint64_t, vector< uint32_t > > postings;
+    vector< uint64_t > ngrams;
+    size_t postingCount = 0;
+    uint32_t chainCount = 0;
+    bool overflown      = false;
+  };
+
+  /// Loads the index stored at the given offset. Returns nullptr if there's
+  /// none, which is the case for the indexes too large to have one.
+  static std::shared_ptr< NgramIndex const > load( File::Index & file, qint64 offset )
+  {
+    file.seek( offset );
+
+    if ( file.read< uint32_t >() != Signature ) {
+      return {};
+    }
+
+    uint32_t leafCount  = file.read< uint32_t >();
+    uint32_t ngramCount = file.read< uint32_t >();
+    uint32_t dataSize   = file.read< uint32_t >();
+
+    if ( !leafCount ) {
+      return {};
+    }
+
+    auto index = std::make_shared< NgramIndex >();
+
+    index->leaves.resize( leafCount );
+    file.read( index->leaves.data(), leafCount * sizeof( Leaf ) );
+
+    index->table.resize( ngramCount );
+    file.read( index->table.data(), ngramCount * sizeof( Entry ) );
+
+    index->dataOffset = file.tell();
+    index->dataSize   = dataSize;
+
+    return index;
+  }
+
+  /// Returns the n-grams of the literal parts of the wildcard pattern. Only
+  /// those which every word matching the pattern has are returned.
+  static vector< uint64_t > ofPattern( std::u32string const & pattern )
+  {
+    vector< uint64_t > result;
+    std::u32string literal;
+
+    auto const endLiteral = [ & ]() {
+      collect( fold( literal ), result );
+      literal.clear();
+    };
+
+    for ( size_t x = 0; x < pattern.size(); ++x ) {
+      char32_t const ch = pattern[ x ];
+
+      if ( ch == U'[' ) {
+        endLiteral();
+
+        // Skip the set. A closing bracket right at its start is a member
+        size_t end = x + 1;
+
+        if ( end < pattern.size() && ( pattern[ end ] == U'!' || pattern[ end ] == U'^' ) ) {
+          ++end;
+        }
+
+        if ( end < pattern.size() && pattern[ end ] == U']' ) {
+          ++end;
+        }
+
+        end = pattern.find( U']', end );
+
+        if ( end == std::u32string::npos ) {
+          break;
+        }
+
+        x = end;
+      }
+      else if ( ch == U'*' || ch == U'?' || ch == U'\\' ) {
+        endLiteral();
+      }
+      else {
+        literal.push_back( ch );
+      }
+    }
+
+    endLiteral();
+
+    std::sort( result.begin(), result.end() );
+    result.erase( std::unique( result.begin(), result.end() ), result.end() );
+
+    return result;
+  }
+
+  /// Returns the ordinals of the chains which have all the given n-grams, in
+  /// ascending order. The file's mutex must be held.
+  vector< uint32_t > find( File::Index & file, vector< uint64_t > const & ngrams ) const
+  {
+    vector< Entry const * > entries;
+
+    for ( uint64_t ngram : ngrams ) {
+      auto i = std::lower_bound( table.begin(), table.end(), ngram, []( Entry const & entry, uint64_t value ) {
+        return entry.ngram < value;
+      } );
+
+      if ( i == table.end() || i->ngram != ngram ) {
+        return {}; // No headword has it
+      }
+
+      entries.push_back( &*i );
+    }
+
+    std::sort( entries.begin(), entries.end(), []( Entry const * a, Entry const * b ) {
+      return a->count < b->count;
+    } );
+
+    if ( entries.size() > MaxLists ) {
+      entries.resize( MaxLists );
+    }
+
+    vector< uint32_t > result, list, common;
+
+    for ( auto const * entry : entries ) {
+      readPostings( file, *entry, list );
+
+      if ( entry == entries.front() ) {
+        result.swap( list );
+      }
+      else {
+        common.clear();
+        std::set_intersection( result.begin(), result.end(), list.begin(), list.end(), std::back_inserter( common ) );
+        result.swap( common );
+      }
+
+      if ( result.empty() ) {
+        break;
+      }
+    }
+
+    return result;
+  }
+
+  /// Returns the leaf holding the chain with the given ordinal
+  Leaf const & leafOf( uint32_t chain ) const
+  {
+    auto i = std::upper_bound( leaves.begin(), leaves.end(), chain, []( uint32_t value, Leaf const & leaf ) {
+      return value < leaf.firstChain;
+    } );
+
+    return *( i == leaves.begin() ? i : i - 1 );
+  }
+
+private:
+
+  struct Entry
+  {
+    uint64_t ngram;
+    uint32_t offset; // Of the posting list, relative to the start of the data
+    uint32_t count;
+  };
+
+  vector< Leaf > leaves;
+  vector< Entry > table; // Sorted by the n-grams
+  qint64 dataOffset = 0;
+  uint32_t dataSize = 0;
+
+  /// The form the n-grams are taken from. It is close to what the wildcard
+  /// search matches its regexp against, which is case-insensitive.
+  static std::u32string fold( std::u32string const & text )
+  {
+    return Folding::applySimpleCaseOnly( Folding::applyDiacriticsOnly( text ) );
+  }
+
+  /// Appends the trigrams of the text, each packed into one number
+  static void collect( std::u32string const & text, vector< uint64_t > & out )
+  {
+    for ( size_t x = 2; x < text.size(); ++x ) {
+      out.push_back( ( uint64_t( text[ x - 2 ] & 0x1FFFFF ) << 42 ) | ( uint64_t( text[ x - 1 ] & 0x1FFFFF ) << 21 )
+                     | ( text[ x ] & 0x1FFFFF ) );
+    }
+  }
+
+  void readPostings( File::Index & file, Entry const & entry, vector< uint32_t > & out ) const
+  {
+    uint32_t const end = &entry + 1 != table.data() + table.size() ? ( &entry + 1 )->offset : dataSize;
+
+    if ( end < entry.offset ) {
+      throw exCorruptedChainData();
+    }
+
+    vector< char > data( end - entry.offset );
+
+    file.seek( dataOffset + entry.offset );
+    file.read( data.data(), data.size() );
+
+    char const * ptr       = data.data();
+    char const * const eod = ptr + data.size();
+    uint32_t chain         = 0;
+
+    out.clear();
+    out.reserve( entry.count );
+
+    for ( uint32_t x = 0; x < entry.count; ++x ) {
+      chain += getNumber( ptr, eod );
+      out.push_back( chain );
+    }
+  }
+
+  static void putNumber( string & out, uint32_t value )
+  {
+    while ( value >= 0x80 ) {
+      out.push_back( char( value | 0x80 ) );
+      value >>= 7;
+    }
+
+    out.push_back( char( value ) );
+  }
+
+  static uint32_t getNumber( char const *& ptr, char const * end )
+  {
+    uint32_t value = 0;
+
+    for ( unsigned shift = 0; shift < 32; shift += 7 ) {
+      if ( ptr == end ) {
+        break;
+      }
+
+      auto const byte = static_cast< unsigned char >( *ptr++ );
+
+      value |= uint32_t( byte & 0x7F ) << shift;
+
+      if ( !( byte & 0x80 ) ) {
+        return value;
+      }
+    }
+
+    throw exCorruptedChainData();
+  }
+};
+
+namespace {
+
+/// Folds the word the very same way findArticles() does before the lookup
+std::u32string foldForLookup( std::u32string const & word )
+{
+  std::u32string folded = Folding::apply( word );
+
+  if ( folded.empty() ) {
+    folded = Folding::applyWhitespaceOnly( word );
+  }
+
+  return folded;
+}
+
+/// A Levenshtein automaton accepting the strings within the given edit
+/// distance of the word. Its states are the rows of the edit distance matrix
+/// against the word, with the distances capped at one past the maximum.
+class LevenshteinAutomaton
+{
+public:
+
+  using State = vector< uint8_t >;
+
+  LevenshteinAutomaton( std::u32string const & word_, unsigned maxDistance_ ):
+    word( word_ ),
+    maxDistance( maxDistance_ ),
+    chars( word_ )
+  {
+    std::sort( chars.begin(), chars.end() );
+    chars.erase( std::unique( chars.begin(), chars.end() ), chars.end() );
+  }
+
+  State start() const
+  {
+    State state( word.size() + 1 );
+
+    for ( size_t x = 0; x < state.size(); ++x ) {
+      state[ x ] = cap( x );
+    }
+
+    return state;
+  }
+
+  State step( State const & state, char32_t ch ) const
+  {
+    State next( state.size() );
+
+    next[ 0 ] = cap( state[ 0 ] + 1 );
+
+    for ( size_t x = 1; x < state.size(); ++x ) {
+      unsigned const substitution = state[ x - 1 ] + ( word[ x - 1 ] == ch ? 0 : 1 );
+
+      next[ x ] = cap( std::min( { substitution, state[ x ] + 1u, next[ x - 1 ] + 1u } ) );
+    }
+
+    return next;
+  }
+
+  /// Whether any string going on from this state can still be accepted
+  bool isAlive( State const & state ) const
+  {
+    return *std::min_element( state.begin(), state.end() ) <= maxDistance;
+  }
+
+  /// Whether a string going on from this state with any character in the
+  /// given range can still be accepted
+  bool isAlive( State const & state, char32_t from, char32_t to ) const
+  {
+    size_t charsInRange = 0;
+
+    for ( char32_t ch : chars ) {
+      if ( ch >= from && ch <= to ) {
+        if ( isAlive( step( state, ch ) ) ) {
+          return true;
+        }
+
+        ++charsInRange;
+      }
+    }
+
+    // All the characters which aren't in the word lead to the same state
+    return to - from + 1 > charsInRange && isAlive( step( state, OtherChar ) );
+  }
+
+  /// Returns the edit distance of the string leading to this state, or a
+  /// value above the maximum if it is not to be accepted
+  unsigned distance( State const & state ) const
+  {
+    return state.back();
+  }
+
+private:
+
+  enum : char32_t {
+    OtherChar = 0xFFFFFFFF // Never found in words
+  };
+
+  std::u32string word;
+  unsigned maxDistance;
+  std::u32string chars; // The distinct characters of the word, sorted
+
+  uint8_t cap( size_t distance ) const
+  {
+    return std::min< size_t >( distance, maxDistance + 1 );
+  }
+};
+
+} // namespace
+
 BtreeIndex::BtreeIndex():
   idxFile( nullptr ),
   rootNodeLoaded( false )
@@ -53,6 +754,70 @@ void BtreeIndex::openIndex( IndexInfo const & indexInfo, File::Index & file, QMu
 
   rootNodeLoaded = false;
   rootNode.clear();
+
+  std::shared_ptr< KeyFilter const > filter;
+
+  {
+    QMutexLocker _( &mutex );
+
+    // Dictionaries may go on reading the file sequentially after opening the index
+    qint64 const position = file.tell();
+
+    try {
+      filter = KeyFilter::load( file, rootOffset );
+    }
+    catch ( std::exception & e ) {
+      qDebug( "No key filter loaded for the index: %s", e.what() );
+    }
+
+    // The headword table follows the filter, and is followed by the n-gram index,
+    // if any. Both are only loaded once needed.
+    headwordTableOffset = 0;
+    ngramIndexOffset    = 0;
+
+    if ( filter ) {
+      try {
+        qint64 const offset = file.tell();
+
+        if ( qint64 const size = HeadwordTable::sizeAt( file, offset ) ) {
+          headwordTableOffset = offset;
+          ngramIndexOffset    = offset + size;
+        }
+      }
+      catch ( std::exception & e ) {
+        qDebug( "No headword table in the index: %s", e.what() );
+      }
+    }
+
+    headwordTableLoaded = false;
+    headwordTable.reset();
+    ngramIndexLoaded = false;
+    ngramIndex.reset();
+
+    file.seek( position );
+  }
+
+  std::atomic_store( &keyFilter, filter );
+}
+
+bool BtreeIndex::mayContain( std::u32string const & word ) const
+{
+  auto const filter = std::atomic_load( &keyFilter );
+
+  if ( !filter ) {
+    return true;
+  }
+
+  std::u32string const folded = foldForLookup( Text::removeTrailingZero( word ) );
+
+  return folded.empty() || filter->mayContain( Text::toUtf8( folded ) );
+}
+
+bool BtreeIndex::mayContainAny( std::u32string const & word, vector< std::u32string > const & alts ) const
+{
+  return mayContain( word ) || std::any_of( alts.begin(), alts.end(), [ this ]( std::u32string const & alt ) {
+           return mayContain( alt );
+         } );
 }
 
 vector< WordArticleLink >
@@ -63,9 +828,14 @@ BtreeIndex::findArticles( std::u32string const & search_word, bool ignoreDiacrit
   vector< WordArticleLink > result;
 
   try {
-    std::u32string folded = Folding::apply( word );
-    if ( folded.empty() ) {
-      folded = Folding::applyWhitespaceOnly( word );
+    std::u32string folded = foldForLookup( word );
+
+    if ( !folded.empty() ) {
+      auto const filter = std::atomic_load( &keyFilter );
+
+      if ( filter && !filter->mayContain( Text::toUtf8( folded ) ) ) {
+        return result;
+      }
     }
 
     bool exactMatch;
@@ -101,8 +871,7 @@ BtreeWordSearchRequest::BtreeWordSearchRequest( BtreeDictionary & dict_,
                                                 unsigned minLength_,
                                                 int maxSuffixVariation_,
                                                 bool allowMiddleMatches_,
-                                                unsigned long maxResults_,
-                                                bool startRunnable ):
+                                                unsigned long maxResults_ ):
   dict( dict_ ),
   str( str_ ),
   maxResults( maxResults_ ),
@@ -110,11 +879,6 @@ BtreeWordSearchRequest::BtreeWordSearchRequest( BtreeDictionary & dict_,
   maxSuffixVariation( maxSuffixVariation_ ),
   allowMiddleMatches( allowMiddleMatches_ )
 {
-  if ( startRunnable ) {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
-  }
 }
 
 void BtreeWordSearchRequest::findMatches()
@@ -231,6 +995,18 @@ void BtreeWordSearchRequest::findMatches()
     }
   }
 
+  // Adds the word if it matches the wildcard pattern
+  auto const addIfMatches = [ & ]( WordArticleLink const & x ) {
+    std::u32string word   = Text::toUtf32( x.prefix + x.word );
+    std::u32string result = Folding::applyDiacriticsOnly( word );
+    if ( result.size() >= (std::u32string::size_type)minMatchLength ) {
+      QRegularExpressionMatch match = regexp.match( QString::fromStdU32String( result ) );
+      if ( match.hasMatch() && match.capturedStart() == 0 ) {
+        addMatch( word );
+      }
+    }
+  };
+
   int initialFoldedSize = folded.size();
 
   int charsLeftToChop = 0;
@@ -247,6 +1023,34 @@ void BtreeWordSearchRequest::findMatches()
   }
 
   try {
+    if ( useWildcards && folded.empty() ) {
+      // There's no prefix to start from, so instead of going through the whole
+      // index, only look at the chains the n-gram index points to
+      bool const narrowed = dict.forEachWildcardCandidate(
+        Folding::applyDiacriticsOnly( Folding::applySimpleCaseOnly( str ) ),
+        [ & ]( vector< WordArticleLink > const & chain ) {
+          QMutexLocker _( &dataMutex );
+
+          for ( auto & x : chain ) {
+            if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
+              return false;
+            }
+
+            addIfMatches( x );
+
+            if ( matches.size() >= maxResults ) {
+              return false;
+            }
+          }
+
+          return true;
+        } );
+
+      if ( narrowed ) {
+        return;
+      }
+    }
+
     for ( ;; ) {
       bool exactMatch;
       vector< char > leaf;
@@ -283,14 +1087,7 @@ void BtreeWordSearchRequest::findMatches()
                 break;
               }
               if ( useWildcards ) {
-                std::u32string word   = Text::toUtf32( x.prefix + x.word );
-                std::u32string result = Folding::applyDiacriticsOnly( word );
-                if ( result.size() >= (std::u32string::size_type)minMatchLength ) {
-                  QRegularExpressionMatch match = regexp.match( QString::fromStdU32String( result ) );
-                  if ( match.hasMatch() && match.capturedStart() == 0 ) {
-                    addMatch( word );
-                  }
-                }
+                addIfMatches( x );
               }
               else {
                 // Skip middle matches, if requested. If suffix variation is specified,
@@ -364,9 +1161,72 @@ void BtreeWordSearchRequest::findMatches()
   catch ( ... ) {
     qWarning( "Index searching failed: \"%s\"", dict.getName().c_str() );
   }
-}
+}
+
+void BtreeWordSearchRequest::run()
+{
+  if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
+    finish();
+    return;
+  }
+
+  if ( dict.ensureInitDone().size() ) {
+    setErrorString( QString::fromUtf8( dict.ensureInitDone().c_str() ) );
+    finish();
+    return;
+  }
+
+  findMatches();
+
+  finish();
+}
+
+sptr< Dictionary::WordSearchRequest > BtreeDictionary::prefixMatch( std::u32string const & str,
+                                                                    unsigned long maxResults )
+
+{
+  return Dictionary::runRequest< BtreeWordSearchRequest >( Scheduler::Priority::Lookup,
+                                                           this,
+                                                           *this,
+                                                           str,
+                                                           0,
+                                                           -1,
+                                                           true,
+                                                           maxResults );
+}
+
+namespace {
+
+class BtreeFuzzySearchRequest: public Dictionary::WordSearchRequest
+{
+  BtreeDictionary & dict;
+  std::u32string str;
+  unsigned maxDistance;
+  unsigned long maxResults;
+  QAtomicInt isCancelled;
+
+public:
+
+  BtreeFuzzySearchRequest( BtreeDictionary & dict_,
+                           std::u32string const & str_,
+                           unsigned maxDistance_,
+                           unsigned long maxResults_ ):
+    dict( dict_ ),
+    str( str_ ),
+    maxDistance( maxDistance_ ),
+    maxResults( maxResults_ )
+  {
+  }
 
-void BtreeWordSearchRequest::run()
+  void run();
+
+  void cancel() override
+  {
+    isCancelled.ref();
+  }
+};
+
+void BtreeFuzzySearchRequest::run()
 {
   if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
     finish();
@@ -379,22 +1239,70 @@ void BtreeWordSearchRequest::run()
     return;
   }
 
-  findMatches();
+  std::u32string folded = foldForLookup( str );
 
-  finish();
-}
+  if ( folded.empty() ) {
+    finish();
+    return;
+  }
 
-BtreeWordSearchRequest::~BtreeWordSearchRequest()
-{
-  isCancelled.ref();
-  f.waitForFinished();
+  // The matches come in the order of keys, so more than needed are gathered
+  // to keep the closest ones
+  size_t const maxGathered = maxResults * 8;
+  vector< Dictionary::WordMatch > gathered;
+
+  try {
+    dict.forEachFuzzyChain(
+      folded,
+      maxDistance,
+      [ & ]( vector< WordArticleLink > const & chain, unsigned distance ) {
+        for ( auto const & x : chain ) {
+          // Like stemmedMatch(), only look for the whole words
+          if ( Folding::apply( Text::toUtf32( x.prefix ) ).empty() ) {
+            gathered.emplace_back( Text::toUtf32( x.prefix + x.word ), -(int)distance );
+          }
+        }
+
+        return gathered.size() < maxGathered && !Utils::AtomicInt::loadAcquire( isCancelled );
+      },
+      &isCancelled );
+  }
+  catch ( std::exception & e ) {
+    qWarning( "Fuzzy searching failed: \"%s\", error: %s", dict.getName().c_str(), e.what() );
+  }
+
+  std::stable_sort( gathered.begin(),
+                    gathered.end(),
+                    []( Dictionary::WordMatch const & a, Dictionary::WordMatch const & b ) {
+                      return a.weight > b.weight;
+                    } );
+
+  {
+    QMutexLocker _( &dataMutex );
+
+    for ( auto const & match : gathered ) {
+      if ( matches.size() >= maxResults ) {
+        break;
+      }
+
+      addMatch( match );
+    }
+  }
+
+  finish();
 }
 
-sptr< Dictionary::WordSearchRequest > BtreeDictionary::prefixMatch( std::u32string const & str,
-                                                                    unsigned long maxResults )
+} // namespace
 
+sptr< Dictionary::WordSearchRequest >
+BtreeDictionary::fuzzyMatch( std::u32string const & str, unsigned maxDistance, unsigned long maxResults )
 {
-  return std::make_shared< BtreeWordSearchRequest >( *this, str, 0, -1, true, maxResults );
+  return Dictionary::runRequest< BtreeFuzzySearchRequest >( Scheduler::Priority::Lookup,
+                                                            this,
+                                                            *this,
+                                                            str,
+                                                            maxDistance,
+                                                            maxResults );
 }
 
 sptr< Dictionary::WordSearchRequest > BtreeDictionary::stemmedMatch( std::u32string const & str,
@@ -403,12 +1311,14 @@ sptr< Dictionary::WordSearchRequest > BtreeDictionary::stemmedMatch( std::u32str
                                                                      unsigned long maxResults )
 
 {
-  return std::make_shared< BtreeWordSearchRequest >( *this,
-                                                     str,
-                                                     minLength,
-                                                     (int)maxSuffixVariation,
-                                                     false,
-                                                     maxResults );
+  return Dictionary::runRequest< BtreeWordSearchRequest >( Scheduler::Priority::Lookup,
+                                                           this,
+                                                           *this,
+                                                           str,
+                                                           minLength,
+                                                           (int)maxSuffixVariation,
+                                                           false,
+                                                           maxResults );
 }
 
 void BtreeIndex::readNode( uint32_t offset, vector< char > & out )
@@ -439,7 +1349,8 @@ char const * BtreeIndex::findChainOffsetExactOrPrefix( std::u32string const & ta
                                                        bool & exactMatch,
                                                        vector< char > & extLeaf,
                                                        uint32_t & nextLeaf,
-                                                       char const *& leafEnd )
+                                                       char const *& leafEnd,
+                                                       uint32_t * leafOffset )
 {
   if ( !idxFile ) {
     throw exIndexWasNotOpened();
@@ -485,6 +1396,9 @@ char const * BtreeIndex::findChainOffsetExactOrPrefix( std::u32string const & ta
           // Only one leaf in index, there's no next leaf
           nextLeaf = 0;
         }
+        if ( leafOffset ) {
+          *leafOffset = currentNodeOffset;
+        }
         if ( !leafEntries ) {
           return nullptr;
         }
@@ -602,6 +1516,10 @@ char const * BtreeIndex::findChainOffsetExactOrPrefix( std::u32string const & ta
       // be in the right place for root node anyway, since we precache it.
       nextLeaf = ( currentNodeOffset != rootOffset ? idxFile->read< uint32_t >() : 0 );
 
+      if ( leafOffset ) {
+        *leafOffset = currentNodeOffset;
+      }
+
       if ( !leafEntries ) {
         // Empty leaf? This may only be possible for entirely empty trees only.
         if ( currentNodeOffset != rootOffset ) {
@@ -691,6 +1609,10 @@ char const * BtreeIndex::findChainOffsetExactOrPrefix( std::u32string const & ta
             // would mean the first element in the next leaf.
             if ( chainToCheck == &chainOffsets.back() ) {
               if ( nextLeaf ) {
+                if ( leafOffset ) {
+                  *leafOffset = nextLeaf;
+                }
+
                 readNode( nextLeaf, extLeaf );
 
                 leafEnd = &extLeaf.front() + extLeaf.size();
@@ -791,11 +1713,14 @@ void BtreeIndex::antialias( std::u32string const & str, vector< WordArticleLink
 /// A function which recursively creates btree node.
 /// The nextIndex iterator is being iterated over and increased when building
 /// leaf nodes.
+/// The offsets of the leaves and the numbers of their chains are appended to
+/// 'leaves', in order.
 static uint32_t buildBtreeNode( IndexedWords::const_iterator & nextIndex,
                                 size_t indexSize,
                                 File::Index & file,
                                 size_t maxElements,
-                                uint32_t & lastLeafLinkOffset )
+                                uint32_t & lastLeafLinkOffset,
+                                vector< pair< uint32_t, uint32_t > > & leaves )
 {
   // We compress all the node data. This buffer would hold it.
   vector< unsigned char > uncompressedData;
@@ -864,7 +1789,7 @@ static uint32_t buildBtreeNode( IndexedWords::const_iterator & nextIndex,
     for ( unsigned x = 0; x < maxElements; ++x ) {
       unsigned curEntry = (uint64_t)indexSize * ( x + 1 ) / ( maxElements + 1 );
 
-      uint32_t offset = buildBtreeNode( nextIndex, curEntry - prevEntry, file, maxElements, lastLeafLinkOffset );
+      uint32_t offset = buildBtreeNode( nextIndex, curEntry - prevEntry, file, maxElements, lastLeafLinkOffset, leaves );
 
       memcpy( &uncompressedData.front() + sizeof( uint32_t ) + x * sizeof( uint32_t ), &offset, sizeof( uint32_t ) );
 
@@ -879,7 +1804,7 @@ static uint32_t buildBtreeNode( IndexedWords::const_iterator & nextIndex,
     }
 
     // Rightmost child
-    uint32_t offset = buildBtreeNode( nextIndex, indexSize - prevEntry, file, maxElements, lastLeafLinkOffset );
+    uint32_t offset = buildBtreeNode( nextIndex, indexSize - prevEntry, file, maxElements, lastLeafLinkOffset, leaves );
     memcpy( &uncompressedData.front() + sizeof( uint32_t ) + maxElements * sizeof( uint32_t ),
             &offset,
             sizeof( offset ) );
@@ -908,187 +1833,506 @@ static uint32_t buildBtreeNode( IndexedWords::const_iterator & nextIndex,
 
     file.write( (uint32_t)0 );
 
-    uint32_t here = file.tell();
+    uint32_t here = file.tell();
+
+    if ( lastLeafLinkOffset ) {
+      // Update the previous leaf to have the offset of this one.
+      file.seek( lastLeafLinkOffset );
+      file.write( offset );
+      file.seek( here );
+    }
+
+    // Make sure next leaf knows where to write its offset for us.
+    lastLeafLinkOffset = here - sizeof( uint32_t );
+
+    leaves.emplace_back( offset, indexSize );
+  }
+
+  return offset;
+}
+
+void IndexedWords::addWord( std::u32string const & index_word, uint32_t articleOffset, unsigned int maxHeadwordSize )
+{
+  addPreparedWord( prepareWord( index_word, maxHeadwordSize ), articleOffset );
+}
+
+PreparedWord IndexedWords::prepareWord( std::u32string const & index_word, unsigned int maxHeadwordSize )
+{
+  PreparedWord result;
+
+  std::u32string word        = Text::removeTrailingZero( index_word );
+  string::size_type wordSize = word.size();
+
+  // Safeguard us against various bugs here. Don't attempt adding words
+  // which are freakishly huge.
+  if ( wordSize > maxHeadwordSize ) {
+    qWarning() << "Abbreviate the too long headword: " << QString::fromStdU32String( word.substr( 0, 30 ) )
+               << "size:" << wordSize;
+
+    //find the closest string to the maxHeadwordSize;
+    auto nonSpacePos = word.find_last_not_of( ' ', maxHeadwordSize );
+    if ( nonSpacePos > 0 ) {
+      word = word.substr( 0, nonSpacePos );
+    }
+    else {
+      word = word.substr( 0, maxHeadwordSize );
+    }
+
+    wordSize = word.size();
+  }
+  char32_t const * wordBegin = word.c_str();
+
+  // Skip any leading whitespace
+  while ( *wordBegin && Folding::isWhitespace( *wordBegin ) ) {
+    ++wordBegin;
+    --wordSize;
+  }
+
+  // Skip any trailing whitespace
+  while ( wordSize && Folding::isWhitespace( wordBegin[ wordSize - 1 ] ) ) {
+    --wordSize;
+  }
+
+  char32_t const * nextChar = wordBegin;
+
+  for ( ;; ) {
+    // Skip any whitespace/punctuation
+    for ( ;; ++nextChar ) {
+      if ( !*nextChar ) // End of string ends everything
+      {
+        if ( result.entries.empty() ) {
+          std::u32string folded = Folding::applyWhitespaceOnly( std::u32string( wordBegin, wordSize ) );
+          if ( !folded.empty() ) {
+            result.entries.push_back( { Text::toUtf8( folded ),
+                                        Text::toUtf8( std::u32string( wordBegin, wordSize ) ),
+                                        string(),
+                                        true } );
+          }
+        }
+        return result;
+      }
+
+      if ( !Folding::isWhitespace( *nextChar ) && !Folding::isPunct( *nextChar ) ) {
+        break;
+      }
+    }
+
+    // Insert this word
+    result.entries.push_back( { Text::toUtf8( Folding::apply( nextChar ) ),
+                                Text::toUtf8( std::u32string( nextChar, wordSize - ( nextChar - wordBegin ) ) ),
+                                Text::toUtf8( std::u32string( wordBegin, nextChar - wordBegin ) ),
+                                nextChar == wordBegin } );
+
+    // Skip all non-whitespace/punctuation
+    for ( ++nextChar;; ++nextChar ) {
+      if ( !*nextChar ) {
+        return result; // End of string ends everything
+      }
+
+      if ( Folding::isWhitespace( *nextChar ) || Folding::isPunct( *nextChar ) ) {
+        break;
+      }
+    }
+  }
+}
+
+void IndexedWords::addPreparedWord( PreparedWord const & word, uint32_t articleOffset )
+{
+  for ( auto const & entry : word.entries ) {
+    auto i = insert( { entry.folded, vector< WordArticleLink >() } ).first;
+
+    if ( ( i->second.size() < 1024 ) || entry.wholeWord ) // Don't overpopulate chains with middle matches
+    {
+      i->second.emplace_back( entry.word, articleOffset, entry.prefix );
+      // reduce the vector reallocation.
+      if ( i->second.size() * 1.0 / i->second.capacity() > 0.75 ) {
+        i->second.reserve( i->second.capacity() * 2 );
+      }
+    }
+  }
+}
+
+void IndexedWords::addSingleWord( std::u32string const & index_word, uint32_t articleOffset )
+{
+  std::u32string const & word = Text::removeTrailingZero( index_word );
+  std::u32string folded       = Folding::apply( word );
+  if ( folded.empty() ) {
+    folded = Folding::applyWhitespaceOnly( word );
+  }
+  operator[]( Text::toUtf8( folded ) ).emplace_back( Text::toUtf8( word ), articleOffset );
+}
+
+IndexInfo buildIndex( IndexedWords const & indexedWords, File::Index & file )
+{
+  size_t indexSize = indexedWords.size();
+  auto nextIndex   = indexedWords.begin();
+
+  // Skip any empty words. No point in indexing those, and some dictionaries
+  // are known to have buggy empty-word entries (Stardict's jargon for instance).
+
+  while ( indexSize && nextIndex->first.empty() ) {
+    indexSize--;
+    ++nextIndex;
+  }
+
+  // We try to stick to two-level tree for most dictionaries. Try finding
+  // the right size for it.
+
+  size_t btreeMaxElements = ( (size_t)sqrt( (double)indexSize ) ) + 1;
+
+  if ( btreeMaxElements < BtreeMinElements ) {
+    btreeMaxElements = BtreeMinElements;
+  }
+  else if ( btreeMaxElements > BtreeMaxElements ) {
+    btreeMaxElements = BtreeMaxElements;
+  }
+
+  qDebug( "Building a tree of %u elements", (unsigned)btreeMaxElements );
+
+
+  uint32_t lastLeafOffset = 0;
+
+  KeyFilter filter( indexSize );
+  NgramIndex::Builder ngrams;
+  auto const nextIndexStart = nextIndex;
+
+  for ( auto i = nextIndex; i != indexedWords.end(); ++i ) {
+    filter.add( i->first );
+    ngrams.addChain( i->second );
+  }
+
+  vector< pair< uint32_t, uint32_t > > leaves;
+
+  uint32_t rootOffset = buildBtreeNode( nextIndex, indexSize, file, btreeMaxElements, lastLeafOffset, leaves );
+
+  // The root node is always the last one written, and KeyFilter::load() relies on that
+  filter.save( file );
+  HeadwordTable::save( file, nextIndexStart, indexedWords.end() );
+  ngrams.save( file, leaves );
+
+  return IndexInfo( btreeMaxElements, rootOffset );
+}
+
+void BtreeIndex::findAllArticleLinks( QList< WordArticleLink > & articleLinks )
+{
+  if ( !idxFile ) {
+    throw exIndexWasNotOpened();
+  }
+
+  QSet< uint32_t > offsets;
+
+  findArticleLinks( &articleLinks, &offsets );
+}
+
+void BtreeIndex::forEachChain( std::function< bool( vector< WordArticleLink > const & ) > const & f )
+{
+  if ( !idxFile ) {
+    throw exIndexWasNotOpened();
+  }
+
+  vector< char > leaf;
+  uint32_t nextLeaf = 0;
+
+  {
+    QMutexLocker _( idxFileMutex );
+
+    if ( !rootNodeLoaded ) {
+      // Time to load our root node. We do it only once, at the first request.
+      readNode( rootOffset, rootNode );
+      rootNodeLoaded = true;
+    }
+
+    // Descend to the first leaf
+
+    leaf = rootNode;
+
+    while ( *(uint32_t *)&leaf.front() == 0xffffFFFF ) {
+      readNode( *( (uint32_t *)&leaf.front() + 1 ), leaf );
+      nextLeaf = idxFile->read< uint32_t >();
+    }
+  }
+
+  for ( ;; ) {
+    char const * chainPtr = &leaf.front() + sizeof( uint32_t );
+    char const * leafEnd  = &leaf.front() + leaf.size();
+
+    while ( chainPtr < leafEnd ) {
+      if ( !f( readChain( chainPtr ) ) ) {
+        return;
+      }
+    }
+
+    if ( !nextLeaf ) {
+      break; // That was the last leaf
+    }
+
+    QMutexLocker _( idxFileMutex );
+
+    readNode( nextLeaf, leaf );
+    nextLeaf = idxFile->read< uint32_t >();
+
+    if ( *(uint32_t *)&leaf.front() == 0xffffFFFF ) {
+      throw exCorruptedChainData();
+    }
+  }
+}
+
+bool BtreeIndex::forEachWildcardCandidate( std::u32string const & pattern,
+                                           std::function< bool( vector< WordArticleLink > const & ) > const & f )
+{
+  if ( !idxFile ) {
+    throw exIndexWasNotOpened();
+  }
+
+  vector< uint64_t > const ngrams = NgramIndex::ofPattern( pattern );
+
+  if ( ngrams.empty() ) {
+    return false;
+  }
+
+  std::shared_ptr< NgramIndex const > index;
+  vector< uint32_t > candidates;
+
+  {
+    QMutexLocker _( idxFileMutex );
+
+    if ( !ngramIndexLoaded ) {
+      ngramIndexLoaded = true;
+
+      if ( ngramIndexOffset ) {
+        try {
+          ngramIndex = NgramIndex::load( *idxFile, ngramIndexOffset );
+        }
+        catch ( std::exception & e ) {
+          qDebug( "No n-gram index loaded for the index: %s", e.what() );
+        }
+      }
+    }
+
+    if ( !ngramIndex ) {
+      return false;
+    }
+
+    index      = ngramIndex;
+    candidates = index->find( *idxFile, ngrams );
+  }
+
+  vector< char > leaf;
+  NgramIndex::Leaf const * currentLeaf = nullptr;
+  char const * chainPtr                = nullptr;
+  char const * leafEnd                 = nullptr;
+  uint32_t chain                       = 0; // The ordinal of the chain at chainPtr
+
+  for ( uint32_t candidate : candidates ) {
+    NgramIndex::Leaf const & candidateLeaf = index->leafOf( candidate );
+
+    if ( &candidateLeaf != currentLeaf ) {
+      {
+        QMutexLocker _( idxFileMutex );
+        readNode( candidateLeaf.offset, leaf );
+      }
+
+      if ( leaf.size() < sizeof( uint32_t ) || *(uint32_t *)&leaf.front() == 0xffffFFFF ) {
+        throw exCorruptedChainData();
+      }
+
+      currentLeaf = &candidateLeaf;
+      chainPtr    = &leaf.front() + sizeof( uint32_t );
+      leafEnd     = &leaf.front() + leaf.size();
+      chain       = candidateLeaf.firstChain;
+    }
+
+    // Skip the chains in between, their sizes are all it takes
+    for ( ; chain < candidate && leafEnd - chainPtr >= (ptrdiff_t)sizeof( uint32_t ); ++chain ) {
+      uint32_t chainSize;
+      memcpy( &chainSize, chainPtr, sizeof( uint32_t ) );
+      chainPtr += sizeof( uint32_t ) + chainSize;
+    }
 
-    if ( lastLeafLinkOffset ) {
-      // Update the previous leaf to have the offset of this one.
-      file.seek( lastLeafLinkOffset );
-      file.write( offset );
-      file.seek( here );
+    if ( chain != candidate || chainPtr >= leafEnd ) {
+      throw exCorruptedChainData();
     }
 
-    // Make sure next leaf knows where to write its offset for us.
-    lastLeafLinkOffset = here - sizeof( uint32_t );
+    ++chain;
+
+    if ( !f( readChain( chainPtr ) ) ) {
+      break;
+    }
   }
 
-  return offset;
+  return true;
 }
 
-void IndexedWords::addWord( std::u32string const & index_word, uint32_t articleOffset, unsigned int maxHeadwordSize )
+void BtreeIndex::forEachFuzzyChain( std::u32string const & folded,
+                                    unsigned maxDistance,
+                                    std::function< bool( vector< WordArticleLink > const &, unsigned ) > const & f,
+                                    QAtomicInt * isCancelled )
 {
-  std::u32string word        = Text::removeTrailingZero( index_word );
-  string::size_type wordSize = word.size();
+  if ( !idxFile ) {
+    throw exIndexWasNotOpened();
+  }
 
-  // Safeguard us against various bugs here. Don't attempt adding words
-  // which are freakishly huge.
-  if ( wordSize > maxHeadwordSize ) {
-    qWarning() << "Abbreviate the too long headword: " << QString::fromStdU32String( word.substr( 0, 30 ) )
-               << "size:" << wordSize;
+  LevenshteinAutomaton const automaton( folded, maxDistance );
 
-    //find the closest string to the maxHeadwordSize;
-    auto nonSpacePos = word.find_last_not_of( ' ', maxHeadwordSize );
-    if ( nonSpacePos > 0 ) {
-      word = word.substr( 0, nonSpacePos );
+  // Whether the range of keys from lo (inclusive) to hi (exclusive) can have
+  // any accepted by the automaton. It is all decided by the common prefix of
+  // the bounds, and by the range of the character following it.
+  auto const mayHaveMatches = [ & ]( std::u32string const & lo, std::u32string const * hi ) {
+    if ( !hi ) {
+      return true;
     }
-    else {
-      word = word.substr( 0, maxHeadwordSize );
+
+    size_t common = 0;
+
+    while ( common < lo.size() && common < hi->size() && lo[ common ] == ( *hi )[ common ] ) {
+      ++common;
     }
 
-    wordSize = word.size();
-  }
-  char32_t const * wordBegin = word.c_str();
+    LevenshteinAutomaton::State state = automaton.start();
 
-  // Skip any leading whitespace
-  while ( *wordBegin && Folding::isWhitespace( *wordBegin ) ) {
-    ++wordBegin;
-    --wordSize;
-  }
+    for ( size_t x = 0; x < common; ++x ) {
+      state = automaton.step( state, lo[ x ] );
 
-  // Skip any trailing whitespace
-  while ( wordSize && Folding::isWhitespace( wordBegin[ wordSize - 1 ] ) ) {
-    --wordSize;
-  }
+      if ( !automaton.isAlive( state ) ) {
+        return false;
+      }
+    }
 
-  char32_t const * nextChar = wordBegin;
+    if ( common == hi->size() ) {
+      return true; // Can't happen with valid bounds, be on the safe side
+    }
+
+    if ( common == lo.size() && automaton.distance( state ) <= maxDistance ) {
+      return true; // The common prefix itself is in the range, and is accepted
+    }
+
+    return automaton.isAlive( state, common < lo.size() ? lo[ common ] : 0, ( *hi )[ common ] );
+  };
 
-  vector< char > utfBuffer( wordSize * 4 );
+  struct Subtree
+  {
+    uint32_t offset;
+    std::u32string lo, hi;
+    bool bounded; // Whether hi is there, it isn't for the rightmost subtrees
+  };
 
-  int wordsAdded = 0; // Number of stored parts
+  vector< Subtree > pending;
+  vector< char > node;
+  bool atRoot = true;
 
   for ( ;; ) {
-    // Skip any whitespace/punctuation
-    for ( ;; ++nextChar ) {
-      if ( !*nextChar ) // End of string ends everything
-      {
-        if ( wordsAdded == 0 ) {
-          std::u32string folded = Folding::applyWhitespaceOnly( std::u32string( wordBegin, wordSize ) );
-          if ( !folded.empty() ) {
-            auto i = insert( { Text::toUtf8( folded ), vector< WordArticleLink >() } ).first;
+    Subtree subtree{ 0, {}, {}, false }; // The root covers all the keys
 
-            string utfWord = Text::toUtf8( std::u32string( wordBegin, wordSize ) );
-            string utfPrefix;
-            i->second.emplace_back( utfWord, articleOffset, utfPrefix );
-          }
+    {
+      QMutexLocker _( idxFileMutex );
+
+      if ( atRoot ) {
+        if ( !rootNodeLoaded ) {
+          // Time to load our root node. We do it only once, at the first request.
+          readNode( rootOffset, rootNode );
+          rootNodeLoaded = true;
         }
-        return;
+
+        node = rootNode;
       }
+      else {
+        if ( pending.empty() ) {
+          break;
+        }
 
-      if ( !Folding::isWhitespace( *nextChar ) && !Folding::isPunct( *nextChar ) ) {
-        break;
+        subtree = std::move( pending.back() );
+        pending.pop_back();
+
+        readNode( subtree.offset, node );
       }
     }
 
-    // Insert this word
-    std::u32string folded = Folding::apply( nextChar );
-    auto name             = Text::toUtf8( folded );
-
-    auto i = insert( { std::move( name ), vector< WordArticleLink >() } ).first;
+    atRoot = false;
 
-    if ( ( i->second.size() < 1024 ) || ( nextChar == wordBegin ) ) // Don't overpopulate chains with middle matches
-    {
-      string utfWord   = Text::toUtf8( std::u32string( nextChar, wordSize - ( nextChar - wordBegin ) ) );
-      string utfPrefix = Text::toUtf8( std::u32string( wordBegin, nextChar - wordBegin ) );
+    if ( isCancelled && Utils::AtomicInt::loadAcquire( *isCancelled ) ) {
+      return;
+    }
 
-      i->second.emplace_back( std::move( utfWord ), articleOffset, std::move( utfPrefix ) );
-      // reduce the vector reallocation.
-      if ( i->second.size() * 1.0 / i->second.capacity() > 0.75 ) {
-        i->second.reserve( i->second.capacity() * 2 );
-      }
+    if ( node.size() < sizeof( uint32_t ) ) {
+      throw exCorruptedChainData();
     }
 
-    wordsAdded += 1;
+    char const * ptr = &node.front();
+    char const * end = ptr + node.size();
 
-    // Skip all non-whitespace/punctuation
-    for ( ++nextChar;; ++nextChar ) {
-      if ( !*nextChar ) {
-        return; // End of string ends everything
-      }
+    if ( *(uint32_t const *)ptr == 0xffffFFFF ) {
+      // A node. Its children are separated by the first keys of all but the
+      // first one, so each child covers the keys from its left separator up
+      // to its right one.
+      uint32_t const * offsets = (uint32_t const *)ptr + 1;
 
-      if ( Folding::isWhitespace( *nextChar ) || Folding::isPunct( *nextChar ) ) {
-        break;
-      }
-    }
-  }
-}
+      ptr += sizeof( uint32_t ) + ( indexNodeSize + 1 ) * sizeof( uint32_t );
 
-void IndexedWords::addSingleWord( std::u32string const & index_word, uint32_t articleOffset )
-{
-  std::u32string const & word = Text::removeTrailingZero( index_word );
-  std::u32string folded       = Folding::apply( word );
-  if ( folded.empty() ) {
-    folded = Folding::applyWhitespaceOnly( word );
-  }
-  operator[]( Text::toUtf8( folded ) ).emplace_back( Text::toUtf8( word ), articleOffset );
-}
+      vector< std::u32string > separators;
 
-IndexInfo buildIndex( IndexedWords const & indexedWords, File::Index & file )
-{
-  size_t indexSize = indexedWords.size();
-  auto nextIndex   = indexedWords.begin();
+      while ( ptr < end && separators.size() < indexNodeSize ) {
+        size_t const size = strnlen( ptr, end - ptr );
+        separators.push_back( Text::toUtf32( string( ptr, size ) ) );
+        ptr += size + 1;
+      }
 
-  // Skip any empty words. No point in indexing those, and some dictionaries
-  // are known to have buggy empty-word entries (Stardict's jargon for instance).
+      if ( separators.size() != indexNodeSize ) {
+        throw exCorruptedChainData();
+      }
 
-  while ( indexSize && nextIndex->first.empty() ) {
-    indexSize--;
-    ++nextIndex;
-  }
+      // Pushed from the right, so that they're popped in the order of keys
+      for ( size_t x = indexNodeSize + 1; x--; ) {
+        std::u32string const & lo = x ? separators[ x - 1 ] : subtree.lo;
+        std::u32string const * hi = x < indexNodeSize ? &separators[ x ] : ( subtree.bounded ? &subtree.hi : nullptr );
 
-  // We try to stick to two-level tree for most dictionaries. Try finding
-  // the right size for it.
+        if ( mayHaveMatches( lo, hi ) ) {
+          pending.push_back( { offsets[ x ], lo, hi ? *hi : std::u32string(), hi != nullptr } );
+        }
+      }
 
-  size_t btreeMaxElements = ( (size_t)sqrt( (double)indexSize ) ) + 1;
+      continue;
+    }
 
-  if ( btreeMaxElements < BtreeMinElements ) {
-    btreeMaxElements = BtreeMinElements;
-  }
-  else if ( btreeMaxElements > BtreeMaxElements ) {
-    btreeMaxElements = BtreeMaxElements;
-  }
+    // A leaf. The automaton's states are kept for each character of the
+    // previous key, so that only the part differing from it is run.
 
-  qDebug( "Building a tree of %u elements", (unsigned)btreeMaxElements );
+    vector< LevenshteinAutomaton::State > states{ automaton.start() };
+    std::u32string previousKey;
 
+    for ( ptr += sizeof( uint32_t ); ptr < end; ) {
+      vector< WordArticleLink > chain = readChain( ptr );
 
-  uint32_t lastLeafOffset = 0;
+      if ( chain.empty() ) {
+        continue;
+      }
 
-  uint32_t rootOffset = buildBtreeNode( nextIndex, indexSize, file, btreeMaxElements, lastLeafOffset );
+      std::u32string const key = foldForLookup( Text::toUtf32( chain[ 0 ].word ) );
 
-  return IndexInfo( btreeMaxElements, rootOffset );
-}
+      size_t common = 0;
 
-void BtreeIndex::getAllHeadwords( QSet< QString > & headwords )
-{
-  if ( !idxFile ) {
-    throw exIndexWasNotOpened();
-  }
+      while ( common < key.size() && common < previousKey.size() && key[ common ] == previousKey[ common ] ) {
+        ++common;
+      }
 
-  findArticleLinks( nullptr, nullptr, &headwords );
-}
+      states.resize( std::min( common + 1, states.size() ) );
 
-void BtreeIndex::findAllArticleLinks( QList< WordArticleLink > & articleLinks )
-{
-  if ( !idxFile ) {
-    throw exIndexWasNotOpened();
-  }
+      while ( states.size() <= key.size() && automaton.isAlive( states.back() ) ) {
+        states.push_back( automaton.step( states.back(), key[ states.size() - 1 ] ) );
+      }
 
-  QSet< uint32_t > offsets;
+      previousKey = key;
 
-  findArticleLinks( &articleLinks, &offsets, nullptr );
+      if ( states.size() == key.size() + 1 && automaton.distance( states.back() ) <= maxDistance ) {
+        if ( !f( chain, automaton.distance( states.back() ) ) ) {
+          return;
+        }
+      }
+    }
+  }
 }
 
 void BtreeIndex::findArticleLinks( QList< WordArticleLink > * articleLinks,
                                    QSet< uint32_t > * offsets,
-                                   QSet< QString > * headwords,
                                    QAtomicInt * isCancelled )
 {
   uint32_t currentNodeOffset = rootOffset;
@@ -1153,10 +2397,6 @@ void BtreeIndex::findArticleLinks( QList< WordArticleLink > * articleLinks,
         return;
       }
 
-      if ( headwords ) {
-        headwords->insert( QString::fromUtf8( ( i.prefix + i.word ).c_str() ) );
-      }
-
       if ( offsets && offsets->contains( i.articleOffset ) ) {
         continue;
       }
@@ -1194,85 +2434,172 @@ void BtreeIndex::findArticleLinks( QList< WordArticleLink > * articleLinks,
   }
 }
 
-void BtreeIndex::findHeadWords( QList< uint32_t > offsets, int & index, QSet< QString > * headwords, uint32_t length )
+namespace {
+
+/// Whether the link is the one of the first word of its headword, i.e. its
+/// prefix, if any, is nothing but whitespace and punctuation
+bool isFirstWordLink( WordArticleLink const & link )
 {
-  for ( auto begin = offsets.begin() + index; begin != offsets.end(); begin++ ) {
-    findSingleNodeHeadwords( *begin, headwords );
-    index++;
+  if ( link.prefix.empty() ) {
+    return true;
+  }
 
-    if ( headwords->size() >= length ) {
-      break;
+  for ( char32_t ch : Text::toUtf32( link.prefix ) ) {
+    if ( !Folding::isWhitespace( ch ) && !Folding::isPunct( ch ) ) {
+      return false;
     }
   }
+
+  return true;
 }
 
-void BtreeIndex::findSingleNodeHeadwords( uint32_t offsets, QSet< QString > * headwords )
+} // namespace
+
+bool BtreeIndex::readHeadwordPage( Dictionary::HeadwordCursor & cursor, QStringList & headwords, int maxCount )
 {
-  uint32_t currentNodeOffset = offsets;
+  if ( !idxFile ) {
+    throw exIndexWasNotOpened();
+  }
 
-  QMutexLocker _( idxFileMutex );
+  if ( cursor.atEnd ) {
+    return false;
+  }
 
-  char const * leaf     = nullptr;
-  char const * leafEnd  = nullptr;
-  char const * chainPtr = nullptr;
+  vector< char > leaf;
+  uint32_t nextLeaf = 0;
 
-  vector< char > extLeaf;
+  {
+    QMutexLocker _( idxFileMutex );
+
+    if ( !rootNodeLoaded ) {
+      // Time to load our root node. We do it only once, at the first request.
+      readNode( rootOffset, rootNode );
+      rootNodeLoaded = true;
+    }
+
+    if ( !cursor.leaf ) {
+      // Descend to the first leaf
+      cursor.leaf = rootOffset;
+      leaf        = rootNode;
 
-  // A node
-  readNode( currentNodeOffset, extLeaf );
-  leaf    = &extLeaf.front();
-  leafEnd = leaf + extLeaf.size();
+      while ( *(uint32_t *)&leaf.front() == 0xffffFFFF ) {
+        cursor.leaf = *( (uint32_t *)&leaf.front() + 1 );
+        readNode( cursor.leaf, leaf );
+        nextLeaf = idxFile->read< uint32_t >();
+      }
+    }
+    else if ( cursor.leaf == rootOffset ) {
+      leaf = rootNode; // The root is the only leaf
+    }
+    else {
+      readNode( cursor.leaf, leaf );
+      nextLeaf = idxFile->read< uint32_t >();
+    }
+  }
 
-  // A leaf
-  chainPtr = leaf + sizeof( uint32_t );
+  int added = 0;
+  std::vector< string > chainWords;
 
   for ( ;; ) {
-    vector< WordArticleLink > result = readChain( chainPtr );
+    if ( *(uint32_t *)&leaf.front() == 0xffffFFFF ) {
+      throw exCorruptedChainData();
+    }
+
+    char const * chainPtr = &leaf.front() + sizeof( uint32_t );
+    char const * leafEnd  = &leaf.front() + leaf.size();
+
+    for ( uint32_t chain = 0; chainPtr < leafEnd; ++chain ) {
+      if ( chain < cursor.chain ) {
+        // Read on the previous page, just skip it
+        uint32_t chainSize;
+        memcpy( &chainSize, chainPtr, sizeof( uint32_t ) );
+        chainPtr += sizeof( uint32_t ) + chainSize;
+        continue;
+      }
+
+      if ( added >= maxCount ) {
+        cursor.chain = chain;
+        return true;
+      }
+
+      vector< WordArticleLink > links = readChain( chainPtr );
+
+      if ( !cursor.prefix.empty() && !links.empty() ) {
+        std::u32string const word = Text::toUtf32( links.front().word );
+        std::u32string key        = Folding::apply( word );
+
+        if ( key.empty() ) {
+          key = Folding::applyWhitespaceOnly( word );
+        }
+
+        if ( key.compare( 0, cursor.prefix.size(), cursor.prefix ) != 0 ) {
+          cursor.atEnd = true; // Past the keys having the prefix
+          return false;
+        }
+      }
+
+      chainWords.clear();
+
+      for ( auto & link : links ) {
+        if ( !isFirstWordLink( link ) ) {
+          continue; // A middle word, the headword is in the chain of its first one
+        }
+
+        string word = link.prefix + link.word;
 
-    if ( headwords ) {
-      for ( auto & i : result ) {
-        headwords->insert( QString::fromUtf8( ( i.prefix + i.word ).c_str() ) );
+        if ( std::find( chainWords.begin(), chainWords.end(), word ) == chainWords.end() ) {
+          headwords.append( QString::fromUtf8( word.c_str(), word.size() ) );
+          chainWords.push_back( std::move( word ) );
+          ++added;
+        }
       }
     }
 
-    if ( chainPtr >= leafEnd ) {
-      break; // That was the last leaf
+    cursor.chain = 0;
+
+    if ( !nextLeaf ) {
+      cursor.atEnd = true; // That was the last leaf
+      return false;
     }
+
+    cursor.leaf = nextLeaf;
+
+    QMutexLocker _( idxFileMutex );
+
+    readNode( nextLeaf, leaf );
+    nextLeaf = idxFile->read< uint32_t >();
   }
 }
 
-//find the next chain ptr ,which is larger than this currentChainPtr
-QList< uint32_t > BtreeIndex::findNodes()
+void BtreeIndex::seekHeadwords( Dictionary::HeadwordCursor & cursor, std::u32string const & folded )
 {
-  QMutexLocker _( idxFileMutex );
+  bool exactMatch;
+  vector< char > leaf;
+  uint32_t nextLeaf;
+  char const * leafEnd;
+  uint32_t leafOffset = 0;
 
-  if ( !rootNodeLoaded ) {
-    // Time to load our root node. We do it only once, at the first request.
-    readNode( rootOffset, rootNode );
-    rootNodeLoaded = true;
-  }
+  char const * chainPtr = findChainOffsetExactOrPrefix( folded, exactMatch, leaf, nextLeaf, leafEnd, &leafOffset );
 
-  char const * leaf = &rootNode.front();
-  QList< uint32_t > leafOffset;
+  cursor        = {};
+  cursor.prefix = folded;
 
-  uint32_t leafEntries;
-  leafEntries = *(uint32_t *)leaf;
-  if ( leafEntries != 0xffffFFFF ) {
-    leafOffset.append( rootOffset );
-    return leafOffset;
+  if ( !chainPtr ) {
+    cursor.atEnd = true;
+    return;
   }
 
-  // the current the btree's implementation has the  height = 2.
+  // The root node is kept loaded, so the pointer may be into it rather than the leaf
+  char const * ptr = ( leafOffset == rootOffset ? &rootNode.front() : &leaf.front() ) + sizeof( uint32_t );
 
-  // A node offset
-  uint32_t * offsets = (uint32_t *)leaf + 1;
-  uint32_t i         = 0;
+  cursor.leaf = leafOffset;
 
-  while ( i++ < ( indexNodeSize + 1 ) ) {
-    leafOffset.append( *( offsets++ ) );
+  while ( ptr < chainPtr ) {
+    uint32_t chainSize;
+    memcpy( &chainSize, ptr, sizeof( uint32_t ) );
+    ptr += sizeof( uint32_t ) + chainSize;
+    ++cursor.chain;
   }
-
-  return leafOffset;
 }
 
 void BtreeIndex::getHeadwordsFromOffsets( QList< uint32_t > & offsets,
@@ -1287,6 +2614,27 @@ void BtreeIndex::getHeadwordsFromOffsets( QList< uint32_t > & offsets,
 
   QMutexLocker _( idxFileMutex );
 
+  if ( auto const table = loadHeadwordTable() ) {
+    // Just look each of them up
+    string headword;
+
+    for ( uint32_t offset : std::as_const( offsets ) ) {
+      if ( isCancelled && Utils::AtomicInt::loadAcquire( *isCancelled ) ) {
+        return;
+      }
+
+      if ( table->find( *idxFile, offset, headword ) ) {
+        auto word = QString::fromUtf8( headword.c_str() );
+
+        if ( headwords.indexOf( word ) == -1 ) {
+          headwords.append( word );
+        }
+      }
+    }
+
+    return;
+  }
+
   if ( !rootNodeLoaded ) {
     // Time to load our root node. We do it only once, at the first request.
     readNode( rootOffset, rootNode );
@@ -1394,38 +2742,79 @@ void BtreeIndex::getHeadwordsFromOffsets( QList< uint32_t > & offsets,
   }
 }
 
-bool BtreeDictionary::getHeadwords( QStringList & headwords )
+void BtreeIndex::getArticleOffsets( QList< uint32_t > & offsets, QAtomicInt * isCancelled )
 {
-  QSet< QString > setOfHeadwords;
+  if ( !idxFile ) {
+    throw exIndexWasNotOpened();
+  }
 
-  headwords.clear();
-  setOfHeadwords.reserve( getWordCount() );
+  offsets.clear();
 
-  try {
-    getAllHeadwords( setOfHeadwords );
+  {
+    QMutexLocker _( idxFileMutex );
+
+    if ( auto const table = loadHeadwordTable() ) {
+      table->appendOffsets( offsets );
+      return;
+    }
+  }
+
+  // No table in the index, so it has to be scanned
+
+  QSet< uint32_t > setOfOffsets;
 
-    if ( setOfHeadwords.size() ) {
-      headwords.reserve( setOfHeadwords.size() );
+  findArticleLinks( nullptr, &setOfOffsets, isCancelled );
 
-      QSet< QString >::const_iterator it  = setOfHeadwords.constBegin();
-      QSet< QString >::const_iterator end = setOfHeadwords.constEnd();
+  offsets = QList< uint32_t >( setOfOffsets.begin(), setOfOffsets.end() );
+  std::sort( offsets.begin(), offsets.end() );
+}
+
+std::shared_ptr< HeadwordTable const > BtreeIndex::loadHeadwordTable()
+{
+  if ( !headwordTableLoaded ) {
+    headwordTableLoaded = true;
 
-      for ( ; it != end; ++it ) {
-        headwords.append( *it );
+    if ( headwordTableOffset ) {
+      try {
+        headwordTable = HeadwordTable::load( *idxFile, headwordTableOffset );
+      }
+      catch ( std::exception & e ) {
+        qDebug( "No headword table loaded for the index: %s", e.what() );
       }
     }
   }
+
+  return headwordTable;
+}
+
+bool BtreeDictionary::getHeadwordPage( Dictionary::HeadwordCursor & cursor, QStringList & headwords, int maxCount )
+{
+  try {
+    return readHeadwordPage( cursor, headwords, maxCount );
+  }
   catch ( std::exception & ex ) {
     qWarning( "Failed headwords retrieving for \"%s\", reason: %s", getName().c_str(), ex.what() );
+    cursor.atEnd = true;
+    return false;
   }
-
-  return headwords.size() > 0;
 }
 
-void BtreeDictionary::findHeadWordsWithLenth( int & index, QSet< QString > * headwords, uint32_t length )
+bool BtreeDictionary::seekHeadwords( Dictionary::HeadwordCursor & cursor, QString const & prefix )
 {
-  auto leafNodeOffsets = findNodes();
-  findHeadWords( leafNodeOffsets, index, headwords, length );
+  std::u32string const folded = Folding::apply( prefix.toStdU32String() );
+
+  if ( folded.empty() ) {
+    return false; // Nothing to narrow the search down with
+  }
+
+  try {
+    BtreeIndex::seekHeadwords( cursor, folded );
+    return true;
+  }
+  catch ( std::exception & ex ) {
+    qWarning( "Failed headwords seeking for \"%s\", reason: %s", getName().c_str(), ex.what() );
+    return false;
+  }
 }
 
 void BtreeDictionary::getArticleText( uint32_t, QString &, QString & ) {}
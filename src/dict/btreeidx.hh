@@ -5,7 +5,9 @@
 
 #include "dict/dictionary.hh"
 #include "dictfile.hh"
+#include <functional>
 #include <map>
+#include <memory>
 #include <stdint.h>
 #include <string>
 #include <vector>
@@ -25,7 +27,7 @@ enum {
   /// This is to be bumped up each time the internal format changes.
   /// The value isn't used here by itself, it is supposed to be added
   /// to each dictionary's internal format version.
-  FormatVersion = 4,
+  FormatVersion = 7,
   //the indexedzip parse logic version
   ZipParseLogicVersion = 1
 };
@@ -53,6 +55,22 @@ struct WordArticleLink
   }
 };
 
+/// A Bloom filter over all the folded keys of an index. It is stored right
+/// after the btree's root node, and lets lookups of words that the dictionary
+/// doesn't have return without walking and decompressing any nodes.
+class KeyFilter;
+
+/// Posting lists of the letter trigrams of all the headwords, pointing to the
+/// chains having them. It is stored after the key filter, and lets wildcard
+/// searches with no prefix to start from only look at the chains which have
+/// all the trigrams of the pattern's literal parts.
+class NgramIndex;
+
+/// The headword of each article, sorted by the articles' offsets. It is stored
+/// after the key filter, and turns the full-text search hits back into the
+/// headwords without going through the whole btree.
+class HeadwordTable;
+
 /// Information needed to open the index
 struct IndexInfo
 {
@@ -79,6 +97,22 @@ public:
   /// The mutex is the one to be locked when working with the file.
   void openIndex( IndexInfo const &, File::Index &, QMutex & );
 
+  /// The offset of the root node, which moves whenever the index is rebuilt
+  /// with other contents
+  uint32_t getRootOffset() const
+  {
+    return rootOffset;
+  }
+
+  /// Returns false if the given word is certainly absent from the index, i.e.
+  /// findArticles() would return nothing for it. The check is done in memory,
+  /// so it is cheap enough to be done on the calling thread. Returns true if
+  /// the index has no key filter.
+  bool mayContain( std::u32string const & ) const;
+
+  /// Same as above, but checks the word and all its alternative forms.
+  bool mayContainAny( std::u32string const & word, vector< std::u32string > const & alts ) const;
+
   /// Finds articles that match the given string. A case-insensitive search
   /// is performed.
   vector< WordArticleLink >
@@ -87,23 +121,50 @@ public:
   /// Find all unique article links in the index
   void findAllArticleLinks( QList< WordArticleLink > & articleLinks );
 
-  /// Retrieve all unique headwords from index
-  void getAllHeadwords( QSet< QString > & headwords );
-
-  /// Find all article links and/or headwords in the index
+  /// Calls the function for every chain of the index, in the order of their
+  /// keys, until it returns false. The index file is only locked while the
+  /// leaves are read, not while the function runs.
+  void forEachChain( std::function< bool( vector< WordArticleLink > const & ) > const & );
+
+  /// Calls the function, in the order of their keys, for each chain which may
+  /// have words matching the given wildcard pattern, until it returns false.
+  /// Returns false without calling it if the index has no n-gram index, or if
+  /// the pattern has no trigrams to narrow the search down with. The pattern
+  /// must be case- and diacritics-folded.
+  bool forEachWildcardCandidate( std::u32string const & pattern,
+                                 std::function< bool( vector< WordArticleLink > const & ) > const & );
+
+  /// Calls the function, in the order of their keys, for each chain whose key
+  /// is within maxDistance edits of the given folded word, along with that
+  /// distance, until it returns false. The btree is walked with a Levenshtein
+  /// automaton, so the subtrees whose keys are all too far are never read.
+  void forEachFuzzyChain( std::u32string const & folded,
+                          unsigned maxDistance,
+                          std::function< bool( vector< WordArticleLink > const &, unsigned distance ) > const &,
+                          QAtomicInt * isCancelled = nullptr );
+
+  /// Reads the next page of the headwords, see Dictionary::Class::getHeadwordPage().
+  /// The chains are gone through in the order of their keys. A headword is
+  /// only taken from the chain of its first word, which is the only chain
+  /// having it, so the duplicates are dropped within each chain.
+  bool readHeadwordPage( Dictionary::HeadwordCursor &, QStringList & headwords, int maxCount );
+
+  /// Moves the cursor to the first chain whose key isn't ordered before the
+  /// given folded prefix, and limits it to the chains whose keys start with it.
+  void seekHeadwords( Dictionary::HeadwordCursor &, std::u32string const & folded );
+
+  /// Find all article links in the index
   void findArticleLinks( QList< WordArticleLink > * articleLinks,
                          QSet< uint32_t > * offsets,
-                         QSet< QString > * headwords,
                          QAtomicInt * isCancelled = 0 );
 
-  void findHeadWords( QList< uint32_t > offsets, int & index, QSet< QString > * headwords, uint32_t length );
-  void findSingleNodeHeadwords( uint32_t offsets, QSet< QString > * headwords );
-  QList< uint32_t > findNodes();
-
   /// Retrieve headwords for presented article addresses
   void
   getHeadwordsFromOffsets( QList< uint32_t > & offsets, QList< QString > & headwords, QAtomicInt * isCancelled = 0 );
 
+  /// Retrieve the offsets of all the articles, sorted and without duplicates
+  void getArticleOffsets( QList< uint32_t > & offsets, QAtomicInt * isCancelled = 0 );
+
 protected:
 
   /// Finds the offset in the btree leaf for the given word, either matching
@@ -117,12 +178,14 @@ protected:
   /// might not get used at all if the root node was the terminal one. In that
   /// case, the returned pointer wouldn't belong to 'leaf' at all. To that end,
   /// the leafEnd pointer always holds the pointer to the first byte outside
-  /// the node data.
+  /// the node data. If leafOffset is given, the offset of the located leaf
+  /// is saved to it.
   char const * findChainOffsetExactOrPrefix( std::u32string const & target,
                                              bool & exactMatch,
                                              vector< char > & leaf,
                                              uint32_t & nextLeaf,
-                                             char const *& leafEnd );
+                                             char const *& leafEnd,
+                                             uint32_t * leafOffset = nullptr );
 
   /// Reads a node or leaf at the given offset. Just uncompresses its data
   /// to the given vector and does nothing more.
@@ -148,6 +211,23 @@ private:
   bool rootNodeLoaded;
   vector< char > rootNode; // We load root note here and keep it at all times,
                            // since all searches always start with it.
+
+  /// Loaded in openIndex(), possibly on another thread than the one doing the
+  /// lookups, hence it's only accessed with std::atomic_load/atomic_store.
+  std::shared_ptr< KeyFilter const > keyFilter;
+
+  /// Loaded on first use. Guarded by idxFileMutex, as is the n-gram index below.
+  qint64 headwordTableOffset = 0;
+  bool headwordTableLoaded   = false;
+  std::shared_ptr< HeadwordTable const > headwordTable;
+
+  /// Returns nullptr if the index has no headword table. idxFileMutex must be held.
+  std::shared_ptr< HeadwordTable const > loadHeadwordTable();
+
+  /// Loaded on the first wildcard search. Guarded by idxFileMutex.
+  qint64 ngramIndexOffset = 0;
+  bool ngramIndexLoaded   = false;
+  std::shared_ptr< NgramIndex const > ngramIndex;
 };
 
 /// A base for the dictionary that utilizes a btree index build using
@@ -159,25 +239,38 @@ public:
   BtreeDictionary( string const & id, vector< string > const & dictionaryFiles );
 
   /// Btree-indexed dictionaries are usually a good source for compound searches.
-  virtual Dictionary::Features getFeatures() const noexcept
+  Dictionary::Features getFeatures() const noexcept override
   {
     return Dictionary::SuitableForCompoundSearching;
   }
 
   /// This function does the search using the btree index. Derivatives usually
   /// need not to implement this function.
-  virtual sptr< Dictionary::WordSearchRequest > prefixMatch( std::u32string const &, unsigned long );
+  sptr< Dictionary::WordSearchRequest > prefixMatch( std::u32string const &, unsigned long ) override;
+
+  sptr< Dictionary::WordSearchRequest > stemmedMatch( std::u32string const &,
+                                                     unsigned minLength,
+                                                     unsigned maxSuffixVariation,
+                                                     unsigned long maxResults ) override;
+
+  /// Walks the btree with a Levenshtein automaton, see forEachFuzzyChain()
+  sptr< Dictionary::WordSearchRequest >
+  fuzzyMatch( std::u32string const &, unsigned maxDistance, unsigned long maxResults ) override;
 
-  virtual sptr< Dictionary::WordSearchRequest >
-  stemmedMatch( std::u32string const &, unsigned minLength, unsigned maxSuffixVariation, unsigned long maxResults );
+  bool isLocalDictionary() override
+  {
+    return true;
+  }
 
-  virtual bool isLocalDictionary()
+  /// Whether prefixMatch() is nothing but the stock btree search. The prefix
+  /// matches of such dictionaries can be served by the GlobalHeadwordIndex.
+  virtual bool isPrefixMatchIndexOnly() const
   {
     return true;
   }
 
-  virtual bool getHeadwords( QStringList & headwords );
-  virtual void findHeadWordsWithLenth( int &, QSet< QString > * headwords, uint32_t length );
+  bool getHeadwordPage( Dictionary::HeadwordCursor &, QStringList & headwords, int maxCount ) override;
+  bool seekHeadwords( Dictionary::HeadwordCursor &, QString const & prefix ) override;
 
   virtual void getArticleText( uint32_t articleAddress, QString & headword, QString & text );
 
@@ -191,6 +284,21 @@ public:
     return ftsIdxMutex;
   }
 
+  /// Held around getArticleText(), unless isArticleTextThreadSafe(). Most of
+  /// the implementations share the dictionary's file handles and decoders, and
+  /// aren't made to be run concurrently.
+  QMutex & getArticleTextMutex()
+  {
+    return articleTextMutex;
+  }
+
+  /// Whether getArticleText() may run on several threads at once. Only the
+  /// formats checked to be safe say so.
+  virtual bool isArticleTextThreadSafe() const
+  {
+    return false;
+  }
+
   virtual uint32_t getFtsIndexVersion()
   {
     return 0;
@@ -205,6 +313,7 @@ public:
 
 protected:
   QMutex ftsIdxMutex;
+  QMutex articleTextMutex;
   string ftsIdxName;
 
   friend class BtreeWordSearchRequest;
@@ -221,7 +330,6 @@ protected:
   int maxSuffixVariation;
   bool allowMiddleMatches;
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -230,8 +338,7 @@ public:
                           unsigned minLength_,
                           int maxSuffixVariation_,
                           bool allowMiddleMatches_,
-                          unsigned long maxResults_,
-                          bool startRunnable = true );
+                          unsigned long maxResults_ );
 
   virtual void findMatches();
 
@@ -241,12 +348,27 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~BtreeWordSearchRequest();
 };
 
 // Everything below is for building the index data.
 
+/// A word which has been folded and split into its index entries, but not yet
+/// added to IndexedWords. Preparing is the costly part of adding a word and
+/// doesn't touch the index, so it can be done concurrently. The prepared words
+/// are then added in their original order to get the very same index.
+struct PreparedWord
+{
+  struct Entry
+  {
+    string folded;  // The key in IndexedWords
+    string word;    // Unfolded word, beginning from the key's position
+    string prefix;  // Unfolded part preceding the key
+    bool wholeWord; // Whether the entry starts at the beginning of the word
+  };
+
+  vector< Entry > entries;
+};
+
 /// This represents the index in its source form, as a map which binds folded
 /// words to sequences of their unfolded source forms and the corresponding
 /// article offsets. The words are utf8-encoded -- it doesn't break Unicode
@@ -258,14 +380,20 @@ struct IndexedWords: public map< string, vector< WordArticleLink > >
   /// each new word.
   void addWord( std::u32string const & word, uint32_t articleOffset, unsigned int maxHeadwordSize = 100U );
 
+  /// The first half of addWord(), does all the folding. Thread-safe.
+  static PreparedWord prepareWord( std::u32string const & word, unsigned int maxHeadwordSize = 100U );
+
+  /// The second half of addWord(), stores the entries prepared by prepareWord().
+  void addPreparedWord( PreparedWord const & word, uint32_t articleOffset );
+
   /// Differs from addWord() in that it only adds a single entry. We use this
   /// for zip's file names.
   void addSingleWord( std::u32string const & word, uint32_t articleOffset );
 };
 
-/// Builds the index, as a compressed btree. Returns IndexInfo.
-/// All the data is stored to the given file, beginning from its current
-/// position.
+/// Builds the index, as a compressed btree, followed by its key filter.
+/// Returns IndexInfo. All the data is stored to the given file, beginning
+/// from its current position.
 IndexInfo buildIndex( IndexedWords const &, File::Index & file );
 
 } // namespace BtreeIndexing
@@ -123,6 +123,13 @@ public:
   getSearchResults( QString const & searchString, int searchMode, bool matchCase, bool ignoreDiacritics ) override;
   void getArticleText( uint32_t articleAddress, QString & headword, QString & text ) override;
 
+  /// The index and the dictzip file are read under their own mutexes, the
+  /// rest works on its own copies
+  bool isArticleTextThreadSafe() const override
+  {
+    return true;
+  }
+
   void makeFTSIndex( QAtomicInt & isCancelled ) override;
 
   void setFTSParameters( Config::FullTextSearch const & fts ) override
@@ -537,11 +544,13 @@ void DictdDictionary::getArticleText( uint32_t articleAddress, QString & headwor
 sptr< Dictionary::DataRequest >
 DictdDictionary::getSearchResults( QString const & searchString, int searchMode, bool matchCase, bool ignoreDiacritics )
 {
-  return std::make_shared< FtsHelpers::FTSResultsRequest >( *this,
-                                                            searchString,
-                                                            searchMode,
-                                                            matchCase,
-                                                            ignoreDiacritics );
+  return Dictionary::runRequest< FtsHelpers::FTSResultsRequest >( Scheduler::Priority::Lookup,
+                                                                  this,
+                                                                  *this,
+                                                                  searchString,
+                                                                  searchMode,
+                                                                  matchCase,
+                                                                  ignoreDiacritics );
 }
 
 } // anonymous namespace
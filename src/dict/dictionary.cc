@@ -11,15 +11,19 @@
 #include <QDateTime>
 
 #include "config.hh"
+#include <QCoreApplication>
 #include <QDir>
 #include <QCryptographicHash>
 #include <QImage>
 #include <QPixmap>
 #include <QPainter>
 #include <QRegularExpression>
+#include <QThread>
+#include <QWaitCondition>
 #include "utils.hh"
 #include "zipfile.hh"
 #include <array>
+#include <set>
 
 namespace Dictionary {
 
@@ -186,6 +190,13 @@ sptr< WordSearchRequest > Class::stemmedMatch( std::u32string const & /*str*/,
   return std::make_shared< WordSearchRequestInstant >();
 }
 
+sptr< WordSearchRequest > Class::fuzzyMatch( std::u32string const & /*str*/,
+                                             unsigned /*maxDistance*/,
+                                             unsigned long /*maxResults*/ )
+{
+  return std::make_shared< WordSearchRequestInstant >();
+}
+
 sptr< WordSearchRequest > Class::findHeadwordsForSynonym( std::u32string const & )
 {
   return std::make_shared< WordSearchRequestInstant >();
@@ -617,4 +628,142 @@ QMap< std::string, sptr< Dictionary::Class > > dictToMap( std::vector< sptr< Dic
   }
   return dictMap;
 }
+
+namespace {
+
+QMutex workersMutex;
+std::set< Request * > runningRequests; // The requests whose workers haven't exited yet
+int heldForWorkers = 0;                // The holdForWorker() references not released yet
+QWaitCondition workersReleased;
+
+/// Lets the GUI thread drop the reference, as the objects kept alive by the
+/// workers, the requests and the dictionaries, live there
+void releaseOnGuiThread( std::shared_ptr< void const > kept )
+{
+  QCoreApplication * app = QCoreApplication::instance();
+
+  if ( app && QThread::currentThread() != app->thread() ) {
+    QMetaObject::invokeMethod( app, [ kept = std::move( kept ) ]() {}, Qt::QueuedConnection );
+  }
+}
+
+/// Drops the object held by holdForWorker(), and counts it as released
+void releaseHeld( std::shared_ptr< void const > held )
+{
+  held.reset();
+
+  QMutexLocker _( &workersMutex );
+
+  if ( --heldForWorkers == 0 ) {
+    workersReleased.wakeAll();
+  }
+}
+
+} // namespace
+
+std::shared_ptr< void const > holdForWorker( std::shared_ptr< void const > object )
+{
+  {
+    QMutexLocker _( &workersMutex );
+    ++heldForWorkers;
+  }
+
+  void const * const pointer = object.get();
+
+  return std::shared_ptr< void const >( pointer, [ held = std::move( object ) ]( void const * ) mutable {
+    QCoreApplication * app = QCoreApplication::instance();
+
+    if ( app && QThread::currentThread() != app->thread() ) {
+      QMetaObject::invokeMethod(
+        app,
+        [ held = std::move( held ) ]() mutable {
+          releaseHeld( std::move( held ) );
+        },
+        Qt::QueuedConnection );
+    }
+    else {
+      releaseHeld( std::move( held ) );
+    }
+  } );
+}
+
+void waitForDetachedWorkers()
+{
+  QCoreApplication * app = QCoreApplication::instance();
+
+  // The references are released there, so it would wait forever
+  Q_ASSERT( !app || QThread::currentThread() != app->thread() );
+
+  QMutexLocker _( &workersMutex );
+
+  while ( heldForWorkers > 0 ) {
+    workersReleased.wait( &workersMutex );
+  }
+}
+
+sptr< Request > detachRequest( Scheduler::Priority priority,
+                               Request * request,
+                               std::shared_ptr< void const > dictionary,
+                               std::function< void() > run )
+{
+  // Requests made on the worker threads have no event loop to be deleted in
+  if ( QCoreApplication * app = QCoreApplication::instance(); app && request->thread() != app->thread() ) {
+    request->moveToThread( app->thread() );
+  }
+
+  sptr< Request > owner( request );
+
+  // What the worker keeps alive. Shared, so that it's released exactly when
+  // the worker is done, whatever copies of the task the pool makes.
+  struct Kept
+  {
+    std::shared_ptr< void const > request;
+    std::shared_ptr< void const > dictionary;
+  };
+
+  // The dictionary is held so that it isn't reloaded while still being read
+  auto kept =
+    std::make_shared< Kept >( Kept{ owner, dictionary ? holdForWorker( std::move( dictionary ) ) : nullptr } );
+
+  {
+    QMutexLocker _( &workersMutex );
+    runningRequests.insert( request );
+  }
+
+  Scheduler::run( priority, [ kept, request, run = std::move( run ) ]() {
+    try {
+      run();
+    }
+    catch ( std::exception & e ) {
+      qWarning( "Request failed: %s", e.what() );
+    }
+
+    {
+      QMutexLocker _( &workersMutex );
+      runningRequests.erase( request );
+    }
+
+    releaseOnGuiThread( std::move( kept->request ) );
+    kept->dictionary.reset();
+  } );
+
+  // Whoever drops the last reference to the handle isn't interested in the
+  // results anymore, so the request stops sending them and is cancelled
+  return sptr< Request >( request, [ owner ]( Request * r ) mutable {
+    r->disconnect();
+    r->cancel();
+    owner.reset();
+  } );
+}
+
+void cancelRequestWorkers()
+{
+  // The requests stay alive while they're listed, as their workers keep them
+  QMutexLocker _( &workersMutex );
+
+  for ( Request * request : runningRequests ) {
+    request->cancel();
+  }
+}
+
 } // namespace Dictionary
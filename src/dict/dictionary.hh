@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <functional>
 #include <map>
 #include <string>
 #include <vector>
@@ -17,6 +18,7 @@
 #include "ex.hh"
 #include "globalbroadcaster.hh"
 #include "langcoder.hh"
+#include "scheduler.hh"
 #include "sptr.hh"
 #include "utils.hh"
 #include "text.hh"
@@ -138,6 +140,16 @@ struct WordMatch
   }
 };
 
+/// A position in the headwords of a dictionary, see Class::getHeadwordPage().
+/// A default-constructed one is at the first headword.
+struct HeadwordCursor
+{
+  uint32_t leaf  = 0;     // The leaf of the index to read next, zero if none read yet
+  uint32_t chain = 0;     // How many chains of it were read already
+  bool atEnd     = false; // Whether all the headwords were read
+  std::u32string prefix;  // If not empty, the folded prefix the keys of the headwords read have
+};
+
 /// This request type corresponds to all types of word searching operations.
 class WordSearchRequest: public Request
 {
@@ -281,7 +293,7 @@ Q_DECLARE_FLAGS( Features, Feature )
 Q_DECLARE_OPERATORS_FOR_FLAGS( Features )
 
 /// A dictionary. Can be used to query words.
-class Class: public QObject
+class Class: public QObject, public std::enable_shared_from_this< Class >
 {
   Q_OBJECT
 
@@ -436,6 +448,14 @@ public:
   virtual sptr< WordSearchRequest >
   stemmedMatch( std::u32string const &, unsigned minLength, unsigned maxSuffixVariation, unsigned long maxResults );
 
+  /// Looks up the words which are within maxDistance edits of the given word,
+  /// to be suggested in case of typos. The distance of each match is stored
+  /// as its weight, negated. Just like with stemmedMatch(), no middle matches
+  /// should be returned.
+  /// The default implementation does nothing, returning an empty result.
+  virtual sptr< WordSearchRequest >
+  fuzzyMatch( std::u32string const &, unsigned maxDistance, unsigned long maxResults );
+
   /// Finds known headwords for the given word, that is, the words for which
   /// the given word is a synonym. If a dictionary can't perform this operation,
   /// it should leave the default implementation which always returns an empty
@@ -511,12 +531,27 @@ public:
   /// Set full-text search parameters
   virtual void setFTSParameters( Config::FullTextSearch const & ) {}
 
-  /// Retrieve all dictionary headwords
-  virtual bool getHeadwords( QStringList & )
+  /// Appends about maxCount of the next headwords to the list and moves the
+  /// cursor past them. The headwords come in the order of the index, each only
+  /// once, and only the part of the index they're in is read, so the headwords
+  /// can be gone through in constant memory whatever the dictionary's size.
+  /// Returns false once there are no more headwords after these, or if the
+  /// dictionary can't list its headwords.
+  virtual bool getHeadwordPage( HeadwordCursor &, QStringList & /*headwords*/, int /*maxCount*/ )
+  {
+    return false;
+  }
+
+  /// Moves the cursor to the first of the headwords which may start with the
+  /// given prefix, and has it stop after the last of them, so only that part
+  /// of the index is read. As the index doesn't tell the case, the diacritics
+  /// and the punctuation apart, the headwords got may still not start with
+  /// it. Returns false, leaving the cursor as it was, if the dictionary can't
+  /// do that.
+  virtual bool seekHeadwords( HeadwordCursor &, QString const & /*prefix*/ )
   {
     return false;
   }
-  virtual void findHeadWordsWithLenth( int &, QSet< QString > * /*headwords*/, uint32_t ) {}
 
   /// Enable/disable search via synonyms
   void setSynonymSearchEnabled( bool enabled )
@@ -563,4 +598,54 @@ QString generateRandomDictionaryId();
 
 QMap< std::string, sptr< Dictionary::Class > > dictToMap( std::vector< sptr< Dictionary::Class > > const & dicts );
 
+/// Implementation of runRequest()
+sptr< Request > detachRequest( Scheduler::Priority,
+                               Request *,
+                               std::shared_ptr< void const > dictionary,
+                               std::function< void() > run );
+
+/// Makes a request out of the arguments and calls its run() member on the
+/// scheduler. Dropping the request returned cancels it, but never waits for
+/// it to exit: the worker keeps the request, and the dictionary it reads,
+/// alive until then, and releases them on the GUI thread afterwards.
+/// The dictionary can be nullptr if the request doesn't use any.
+template< class Req, class... Args >
+sptr< Req > runRequest( Scheduler::Priority priority, Class const * dictionary, Args &&... args )
+{
+  Req * request = new Req( std::forward< Args >( args )... );
+
+  return sptr< Req >( detachRequest( priority,
+                                     request,
+                                     dictionary ? dictionary->weak_from_this().lock() : nullptr,
+                                     [ request ]() {
+                                       request->run();
+                                     } ),
+                      request );
+}
+
+/// Cancels the requests whose workers are still running, including the ones
+/// whose handles are still held. Called before the dictionaries are
+/// reloaded: it doesn't wait, the old dictionaries are released once the
+/// last of their workers exits.
+void cancelRequestWorkers();
+
+/// Keeps the object, e.g. a dictionary, alive for a worker running detached
+/// from the GUI. Once the last copy of the reference returned is dropped, the
+/// object is released on the GUI thread, and waitForDetachedWorkers() stops
+/// waiting for it.
+std::shared_ptr< void const > holdForWorker( std::shared_ptr< void const > );
+
+/// Same, keeping the type
+template< class T >
+std::shared_ptr< T > holdForWorker( std::shared_ptr< T > object )
+{
+  T * const pointer = object.get();
+  return std::shared_ptr< T >( holdForWorker( std::shared_ptr< void const >( std::move( object ) ) ), pointer );
+}
+
+/// Waits until everything held by holdForWorker() is released, so that no
+/// worker reads the old dictionaries' files anymore. Must not be called on
+/// the GUI thread, which does the releasing.
+void waitForDetachedWorkers();
+
 } // namespace Dictionary
@@ -9,9 +9,13 @@
 #include "htmlescape.hh"
 #include <QCryptographicHash>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFileInfo>
+#include <QPointer>
 #include <QRegularExpression>
-#include <QtConcurrentRun>
+#include <algorithm>
+#include <deque>
+#include <functional>
 
 namespace DictServer {
 
@@ -23,24 +27,20 @@ enum {
 
 namespace {
 
+#define MAX_MATCHES_COUNT 60
 
-enum class DictServerState {
-  START,
-  CONNECT,
-  DB,
-  DB_DATA,
-  DB_DATA_FINISHED,
-  CLIENT,
-  AUTH,
-  OPTION,
-  MATCH,
-  MATCH_DATA,
-  FINISHED,
-  DEFINE,
-  DEFINE_DATA,
-};
+/// The connections to a server which are kept open at most
+size_t const MaxConnections = 4;
 
-#define MAX_MATCHES_COUNT 60
+/// How long a connection may take to get through the handshake
+int const ConnectTimeoutMs = 10000;
+
+/// An idle connection sends STATUS this often, so that neither the server
+/// nor anything in between drops it for being silent
+int const KeepAliveMs = 60000;
+
+/// An idle connection is closed once it hasn't been used for this long
+int const IdleTimeoutMs = 10 * 60000;
 
 
 void disconnectFromServer( QTcpSocket & socket )
@@ -52,125 +52,499 @@ void disconnectFromServer( QTcpSocket & socket )
   socket.disconnectFromHost();
 }
 
+/// The reply to a command: the status line ending it, along with the texts
+/// which came before it, e.g. the matches or the definitions
+struct Reply
+{
+  struct Text
+  {
+    QByteArray status;      // The line preceding the text, e.g. 151 "word" db "Db name"
+    QByteArray contentType; // From the mime headers, if any
+    QByteArray body;        // The lines, separated with \n
+  };
+
+  int code = 0; // Zero if the connection was lost before the reply came
+  QByteArray status;
+  std::vector< Text > texts;
+};
+
+using ReplyHandler = std::function< void( Reply const & ) >;
 
-class DictServerImpl: public QObject
+struct Command
 {
-  Q_OBJECT
+  QByteArray line;           // Without the CRLF
+  QPointer< QObject > owner; // The reply is dropped once the owner is gone
+  ReplyHandler handler;
+  bool retried = false; // Has been sent again after its connection was lost
+};
 
-  QString url;
-  QString errorString;
+/// Quotes the argument of a command
+QByteArray quote( QString const & str )
+{
+  QByteArray result = str.toUtf8();
+  result.replace( '\\', "\\\\" );
+  result.replace( '"', "\\\"" );
+  return '"' + result + '"';
+}
 
 
-  QString msgId;
-  QString client;
+/// A connection to a server, done with the handshake once and then used for
+/// any number of commands. The commands are pipelined: they are written as
+/// soon as they come, and their replies are matched to them in order.
+class DictServerConnection: public QObject
+{
+  Q_OBJECT
 
 public:
-  QTcpSocket socket;
-  DictServerState state;
-  QMutex mutex;
 
+  using LostHandler = std::function< void( DictServerConnection *, std::vector< Command > ) >;
+
+  DictServerConnection( QUrl const & url, QString const & client, LostHandler onLost, QObject * parent );
 
-  DictServerImpl( QObject * parent, QString const & url_, QString client_ ):
-    QObject( parent ),
-    url( url_ ),
-    client( client_ )
+  ~DictServerConnection() override;
+
+  /// Writes the commands at once, or along with the handshake if that hasn't
+  /// been done yet
+  void send( std::vector< Command > );
+
+  /// Returns the number of commands still waiting for their replies
+  size_t pending() const;
+
+  bool isLost() const
   {
+    return lost;
   }
 
-  void run( std::function< void() > callback )
-  {
-    int pos = url.indexOf( "://" );
-    if ( pos < 0 ) {
-      url = "dict://" + url;
+private:
+
+  enum class ReadState {
+    Status,
+    Headers,
+    Text,
+  };
+
+  QUrl url;
+  QString client;
+  LostHandler onLost;
+  QTcpSocket socket;
+
+  bool greeted = false; // The banner came and the handshake was sent
+  bool mime    = false; // The texts come with mime headers
+  bool lost    = false;
+  QByteArray msgId;
+
+  std::vector< Command > queued; // To be sent once greeted
+  std::deque< Command > waiting; // Sent, in the order of their replies
+
+  ReadState readState = ReadState::Status;
+  Reply reply;
+
+  QTimer connectTimer;
+  QTimer keepAliveTimer;
+  QElapsedTimer sinceUsed;
+
+  Command internal( QByteArray line, ReplyHandler = {} );
+  void write( std::vector< Command > & );
+
+  void greet( Reply const & banner );
+  void readLines();
+  void readStatus( QByteArray const & line );
+  void complete();
+  void keepAlive();
+  void drop( QString const & reason );
+};
+
+DictServerConnection::DictServerConnection( QUrl const & url_,
+                                            QString const & client_,
+                                            LostHandler onLost_,
+                                            QObject * parent ):
+  QObject( parent ),
+  url( url_ ),
+  client( client_ ),
+  onLost( std::move( onLost_ ) )
+{
+  // The banner is the reply to connecting
+  waiting.push_back( internal( {}, [ this ]( Reply const & banner ) {
+    greet( banner );
+  } ) );
+
+  connect( &socket, &QTcpSocket::readyRead, this, &DictServerConnection::readLines );
+
+  connect( &socket, &QTcpSocket::errorOccurred, this, [ this ]( QAbstractSocket::SocketError error ) {
+    qDebug() << "socket error message: " << error;
+    drop( socket.errorString() );
+  } );
+
+  connect( &socket, &QTcpSocket::disconnected, this, [ this ]() {
+    drop( "disconnected" );
+  } );
+
+  connectTimer.setSingleShot( true );
+  connectTimer.setInterval( ConnectTimeoutMs );
+  connect( &connectTimer, &QTimer::timeout, this, [ this ]() {
+    drop( "timed out" );
+  } );
+
+  keepAliveTimer.setInterval( KeepAliveMs );
+  connect( &keepAliveTimer, &QTimer::timeout, this, &DictServerConnection::keepAlive );
+
+  sinceUsed.start();
+  connectTimer.start();
+  socket.connectToHost( url.host(), url.port( DefaultPort ) );
+}
+
+DictServerConnection::~DictServerConnection()
+{
+  socket.disconnect( this );
+  disconnectFromServer( socket );
+}
+
+size_t DictServerConnection::pending() const
+{
+  size_t count = queued.size();
+
+  for ( auto const & command : waiting ) {
+    if ( command.owner != this ) {
+      ++count;
     }
+  }
 
-    QUrl serverUrl( url );
-    quint16 port = serverUrl.port( DefaultPort );
-    QString reply;
-    socket.connectToHost( serverUrl.host(), port );
-    state = DictServerState::CONNECT;
-    connect( &socket, &QTcpSocket::connected, this, []() {} );
+  return count;
+}
 
-    connect( &socket, &QTcpSocket::errorOccurred, this, []( QAbstractSocket::SocketError error ) {
-      qDebug() << "socket error message: " << error;
-    } );
-    connect( &socket, &QTcpSocket::readyRead, this, [ this, callback ]() {
-      QMutexLocker const _( &mutex );
+Command DictServerConnection::internal( QByteArray line, ReplyHandler handler )
+{
+  return Command{ std::move( line ), this, std::move( handler ) };
+}
 
-      if ( state == DictServerState::CONNECT ) {
-        QByteArray reply = socket.readLine();
-        qDebug() << "received:" << reply;
+void DictServerConnection::send( std::vector< Command > commands )
+{
+  sinceUsed.restart();
 
-        if ( !reply.isEmpty() && reply.left( 3 ) != "220" ) {
-          errorString = "Server refuse connection: " + reply;
-          return;
-        }
+  if ( !greeted ) {
+    std::move( commands.begin(), commands.end(), std::back_inserter( queued ) );
+    return;
+  }
+
+  write( commands );
+}
+
+void DictServerConnection::write( std::vector< Command > & commands )
+{
+  QByteArray data;
+
+  for ( auto & command : commands ) {
+    if ( !command.owner ) {
+      continue; // Nobody waits for it anymore
+    }
+
+    qDebug() << "write:" << command.line;
+
+    data += command.line + "\r\n";
+    waiting.push_back( std::move( command ) );
+  }
 
-        msgId = reply.mid( reply.lastIndexOf( " " ) ).trimmed();
+  if ( !data.isEmpty() ) {
+    socket.write( data );
+  }
+
+  commands.clear();
+}
+
+void DictServerConnection::greet( Reply const & banner )
+{
+  connectTimer.stop();
+
+  if ( banner.code != 220 ) {
+    drop( "Server refuse connection: " + banner.status );
+    return;
+  }
+
+  msgId = banner.status.mid( banner.status.lastIndexOf( ' ' ) ).trimmed();
+
+  std::vector< Command > handshake;
+
+  handshake.push_back( internal( "CLIENT " + client.toUtf8() ) );
+
+  if ( !url.userInfo().isEmpty() ) {
+    QString const userInfo = url.userInfo();
+    QByteArray authCommand = "AUTH ";
+    QByteArray authString  = msgId;
 
-        state = DictServerState::CLIENT;
-        socket.write( QString( "CLIENT %1\r\n" ).arg( client ).toUtf8() );
+    int pos = userInfo.indexOf( QRegularExpression( "[:;]" ) );
+    if ( pos > 0 ) {
+      authCommand += userInfo.left( pos ).toUtf8();
+      authString += userInfo.mid( pos + 1 ).toUtf8();
+    }
+    else {
+      authCommand += userInfo.toUtf8();
+    }
+
+    authCommand += " ";
+    authCommand += QCryptographicHash::hash( authString, QCryptographicHash::Md5 ).toHex();
+
+    handshake.push_back( internal( authCommand, []( Reply const & r ) {
+      if ( r.code != 230 ) {
+        qWarning() << "DICT server authentication failed:" << r.status;
       }
+    } ) );
+  }
 
-      else if ( state == DictServerState::CLIENT ) {
-        QByteArray reply = socket.readLine();
-        qDebug() << "received:" << reply;
+  // RFC 2229, 3.10.1.1:
+  // OPTION MIME is a REQUIRED server capability,
+  // all DICT servers MUST implement this command.
+  handshake.push_back( internal( "OPTION MIME", [ this ]( Reply const & r ) {
+    mime = r.code == 250;
+    if ( !mime ) {
+      qWarning() << "Server doesn't support mime capability:" << r.status;
+    }
+  } ) );
 
-        QUrl serverUrl( url );
-        if ( !serverUrl.userInfo().isEmpty() ) {
-          QString authCommand = QString( "AUTH " );
-          QString authString  = msgId;
+  greeted = true;
 
-          int pos = serverUrl.userInfo().indexOf( QRegularExpression( "[:;]" ) );
-          if ( pos > 0 ) {
-            authCommand += serverUrl.userInfo().left( pos );
-            authString += serverUrl.userInfo().mid( pos + 1 );
-          }
-          else {
-            authCommand += serverUrl.userInfo();
-          }
+  // The commands which came meanwhile go out along with the handshake
+  std::move( queued.begin(), queued.end(), std::back_inserter( handshake ) );
+  queued.clear();
 
-          authCommand += " ";
-          authCommand += QCryptographicHash::hash( authString.toUtf8(), QCryptographicHash::Md5 ).toHex();
-          authCommand += "\r\n";
+  write( handshake );
 
-          state = DictServerState::AUTH;
-          socket.write( authCommand.toUtf8() );
-        }
-        else {
-          const QByteArray & data = QByteArray( "OPTION MIME\r\n" );
-          socket.write( data );
-          qDebug() << "write:" << data;
-          state = DictServerState::OPTION;
-        }
+  keepAliveTimer.start();
+}
+
+void DictServerConnection::readLines()
+{
+  while ( socket.canReadLine() ) {
+    QByteArray line = socket.readLine();
+
+    while ( line.endsWith( '\n' ) || line.endsWith( '\r' ) ) {
+      line.chop( 1 );
+    }
+
+    if ( readState == ReadState::Status ) {
+      readStatus( line );
+    }
+    else if ( line == "." ) {
+      readState = ReadState::Status;
+    }
+    else if ( readState == ReadState::Headers ) {
+      if ( line.isEmpty() ) {
+        readState = ReadState::Text;
       }
-      else if ( ( state == DictServerState::OPTION ) || ( state == DictServerState::AUTH ) ) {
-        QByteArray reply = socket.readLine();
-        qDebug() << "received option:" << reply;
-
-        if ( reply.left( 3 ) != "250" ) {
-          // RFC 2229, 3.10.1.1:
-          // OPTION MIME is a REQUIRED server capability,
-          // all DICT servers MUST implement this command.
-          errorString = "Server doesn't support mime capability: " + reply;
-          return;
-        }
+      else if ( line.toLower().startsWith( "content-type:" ) ) {
+        reply.texts.back().contentType = line.mid( 13 ).trimmed().toLower();
+      }
+    }
+    else {
+      Reply::Text & text = reply.texts.back();
 
-        state = DictServerState::FINISHED;
+      if ( line.startsWith( ".." ) ) {
+        line.remove( 0, 1 );
+      }
 
-        if ( callback ) {
-          callback();
-        }
+      if ( !text.body.isEmpty() ) {
+        text.body += '\n';
       }
-    } );
+      text.body += line;
+    }
+
+    if ( lost ) {
+      return;
+    }
   }
+}
 
-  ~DictServerImpl() override
-  {
-    disconnectFromServer( socket );
+void DictServerConnection::readStatus( QByteArray const & line )
+{
+  qDebug() << "received:" << line;
+
+  int const code = line.left( 3 ).toInt();
+
+  switch ( code ) {
+    case 110: // Databases
+    case 111: // Strategies
+    case 112: // Database information
+    case 113: // Help
+    case 114: // Server information
+    case 151: // A definition
+    case 152: // Matches
+      reply.texts.push_back( { line, {}, {} } );
+      readState = mime ? ReadState::Headers : ReadState::Text;
+      break;
+
+    default:
+      if ( code >= 200 || code < 100 ) {
+        // The status ending the reply
+        reply.code   = code;
+        reply.status = line;
+        complete();
+      }
+      // Any other preliminary status, such as 150, needs nothing
   }
+}
+
+void DictServerConnection::complete()
+{
+  Reply done;
+  std::swap( done, reply );
+
+  if ( waiting.empty() ) {
+    qWarning() << "DICT server sent an unexpected reply:" << done.status;
+    return;
+  }
+
+  Command command = std::move( waiting.front() );
+  waiting.pop_front();
+
+  if ( command.owner && command.handler ) {
+    command.handler( done );
+  }
+
+  if ( waiting.empty() ) {
+    keepAliveTimer.start();
+  }
+}
+
+void DictServerConnection::keepAlive()
+{
+  if ( !waiting.empty() || !queued.empty() ) {
+    return;
+  }
+
+  if ( sinceUsed.hasExpired( IdleTimeoutMs ) ) {
+    drop( "idle" );
+    return;
+  }
+
+  std::vector< Command > status{ internal( "STATUS" ) };
+  write( status );
+}
+
+void DictServerConnection::drop( QString const & reason )
+{
+  if ( lost ) {
+    return;
+  }
+
+  lost = true;
+  qDebug() << "DICT server connection to" << url.host() << "closed:" << reason;
+
+  connectTimer.stop();
+  keepAliveTimer.stop();
+  socket.disconnect( this );
+  disconnectFromServer( socket );
+
+  // The commands of the others which never got their replies
+  std::vector< Command > unanswered;
+
+  for ( auto & command : waiting ) {
+    if ( command.owner != this ) {
+      unanswered.push_back( std::move( command ) );
+    }
+  }
+  std::move( queued.begin(), queued.end(), std::back_inserter( unanswered ) );
+
+  waiting.clear();
+  queued.clear();
+
+  onLost( this, std::move( unanswered ) );
+}
+
+
+/// Keeps the connections to a server open between the lookups, so that these
+/// don't pay for connecting and the handshake every time. A lookup's
+/// commands all go to one connection in one write.
+class DictServerPool: public QObject
+{
+public:
+
+  DictServerPool( QString const & url, QString const & client );
+
+  /// Sends the commands of the owner. Their handlers are called as the
+  /// replies come, or with an empty reply if the server can't be reached.
+  void send( QObject * owner, std::vector< Command > );
+
+private:
+
+  QUrl url;
+  QString client;
+  std::vector< DictServerConnection * > connections; // Owned as children
+
+  DictServerConnection * pick();
+  void connectionLost( DictServerConnection *, std::vector< Command > );
 };
 
+DictServerPool::DictServerPool( QString const & url_, QString const & client_ ):
+  url( url_ ),
+  client( client_ )
+{
+}
+
+void DictServerPool::send( QObject * owner, std::vector< Command > commands )
+{
+  for ( auto & command : commands ) {
+    command.owner = owner;
+  }
+
+  pick()->send( std::move( commands ) );
+}
+
+DictServerConnection * DictServerPool::pick()
+{
+  DictServerConnection * best = nullptr;
+
+  for ( auto * connection : connections ) {
+    if ( !best || connection->pending() < best->pending() ) {
+      best = connection;
+    }
+  }
+
+  if ( best && ( best->pending() == 0 || connections.size() >= MaxConnections ) ) {
+    return best;
+  }
+
+  auto * connection = new DictServerConnection(
+    url,
+    client,
+    [ this ]( DictServerConnection * lost, std::vector< Command > unanswered ) {
+      connectionLost( lost, std::move( unanswered ) );
+    },
+    this );
+
+  connections.push_back( connection );
+
+  return connection;
+}
+
+void DictServerPool::connectionLost( DictServerConnection * lost, std::vector< Command > unanswered )
+{
+  connections.erase( std::find( connections.begin(), connections.end(), lost ) );
+  lost->deleteLater();
+
+  // The server may have closed an idle connection just as the commands went
+  // out, so these get another try on a new connection, but only one
+  std::vector< Command > retries;
+
+  for ( auto & command : unanswered ) {
+    if ( !command.owner ) {
+      continue;
+    }
+
+    if ( command.retried ) {
+      if ( command.handler ) {
+        command.handler( Reply() );
+      }
+    }
+    else {
+      command.retried = true;
+      retries.push_back( std::move( command ) );
+    }
+  }
+
+  if ( !retries.empty() ) {
+    pick()->send( std::move( retries ) );
+  }
+}
+
 
 class DictServerDictionary: public Dictionary::Class
 {
@@ -182,10 +556,7 @@ class DictServerDictionary: public Dictionary::Class
   QStringList databases;
   QStringList strategies;
   QStringList serverDatabases;
-  DictServerState state;
-  QMutex mutex;
-  QTcpSocket socket;
-  QString msgId;
+  DictServerPool pool;
 
 public:
   DictServerDictionary( string const & id,
@@ -195,18 +566,14 @@ public:
                         QString const & strategies_,
                         QString const & icon_ ):
     Dictionary::Class( id, vector< string >() ),
-    url( url_ ),
+    url( url_.contains( "://" ) ? url_ : "dict://" + url_ ),
     icon( icon_ ),
-    langId( 0 )
+    langId( 0 ),
+    pool( url, "GoldenDict" )
   {
 
     dictionaryName = name_;
 
-    int pos = url.indexOf( "://" );
-    if ( pos < 0 ) {
-      url = "dict://" + url;
-    }
-
     databases = database_.split( QRegularExpression( "[ ,;]" ), Qt::SkipEmptyParts );
     if ( databases.isEmpty() ) {
       databases.append( "*" );
@@ -216,93 +583,22 @@ public:
     if ( strategies.isEmpty() ) {
       strategies.append( "prefix" );
     }
-    QUrl serverUrl( url );
-    quint16 port = serverUrl.port( DefaultPort );
-    QString reply;
-    socket.connectToHost( serverUrl.host(), port );
-    connect( &socket, &QTcpSocket::connected, this, [ this ]() {
-      //initialize the description.
-      QString req = QString( "SHOW DB\r\n" );
-      socket.write( req.toUtf8() );
-      state = DictServerState::DB;
-    } );
-
-    connect( this, &DictServerDictionary::finishDatabase, this, [ this ]() {
-      socket.write( QByteArray( "CLIENT GoldenDict\r\n" ) );
-    } );
 
-    connect( &socket, &QTcpSocket::errorOccurred, this, []( QAbstractSocket::SocketError error ) {
-      qDebug() << "socket error message: " << error;
-    } );
-    connect( &socket, &QTcpSocket::readyRead, this, [ this ]() {
-      QMutexLocker const _( &mutex );
-      QByteArray reply = socket.readLine();
-      qDebug() << "received:" << reply;
-      if ( state == DictServerState::DB ) {
-
-        if ( reply.left( 3 ) == "110" ) {
-          state        = DictServerState::DB_DATA;
-          int countPos = reply.indexOf( ' ', 4 );
-          // Get databases count
-          int count = reply.mid( 4, countPos > 4 ? countPos - 4 : -1 ).toInt();
-
-          // Read databases
-          int x = 0;
-          for ( ; x < count; x++ ) {
-            reply = socket.readLine();
-
-            if ( reply.isEmpty() ) {
-              return;
-            }
-            reply = reply.trimmed();
-
-            qDebug() << "receive db:" << reply;
-
-            if ( reply[ 0 ] == '.' ) {
-              state = DictServerState::DB_DATA_FINISHED;
-              emit finishDatabase();
-              return;
-            }
-
-            if ( !reply.isEmpty() ) {
-              serverDatabases.append( reply );
-            }
-          }
+    //initialize the description. This also opens the first connection of the pool.
+    Command showDb{ "SHOW DB", {}, [ this ]( Reply const & reply ) {
+      for ( auto const & text : reply.texts ) {
+        for ( auto const & line : text.body.split( '\n' ) ) {
+          qDebug() << "receive db:" << line;
 
-          qDebug() << "db count:" << x;
-          if ( x == count ) {
-            emit finishDatabase();
+          if ( !line.trimmed().isEmpty() ) {
+            serverDatabases.append( line.trimmed() );
           }
         }
       }
-      else if ( state == DictServerState::DB_DATA ) {
-        while ( !reply.isEmpty() ) {
-
-          qDebug() << "receive db:" << reply;
-          if ( reply[ 0 ] == '.' ) {
-            state = DictServerState::DB_DATA_FINISHED;
-            emit finishDatabase();
-            return;
-          }
-
-          reply = reply.trimmed();
-
-          if ( !reply.isEmpty() ) {
-            serverDatabases.append( reply );
-          }
-
-          reply = socket.readLine();
-        }
-      }
-    } );
-  }
-
-  ~DictServerDictionary() override
-  {
-    disconnectFromServer( socket );
+    } };
+    pool.send( this, { std::move( showDb ) } );
   }
 
-
   unsigned long getArticleCount() noexcept override
   {
     return 0;
@@ -336,12 +632,7 @@ protected:
 
   friend class DictServerWordSearchRequest;
   friend class DictServerArticleRequest;
-
-private:
-signals:
-  void finishDatabase();
 };
-
 void DictServerDictionary::loadIcon() noexcept
 {
   if ( dictionaryIconLoaded ) {
@@ -383,6 +674,7 @@ QString const & DictServerDictionary::getDescription()
 }
 
 
+
 class DictServerWordSearchRequest: public Dictionary::WordSearchRequest
 {
   Q_OBJECT
@@ -392,157 +684,101 @@ class DictServerWordSearchRequest: public Dictionary::WordSearchRequest
   DictServerDictionary & dict;
 
   QStringList matchesList;
-  int currentStrategy = 0;
-  int currentDatabase = 0;
-
-  DictServerState state = DictServerState::START;
-  QString msgId;
-
-  DictServerImpl * dictImpl;
+  int repliesLeft = 0;
 
 public:
 
   DictServerWordSearchRequest( std::u32string word_, DictServerDictionary & dict_ ):
     word( std::move( word_ ) ),
-    dict( dict_ ),
-    dictImpl( new DictServerImpl( this, dict_.url, "GoldenDict-w" ) )
+    dict( dict_ )
   {
-
-    connect( this, &DictServerWordSearchRequest::finishedMatches, this, [ this ]() {
-      state = DictServerState::FINISHED;
-
-      matchesList.removeDuplicates();
-      int countn = qMin( matchesList.size(), MAX_MATCHES_COUNT );
-
-      if ( countn ) {
-        QMutexLocker _( &dataMutex );
-        for ( int x = 0; x < countn; x++ ) {
-          matches.emplace_back( matchesList.at( x ).toStdU32String() );
-        }
+    // All the matches are asked for at once
+    std::vector< Command > commands;
+    QByteArray const quotedWord = quote( QString::fromStdU32String( word ) );
+
+    for ( auto const & strategy : std::as_const( dict.strategies ) ) {
+      for ( auto const & database : std::as_const( dict.databases ) ) {
+        commands.push_back( { "MATCH " + database.toUtf8() + " " + strategy.toUtf8() + " " + quotedWord,
+                              {},
+                              [ this ]( Reply const & reply ) {
+                                readMatches( reply );
+                              } } );
       }
-      finish();
-    } );
-
-    this->run();
-
-    dictImpl->run( [ this ]() {
-      state = dictImpl->state;
-
-      matchNext();
-    } );
-  }
-
-  void matchNext()
-  {
-    if ( currentDatabase >= dict.databases.size() ) {
-      currentStrategy++;
-      currentDatabase = 0;
     }
-    if ( currentStrategy >= dict.strategies.size() ) {
-      emit finishedMatches();
-      return;
-    }
-    state = DictServerState::MATCH;
 
-    QString matchReq = QString( "MATCH " ) + dict.databases.at( currentDatabase ) + " "
-      + dict.strategies.at( currentStrategy ) + " \"" + QString::fromStdU32String( word ) + "\"\r\n";
-    dictImpl->socket.write( matchReq.toUtf8() );
-    currentDatabase++;
+    repliesLeft = int( commands.size() );
+    dict.pool.send( this, std::move( commands ) );
   }
 
-  void run();
-
   ~DictServerWordSearchRequest() override = default;
 
   void cancel() override;
 
-  void addMatchedWord( const QString & );
-
 private:
-  void readMatchData( QByteArray & reply );
 
-signals:
-  void finishedMatches();
+  void readMatches( Reply const & );
+  void addMatchedWord( const QString & );
+  void finishMatches();
 };
 
-void DictServerWordSearchRequest::run()
+void DictServerWordSearchRequest::readMatches( Reply const & reply )
 {
-  if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
-    finish();
+  --repliesLeft;
+
+  if ( isFinished() ) {
     return;
   }
 
-  connect( &dictImpl->socket, &QTcpSocket::readyRead, this, [ this ]() {
-    QMutexLocker const _( &dictImpl->mutex );
-    if ( state == DictServerState::MATCH ) {
-      QByteArray reply = dictImpl->socket.readLine();
-      qDebug() << "receive match:" << reply;
-      auto code = reply.left( 3 );
+  if ( !reply.code ) {
+    setErrorString( QCoreApplication::translate( "DictServer", "The server can't be reached" ) );
+  }
 
-      if ( code != "152" ) {
+  for ( auto const & text : reply.texts ) {
+    for ( auto const & line : text.body.split( '\n' ) ) {
+      qDebug() << "receive match data:" << line;
 
-        matchNext();
-      }
-      else {
-        state = DictServerState::MATCH_DATA;
+      int pos = line.indexOf( ' ' );
+      if ( pos >= 0 ) {
+        QString word = line.mid( pos + 1 ).trimmed();
+        if ( word.endsWith( '\"' ) ) {
+          word.chop( 1 );
+        }
+        if ( word.startsWith( '\"' ) ) {
+          word = word.remove( 0, 1 );
+        }
 
-        readMatchData( reply );
+        if ( !word.isEmpty() ) {
+          this->addMatchedWord( word );
+        }
+
+        if ( isFinished() ) {
+          return;
+        }
       }
     }
-    else if ( state == DictServerState::MATCH_DATA ) {
-      QByteArray reply = dictImpl->socket.readLine();
-      qDebug() << "receive match data:" << reply;
-      readMatchData( reply );
-    }
-  } );
+  }
 
-  connect( &dictImpl->socket, &QTcpSocket::errorOccurred, this, [ this ]( QAbstractSocket::SocketError error ) {
-    qDebug() << "socket error message: " << error;
-    cancel();
-  } );
+  if ( !repliesLeft ) {
+    finishMatches();
+  }
 }
-void DictServerWordSearchRequest::readMatchData( QByteArray & reply )
-{
-  do {
-
-    if ( reply.isEmpty() ) {
-      return;
-    }
-
-    reply = reply.trimmed();
-
-    if ( reply == "." ) {
-      //discard left response.  such as
-      // 250 ok [d/m/c = 0/3/20; 0.000r 0.000u 0.000s]
-      while ( !dictImpl->socket.readLine().isEmpty() ) {}
-      matchNext();
-      return;
-    }
 
-    if ( reply.left( 3 ) == "152" ) {
-      reply = this->dictImpl->socket.readLine();
-
-      continue;
-    }
+void DictServerWordSearchRequest::finishMatches()
+{
+  if ( isFinished() ) {
+    return;
+  }
 
-    int pos = reply.indexOf( ' ' );
-    if ( pos >= 0 ) {
-      QString word = reply.mid( pos + 1 );
-      if ( word.endsWith( '\"' ) ) {
-        word.chop( 1 );
-      }
-      if ( word.startsWith( '\"' ) ) {
-        word = word.remove( 0, 1 );
-      }
+  matchesList.removeDuplicates();
+  int countn = qMin( matchesList.size(), MAX_MATCHES_COUNT );
 
-      if ( !word.isEmpty() ) {
-        this->addMatchedWord( word );
-      }
+  if ( countn ) {
+    QMutexLocker _( &dataMutex );
+    for ( int x = 0; x < countn; x++ ) {
+      matches.emplace_back( matchesList.at( x ).toStdU32String() );
     }
-
-    reply = this->dictImpl->socket.readLine();
-
-  } while ( true );
+  }
+  finish();
 }
 
 void DictServerWordSearchRequest::cancel()
@@ -550,12 +786,13 @@ void DictServerWordSearchRequest::cancel()
   isCancelled.ref();
   finish();
 }
-void DictServer::DictServerWordSearchRequest::addMatchedWord( const QString & str )
+
+void DictServerWordSearchRequest::addMatchedWord( const QString & str )
 {
   matchesList.append( str );
 
   if ( matchesList.size() >= MAX_MATCHES_COUNT ) {
-    emit finishedMatches();
+    finishMatches();
   }
 }
 
@@ -565,339 +802,243 @@ class DictServerArticleRequest: public Dictionary::DataRequest
   std::u32string word;
   QString errorString;
   DictServerDictionary & dict;
-  string articleData;
-
-  QString articleText;
 
-  int currentDatabase = 0;
-  DictServerState state;
+  int repliesLeft = 0;
   QTimer * timer;
-  bool contentInHtml = false;
-
 
 public:
 
-  DictServerImpl * dictImpl;
   DictServerArticleRequest( std::u32string word_, DictServerDictionary & dict_ ):
     word( std::move( word_ ) ),
-    dict( dict_ ),
-    dictImpl( new DictServerImpl( this, dict_.url, "GoldenDict-t" ) )
+    dict( dict_ )
   {
     timer = new QTimer( this );
     timer->setInterval( 5000 );
     timer->setSingleShot( true );
-    qDebug() << "receive data:" << QDateTime::currentDateTime();
     connect( timer, &QTimer::timeout, this, [ this ]() {
       qDebug() << "Server takes too much time to response" << QDateTime::currentDateTime();
       cancel();
     } );
 
-    connect( this, &DictServerArticleRequest::finishedArticle, this, [ this ]( QString _articleText ) {
-      if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
-        cancel();
-        return;
-      }
+    // All the databases are asked at once
+    std::vector< Command > commands;
+    QByteArray const quotedWord = quote( QString::fromStdU32String( word ) );
 
-      //modify the _articleText,remove extra lines[start with 15X etc.]
-      QList< QString > lines = _articleText.split( "\n", Qt::SkipEmptyParts );
+    for ( auto const & database : std::as_const( dict.databases ) ) {
+      commands.push_back( { "DEFINE " + database.toUtf8() + " " + quotedWord, {}, [ this ]( Reply const & reply ) {
+                             readDefinitions( reply );
+                           } } );
+    }
 
-      QString resultStr;
+    repliesLeft = int( commands.size() );
+    dict.pool.send( this, std::move( commands ) );
 
-      // process the line
-      static QRegularExpression leadingRespCode( "^\\d{3} " );
-      uint32_t leadingSpaceCount      = 0;
-      uint32_t firstLeadingSpaceCount = 0;
-      for ( const QString & line : std::as_const( lines ) ) {
-        //ignore 15X lines
-        if ( leadingRespCode.match( line ).hasMatch() ) {
-          continue;
-        }
-        // ignore dot(.),the end line character
-        if ( line.trimmed() == "." ) {
-          break;
-        }
+    timer->start();
+  }
 
-        auto lsc = Utils::leadingSpaceCount( line );
+  ~DictServerArticleRequest() override = default;
 
-        if ( firstLeadingSpaceCount == 0 && lsc > firstLeadingSpaceCount ) {
-          firstLeadingSpaceCount = lsc;
-        }
+  void cancel() override;
 
-        if ( lsc >= leadingSpaceCount && lsc > firstLeadingSpaceCount ) {
-          //extra space
-          resultStr.append( " " );
-          resultStr.append( line.trimmed() );
-        }
-        else {
-          resultStr.append( "\n" );
-          resultStr.append( line );
-        }
-        leadingSpaceCount = lsc;
-      }
+private:
 
-      static QRegularExpression phonetic( R"(\\([^\\]+)\\)",
-                                          QRegularExpression::CaseInsensitiveOption ); // phonetics: \stuff\ ...
-      static QRegularExpression divs_inside_phonetic( "</div([^>]*)><div([^>]*)>",
-                                                      QRegularExpression::CaseInsensitiveOption );
-      static QRegularExpression refs( R"(\{([^\{\}]+)\})",
-                                      QRegularExpression::CaseInsensitiveOption ); // links: {stuff}
-      static QRegularExpression links( "<a href=\"gdlookup://localhost/([^\"]*)\">",
-                                       QRegularExpression::CaseInsensitiveOption );
-      static QRegularExpression tags( "<[^>]*>", QRegularExpression::CaseInsensitiveOption );
-
-      string articleStr;
-      if ( contentInHtml ) {
-        articleStr = resultStr.toUtf8().data();
-      }
-      else {
-        articleStr = Html::preformat( resultStr.toUtf8().data() );
-      }
+  void readDefinitions( Reply const & );
+  void appendDefinition( Reply::Text const & );
+};
 
-      _articleText = QString::fromUtf8( articleStr.c_str(), articleStr.size() );
-      int pos;
-      if ( !contentInHtml ) {
-        _articleText = _articleText.replace( refs, R"(<a href="gdlookup://localhost/\1">\1</a>)" );
+void DictServerArticleRequest::readDefinitions( Reply const & reply )
+{
+  --repliesLeft;
 
-        pos = 0;
-        QString articleNewText;
+  if ( isFinished() ) {
+    return;
+  }
 
-        // Handle phonetics
+  //restart.
+  timer->start();
 
-        QRegularExpressionMatchIterator it = phonetic.globalMatch( _articleText );
-        while ( it.hasNext() ) {
-          QRegularExpressionMatch match = it.next();
-          articleNewText += _articleText.mid( pos, match.capturedStart() - pos );
-          pos = match.capturedEnd();
+  if ( !reply.code ) {
+    setErrorString( QCoreApplication::translate( "DictServer", "The server can't be reached" ) );
+  }
 
-          QString phonetic_text = match.captured( 1 );
-          phonetic_text.replace( divs_inside_phonetic, R"(</span></div\1><div\2><span class="dictd_phonetic">)" );
+  for ( auto const & text : reply.texts ) {
+    appendDefinition( text );
+  }
 
-          articleNewText += R"(<span class="dictd_phonetic">)" + phonetic_text + "</span>";
-        }
-        if ( pos ) {
-          articleNewText += _articleText.mid( pos );
-          _articleText = articleNewText;
-          articleNewText.clear();
-        }
+  if ( !repliesLeft ) {
+    timer->stop();
+    finish();
+  }
+}
 
-        // Handle links
+void DictServerArticleRequest::appendDefinition( Reply::Text const & text )
+{
+  QByteArray const & reply = text.status;
 
-        pos = 0;
-        it  = links.globalMatch( _articleText );
-        while ( it.hasNext() ) {
-          QRegularExpressionMatch match = it.next();
-          articleNewText += _articleText.mid( pos, match.capturedStart() - pos );
-          pos = match.capturedEnd();
+  int pos = 4;
+  int endPos;
 
-          QString link = match.captured( 1 );
-          link.replace( tags, " " );
-          link.replace( "&nbsp;", " " );
+  if ( reply.size() <= pos ) {
+    // It seems mailformed string
+    return;
+  }
 
-          QString newLink = match.captured();
-          newLink.replace( 30,
-                           match.capturedLength( 1 ),
-                           QString::fromUtf8( QUrl::toPercentEncoding( link.simplified() ) ) );
-          articleNewText += newLink;
-        }
-        if ( pos ) {
-          articleNewText += _articleText.mid( pos );
-          _articleText = articleNewText;
-          articleNewText.clear();
-        }
-      }
+  // Skip requested word
+  if ( reply[ pos ] == '\"' ) {
+    endPos = reply.indexOf( '\"', pos + 1 ) + 1;
+  }
+  else {
+    endPos = reply.indexOf( ' ', pos );
+  }
 
-      articleData += string( "<div class=\"dictd_article\">" ) + _articleText.toUtf8().data() + "<br></div>";
+  if ( endPos < pos ) {
+    // It seems mailformed string
+    return;
+  }
 
+  pos = endPos + 1;
 
-      if ( !articleData.empty() ) {
-        appendString( articleData );
-        articleData.clear();
+  QString dbID;
+  QString dbName;
 
-        hasAnyData = true;
-      }
+  // Retrieve database ID
+  endPos = reply.indexOf( ' ', pos );
 
-      defineNext();
-    } );
-    this->run();
+  if ( endPos < pos ) {
+    // It seems mailformed string
+    return;
+  }
 
-    dictImpl->run( [ this ]() {
-      state = dictImpl->state;
-      state = DictServerState::DEFINE;
+  dbID = reply.mid( pos, endPos - pos );
 
-      defineNext();
-    } );
+  // Retrieve database name
+  pos = endPos + 1;
+  if ( pos < reply.size() && reply[ pos ] == '\"' ) {
+    endPos = reply.indexOf( '\"', pos + 1 ) + 1;
+  }
+  else {
+    endPos = reply.indexOf( ' ', pos );
+  }
 
-    timer->start();
+  if ( endPos < pos ) {
+    endPos = reply.size();
   }
 
-  void run();
+  dbName = reply.mid( pos, endPos - pos );
+  if ( dbName.endsWith( '\"' ) ) {
+    dbName.chop( 1 );
+  }
+  if ( dbName.startsWith( '\"' ) ) {
+    dbName = dbName.mid( 1 );
+  }
 
-  ~DictServerArticleRequest() override = default;
+  string articleData = string( "<div class=\"dictserver_from\">" ) + dbName.toUtf8().data() + "["
+    + dbID.toUtf8().data() + "]" + "</div>";
 
-  void cancel() override;
-  void readData( QByteArray reply );
-  bool defineNext();
-};
+  bool const contentInHtml = text.contentType.startsWith( "text/html" );
 
-bool DictServerArticleRequest::defineNext()
-{
-  if ( currentDatabase >= dict.databases.size() ) {
-    finish();
-    return false;
-  }
-  QString defineReq =
-    QString( "DEFINE " ) + dict.databases.at( currentDatabase ) + " \"" + QString::fromStdU32String( word ) + "\"\r\n";
-  dictImpl->socket.write( defineReq.toUtf8() );
-  qDebug() << "define req:" << defineReq;
-  currentDatabase++;
-  return true;
-}
+  //modify the text,remove extra lines
+  QList< QString > lines = QString::fromUtf8( text.body ).split( "\n", Qt::SkipEmptyParts );
 
-void DictServerArticleRequest::run()
-{
-  if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
-    finish();
-    return;
-  }
+  QString resultStr;
 
-  connect( &dictImpl->socket, &QTcpSocket::readyRead, this, [ this ]() {
-    QMutexLocker const _( &dictImpl->mutex );
-    timer->start();
-    if ( state == DictServerState::DEFINE ) {
-      QByteArray reply = dictImpl->socket.readLine();
-      qDebug() << "receive define:" << reply;
-
-      //work around to fix ,some extra response .
-      if ( reply.left( 3 ) == "250" ) {
-        reply = dictImpl->socket.readLine();
-        if ( reply.isEmpty() ) {
-          return;
-        }
-      }
+  // process the line
+  uint32_t leadingSpaceCount      = 0;
+  uint32_t firstLeadingSpaceCount = 0;
+  for ( const QString & line : std::as_const( lines ) ) {
+    auto lsc = Utils::leadingSpaceCount( line );
 
-      //no match
-      if ( reply.left( 3 ) == "552" ) {
-        defineNext();
-        return;
-      }
+    if ( firstLeadingSpaceCount == 0 && lsc > firstLeadingSpaceCount ) {
+      firstLeadingSpaceCount = lsc;
+    }
 
-      auto code = reply.left( 3 );
-      if ( reply.left( 3 ) == "150" ) {
-        // Articles found
-        // int countPos = reply.indexOf( ' ', 4 );
-        // Get articles count,
-        // todo ,how to use this count?
-        // int count = reply.mid( 4, countPos > 4 ? countPos - 4 : -1 ).toInt();
-
-        // Read articles
-        readData( reply );
-        state = DictServerState::DEFINE_DATA;
-      }
+    if ( lsc >= leadingSpaceCount && lsc > firstLeadingSpaceCount ) {
+      //extra space
+      resultStr.append( " " );
+      resultStr.append( line.trimmed() );
     }
-    else if ( state == DictServerState::DEFINE_DATA ) {
-      QByteArray reply = dictImpl->socket.readLine();
-      qDebug() << "receive define data:" << reply << QDateTime::currentDateTime();
-      readData( reply );
+    else {
+      resultStr.append( "\n" );
+      resultStr.append( line );
     }
-  } );
-
-  connect( &dictImpl->socket, &QTcpSocket::errorOccurred, this, [ this ]( QAbstractSocket::SocketError error ) {
-    qDebug() << "socket error message: " << error;
-    cancel();
-  } );
-}
-
-void DictServerArticleRequest::readData( QByteArray reply )
-{
-  if ( reply.isEmpty() ) {
-    return;
+    leadingSpaceCount = lsc;
   }
 
-  if ( reply.left( 3 ) == "250" ) {
-    return;
+  static QRegularExpression phonetic( R"(\\([^\\]+)\\)",
+                                      QRegularExpression::CaseInsensitiveOption ); // phonetics: \stuff\ ...
+  static QRegularExpression divs_inside_phonetic( "</div([^>]*)><div([^>]*)>",
+                                                  QRegularExpression::CaseInsensitiveOption );
+  static QRegularExpression refs( R"(\{([^\{\}]+)\})",
+                                  QRegularExpression::CaseInsensitiveOption ); // links: {stuff}
+  static QRegularExpression links( "<a href=\"gdlookup://localhost/([^\"]*)\">",
+                                   QRegularExpression::CaseInsensitiveOption );
+  static QRegularExpression tags( "<[^>]*>", QRegularExpression::CaseInsensitiveOption );
+
+  string articleStr;
+  if ( contentInHtml ) {
+    articleStr = resultStr.toUtf8().data();
+  }
+  else {
+    articleStr = Html::preformat( resultStr.toUtf8().data() );
   }
 
-  if ( reply.left( 3 ) == "151" ) {
-    int pos = 4;
-    int endPos;
-
-    // Skip requested word
-    if ( reply[ pos ] == '\"' ) {
-      endPos = reply.indexOf( '\"', pos + 1 ) + 1;
-    }
-    else {
-      endPos = reply.indexOf( ' ', pos );
-    }
+  QString articleText = QString::fromUtf8( articleStr.c_str(), articleStr.size() );
+  if ( !contentInHtml ) {
+    articleText = articleText.replace( refs, R"(<a href="gdlookup://localhost/\1">\1</a>)" );
 
-    if ( endPos < pos ) {
-      // It seems mailformed string
-      return;
-    }
+    pos = 0;
+    QString articleNewText;
 
-    pos = endPos + 1;
+    // Handle phonetics
 
-    QString dbID;
-    QString dbName;
+    QRegularExpressionMatchIterator it = phonetic.globalMatch( articleText );
+    while ( it.hasNext() ) {
+      QRegularExpressionMatch match = it.next();
+      articleNewText += articleText.mid( pos, match.capturedStart() - pos );
+      pos = match.capturedEnd();
 
-    // Retrieve database ID
-    endPos = reply.indexOf( ' ', pos );
+      QString phonetic_text = match.captured( 1 );
+      phonetic_text.replace( divs_inside_phonetic, R"(</span></div\1><div\2><span class="dictd_phonetic">)" );
 
-    if ( endPos < pos ) {
-      // It seems mailformed string
-      return;
+      articleNewText += R"(<span class="dictd_phonetic">)" + phonetic_text + "</span>";
+    }
+    if ( pos ) {
+      articleNewText += articleText.mid( pos );
+      articleText = articleNewText;
+      articleNewText.clear();
     }
 
-    dbID = reply.mid( pos, endPos - pos );
+    // Handle links
 
-    // Retrieve database ID
-    pos = endPos + 1;
-    if ( reply[ pos ] == '\"' ) {
-      endPos = reply.indexOf( '\"', pos + 1 ) + 1;
-    }
-    else {
-      endPos = reply.indexOf( ' ', pos );
-    }
+    pos = 0;
+    it  = links.globalMatch( articleText );
+    while ( it.hasNext() ) {
+      QRegularExpressionMatch match = it.next();
+      articleNewText += articleText.mid( pos, match.capturedStart() - pos );
+      pos = match.capturedEnd();
 
-    if ( endPos < pos ) {
-      // It seems mailformed string
-      return;
-    }
+      QString link = match.captured( 1 );
+      link.replace( tags, " " );
+      link.replace( "&nbsp;", " " );
 
-    dbName = reply.mid( pos, endPos - pos );
-    if ( dbName.endsWith( '\"' ) ) {
-      dbName.chop( 1 );
+      QString newLink = match.captured();
+      newLink.replace( 30,
+                       match.capturedLength( 1 ),
+                       QString::fromUtf8( QUrl::toPercentEncoding( link.simplified() ) ) );
+      articleNewText += newLink;
     }
-    if ( dbName[ 0 ] == '\"' ) {
-      dbName = dbName.mid( 1 );
+    if ( pos ) {
+      articleNewText += articleText.mid( pos );
+      articleText = articleNewText;
+      articleNewText.clear();
     }
+  }
 
-    articleData += string( "<div class=\"dictserver_from\">" ) + dbName.toUtf8().data() + "[" + dbID.toUtf8().data()
-      + "]" + "</div>";
+  articleData += string( "<div class=\"dictd_article\">" ) + articleText.toUtf8().data() + "<br></div>";
 
-    reply = dictImpl->socket.readAll();
+  appendString( articleData );
 
-    articleText += reply;
-    qDebug() << "reply data:" << reply << QDateTime::currentDateTime();
-    if ( articleText.contains( "\r\n.\r\n" ) ) {
-      //discard all left message.
-      emit finishedArticle( articleText );
-      return;
-    }
-  }
-  else {
-    articleText += reply;
-    reply = dictImpl->socket.readAll();
-    qDebug() << "reply data:" << reply << QDateTime::currentDateTime();
-
-    articleText += reply;
-    if ( reply.contains( "\r\n.\r\n" ) ) {
-      //discard all left message. maybe delete all the remaining data after `.\r\n`
-      emit finishedArticle( articleText );
-      return;
-    }
-  }
-  //restart.
-  timer->start();
+  hasAnyData = true;
 }
 
 void DictServerArticleRequest::cancel()
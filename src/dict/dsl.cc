@@ -22,7 +22,6 @@
 #include <vector>
 #include <list>
 #include <wctype.h>
-#include <QThreadPool>
 #include <QAtomicInt>
 #include <QUrl>
 #include <QDir>
@@ -31,8 +30,10 @@
 #include <QRegularExpression>
 #include <QByteArray>
 #include <QSvgRenderer>
-#include <QtConcurrentRun>
+#include <QScopeGuard>
+#include <QtConcurrentMap>
 #include "utils.hh"
+#include "scheduler.hh"
 
 namespace Dsl {
 
@@ -241,10 +242,10 @@ private:
   /// Converts DSL language to an Html.
   string dslToHtml( std::u32string const &, std::u32string const & headword = std::u32string() );
 
-  // Parts of dslToHtml()
-  string nodeToHtml( ArticleDom::Node const & );
-  string processNodeChildren( ArticleDom::Node const & node );
-  string getNodeLink( ArticleDom::Node const & node );
+  // Parts of dslToHtml(), which append the html to the given string
+  void nodeToHtml( ArticleDom const &, ArticleDom::Node const &, string & out );
+  void processNodeChildren( ArticleDom const &, ArticleDom::Node const & node, string & out );
+  string getNodeLink( ArticleDom const &, ArticleDom::Node const & node );
 
   bool hasHiddenZones() /// Return true if article has hidden zones
   {
@@ -311,11 +312,9 @@ void DslDictionary::deferredInit()
     }
 
     if ( !deferredInitRunnableStarted ) {
-      QThreadPool::globalInstance()->start(
-        [ this ]() {
-          this->doDeferredInit();
-        },
-        -1000 );
+      Scheduler::run( Scheduler::Priority::Background, [ this ]() {
+        this->doDeferredInit();
+      } );
       deferredInitRunnableStarted = true;
     }
   }
@@ -462,6 +461,56 @@ bool isDslWs( char32_t ch )
   }
 }
 
+namespace {
+
+/// Appends the text escaped the same way Html::escape() does it. Its line
+/// breaks become paragraphs, unless it's the value of an attribute.
+void appendEscaped( string & out, std::u32string_view text, bool lineBreaks = true )
+{
+  size_t run = 0; // The start of the text not appended yet
+
+  for ( size_t x = 0; x < text.size(); ++x ) {
+    char const * replacement;
+
+    switch ( text[ x ] ) {
+      case '&':
+        replacement = "&amp;";
+        break;
+      case '<':
+        replacement = "&lt;";
+        break;
+      case '>':
+        replacement = "&gt;";
+        break;
+      case '"':
+        replacement = "&quot;";
+        break;
+      case '\r':
+        if ( !lineBreaks ) {
+          continue;
+        }
+        replacement = "";
+        break;
+      case '\n':
+        if ( !lineBreaks ) {
+          continue;
+        }
+        replacement = "<p></p>";
+        break;
+      default:
+        continue;
+    }
+
+    Text::appendUtf8( out, text.substr( run, x - run ) );
+    out += replacement;
+    run = x + 1;
+  }
+
+  Text::appendUtf8( out, text.substr( run ) );
+}
+
+} // namespace
+
 void DslDictionary::loadArticle( uint32_t address,
                                  std::u32string const & requestedHeadwordFolded,
                                  bool ignoreDiacritics,
@@ -505,8 +554,7 @@ void DslDictionary::loadArticle( uint32_t address,
     }
     else {
       try {
-        articleData =
-          Iconv::toWstring( Text::getEncodingNameFor( Encoding( idxHeader.dslEncoding ) ), articleBody, articleSize );
+        Iconv::toWstring( Encoding( idxHeader.dslEncoding ), articleBody, articleSize, articleData );
         free( articleBody );
 
         // Strip DSL comments
@@ -703,27 +751,27 @@ string DslDictionary::dslToHtml( std::u32string const & str, std::u32string cons
 
   optionalPartNom = 0;
 
-  string html = processNodeChildren( dom.root );
+  string html;
+  html.reserve( normalizedStr.size() * 2 );
+
+  processNodeChildren( dom, dom.root(), html );
 
   return html;
 }
 
-string DslDictionary::processNodeChildren( ArticleDom::Node const & node )
+void DslDictionary::processNodeChildren( ArticleDom const & dom, ArticleDom::Node const & node, string & out )
 {
-  string result;
-
-  for ( const auto & i : node ) {
-    result += nodeToHtml( i );
+  for ( const auto & i : dom.children( node ) ) {
+    nodeToHtml( dom, i, out );
   }
-
-  return result;
 }
 
-string DslDictionary::getNodeLink( ArticleDom::Node const & node )
+string DslDictionary::getNodeLink( ArticleDom const & dom, ArticleDom::Node const & node )
 {
   string link;
-  if ( !node.tagAttrs.empty() ) {
-    QString attrs = QString::fromStdU32String( node.tagAttrs );
+  std::u32string_view const tagAttrs = dom.tagAttrs( node );
+  if ( !tagAttrs.empty() ) {
+    QString attrs = QString::fromUcs4( tagAttrs.data(), tagAttrs.size() );
     int n         = attrs.indexOf( "target=\"" );
     if ( n >= 0 ) {
       int n_end      = attrs.indexOf( '\"', n + 8 );
@@ -732,83 +780,98 @@ string DslDictionary::getNodeLink( ArticleDom::Node const & node )
     }
   }
   if ( link.empty() ) {
-    link = Html::escape( Filetype::simplifyString( Text::toUtf8( node.renderAsText() ), false ) );
+    link = Html::escape( Filetype::simplifyString( Text::toUtf8( dom.renderAsText( node ) ), false ) );
   }
 
   return link;
 }
 
-string DslDictionary::nodeToHtml( ArticleDom::Node const & node )
+void DslDictionary::nodeToHtml( ArticleDom const & dom, ArticleDom::Node const & node, string & out )
 {
-  string result;
-
   if ( !node.isTag ) {
-    result = Html::escape( Text::toUtf8( node.text ) );
-
-    // Handle all end-of-line
+    appendEscaped( out, dom.text( node ) );
+    return;
+  }
 
-    string::size_type n;
+  std::u32string_view const tagName  = dom.tagName( node );
+  std::u32string_view const tagAttrs = dom.tagAttrs( node );
 
-    // Strip all '\r'
-    while ( ( n = result.find( '\r' ) ) != string::npos ) {
-      result.erase( n, 1 );
-    }
+  if ( tagName == U"b" ) {
+    out += "<b class=\"dsl_b\">";
+    processNodeChildren( dom, node, out );
+    out += "</b>";
+  }
+  else if ( tagName == U"i" ) {
+    out += "<i class=\"dsl_i\">";
+    processNodeChildren( dom, node, out );
+    out += "</i>";
+  }
+  else if ( tagName == U"u" ) {
+    size_t const start = out.size();
 
-    // Replace all '\n'
-    while ( ( n = result.find( '\n' ) ) != string::npos ) {
-      result.replace( n, 1, "<p></p>" );
-    }
+    out += "<span class=\"dsl_u\">";
 
-    return result;
-  }
+    size_t const body = out.size();
 
-  if ( node.tagName == U"b" ) {
-    result += "<b class=\"dsl_b\">" + processNodeChildren( node ) + "</b>";
-  }
-  else if ( node.tagName == U"i" ) {
-    result += "<i class=\"dsl_i\">" + processNodeChildren( node ) + "</i>";
-  }
-  else if ( node.tagName == U"u" ) {
-    string nodeText = processNodeChildren( node );
+    processNodeChildren( dom, node, out );
 
-    if ( nodeText.size() && isDslWs( nodeText[ 0 ] ) ) {
-      result.push_back( ' ' ); // Fix a common problem where in "foo[i] bar[/i]"
+    if ( out.size() > body && isDslWs( out[ body ] ) ) {
+      out.insert( start, 1, ' ' ); // Fix a common problem where in "foo[i] bar[/i]"
     }
     // the space before "bar" gets underlined.
 
-    result += "<span class=\"dsl_u\">" + nodeText + "</span>";
+    out += "</span>";
   }
-  else if ( node.tagName == U"c" ) {
-    if ( node.tagAttrs.empty() ) {
-      result += "<span class=\"c_default_color\">" + processNodeChildren( node ) + "</span>";
+  else if ( tagName == U"c" ) {
+    if ( tagAttrs.empty() ) {
+      out += "<span class=\"c_default_color\">";
+      processNodeChildren( dom, node, out );
+      out += "</span>";
     }
     else {
-      result += "<font color=\"" + Html::escape( Text::toUtf8( node.tagAttrs ) ) + "\">" + processNodeChildren( node )
-        + "</font>";
+      out += "<font color=\"";
+      appendEscaped( out, tagAttrs, false );
+      out += "\">";
+      processNodeChildren( dom, node, out );
+      out += "</font>";
     }
   }
-  else if ( node.tagName == U"*" ) {
+  else if ( tagName == U"*" ) {
     string id = "O" + getId().substr( 0, 7 ) + "_" + QString::number( articleNom ).toStdString() + "_opt_"
       + QString::number( optionalPartNom++ ).toStdString();
-    result += R"(<span class="dsl_opt" id=")" + id + "\">" + processNodeChildren( node ) + "</span>";
-  }
-  else if ( node.tagName == U"m" ) {
-    result += "<div class=\"dsl_m\">" + processNodeChildren( node ) + "</div>";
-  }
-  else if ( node.tagName.size() == 2 && node.tagName[ 0 ] == L'm' && iswdigit( node.tagName[ 1 ] ) ) {
-    result += "<div class=\"dsl_" + Text::toUtf8( node.tagName ) + "\">" + processNodeChildren( node ) + "</div>";
-  }
-  else if ( node.tagName == U"trn" ) {
-    result += "<span class=\"dsl_trn\">" + processNodeChildren( node ) + "</span>";
-  }
-  else if ( node.tagName == U"ex" ) {
-    result += "<span class=\"dsl_ex\">" + processNodeChildren( node ) + "</span>";
-  }
-  else if ( node.tagName == U"com" ) {
-    result += "<span class=\"dsl_com\">" + processNodeChildren( node ) + "</span>";
-  }
-  else if ( node.tagName == U"s" || node.tagName == U"video" ) {
-    string filename = Filetype::simplifyString( Text::toUtf8( node.renderAsText() ), false );
+    out += R"(<span class="dsl_opt" id=")" + id + "\">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
+  }
+  else if ( tagName == U"m" ) {
+    out += "<div class=\"dsl_m\">";
+    processNodeChildren( dom, node, out );
+    out += "</div>";
+  }
+  else if ( tagName.size() == 2 && tagName[ 0 ] == L'm' && iswdigit( tagName[ 1 ] ) ) {
+    out += "<div class=\"dsl_";
+    Text::appendUtf8( out, tagName );
+    out += "\">";
+    processNodeChildren( dom, node, out );
+    out += "</div>";
+  }
+  else if ( tagName == U"trn" ) {
+    out += "<span class=\"dsl_trn\">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
+  }
+  else if ( tagName == U"ex" ) {
+    out += "<span class=\"dsl_ex\">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
+  }
+  else if ( tagName == U"com" ) {
+    out += "<span class=\"dsl_com\">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
+  }
+  else if ( tagName == U"s" || tagName == U"video" ) {
+    string filename = Filetype::simplifyString( Text::toUtf8( dom.renderAsText( node ) ), false );
     string n        = resourceDir1 + filename;
 
     if ( Filetype::isNameOfSound( filename ) ) {
@@ -822,9 +885,9 @@ string DslDictionary::nodeToHtml( ArticleDom::Node const & node )
 
       string ref = string( "\"" ) + url.toEncoded().data() + "\"";
 
-      result += addAudioLink( url.toEncoded(), getId() );
+      out += addAudioLink( url.toEncoded(), getId() );
 
-      result += "<span class=\"dsl_s_wav\"><a href=" + ref
+      out += "<span class=\"dsl_s_wav\"><a href=" + ref
         + R"(><img src="qrc:///icons/playsound.png" border="0" align="absmiddle" alt="Play"/></a></span>)";
     }
     else if ( Filetype::isNameOfPicture( filename ) ) {
@@ -835,7 +898,7 @@ string DslDictionary::nodeToHtml( ArticleDom::Node const & node )
 
       string maxWidthStyle = " style=\"max-width:100%;\" ";
 
-      result += string( "<img src=\"" ) + url.toEncoded().data() + "\" " + maxWidthStyle + " alt=\""
+      out += string( "<img src=\"" ) + url.toEncoded().data() + "\" " + maxWidthStyle + " alt=\""
         + Html::escape( filename ) + "\"/>";
     }
     else if ( Filetype::isNameOfVideo( filename ) ) {
@@ -844,9 +907,10 @@ string DslDictionary::nodeToHtml( ArticleDom::Node const & node )
       url.setHost( QString::fromUtf8( getId().c_str() ) );
       url.setPath( Utils::Url::ensureLeadingSlash( QString::fromUtf8( filename.c_str() ) ) );
 
-      result += string( R"(<a class="dsl_s dsl_video" href=")" ) + url.toEncoded().data() + "\">"
-        + "<span class=\"img\"></span>" + "<span class=\"filename\">" + processNodeChildren( node ) + "</span>"
-        + "</a>";
+      out += string( R"(<a class="dsl_s dsl_video" href=")" ) + url.toEncoded().data() + "\">"
+        + "<span class=\"img\"></span>" + "<span class=\"filename\">";
+      processNodeChildren( dom, node, out );
+      out += "</span></a>";
     }
     else {
       // Unknown file type, downgrade to a hyperlink
@@ -856,12 +920,13 @@ string DslDictionary::nodeToHtml( ArticleDom::Node const & node )
       url.setHost( QString::fromUtf8( getId().c_str() ) );
       url.setPath( Utils::Url::ensureLeadingSlash( QString::fromUtf8( filename.c_str() ) ) );
 
-      result +=
-        string( R"(<a class="dsl_s" href=")" ) + url.toEncoded().data() + "\">" + processNodeChildren( node ) + "</a>";
+      out += string( R"(<a class="dsl_s" href=")" ) + url.toEncoded().data() + "\">";
+      processNodeChildren( dom, node, out );
+      out += "</a>";
     }
   }
-  else if ( node.tagName == U"url" ) {
-    string link = getNodeLink( node );
+  else if ( tagName == U"url" ) {
+    string link = getNodeLink( dom, node );
     if ( QUrl::fromEncoded( link.c_str() ).scheme().isEmpty() ) {
       link = "http://" + link;
     }
@@ -879,15 +944,19 @@ string DslDictionary::nodeToHtml( ArticleDom::Node const & node )
       }
     }
 
-    result += R"(<a class="dsl_url" href=")" + link + "\">" + processNodeChildren( node ) + "</a>";
+    out += R"(<a class="dsl_url" href=")" + link + "\">";
+    processNodeChildren( dom, node, out );
+    out += "</a>";
   }
-  else if ( node.tagName == U"!trs" ) {
-    result += "<span class=\"dsl_trs\">" + processNodeChildren( node ) + "</span>";
+  else if ( tagName == U"!trs" ) {
+    out += "<span class=\"dsl_trs\">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
   }
-  else if ( node.tagName == U"p" ) {
-    result += "<span class=\"dsl_p\"";
+  else if ( tagName == U"p" ) {
+    out += "<span class=\"dsl_p\"";
 
-    string val = Text::toUtf8( node.renderAsText() );
+    string val = Text::toUtf8( dom.renderAsText( node ) );
 
     // If we have such a key, display a title
 
@@ -896,26 +965,36 @@ string DslDictionary::nodeToHtml( ArticleDom::Node const & node )
     if ( i != abrv.end() ) {
       string title = i->second;
 
-      result += " title=\"" + Html::escape( title ) + "\"";
+      out += " title=\"" + Html::escape( title ) + "\"";
     }
 
-    result += ">" + processNodeChildren( node ) + "</span>";
+    out += ">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
   }
-  else if ( node.tagName == U"'" ) {
+  else if ( tagName == U"'" ) {
     // There are two ways to display the stress: by adding an accent sign or via font styles.
     // We generate two spans, one with accented data and another one without it, so the
     // user could pick up the best suitable option.
-    string data = processNodeChildren( node );
-    result += R"(<span class="dsl_stress"><span class="dsl_stress_without_accent">)" + data + "</span>"
-      + "<span class=\"dsl_stress_with_accent\">" + data + Text::toUtf8( std::u32string( 1, 0x301 ) )
-      + "</span></span>";
-  }
-  else if ( node.tagName == U"lang" ) {
-    result += "<span class=\"dsl_lang\"";
-    if ( !node.tagAttrs.empty() ) {
+    out += R"(<span class="dsl_stress"><span class="dsl_stress_without_accent">)";
+
+    size_t const data = out.size();
+
+    processNodeChildren( dom, node, out );
+
+    size_t const dataSize = out.size() - data;
+
+    out += "</span><span class=\"dsl_stress_with_accent\">";
+    out.append( out, data, dataSize );
+    Text::appendUtf8( out, U"\u0301" ); // The combining acute accent
+    out += "</span></span>";
+  }
+  else if ( tagName == U"lang" ) {
+    out += "<span class=\"dsl_lang\"";
+    if ( !tagAttrs.empty() ) {
       // Find ISO 639-1 code
       string langcode;
-      QString attr = QString::fromStdU32String( node.tagAttrs );
+      QString attr = QString::fromUcs4( tagAttrs.data(), tagAttrs.size() );
       int n        = attr.indexOf( "id=" );
       if ( n >= 0 ) {
         int id = attr.mid( n + 3 ).toInt();
@@ -934,22 +1013,24 @@ string DslDictionary::nodeToHtml( ArticleDom::Node const & node )
         }
       }
       if ( !langcode.empty() ) {
-        result += " lang=\"" + langcode + "\"";
+        out += " lang=\"" + langcode + "\"";
       }
     }
-    result += ">" + processNodeChildren( node ) + "</span>";
+    out += ">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
   }
-  else if ( node.tagName == U"ref" ) {
+  else if ( tagName == U"ref" ) {
     QUrl url;
 
     url.setScheme( "gdlookup" );
     url.setHost( "localhost" );
-    auto nodeStr = Text::toUtf32( getNodeLink( node ) );
+    auto nodeStr = Text::toUtf32( getNodeLink( dom, node ) );
 
     normalizeHeadword( nodeStr );
     url.setPath( Utils::Url::ensureLeadingSlash( QString::fromStdU32String( nodeStr ) ) );
-    if ( !node.tagAttrs.empty() ) {
-      QString attr = QString::fromStdU32String( node.tagAttrs ).remove( '\"' );
+    if ( !tagAttrs.empty() ) {
+      QString attr = QString::fromUcs4( tagAttrs.data(), tagAttrs.size() ).remove( '\"' );
       int n        = attr.indexOf( '=' );
       if ( n > 0 ) {
         QList< std::pair< QString, QString > > query;
@@ -958,50 +1039,61 @@ string DslDictionary::nodeToHtml( ArticleDom::Node const & node )
       }
     }
 
-    result +=
-      string( R"(<a class="dsl_ref" href=")" ) + url.toEncoded().data() + "\">" + processNodeChildren( node ) + "</a>";
+    out += string( R"(<a class="dsl_ref" href=")" ) + url.toEncoded().data() + "\">";
+    processNodeChildren( dom, node, out );
+    out += "</a>";
   }
-  else if ( node.tagName == U"@" ) {
+  else if ( tagName == U"@" ) {
     // Special case - insided card header was not parsed
 
     QUrl url;
 
     url.setScheme( "gdlookup" );
     url.setHost( "localhost" );
-    std::u32string nodeStr = node.renderAsText();
+    std::u32string nodeStr = dom.renderAsText( node );
     normalizeHeadword( nodeStr );
     url.setPath( Utils::Url::ensureLeadingSlash( QString::fromStdU32String( nodeStr ) ) );
 
-    result +=
-      string( R"(<a class="dsl_ref" href=")" ) + url.toEncoded().data() + "\">" + processNodeChildren( node ) + "</a>";
+    out += string( R"(<a class="dsl_ref" href=")" ) + url.toEncoded().data() + "\">";
+    processNodeChildren( dom, node, out );
+    out += "</a>";
   }
-  else if ( node.tagName == U"sub" ) {
-    result += "<sub>" + processNodeChildren( node ) + "</sub>";
+  else if ( tagName == U"sub" ) {
+    out += "<sub>";
+    processNodeChildren( dom, node, out );
+    out += "</sub>";
   }
-  else if ( node.tagName == U"sup" ) {
-    result += "<sup>" + processNodeChildren( node ) + "</sup>";
+  else if ( tagName == U"sup" ) {
+    out += "<sup>";
+    processNodeChildren( dom, node, out );
+    out += "</sup>";
   }
-  else if ( node.tagName == U"t" ) {
-    result += "<span class=\"dsl_t\">" + processNodeChildren( node ) + "</span>";
+  else if ( tagName == U"t" ) {
+    out += "<span class=\"dsl_t\">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
   }
-  else if ( node.tagName == U"br" ) {
-    result += "<br />";
+  else if ( tagName == U"br" ) {
+    out += "<br />";
   }
   else {
+    QByteArray const name  = QString::fromUcs4( tagName.data(), tagName.size() ).toUtf8();
+    QByteArray const attrs = QString::fromUcs4( tagAttrs.data(), tagAttrs.size() ).toUtf8();
+
     qWarning( R"(DSL: Unknown tag "%s" with attributes "%s" found in "%s", article "%s".)",
-              QString::fromStdU32String( node.tagName ).toUtf8().data(),
-              QString::fromStdU32String( node.tagAttrs ).toUtf8().data(),
+              name.data(),
+              attrs.data(),
               getName().c_str(),
               QString::fromStdU32String( currentHeadword ).toUtf8().data() );
 
-    result += "<span class=\"dsl_unknown\">[" + string( QString::fromStdU32String( node.tagName ).toUtf8().data() );
-    if ( !node.tagAttrs.empty() ) {
-      result += " " + string( QString::fromStdU32String( node.tagAttrs ).toUtf8().data() );
+    out += "<span class=\"dsl_unknown\">[" + string( name.data() );
+    if ( !tagAttrs.empty() ) {
+      out += " " + string( attrs.data() );
     }
-    result += "]" + processNodeChildren( node ) + "</span>";
+    out += "]";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
   }
-
-  return result;
 }
 
 QString const & DslDictionary::getDescription()
@@ -1144,9 +1236,7 @@ void DslDictionary::getArticleText( uint32_t articleAddress, QString & headword,
   }
   else {
     try {
-      articleData = Iconv::toWstring( getEncodingNameFor( static_cast< Encoding >( idxHeader.dslEncoding ) ),
-                                      articleBody,
-                                      articleSize );
+      Iconv::toWstring( static_cast< Encoding >( idxHeader.dslEncoding ), articleBody, articleSize, articleData );
       free( articleBody );
 
       // Strip DSL comments
@@ -1355,7 +1445,7 @@ void DslDictionary::getArticleText( uint32_t articleAddress, QString & headword,
     if ( haveInsidedCards ) {
       // Use base DSL parser for articles with insided cards
       ArticleDom dom( text.toStdU32String(), getName(), articleHeadword );
-      text = QString::fromStdU32String( dom.root.renderAsText( true ) );
+      text = QString::fromStdU32String( dom.renderAsText( dom.root(), true ) );
     }
     else {
       // Unescape DSL symbols
@@ -1384,7 +1474,6 @@ class DslArticleRequest: public Dictionary::DataRequest
   bool ignoreDiacritics;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -1397,9 +1486,6 @@ public:
     dict( dict_ ),
     ignoreDiacritics( ignoreDiacritics_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -1408,12 +1494,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~DslArticleRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void DslArticleRequest::run()
@@ -1548,7 +1628,16 @@ sptr< Dictionary::DataRequest > DslDictionary::getArticle( std::u32string const
                                                            bool ignoreDiacritics )
 
 {
-  return std::make_shared< DslArticleRequest >( word, alts, *this, ignoreDiacritics );
+  if ( !mayContainAny( word, alts ) ) {
+    return std::make_shared< Dictionary::DataRequestInstant >( false ); // No such word
+  }
+
+  return Dictionary::runRequest< DslArticleRequest >( Scheduler::Priority::Lookup,
+                                                      this,
+                                                      word,
+                                                      alts,
+                                                      *this,
+                                                      ignoreDiacritics );
 }
 
 //// DslDictionary::getResource()
@@ -1560,7 +1649,6 @@ class DslResourceRequest: public Dictionary::DataRequest
   string resourceName;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -1568,9 +1656,6 @@ public:
     dict( dict_ ),
     resourceName( resourceName_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -1579,13 +1664,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~DslResourceRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-    //hasExited.acquire();
-  }
 };
 
 void DslResourceRequest::run()
@@ -1643,7 +1721,7 @@ void DslResourceRequest::run()
 sptr< Dictionary::DataRequest > DslDictionary::getResource( string const & name )
 
 {
-  return std::make_shared< DslResourceRequest >( *this, name );
+  return Dictionary::runRequest< DslResourceRequest >( Scheduler::Priority::Resource, this, *this, name );
 }
 
 
@@ -1653,11 +1731,251 @@ sptr< Dictionary::DataRequest > DslDictionary::getSearchResults( QString const &
 
                                                                  bool ignoreDiacritics )
 {
-  return std::make_shared< FtsHelpers::FTSResultsRequest >( *this,
-                                                            searchString,
-                                                            searchMode,
-                                                            matchCase,
-                                                            ignoreDiacritics );
+  return Dictionary::runRequest< FtsHelpers::FTSResultsRequest >( Scheduler::Priority::Lookup,
+                                                                  this,
+                                                                  *this,
+                                                                  searchString,
+                                                                  searchMode,
+                                                                  matchCase,
+                                                                  ignoreDiacritics );
+}
+
+/// An article split off the .dsl file while building the index. The scanner
+/// stores the raw headwords, prepareScannedArticle() turns them into index
+/// entries.
+struct ScannedArticle
+{
+  uint32_t articleOffset = 0;
+  uint32_t articleSize   = 0;
+  vector< std::u32string > headwordLines;
+  QList< InsidedCard > insidedCards;
+
+  vector< BtreeIndexing::PreparedWord > words;
+  vector< vector< BtreeIndexing::PreparedWord > > insidedWords;
+  uint32_t wordCount = 0;
+};
+
+/// Number of articles handed to the thread pool at once while indexing
+constexpr size_t ArticlesPerIndexingBatch = 4096;
+
+/// Reads the next article for the index. Returns false when there are no more
+/// articles. When hasString is true, curString holds a line which was read
+/// ahead and has yet to be processed.
+bool scanArticle( DslScanner & scanner,
+                  string const & fileName,
+                  std::u32string & curString,
+                  size_t & curOffset,
+                  bool & hasString,
+                  ScannedArticle & article )
+{
+  for ( ;; ) {
+    // Find the main headword
+
+    if ( !hasString && !scanner.readNextLineWithoutComments( curString, curOffset, true ) ) {
+      return false; // Clean end of file
+    }
+
+    hasString = false;
+
+    // The line read should either consist of pure whitespace, or be a headword
+    // skip too long headword,it can never be headword.
+    if ( curString.empty() || curString.size() > 100 ) {
+      continue;
+    }
+
+    if ( isDslWs( curString[ 0 ] ) ) {
+      // The first character is blank. Let's make sure that all other
+      // characters are blank, too.
+      for ( size_t x = 1; x < curString.size(); ++x ) {
+        if ( !isDslWs( curString[ x ] ) ) {
+          qWarning( "Garbage string in %s at offset 0x%lX", fileName.c_str(), curOffset );
+          break;
+        }
+      }
+      continue;
+    }
+
+    // Ok, got the headword
+
+    article.headwordLines.push_back( curString );
+    article.articleOffset = curOffset;
+
+    // More headwords may follow
+
+    for ( ;; ) {
+      if ( !( hasString = scanner.readNextLineWithoutComments( curString, curOffset ) ) ) {
+        qWarning( "Premature end of file %s", fileName.c_str() );
+        break;
+      }
+
+      // Lingvo skips empty strings between the headwords
+      if ( curString.empty() ) {
+        continue;
+      }
+
+      if ( isDslWs( curString[ 0 ] ) ) {
+        break; // No more headwords
+      }
+
+      qDebug() << "dsl Alt headword" << QString::fromStdU32String( curString );
+
+      article.headwordLines.push_back( curString );
+    }
+
+    if ( !hasString ) {
+      return false;
+    }
+
+    int insideInsided = 0;
+    std::u32string headword;
+    uint32_t offset = curOffset;
+    QList< std::u32string > insidedHeadwords;
+    unsigned linesInsideCard = 0;
+    int dogLine              = 0;
+    bool wasEmptyLine        = false;
+    int headwordLine         = scanner.getLinesRead() - 2;
+    bool noSignificantLines  = Folding::applyWhitespaceOnly( curString ).empty();
+    bool haveLine            = !noSignificantLines;
+
+    // Skip the article's body
+    for ( ;; ) {
+      hasString = haveLine ? true : scanner.readNextLineWithoutComments( curString, curOffset );
+      haveLine  = false;
+
+      if ( !hasString || ( curString.size() && !isDslWs( curString[ 0 ] ) ) ) {
+        if ( insideInsided ) {
+          qWarning( "Unclosed tag '@' at line %i", dogLine );
+          article.insidedCards.append( InsidedCard( offset, curOffset - offset, insidedHeadwords ) );
+        }
+        if ( noSignificantLines ) {
+          qWarning( "Orphan headword at line %i", headwordLine );
+        }
+
+        break;
+      }
+
+      // Check for orphan strings
+
+      if ( curString.empty() ) {
+        wasEmptyLine = true;
+        continue;
+      }
+      else {
+        if ( wasEmptyLine && !Folding::applyWhitespaceOnly( curString ).empty() ) {
+          qWarning( "Orphan string at line %i", scanner.getLinesRead() - 1 );
+        }
+      }
+
+      if ( noSignificantLines ) {
+        noSignificantLines = Folding::applyWhitespaceOnly( curString ).empty();
+      }
+
+      // Find embedded cards
+
+      std::u32string::size_type n = curString.find( L'@' );
+      if ( n == std::u32string::npos || curString[ n - 1 ] == L'\\' ) {
+        if ( insideInsided ) {
+          linesInsideCard++;
+        }
+
+        continue;
+      }
+      else {
+        // Embedded card tag must be placed at first position in line after spaces
+        if ( !isAtSignFirst( curString ) ) {
+          qWarning( "Unescaped '@' symbol at line %i", scanner.getLinesRead() - 1 );
+
+          if ( insideInsided ) {
+            linesInsideCard++;
+          }
+
+          continue;
+        }
+      }
+
+      dogLine = scanner.getLinesRead() - 1;
+
+      // Handle embedded card
+
+      if ( insideInsided ) {
+        if ( linesInsideCard ) {
+          article.insidedCards.append( InsidedCard( offset, curOffset - offset, insidedHeadwords ) );
+
+          insidedHeadwords.clear();
+          linesInsideCard = 0;
+          offset          = curOffset;
+        }
+      }
+      else {
+        offset          = curOffset;
+        linesInsideCard = 0;
+      }
+
+      headword = Folding::trimWhitespace( curString.substr( n + 1 ) );
+
+      if ( !headword.empty() ) {
+        // The headword is expanded later on, by prepareScannedArticle()
+        insidedHeadwords.append( headword );
+        insideInsided = true;
+      }
+      else {
+        insideInsided = false;
+      }
+    }
+
+    // Now that we're having read the first string after the article
+    // itself, we can use its offset to calculate the article's size.
+    // An end of file works here, too.
+
+    article.articleSize = curOffset - article.articleOffset;
+
+    return true;
+  }
+}
+
+/// Expands and folds the headwords of a scanned article. Only touches the
+/// article itself, so it is run on the thread pool.
+void prepareScannedArticle( ScannedArticle & article, unsigned int maxHeadwordSize )
+{
+  list< std::u32string > allEntryWords;
+
+  for ( size_t x = 0; x < article.headwordLines.size(); ++x ) {
+    std::u32string & line = article.headwordLines[ x ];
+
+    processUnsortedParts( line, true );
+    if ( x != 0 ) {
+      expandTildes( line, allEntryWords.front() );
+    }
+    expandOptionalParts( line, &allEntryWords );
+  }
+
+  for ( auto & allEntryWord : allEntryWords ) {
+    unescapeDsl( allEntryWord );
+    normalizeHeadword( allEntryWord );
+    article.words.push_back( IndexedWords::prepareWord( allEntryWord, maxHeadwordSize ) );
+  }
+
+  article.wordCount = allEntryWords.size();
+
+  for ( auto const & insidedCard : article.insidedCards ) {
+    auto & cardWords = article.insidedWords.emplace_back();
+
+    for ( auto hw : insidedCard.headwords ) {
+      processUnsortedParts( hw, true );
+      expandTildes( hw, allEntryWords.front() );
+
+      list< std::u32string > insidedEntryWords;
+      expandOptionalParts( hw, &insidedEntryWords );
+
+      for ( auto & insidedEntryWord : insidedEntryWords ) {
+        unescapeDsl( insidedEntryWord );
+        normalizeHeadword( insidedEntryWord );
+        cardWords.push_back( IndexedWords::prepareWord( insidedEntryWord, maxHeadwordSize ) );
+      }
+
+      article.wordCount += insidedEntryWords.size();
+    }
+  }
 }
 
 } // anonymous namespace
@@ -1827,7 +2145,8 @@ vector< sptr< Dictionary::Class > > makeDictionaries( vector< string > const & f
                 }
 
                 // If the string has any dsl markup, we strip it
-                string value = Text::toUtf8( ArticleDom( curString ).root.renderAsText() );
+                ArticleDom const dom( curString );
+                string value = Text::toUtf8( dom.renderAsText( dom.root() ) );
 
                 for ( auto & key : keys ) {
                   unescapeDsl( key );
@@ -1866,219 +2185,77 @@ vector< sptr< Dictionary::Class > > makeDictionaries( vector< string > const & f
 
           uint32_t articleCount = 0, wordCount = 0;
 
-          for ( ;; ) {
-            // Find the main headword
-
-            if ( !hasString && !scanner.readNextLineWithoutComments( curString, curOffset, true ) ) {
-              break; // Clean end of file
-            }
-
-            hasString = false;
-
-            // The line read should either consist of pure whitespace, or be a headword
-            // skip too long headword,it can never be headword.
-            if ( curString.empty() || curString.size() > 100 ) {
-              continue;
-            }
-
-            if ( isDslWs( curString[ 0 ] ) ) {
-              // The first character is blank. Let's make sure that all other
-              // characters are blank, too.
-              for ( size_t x = 1; x < curString.size(); ++x ) {
-                if ( !isDslWs( curString[ x ] ) ) {
-                  qWarning( "Garbage string in %s at offset 0x%lX", fileName.c_str(), curOffset );
-                  break;
-                }
-              }
-              continue;
-            }
-
-            // Ok, got the headword
-
-            list< std::u32string > allEntryWords;
-
-            processUnsortedParts( curString, true );
-            expandOptionalParts( curString, &allEntryWords );
-
-            uint32_t articleOffset = curOffset;
-
-            //qDebug( "Headword: %ls", curString.c_str() );
-
-            // More headwords may follow
-
-            for ( ;; ) {
-              if ( !( hasString = scanner.readNextLineWithoutComments( curString, curOffset ) ) ) {
-                qWarning( "Premature end of file %s", fileName.c_str() );
-                break;
-              }
-
-              // Lingvo skips empty strings between the headwords
-              if ( curString.empty() ) {
-                continue;
-              }
-
-              if ( isDslWs( curString[ 0 ] ) ) {
-                break; // No more headwords
-              }
-
-              qDebug() << "dsl Alt headword" << QString::fromStdU32String( curString );
-
-              processUnsortedParts( curString, true );
-              expandTildes( curString, allEntryWords.front() );
-              expandOptionalParts( curString, &allEntryWords );
-            }
-
-            if ( !hasString ) {
-              break;
+          // The index is built in a pipeline: the scanner splits the file into
+          // articles on this thread, the headwords of one batch get expanded and
+          // folded on the thread pool while the next batch is being read, and
+          // the batches are merged in file order, so the index is exactly the
+          // one a sequential build would produce.
+          vector< ScannedArticle > scannedBatch, preparedBatch;
+          QFuture< void > preparing;
+
+          // The workers reference preparedBatch, never let it go while they run
+          auto preparingGuard = qScopeGuard( [ &preparing ]() {
+            preparing.cancel();
+            try {
+              preparing.waitForFinished();
             }
-
-            // Insert new entry
-
-            uint32_t descOffset = chunks.startNewBlock();
-
-            chunks.addToBlock( &articleOffset, sizeof( articleOffset ) );
-
-            for ( auto & allEntryWord : allEntryWords ) {
-              unescapeDsl( allEntryWord );
-              normalizeHeadword( allEntryWord );
-              indexedWords.addWord( allEntryWord, descOffset, maxHeadwordSize );
+            catch ( ... ) {
+              // Already leaving with an error
             }
+          } );
 
-            ++articleCount;
-            wordCount += allEntryWords.size();
-
-            int insideInsided = 0;
-            std::u32string headword;
-            QList< InsidedCard > insidedCards;
-            uint32_t offset = curOffset;
-            QList< std::u32string > insidedHeadwords;
-            unsigned linesInsideCard = 0;
-            int dogLine              = 0;
-            bool wasEmptyLine        = false;
-            int headwordLine         = scanner.getLinesRead() - 2;
-            bool noSignificantLines  = Folding::applyWhitespaceOnly( curString ).empty();
-            bool haveLine            = !noSignificantLines;
-
-            // Skip the article's body
-            for ( ;; ) {
-              hasString = haveLine ? true : scanner.readNextLineWithoutComments( curString, curOffset );
-              haveLine  = false;
-
-              if ( !hasString || ( curString.size() && !isDslWs( curString[ 0 ] ) ) ) {
-                if ( insideInsided ) {
-                  qWarning( "Unclosed tag '@' at line %i", dogLine );
-                  insidedCards.append( InsidedCard( offset, curOffset - offset, insidedHeadwords ) );
-                }
-                if ( noSignificantLines ) {
-                  qWarning( "Orphan headword at line %i", headwordLine );
-                }
-
-                break;
-              }
-
-              // Check for orphan strings
-
-              if ( curString.empty() ) {
-                wasEmptyLine = true;
-                continue;
-              }
-              else {
-                if ( wasEmptyLine && !Folding::applyWhitespaceOnly( curString ).empty() ) {
-                  qWarning( "Orphan string at line %i", scanner.getLinesRead() - 1 );
-                }
-              }
-
-              if ( noSignificantLines ) {
-                noSignificantLines = Folding::applyWhitespaceOnly( curString ).empty();
-              }
-
-              // Find embedded cards
-
-              std::u32string::size_type n = curString.find( L'@' );
-              if ( n == std::u32string::npos || curString[ n - 1 ] == L'\\' ) {
-                if ( insideInsided ) {
-                  linesInsideCard++;
-                }
+          auto mergePreparedBatch = [ & ]() {
+            preparing.waitForFinished();
 
-                continue;
-              }
-              else {
-                // Embedded card tag must be placed at first position in line after spaces
-                if ( !isAtSignFirst( curString ) ) {
-                  qWarning( "Unescaped '@' symbol at line %i", scanner.getLinesRead() - 1 );
+            for ( auto const & article : preparedBatch ) {
+              uint32_t descOffset = chunks.startNewBlock();
 
-                  if ( insideInsided ) {
-                    linesInsideCard++;
-                  }
+              chunks.addToBlock( &article.articleOffset, sizeof( article.articleOffset ) );
+              chunks.addToBlock( &article.articleSize, sizeof( article.articleSize ) );
 
-                  continue;
-                }
+              for ( auto const & word : article.words ) {
+                indexedWords.addPreparedWord( word, descOffset );
               }
 
-              dogLine = scanner.getLinesRead() - 1;
-
-              // Handle embedded card
+              for ( qsizetype x = 0; x < article.insidedCards.size(); ++x ) {
+                auto const & insidedCard = article.insidedCards[ x ];
 
-              if ( insideInsided ) {
-                if ( linesInsideCard ) {
-                  insidedCards.append( InsidedCard( offset, curOffset - offset, insidedHeadwords ) );
+                uint32_t desc_offset = chunks.startNewBlock();
+                chunks.addToBlock( &insidedCard.offset, sizeof( insidedCard.offset ) );
+                chunks.addToBlock( &insidedCard.size, sizeof( insidedCard.size ) );
 
-                  insidedHeadwords.clear();
-                  linesInsideCard = 0;
-                  offset          = curOffset;
+                for ( auto const & word : article.insidedWords[ x ] ) {
+                  indexedWords.addPreparedWord( word, desc_offset );
                 }
               }
-              else {
-                offset          = curOffset;
-                linesInsideCard = 0;
-              }
 
-              headword = Folding::trimWhitespace( curString.substr( n + 1 ) );
-
-              if ( !headword.empty() ) {
-                processUnsortedParts( headword, true );
-                expandTildes( headword, allEntryWords.front() );
-                insidedHeadwords.append( headword );
-                insideInsided = true;
-              }
-              else {
-                insideInsided = false;
-              }
+              articleCount += 1 + article.insidedCards.size();
+              wordCount += article.wordCount;
             }
 
-            // Now that we're having read the first string after the article
-            // itself, we can use its offset to calculate the article's size.
-            // An end of file works here, too.
-
-            uint32_t articleSize = ( curOffset - articleOffset );
-
-            chunks.addToBlock( &articleSize, sizeof( articleSize ) );
-
-            for ( auto & insidedCard : insidedCards ) {
-              uint32_t desc_offset = chunks.startNewBlock();
-              chunks.addToBlock( &insidedCard.offset, sizeof( insidedCard.offset ) );
-              chunks.addToBlock( &insidedCard.size, sizeof( insidedCard.size ) );
-
-              for ( auto & hw : insidedCard.headwords ) {
-                allEntryWords.clear();
-                expandOptionalParts( hw, &allEntryWords );
+            preparedBatch.clear();
+          };
 
-                for ( auto & allEntryWord : allEntryWords ) {
-                  unescapeDsl( allEntryWord );
-                  normalizeHeadword( allEntryWord );
-                  indexedWords.addWord( allEntryWord, desc_offset, maxHeadwordSize );
-                }
-
-                wordCount += allEntryWords.size();
+          for ( bool eof = false; !eof; ) {
+            while ( scannedBatch.size() < ArticlesPerIndexingBatch ) {
+              ScannedArticle article;
+              if ( !scanArticle( scanner, fileName, curString, curOffset, hasString, article ) ) {
+                eof = true;
+                break;
               }
-              ++articleCount;
+              scannedBatch.push_back( std::move( article ) );
             }
 
-            if ( !hasString ) {
-              break;
-            }
+            mergePreparedBatch();
+
+            std::swap( scannedBatch, preparedBatch );
+            preparing = QtConcurrent::map( preparedBatch, [ maxHeadwordSize ]( ScannedArticle & article ) {
+              prepareScannedArticle( article, maxHeadwordSize );
+            } );
           }
 
+          mergePreparedBatch();
+
           // Finish with the chunks
 
           idxHeader.chunksOffset = chunks.finish();
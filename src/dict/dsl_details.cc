@@ -48,56 +48,152 @@ bool isAtSignFirst( std::u32string const & str )
 
 /////////////// ArticleDom
 
-std::u32string ArticleDom::Node::renderAsText( bool stripTrsTag ) const
+std::u32string ArticleDom::renderAsText( Node const & node, bool stripTrsTag ) const
 {
-  if ( !isTag ) {
-    return text;
-  }
-
   std::u32string result;
 
-  for ( const auto & i : *this ) {
-    if ( !stripTrsTag || i.tagName != U"!trs" ) {
-      result += i.renderAsText( stripTrsTag );
+  appendText( node, stripTrsTag, result );
+
+  return result;
+}
+
+void ArticleDom::appendText( Node const & node, bool stripTrsTag, std::u32string & out ) const
+{
+  if ( !node.isTag ) {
+    out += text( node );
+    return;
+  }
+
+  for ( auto const & i : children( node ) ) {
+    if ( !stripTrsTag || tagName( i ) != U"!trs" ) {
+      appendText( i, stripTrsTag, out );
     }
   }
+}
 
-  return result;
+ArticleDom::Index ArticleDom::addNode( Index parent, Node const & node )
+{
+  Index const index = nodes.size();
+
+  nodes.push_back( node );
+
+  Node & p = nodes[ parent ];
+
+  if ( p.lastChild == None ) {
+    p.firstChild = index;
+  }
+  else {
+    nodes[ p.lastChild ].nextSibling = index;
+    nodes[ index ].prevSibling       = p.lastChild;
+  }
+
+  p.lastChild = index;
+
+  return index;
+}
+
+ArticleDom::Index ArticleDom::addTag( Index parent, Span name, Span attrs )
+{
+  Node node;
+
+  node.isTag    = true;
+  node.tagName  = name;
+  node.tagAttrs = attrs;
+
+  return addNode( parent, node );
+}
+
+ArticleDom::Index ArticleDom::addTag( Index parent, std::u32string_view name, std::u32string_view attrs )
+{
+  Span const nameSpan = store( name );
+
+  return addTag( parent, nameSpan, store( attrs ) );
+}
+
+ArticleDom::Index ArticleDom::addText( Index parent, std::u32string_view text )
+{
+  Node node;
+
+  node.isTag = false;
+  node.text  = store( text );
+
+  return addNode( parent, node );
+}
+
+void ArticleDom::appendChar( Index textNode, char32_t c )
+{
+  Span & text = nodes[ textNode ].text;
+
+  Q_ASSERT( text.offset + text.size == chars.size() );
+
+  chars.push_back( c );
+  ++text.size;
+}
+
+ArticleDom::Span ArticleDom::store( std::u32string_view str )
+{
+  Span span;
+
+  span.offset = chars.size();
+  span.size   = str.size();
+
+  chars.append( str );
+
+  return span;
+}
+
+void ArticleDom::removeLastChild( Index parent )
+{
+  Node & p           = nodes[ parent ];
+  Index const last   = p.lastChild;
+  Index const before = nodes[ last ].prevSibling;
+
+  Q_ASSERT( nodes[ last ].firstChild == None );
+
+  // The node itself stays in the array, unreachable
+  p.lastChild = before;
+
+  if ( before == None ) {
+    p.firstChild = None;
+  }
+  else {
+    nodes[ before ].nextSibling = None;
+  }
+}
+
+void ArticleDom::adopt( ArticleDom const & other, Node const & from, Index to )
+{
+  for ( auto const & n : other.children( from ) ) {
+    if ( n.isTag ) {
+      adopt( other, n, addTag( to, other.tagName( n ), other.tagAttrs( n ) ) );
+    }
+    else {
+      addText( to, other.text( n ) );
+    }
+  }
 }
 
 namespace {
 
 /// @return true if @p tagName equals "mN" where N is a digit
-bool is_mN( std::u32string const & tagName )
+bool is_mN( std::u32string_view tagName )
 {
   return tagName.size() == 2 && tagName[ 0 ] == U'm' && iswdigit( tagName[ 1 ] );
 }
 
-bool isAnyM( std::u32string const & tagName )
+bool isAnyM( std::u32string_view tagName )
 {
   return tagName == U"m" || is_mN( tagName );
 }
 
-bool checkM( std::u32string const & dest, std::u32string const & src )
+bool checkM( std::u32string_view dest, std::u32string_view src )
 {
   return src == U"m" && is_mN( dest );
 }
 
-/// Closing the [mN] tags is optional. Quote from https://documentation.help/ABBYY-Lingvo8/paragraph_form.htm:
-/// Any paragraph from this tag until the end of card or until system meets an «[/m]» (margin shift toggle off) tag
-struct MustTagBeClosed
-{
-  bool operator()( ArticleDom::Node const * tag ) const
-  {
-    Q_ASSERT( tag->isTag );
-    return !isAnyM( tag->tagName );
-  }
-};
-
 } // unnamed namespace
 
 ArticleDom::ArticleDom( std::u32string const & str, string const & dictName, std::u32string const & headword_ ):
-  root( Node::Tag(), std::u32string(), std::u32string() ),
   stringPos( str.c_str() ),
   lineStartPos( str.c_str() ),
   transcriptionCount( 0 ),
@@ -105,9 +201,15 @@ ArticleDom::ArticleDom( std::u32string const & str, string const & dictName, std
   dictionaryName( dictName ),
   headword( headword_ )
 {
-  list< Node * > stack; // Currently opened tags
+  // The article's own text is the most there usually is to store
+  nodes.reserve( str.size() / 8 + 1 );
+  chars.reserve( str.size() );
+
+  nodes.emplace_back().isTag = true; // The root
 
-  Node * textNode = 0; // A leaf node which currently accumulates text.
+  vector< Index > stack; // Currently opened tags
+
+  Index textNode = None; // A leaf node which currently accumulates text.
 
   try {
     for ( ;; ) {
@@ -146,48 +248,27 @@ ArticleDom::ArticleDom( std::u32string const & str, string const & dictName, std
             expandOptionalParts( linkTo, &allLinkEntries );
 
             for ( auto entry = allLinkEntries.begin(); entry != allLinkEntries.end(); ) {
-              if ( !textNode ) {
-                Node text = Node( Node::Text(), std::u32string() );
-
-                if ( stack.empty() ) {
-                  root.push_back( text );
-                  stack.push_back( &root.back() );
-                }
-                else {
-                  stack.back()->push_back( text );
-                  stack.push_back( &stack.back()->back() );
-                }
-
-                textNode = stack.back();
+              if ( textNode == None ) {
+                textNode = addText( parentOf( stack ) );
+                stack.push_back( textNode );
               }
-              textNode->text.push_back( L'-' );
-              textNode->text.push_back( L' ' );
+              appendChar( textNode, L'-' );
+              appendChar( textNode, L' ' );
 
               // Close the currently opened text node
               stack.pop_back();
-              textNode = 0;
+              textNode = None;
 
               std::u32string linkText = Folding::trimWhitespace( *entry );
               ArticleDom nodeDom( linkText, dictName, headword_ );
 
-              Node link( Node::Tag(), U"@", std::u32string() );
-              for ( auto & n : nodeDom.root ) {
-                link.push_back( n );
-              }
+              Index const parent = parentOf( stack );
+              adopt( nodeDom, nodeDom.root(), addTag( parent, U"@", {} ) );
 
               ++entry;
 
-              if ( stack.empty() ) {
-                root.push_back( link );
-                if ( entry != allLinkEntries.end() ) { // Add line break before next entry
-                  root.push_back( Node( Node::Tag(), U"br", std::u32string() ) );
-                }
-              }
-              else {
-                stack.back()->push_back( link );
-                if ( entry != allLinkEntries.end() ) {
-                  stack.back()->push_back( Node( Node::Tag(), U"br", std::u32string() ) );
-                }
+              if ( entry != allLinkEntries.end() ) { // Add line break before next entry
+                addTag( parent, U"br", {} );
               }
             }
 
@@ -261,10 +342,10 @@ ArticleDom::ArticleDom( std::u32string const & str, string const & dictName, std
 
         // Add the tag, or close it
 
-        if ( textNode ) {
+        if ( textNode != None ) {
           // Close the currently opened text node
           stack.pop_back();
-          textNode = 0;
+          textNode = None;
         }
 
         // If the tag is [t], we update the transcriptionCount
@@ -362,27 +443,17 @@ ArticleDom::ArticleDom( std::u32string const & str, string const & dictName, std
 
           // Add the corresponding node
 
-          if ( textNode ) {
+          if ( textNode != None ) {
             // Close the currently opened text node
             stack.pop_back();
-            textNode = 0;
+            textNode = None;
           }
 
           linkText = Folding::trimWhitespace( linkText );
           processUnsortedParts( linkText, true );
           ArticleDom nodeDom( linkText, dictName, headword_ );
 
-          Node link( Node::Tag(), U"ref", std::u32string() );
-          for ( auto & n : nodeDom.root ) {
-            link.push_back( n );
-          }
-
-          if ( stack.empty() ) {
-            root.push_back( link );
-          }
-          else {
-            stack.back()->push_back( link );
-          }
+          adopt( nodeDom, nodeDom.root(), addTag( parentOf( stack ), U"ref", {} ) );
 
           continue;
         }
@@ -425,19 +496,9 @@ ArticleDom::ArticleDom( std::u32string const & str, string const & dictName, std
       // If we're here, we've got a normal symbol, to be saved as text.
 
       // If there's currently no text node, open one
-      if ( !textNode ) {
-        Node text = Node( Node::Text(), std::u32string() );
-
-        if ( stack.empty() ) {
-          root.push_back( text );
-          stack.push_back( &root.back() );
-        }
-        else {
-          stack.back()->push_back( text );
-          stack.push_back( &stack.back()->back() );
-        }
-
-        textNode = stack.back();
+      if ( textNode == None ) {
+        textNode = addText( parentOf( stack ) );
+        stack.push_back( textNode );
       }
 
       // If we're inside the transcription, do old-encoding conversion
@@ -550,28 +611,28 @@ ArticleDom::ArticleDom( std::u32string const & str, string const & dictName, std
             ch = 0x153;
             break;
           case 0x405:
-            textNode->text.push_back( 0x153 );
+            appendChar( textNode, 0x153 );
             ch = 0x303;
             break;
           case 0x441:
             ch = 0x272;
             break;
           case 0x442:
-            textNode->text.push_back( 0x254 );
+            appendChar( textNode, 0x254 );
             ch = 0x303;
             break;
           case 0x443:
             ch = 0xF8;
             break;
           case 0x445:
-            textNode->text.push_back( 0x25B );
+            appendChar( textNode, 0x25B );
             ch = 0x303;
             break;
           case 0x446:
             ch = 0xE7;
             break;
           case 0x44C:
-            textNode->text.push_back( 0x251 );
+            appendChar( textNode, 0x251 );
             ch = 0x303;
             break;
           case 0x44D:
@@ -584,7 +645,7 @@ ArticleDom::ArticleDom( std::u32string const & str, string const & dictName, std
             ch = 0x3B2;
             break;
           case 0x31:
-            textNode->text.push_back( 0x65 );
+            appendChar( textNode, 0x65 );
             ch = 0x303;
             break;
           case 0x32:
@@ -623,11 +684,11 @@ ArticleDom::ArticleDom( std::u32string const & str, string const & dictName, std
             break;
           //case 0x00b1: ch = 0x0261; break;
           case 0x0402:
-            textNode->text.push_back( 0x0069 );
+            appendChar( textNode, 0x0069 );
             ch = L':';
             break;
           case 0x0403:
-            textNode->text.push_back( 0x0251 );
+            appendChar( textNode, 0x0251 );
             ch = L':';
             break;
           //case 0x040b: ch = 0x03b8; break;
@@ -636,7 +697,7 @@ ArticleDom::ArticleDom( std::u32string const & str, string const & dictName, std
             ch = 0x0061;
             break;
           case 0x0453:
-            textNode->text.push_back( 0x0075 );
+            appendChar( textNode, 0x0075 );
             ch = L':';
             break;
           case 0x201a:
@@ -646,7 +707,7 @@ ArticleDom::ArticleDom( std::u32string const & str, string const & dictName, std
             ch = 0x0259;
             break;
           case 0x2039:
-            textNode->text.push_back( 0x0064 );
+            appendChar( textNode, 0x0064 );
             ch = 0x0292;
             break;
         }
@@ -656,24 +717,32 @@ ArticleDom::ArticleDom( std::u32string const & str, string const & dictName, std
         ch = 0xA0; // Escaped spaces turn into non-breakable ones in Lingvo
       }
 
-      textNode->text.push_back( ch );
+      appendChar( textNode, ch );
     } // for( ; ; )
   }
   catch ( eot & ) {
   }
 
-  if ( textNode ) {
+  if ( textNode != None ) {
     stack.pop_back();
   }
 
   if ( !stack.empty() ) {
-    auto it = std::find_if( stack.begin(), stack.end(), MustTagBeClosed() );
+    // Closing the [mN] tags is optional. Quote from https://documentation.help/ABBYY-Lingvo8/paragraph_form.htm:
+    // Any paragraph from this tag until the end of card or until system meets an «[/m]» (margin shift toggle off) tag
+    auto const mustTagBeClosed = [ this ]( Index tag ) {
+      Q_ASSERT( nodes[ tag ].isTag );
+      return !isAnyM( tagName( nodes[ tag ] ) );
+    };
+
+    auto it = std::find_if( stack.begin(), stack.end(), mustTagBeClosed );
     if ( it == stack.end() ) {
       return; // no unclosed tags that must be closed => nothing to warn about
     }
-    QByteArray const firstTagName = QString::fromStdU32String( ( *it )->tagName ).toUtf8();
+    std::u32string_view const firstTag = tagName( nodes[ *it ] );
+    QByteArray const firstTagName      = QString::fromUcs4( firstTag.data(), firstTag.size() ).toUtf8();
     ++it;
-    unsigned const unclosedTagCount = 1 + std::count_if( it, stack.end(), MustTagBeClosed() );
+    unsigned const unclosedTagCount = 1 + std::count_if( it, stack.end(), mustTagBeClosed );
 
     if ( dictName.empty() ) {
       qWarning( "Warning: %u tag(s) were unclosed, first tag name \"%s\".",
@@ -690,69 +759,53 @@ ArticleDom::ArticleDom( std::u32string const & str, string const & dictName, std
   }
 }
 
-void ArticleDom::openTag( std::u32string const & name, std::u32string const & attrs, list< Node * > & stack )
+void ArticleDom::openTag( std::u32string const & name, std::u32string const & attrs, vector< Index > & stack )
 {
-  list< Node > nodesToReopen;
+  // The names and attributes of the reopened tags are already stored, so
+  // they're just referred to again
+  vector< std::pair< Span, Span > > nodesToReopen;
 
   if ( isAnyM( name ) ) {
     // All tags above [m] tag will be closed and reopened after
     // to avoid break this tag by closing some other tag.
 
     while ( !stack.empty() ) {
-      nodesToReopen.emplace_back( Node::Tag(), stack.back()->tagName, stack.back()->tagAttrs );
+      Node const & top = nodes[ stack.back() ];
 
-      if ( stack.back()->empty() ) {
-        // Empty nodes are deleted since they're no use
+      nodesToReopen.emplace_back( top.tagName, top.tagAttrs );
 
-        stack.pop_back();
+      bool const empty = top.firstChild == None;
 
-        Node * parent = !stack.empty() ? stack.back() : &root;
+      stack.pop_back();
 
-        parent->pop_back();
-      }
-      else {
-        stack.pop_back();
+      if ( empty ) {
+        // Empty nodes are deleted since they're no use
+        removeLastChild( parentOf( stack ) );
       }
     }
   }
 
   // Add tag
 
-  Node node( Node::Tag(), name, attrs );
-
-  if ( stack.empty() ) {
-    root.push_back( node );
-    stack.push_back( &root.back() );
-  }
-  else {
-    stack.back()->push_back( node );
-    stack.push_back( &stack.back()->back() );
-  }
+  stack.push_back( addTag( parentOf( stack ), name, attrs ) );
 
   // Reopen tags if needed
 
   while ( !nodesToReopen.empty() ) {
-    if ( stack.empty() ) {
-      root.push_back( nodesToReopen.back() );
-      stack.push_back( &root.back() );
-    }
-    else {
-      stack.back()->push_back( nodesToReopen.back() );
-      stack.push_back( &stack.back()->back() );
-    }
+    stack.push_back( addTag( parentOf( stack ), nodesToReopen.back().first, nodesToReopen.back().second ) );
 
     nodesToReopen.pop_back();
   }
 }
 
-void ArticleDom::closeTag( std::u32string const & name, list< Node * > & stack, bool warn )
+void ArticleDom::closeTag( std::u32string const & name, vector< Index > & stack, bool warn )
 {
   // Find the tag which is to be closed
 
-  list< Node * >::reverse_iterator n;
+  vector< Index >::reverse_iterator n;
 
   for ( n = stack.rbegin(); n != stack.rend(); ++n ) {
-    if ( ( *n )->tagName == name || checkM( ( *n )->tagName, name ) ) {
+    if ( tagName( nodes[ *n ] ) == name || checkM( tagName( nodes[ *n ] ), name ) ) {
       // Found it
       break;
     }
@@ -763,19 +816,16 @@ void ArticleDom::closeTag( std::u32string const & name, list< Node * > & stack,
     // then close the tag itself
 
     while ( !stack.empty() ) {
-      bool found = stack.back()->tagName == name || checkM( stack.back()->tagName, name );
+      Node const & top            = nodes[ stack.back() ];
+      std::u32string_view const t = tagName( top );
+      bool found                  = t == name || checkM( t, name );
+      bool const empty            = top.firstChild == None && t != U"br";
 
-      if ( stack.back()->empty() && stack.back()->tagName != U"br" ) {
-        // Empty nodes except [br] tag are deleted since they're no use
-
-        stack.pop_back();
-
-        Node * parent = !stack.empty() ? stack.back() : &root;
+      stack.pop_back();
 
-        parent->pop_back();
-      }
-      else {
-        stack.pop_back();
+      if ( empty ) {
+        // Empty nodes except [br] tag are deleted since they're no use
+        removeLastChild( parentOf( stack ) );
       }
 
       if ( found ) {
@@ -1037,8 +1087,8 @@ bool DslScanner::readNextLine( std::u32string & out, size_t & offset, bool only_
     if ( pos == -1 ) {
       return false;
     }
-    QString line = Iconv::toQString( getEncodingNameFor( encoding ), readBufferPtr, pos );
-    line         = Utils::rstrip( line );
+    Iconv::toWstring( encoding, readBufferPtr, pos, out );
+    Utils::rstrip( out );
 
     if ( pos > readBufferLeft ) {
       pos = readBufferLeft;
@@ -1046,10 +1096,9 @@ bool DslScanner::readNextLine( std::u32string & out, size_t & offset, bool only_
     readBufferLeft -= pos;
     readBufferPtr += pos;
     linesRead++;
-    if ( only_head_word && ( line.isEmpty() || line.at( 0 ).isSpace() ) ) {
+    if ( only_head_word && ( out.empty() || QChar::isSpace( out[ 0 ] ) ) ) {
       continue;
     }
-    out = line.toStdU32String();
     return true;
   }
 }
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <list>
 #include <vector>
 #include <zlib.h>
@@ -27,54 +28,157 @@ string findCodeForDslId( int id );
 bool isAtSignFirst( std::u32string const & str );
 
 /// Parses the DSL language, representing it in its structural DOM form.
+/// The nodes live in one array and refer to each other by their indices,
+/// while the names, attributes and texts they have are kept in one character
+/// buffer, so a parse takes a couple of allocations instead of several per node.
 struct ArticleDom
 {
-  struct Node: public list< Node >
+  using Index = uint32_t;
+
+  static constexpr Index None = ~Index( 0 );
+
+  /// A part of the character buffer
+  struct Span
+  {
+    uint32_t offset = 0;
+    uint32_t size   = 0;
+  };
+
+  struct Node
   {
     bool isTag; // true if it is a tag with subnodes, false if it's a leaf text
                 // data.
     // Those are only used if isTag is true
-    std::u32string tagName;
-    std::u32string tagAttrs;
-    std::u32string text; // This is only used if isTag is false
-
-    class Text
-    {};
-    class Tag
-    {};
-
-    Node( Tag, std::u32string const & name, std::u32string const & attrs ):
-      isTag( true ),
-      tagName( name ),
-      tagAttrs( attrs )
+    Span tagName;
+    Span tagAttrs;
+    Span text; // This is only used if isTag is false
+
+    Index firstChild  = None;
+    Index lastChild   = None;
+    Index prevSibling = None;
+    Index nextSibling = None;
+  };
+
+  /// Iterates over the children of a node
+  class ChildIterator
+  {
+    ArticleDom const * dom;
+    Index index;
+
+  public:
+
+    ChildIterator( ArticleDom const * dom_, Index index_ ):
+      dom( dom_ ),
+      index( index_ )
+    {
+    }
+
+    Node const & operator*() const
     {
+      return dom->nodes[ index ];
     }
 
-    Node( Text, std::u32string const & text_ ):
-      isTag( false ),
-      text( text_ )
+    ChildIterator & operator++()
     {
+      index = dom->nodes[ index ].nextSibling;
+      return *this;
     }
 
-    /// Concatenates all childen text nodes recursively to form all text
-    /// the node contains stripped of any markup.
-    std::u32string renderAsText( bool stripTrsTag = false ) const;
+    bool operator!=( ChildIterator const & other ) const
+    {
+      return index != other.index;
+    }
   };
 
-  /// Does the parse at construction. Refer to the 'root' member variable
-  /// afterwards.
+  struct Children
+  {
+    ArticleDom const * dom;
+    Index first;
+
+    ChildIterator begin() const
+    {
+      return { dom, first };
+    }
+
+    ChildIterator end() const
+    {
+      return { dom, None };
+    }
+  };
+
+  /// Does the parse at construction. Refer to root() afterwards.
   explicit ArticleDom( std::u32string const &,
                        string const & dictName          = string(),
                        std::u32string const & headword_ = std::u32string() );
 
   /// Root of DOM's tree
-  Node root;
+  Node const & root() const
+  {
+    return nodes.front();
+  }
+
+  Children children( Node const & node ) const
+  {
+    return { this, node.firstChild };
+  }
+
+  std::u32string_view tagName( Node const & node ) const
+  {
+    return view( node.tagName );
+  }
+
+  std::u32string_view tagAttrs( Node const & node ) const
+  {
+    return view( node.tagAttrs );
+  }
+
+  std::u32string_view text( Node const & node ) const
+  {
+    return view( node.text );
+  }
+
+  /// Concatenates all childen text nodes recursively to form all text
+  /// the node contains stripped of any markup.
+  std::u32string renderAsText( Node const &, bool stripTrsTag = false ) const;
 
 private:
 
-  void openTag( std::u32string const & name, std::u32string const & attr, list< Node * > & stack );
+  vector< Node > nodes; // The root comes first
+  std::u32string chars;
+
+  std::u32string_view view( Span span ) const
+  {
+    return { chars.data() + span.offset, span.size };
+  }
+
+  void appendText( Node const &, bool stripTrsTag, std::u32string & out ) const;
+
+  /// Returns the node the new nodes go to, which is the innermost opened one
+  static Index parentOf( vector< Index > const & stack )
+  {
+    return stack.empty() ? 0 : stack.back();
+  }
+
+  Index addNode( Index parent, Node const & );
+  Index addTag( Index parent, Span name, Span attrs );
+  Index addTag( Index parent, std::u32string_view name, std::u32string_view attrs );
+  Index addText( Index parent, std::u32string_view text = {} );
+
+  /// Only the text node added last can grow, since its text has to stay at
+  /// the end of the character buffer
+  void appendChar( Index textNode, char32_t );
+
+  Span store( std::u32string_view );
+
+  /// Drops the last child of the given node, which must have no children
+  void removeLastChild( Index parent );
+
+  /// Copies the children of the given node of another dom under our node
+  void adopt( ArticleDom const & other, Node const & from, Index to );
+
+  void openTag( std::u32string const & name, std::u32string const & attr, vector< Index > & stack );
 
-  void closeTag( std::u32string const & name, list< Node * > & stack, bool warn = true );
+  void closeTag( std::u32string const & name, vector< Index > & stack, bool warn = true );
 
   bool atSignFirstInLine();
 
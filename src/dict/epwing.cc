@@ -7,7 +7,7 @@
   #include "epwing.hh"
   #include <QByteArray>
   #include <map>
-  #include <QtConcurrentRun>
+  #include "scheduler.hh"
   #include <set>
   #include <string>
   #include "btreeidx.hh"
@@ -142,6 +142,12 @@ public:
 
   sptr< Dictionary::WordSearchRequest > prefixMatch( u32string const &, unsigned long ) override;
 
+  /// The prefix search also looks into the book itself
+  bool isPrefixMatchIndexOnly() const override
+  {
+    return false;
+  }
+
   sptr< Dictionary::WordSearchRequest >
   stemmedMatch( u32string const &, unsigned minLength, unsigned maxSuffixVariation, unsigned long maxResults ) override;
 
@@ -450,7 +456,6 @@ class EpwingHeadwordsRequest: public Dictionary::WordSearchRequest
   EpwingDictionary & dict;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -458,9 +463,6 @@ public:
     str( word_ ),
     dict( dict_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -469,12 +471,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~EpwingHeadwordsRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 
@@ -532,8 +528,11 @@ void EpwingHeadwordsRequest::run()
 }
 sptr< Dictionary::WordSearchRequest > EpwingDictionary::findHeadwordsForSynonym( u32string const & word )
 {
-  return synonymSearchEnabled ? std::make_shared< EpwingHeadwordsRequest >( word, *this ) :
-                                Class::findHeadwordsForSynonym( word );
+  if ( !synonymSearchEnabled ) {
+    return Class::findHeadwordsForSynonym( word );
+  }
+
+  return Dictionary::runRequest< EpwingHeadwordsRequest >( Scheduler::Priority::Lookup, this, word, *this );
 }
 /// EpwingDictionary::getArticle()
 
@@ -545,7 +544,6 @@ class EpwingArticleRequest: public Dictionary::DataRequest
   bool ignoreDiacritics;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -558,9 +556,6 @@ public:
     dict( dict_ ),
     ignoreDiacritics( ignoreDiacritics_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -574,12 +569,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~EpwingArticleRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void EpwingArticleRequest::run()
@@ -770,7 +759,12 @@ sptr< Dictionary::DataRequest > EpwingDictionary::getArticle( u32string const &
                                                               bool ignoreDiacritics )
 
 {
-  return std::make_shared< EpwingArticleRequest >( word, alts, *this, ignoreDiacritics );
+  return Dictionary::runRequest< EpwingArticleRequest >( Scheduler::Priority::Lookup,
+                                                         this,
+                                                         word,
+                                                         alts,
+                                                         *this,
+                                                         ignoreDiacritics );
 }
 
 //// EpwingDictionary::getResource()
@@ -782,7 +776,6 @@ class EpwingResourceRequest: public Dictionary::DataRequest
   string resourceName;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -790,9 +783,6 @@ public:
     dict( dict_ ),
     resourceName( resourceName_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -801,12 +791,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~EpwingResourceRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void EpwingResourceRequest::run()
@@ -863,7 +847,7 @@ void EpwingResourceRequest::run()
 sptr< Dictionary::DataRequest > EpwingDictionary::getResource( string const & name )
 
 {
-  return std::make_shared< EpwingResourceRequest >( *this, name );
+  return Dictionary::runRequest< EpwingResourceRequest >( Scheduler::Priority::Resource, this, *this, name );
 }
 
 
@@ -872,11 +856,13 @@ sptr< Dictionary::DataRequest > EpwingDictionary::getSearchResults( QString cons
                                                                     bool matchCase,
                                                                     bool ignoreDiacritics )
 {
-  return std::make_shared< FtsHelpers::FTSResultsRequest >( *this,
-                                                            searchString,
-                                                            searchMode,
-                                                            matchCase,
-                                                            ignoreDiacritics );
+  return Dictionary::runRequest< FtsHelpers::FTSResultsRequest >( Scheduler::Priority::Lookup,
+                                                                  this,
+                                                                  *this,
+                                                                  searchString,
+                                                                  searchMode,
+                                                                  matchCase,
+                                                                  ignoreDiacritics );
 }
 
 int EpwingDictionary::japaneseWriting( char32_t ch )
@@ -931,12 +917,9 @@ public:
                            int maxSuffixVariation_,
                            bool allowMiddleMatches_,
                            unsigned long maxResults_ ):
-    BtreeWordSearchRequest( dict_, str_, minLength_, maxSuffixVariation_, allowMiddleMatches_, maxResults_, false ),
+    BtreeWordSearchRequest( dict_, str_, minLength_, maxSuffixVariation_, allowMiddleMatches_, maxResults_ ),
     edict( dict_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void findMatches() override;
@@ -976,7 +959,14 @@ void EpwingWordSearchRequest::findMatches()
 sptr< Dictionary::WordSearchRequest > EpwingDictionary::prefixMatch( u32string const & str, unsigned long maxResults )
 
 {
-  return std::make_shared< EpwingWordSearchRequest >( *this, str, 0, -1, true, maxResults );
+  return Dictionary::runRequest< EpwingWordSearchRequest >( Scheduler::Priority::Lookup,
+                                                            this,
+                                                            *this,
+                                                            str,
+                                                            0,
+                                                            -1,
+                                                            true,
+                                                            maxResults );
 }
 
 sptr< Dictionary::WordSearchRequest > EpwingDictionary::stemmedMatch( u32string const & str,
@@ -985,12 +975,14 @@ sptr< Dictionary::WordSearchRequest > EpwingDictionary::stemmedMatch( u32string
                                                                       unsigned long maxResults )
 
 {
-  return std::make_shared< EpwingWordSearchRequest >( *this,
-                                                      str,
-                                                      minLength,
-                                                      (int)maxSuffixVariation,
-                                                      false,
-                                                      maxResults );
+  return Dictionary::runRequest< EpwingWordSearchRequest >( Scheduler::Priority::Lookup,
+                                                            this,
+                                                            *this,
+                                                            str,
+                                                            minLength,
+                                                            (int)maxSuffixVariation,
+                                                            false,
+                                                            maxResults );
 }
 bool Epwing::EpwingDictionary::readHeadword( const EB_Position & pos, QString & headword )
 {
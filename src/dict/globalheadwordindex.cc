@@ -0,0 +1,640 @@
+/* Licensed under GPLv3 or later, see the LICENSE file */
+
+#include "globalheadwordindex.hh"
+#include "btreeidx.hh"
+#include "folding.hh"
+#include "text.hh"
+#include "utils.hh"
+#include "scheduler.hh"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFileInfo>
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <unordered_set>
+
+using HeadwordArray = GlobalHeadwordIndex::HeadwordArray;
+
+namespace {
+
+enum : uint32_t {
+  BlockSize = 16,         // Entries per front-coded block
+  Dropped   = 0xFFFFFFFF, // Marks the dictionaries no longer indexed
+};
+
+void putNumber( std::string & out, size_t value )
+{
+  while ( value >= 0x80 ) {
+    out.push_back( char( value | 0x80 ) );
+    value >>= 7;
+  }
+
+  out.push_back( char( value ) );
+}
+
+size_t getNumber( char const *& ptr )
+{
+  size_t value = 0;
+
+  for ( unsigned shift = 0;; shift += 7 ) {
+    auto const byte = static_cast< unsigned char >( *ptr++ );
+
+    value |= size_t( byte & 0x7F ) << shift;
+
+    if ( !( byte & 0x80 ) ) {
+      return value;
+    }
+  }
+}
+
+/// Folds the word the same way the btree search does
+std::string foldForIndex( std::u32string const & word )
+{
+  std::u32string folded = Folding::apply( word );
+
+  if ( folded.empty() ) {
+    folded = Folding::applyWhitespaceOnly( word );
+  }
+
+  return Text::toUtf8( folded );
+}
+
+/// Dictionary ids only depend on the file names, so something is needed to
+/// notice the dictionaries which were rebuilt with other contents. The counts
+/// may well stay the same, so the root of the btree and the index file, which
+/// is rewritten on every rebuild, are taken into account too.
+uint64_t fingerprintOf( BtreeIndexing::BtreeDictionary & dict )
+{
+  QCryptographicHash hash( QCryptographicHash::Md5 );
+
+  quint64 const counts[] = { quint64( dict.getWordCount() ),
+                             quint64( dict.getArticleCount() ),
+                             quint64( dict.getRootOffset() ) };
+  hash.addData( QByteArrayView( reinterpret_cast< char const * >( counts ), sizeof( counts ) ) );
+
+  // The index file is the one the full-text index is named after
+  std::string indexFile    = dict.ftsIndexName();
+  std::string const suffix = Dictionary::getFtsSuffix();
+
+  if ( indexFile.size() > suffix.size()
+       && indexFile.compare( indexFile.size() - suffix.size(), suffix.size(), suffix ) == 0 ) {
+    indexFile.resize( indexFile.size() - suffix.size() );
+
+    QFileInfo const info( QString::fromStdString( indexFile ) );
+    qint64 const stamp[] = { info.size(), info.lastModified().toMSecsSinceEpoch() };
+    hash.addData( QByteArrayView( reinterpret_cast< char const * >( stamp ), sizeof( stamp ) ) );
+  }
+
+  uint64_t fingerprint;
+  memcpy( &fingerprint, hash.result().constData(), sizeof( fingerprint ) );
+
+  return fingerprint;
+}
+
+} // namespace
+
+class GlobalHeadwordIndex::HeadwordArray::Builder
+{
+public:
+
+  explicit Builder( HeadwordArray & array_ ):
+    array( array_ )
+  {
+  }
+
+  void add( std::string_view key, std::vector< Posting > const & postings )
+  {
+    size_t shared = 0;
+
+    if ( array.entryCount % BlockSize == 0 ) {
+      array.blocks.push_back( array.data.size() );
+    }
+    else {
+      size_t const limit = std::min( key.size(), lastKey.size() );
+
+      while ( shared < limit && key[ shared ] == lastKey[ shared ] ) {
+        ++shared;
+      }
+    }
+
+    putNumber( array.data, shared );
+    putNumber( array.data, key.size() - shared );
+    array.data.append( key.substr( shared ) );
+
+    putNumber( array.data, postings.size() );
+
+    for ( auto const & posting : postings ) {
+      putNumber( array.data, posting.dictionary );
+      putNumber( array.data, posting.spelling.size() );
+      array.data.append( posting.spelling );
+    }
+
+    lastKey.assign( key );
+    ++array.entryCount;
+  }
+
+private:
+
+  HeadwordArray & array;
+  std::string lastKey;
+};
+
+class GlobalHeadwordIndex::HeadwordArray::Cursor
+{
+public:
+
+  explicit Cursor( HeadwordArray const & array, size_t block = 0 ):
+    ptr( array.data.data() + ( block < array.blocks.size() ? array.blocks[ block ] : array.data.size() ) ),
+    end( array.data.data() + array.data.size() )
+  {
+  }
+
+  /// Decodes the next entry into key and postings. Returns false if there
+  /// are no more entries.
+  bool next()
+  {
+    if ( ptr >= end ) {
+      return false;
+    }
+
+    size_t const shared = getNumber( ptr );
+    size_t const suffix = getNumber( ptr );
+
+    key.resize( shared );
+    key.append( ptr, suffix );
+    ptr += suffix;
+
+    postings.resize( getNumber( ptr ) );
+
+    for ( auto & posting : postings ) {
+      posting.dictionary  = getNumber( ptr );
+      size_t const length = getNumber( ptr );
+      posting.spelling    = std::string_view( ptr, length );
+      ptr += length;
+    }
+
+    return true;
+  }
+
+  std::string key;
+  std::vector< Posting > postings; // Point into the array's data
+
+private:
+
+  char const * ptr;
+  char const * end;
+};
+
+std::string_view GlobalHeadwordIndex::HeadwordArray::blockHead( size_t block ) const
+{
+  char const * ptr = data.data() + blocks[ block ];
+
+  getNumber( ptr ); // Nothing is shared at the beginning of a block
+  size_t const length = getNumber( ptr );
+
+  return { ptr, length };
+}
+
+size_t GlobalHeadwordIndex::HeadwordArray::findBlock( std::string_view key ) const
+{
+  // Find the first block whose head is greater than the key, the key can
+  // only be in the one before it
+  size_t first = 0, count = blocks.size();
+
+  while ( count ) {
+    size_t const step = count / 2;
+
+    if ( blockHead( first + step ) <= key ) {
+      first += step + 1;
+      count -= step + 1;
+    }
+    else {
+      count = step;
+    }
+  }
+
+  return first ? first - 1 : 0;
+}
+
+/// Scans the range of the headwords beginning with the word
+class GlobalHeadwordIndexRequest: public Dictionary::WordSearchRequest
+{
+  std::shared_ptr< GlobalHeadwordIndex::Snapshot const > snapshot;
+  std::u32string word;
+  std::vector< uint32_t > dictionaries;
+  unsigned long maxResults;
+
+  QAtomicInt isCancelled;
+
+public:
+
+  GlobalHeadwordIndexRequest( std::shared_ptr< GlobalHeadwordIndex::Snapshot const > snapshot_,
+                              std::u32string const & word_,
+                              std::vector< uint32_t > dictionaries_,
+                              unsigned long maxResults_ ):
+    snapshot( std::move( snapshot_ ) ),
+    word( word_ ),
+    dictionaries( std::move( dictionaries_ ) ),
+    maxResults( maxResults_ )
+  {
+  }
+
+  void run();
+
+  void cancel() override
+  {
+    isCancelled.ref();
+  }
+};
+
+void GlobalHeadwordIndexRequest::run()
+{
+  if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
+    finish();
+    return;
+  }
+
+  std::string const prefix = foldForIndex( word );
+  HeadwordArray const & headwords = snapshot->headwords;
+
+  // Like the btree search does, each dictionary gives up to maxResults matches
+  std::vector< bool > wanted( snapshot->dictionaries.size() );
+  std::vector< unsigned long > found( snapshot->dictionaries.size() );
+
+  for ( uint32_t dictionary : dictionaries ) {
+    wanted[ dictionary ] = true;
+  }
+
+  size_t unsaturated = dictionaries.size();
+
+  std::unordered_set< std::string_view > spellings;
+  std::vector< Dictionary::WordMatch > results;
+
+  HeadwordArray::Cursor cursor( headwords, headwords.findBlock( prefix ) );
+
+  for ( size_t scanned = 0; unsaturated && cursor.next(); ++scanned ) {
+    if ( ( scanned & 1023 ) == 0 && Utils::AtomicInt::loadAcquire( isCancelled ) ) {
+      break;
+    }
+
+    if ( cursor.key < prefix ) {
+      continue; // Still in the block's part preceding the range
+    }
+
+    if ( cursor.key.compare( 0, prefix.size(), prefix ) != 0 ) {
+      break; // Past the range
+    }
+
+    for ( auto const & posting : cursor.postings ) {
+      if ( !wanted[ posting.dictionary ] || found[ posting.dictionary ] >= maxResults ) {
+        continue;
+      }
+
+      if ( ++found[ posting.dictionary ] == maxResults ) {
+        --unsaturated;
+      }
+
+      if ( spellings.insert( posting.spelling ).second ) {
+        results.emplace_back( Text::toUtf32( std::string( posting.spelling ) ) );
+      }
+    }
+  }
+
+  {
+    QMutexLocker _( &dataMutex );
+    matches = std::move( results );
+  }
+
+  finish();
+}
+
+bool GlobalHeadwordIndex::Snapshot::covers( std::string const & dictionaryId ) const
+{
+  return dictionaryIndices.find( dictionaryId ) != dictionaryIndices.end();
+}
+
+sptr< Dictionary::WordSearchRequest >
+GlobalHeadwordIndex::Snapshot::prefixMatch( std::u32string const & word,
+                                            std::vector< std::string > const & dictionaryIds,
+                                            unsigned long maxResults ) const
+{
+  std::vector< uint32_t > indices;
+
+  for ( auto const & id : dictionaryIds ) {
+    auto const i = dictionaryIndices.find( id );
+
+    if ( i != dictionaryIndices.end() ) {
+      indices.push_back( i->second );
+    }
+  }
+
+  std::sort( indices.begin(), indices.end() );
+  indices.erase( std::unique( indices.begin(), indices.end() ), indices.end() );
+
+  return Dictionary::runRequest< GlobalHeadwordIndexRequest >( Scheduler::Priority::Lookup,
+                                                               nullptr,
+                                                               shared_from_this(),
+                                                               word,
+                                                               std::move( indices ),
+                                                               maxResults );
+}
+
+namespace {
+
+/// Collects all the headwords of the dictionary into a segment, posted under
+/// the given dictionary index
+bool indexDictionary( BtreeIndexing::BtreeDictionary & dict,
+                      uint32_t index,
+                      HeadwordArray & segment,
+                      QAtomicInt & isCancelled )
+{
+  if ( Utils::AtomicInt::loadAcquire( isCancelled ) || !dict.ensureInitDone().empty() ) {
+    return false;
+  }
+
+  std::vector< std::pair< std::string, std::string > > entries; // Folded key and spelling
+
+  try {
+    dict.forEachChain( [ & ]( std::vector< BtreeIndexing::WordArticleLink > const & chain ) {
+      if ( !chain.empty() ) {
+        // All the links of a chain share the key
+        std::string const key = foldForIndex( Text::toUtf32( chain[ 0 ].word ) );
+
+        for ( auto const & link : chain ) {
+          entries.emplace_back( key, link.prefix + link.word );
+        }
+      }
+
+      return !Utils::AtomicInt::loadAcquire( isCancelled );
+    } );
+  }
+  catch ( std::exception & e ) {
+    qWarning( "Can't add \"%s\" to the global headword index: %s", dict.getName().c_str(), e.what() );
+    return false;
+  }
+
+  // The sort takes a while for the big dictionaries, and can't be interrupted
+  if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
+    return false;
+  }
+
+  std::sort( entries.begin(), entries.end() );
+  entries.erase( std::unique( entries.begin(), entries.end() ), entries.end() );
+
+  HeadwordArray::Builder builder( segment );
+  std::vector< HeadwordArray::Posting > postings;
+
+  for ( size_t x = 0; x < entries.size(); ) {
+    postings.clear();
+
+    size_t y = x;
+
+    for ( ; y < entries.size() && entries[ y ].first == entries[ x ].first; ++y ) {
+      postings.push_back( { index, entries[ y ].second } );
+    }
+
+    builder.add( entries[ x ].first, postings );
+    x = y;
+  }
+
+  return true;
+}
+
+} // namespace
+
+GlobalHeadwordIndex::GlobalHeadwordIndex():
+  current( std::make_shared< Snapshot >() )
+{
+}
+
+GlobalHeadwordIndex::~GlobalHeadwordIndex()
+{
+  stop();
+
+  // They use the index, and this is only destroyed on exit
+  for ( auto & update : updates ) {
+    update.waitForFinished();
+  }
+}
+
+GlobalHeadwordIndex & GlobalHeadwordIndex::instance()
+{
+  static GlobalHeadwordIndex index;
+  return index;
+}
+
+void GlobalHeadwordIndex::update( std::vector< sptr< Dictionary::Class > > const & dictionaries )
+{
+  stop();
+
+  // Held, as the updates stopped aren't waited for, and the dictionaries
+  // mustn't be reloaded while one of them still reads them
+  auto const held =
+    Dictionary::holdForWorker( std::make_shared< std::vector< sptr< Dictionary::Class > > const >( dictionaries ) );
+
+  QMutexLocker _( &mutex );
+
+  auto const cancelled   = std::make_shared< QAtomicInt >( 0 );
+  updateCancelled        = cancelled;
+  uint64_t const started = generation;
+
+  // The updates stopped earlier may still be finishing
+  updates.removeIf( []( QFuture< void > const & update ) {
+    return update.isFinished();
+  } );
+
+  updates.append(
+    Scheduler::run( Scheduler::Priority::Background, [ this, held, cancelled, started, previous = current ]() {
+      try {
+        auto next = build( previous, *held, *cancelled );
+
+        QMutexLocker _( &mutex );
+
+        // A stopped update may only notice it after it's done
+        if ( next && generation == started ) {
+          current = std::move( next );
+        }
+      }
+      catch ( std::exception & e ) {
+        qWarning( "Global headword index update failed: %s", e.what() );
+      }
+    } ) );
+}
+
+void GlobalHeadwordIndex::stop()
+{
+  QMutexLocker _( &mutex );
+
+  ++generation;
+
+  if ( updateCancelled ) {
+    updateCancelled->storeRelease( 1 );
+    updateCancelled.reset();
+  }
+}
+
+void GlobalHeadwordIndex::clear()
+{
+  stop();
+
+  QMutexLocker _( &mutex );
+  current = std::make_shared< Snapshot >();
+}
+
+std::shared_ptr< GlobalHeadwordIndex::Snapshot const > GlobalHeadwordIndex::snapshot() const
+{
+  QMutexLocker _( &mutex );
+  return current;
+}
+
+bool GlobalHeadwordIndex::canMatch( std::u32string const & word )
+{
+  return word.find_first_of( U"*?[]" ) == std::u32string::npos;
+}
+
+std::shared_ptr< GlobalHeadwordIndex::Snapshot const >
+GlobalHeadwordIndex::build( std::shared_ptr< Snapshot const > previous,
+                            std::vector< sptr< Dictionary::Class > > const & dictionaries,
+                            QAtomicInt & isCancelled )
+{
+  auto next = std::make_shared< Snapshot >();
+
+  // Where each of the previous snapshot's dictionaries goes in the new one
+  std::vector< uint32_t > kept( previous->dictionaries.size(), Dropped );
+  std::vector< std::pair< uint32_t, BtreeIndexing::BtreeDictionary * > > added;
+
+  for ( auto const & dict : dictionaries ) {
+    auto * btreeDict = dynamic_cast< BtreeIndexing::BtreeDictionary * >( dict.get() );
+
+    if ( !btreeDict || !btreeDict->isPrefixMatchIndexOnly() || next->covers( dict->getId() ) ) {
+      continue;
+    }
+
+    uint32_t const index         = next->dictionaries.size();
+    uint64_t const fingerprint   = fingerprintOf( *btreeDict );
+    auto const previouslyIndexed = previous->dictionaryIndices.find( dict->getId() );
+
+    if ( previouslyIndexed != previous->dictionaryIndices.end()
+         && previous->dictionaries[ previouslyIndexed->second ].fingerprint == fingerprint ) {
+      kept[ previouslyIndexed->second ] = index;
+    }
+    else {
+      added.emplace_back( index, btreeDict );
+    }
+
+    next->dictionaries.push_back( { dict->getId(), fingerprint } );
+    next->dictionaryIndices.emplace( dict->getId(), index );
+  }
+
+  bool unchanged = added.empty() && next->dictionaries.size() == previous->dictionaries.size();
+
+  for ( uint32_t x = 0; unchanged && x < kept.size(); ++x ) {
+    unchanged = kept[ x ] == x;
+  }
+
+  if ( unchanged ) {
+    return {};
+  }
+
+  // Walk the btrees of the new dictionaries
+
+  std::vector< HeadwordArray > segments;
+
+  for ( auto const & [ index, btreeDict ] : added ) {
+    Scheduler::yieldToInteractive();
+
+    if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
+      return {};
+    }
+
+    HeadwordArray segment;
+
+    if ( indexDictionary( *btreeDict, index, segment, isCancelled ) ) {
+      segments.push_back( std::move( segment ) );
+    }
+    else {
+      // Keep its slot so that the indices stay the same, but don't claim to cover it
+      next->dictionaryIndices.erase( next->dictionaries[ index ].id );
+    }
+  }
+
+  // Merge the new segments with what's kept of the previous snapshot
+
+  struct Source
+  {
+    HeadwordArray::Cursor cursor;
+    std::vector< uint32_t > const * remap; // Only needed for the previous snapshot
+  };
+
+  std::vector< Source > sources;
+  sources.reserve( segments.size() + 1 );
+  sources.push_back( { HeadwordArray::Cursor( previous->headwords ), &kept } );
+
+  for ( auto const & segment : segments ) {
+    sources.push_back( { HeadwordArray::Cursor( segment ), nullptr } );
+  }
+
+  auto const later = [ &sources ]( size_t a, size_t b ) {
+    return sources[ a ].cursor.key > sources[ b ].cursor.key;
+  };
+
+  std::priority_queue< size_t, std::vector< size_t >, decltype( later ) > queue( later );
+
+  for ( size_t x = 0; x < sources.size(); ++x ) {
+    if ( sources[ x ].cursor.next() ) {
+      queue.push( x );
+    }
+  }
+
+  HeadwordArray::Builder builder( next->headwords );
+  std::string key;
+  std::vector< HeadwordArray::Posting > postings;
+  std::vector< size_t > advanced;
+
+  for ( size_t merged = 0; !queue.empty(); ++merged ) {
+    if ( ( merged & 0xFFFF ) == 0 && Utils::AtomicInt::loadAcquire( isCancelled ) ) {
+      return {};
+    }
+
+    key = sources[ queue.top() ].cursor.key;
+    postings.clear();
+    advanced.clear();
+
+    while ( !queue.empty() && sources[ queue.top() ].cursor.key == key ) {
+      Source const & source = sources[ queue.top() ];
+
+      for ( auto const & posting : source.cursor.postings ) {
+        uint32_t const dictionary = source.remap ? ( *source.remap )[ posting.dictionary ] : posting.dictionary;
+
+        if ( dictionary != Dropped ) {
+          postings.push_back( { dictionary, posting.spelling } );
+        }
+      }
+
+      advanced.push_back( queue.top() );
+      queue.pop();
+    }
+
+    if ( !postings.empty() ) {
+      std::sort( postings.begin(), postings.end(), []( auto const & a, auto const & b ) {
+        return a.dictionary < b.dictionary || ( a.dictionary == b.dictionary && a.spelling < b.spelling );
+      } );
+
+      builder.add( key, postings );
+    }
+
+    for ( size_t source : advanced ) {
+      if ( sources[ source ].cursor.next() ) {
+        queue.push( source );
+      }
+    }
+  }
+
+  qDebug( "Global headword index: %zu headwords of %zu dictionaries in %zu KiB",
+          next->headwords.size(),
+          next->dictionaryIndices.size(),
+          next->headwords.bytes() / 1024 );
+
+  return next;
+}
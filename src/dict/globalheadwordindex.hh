@@ -0,0 +1,149 @@
+/* Licensed under GPLv3 or later, see the LICENSE file */
+
+#pragma once
+
+#include "dictionary.hh"
+#include <QAtomicInt>
+#include <QFuture>
+#include <QList>
+#include <QMutex>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// An optional in-memory index of the headwords of all the local dictionaries.
+/// It maps each folded headword to the dictionaries having it along with its
+/// unfolded spellings, so that a prefix search in any number of dictionaries
+/// is one range scan instead of a btree walk per dictionary. The btrees are
+/// still used for everything else, e.g. fetching the articles.
+/// The index is built from the dictionaries' btrees in the background, and is
+/// updated incrementally: only the dictionaries which are new or have changed
+/// get their btrees walked again.
+class GlobalHeadwordIndex
+{
+public:
+
+  /// The headwords, sorted by their folded utf8 form and front-coded in blocks.
+  /// Only the first key of each block is stored in full, which is enough to
+  /// binary search the blocks.
+  class HeadwordArray
+  {
+  public:
+
+    struct Posting
+    {
+      uint32_t dictionary; // Index into Snapshot's dictionary list
+      std::string_view spelling;
+    };
+
+    /// Appends entries, which must come in strictly increasing key order
+    class Builder;
+
+    /// Iterates over the entries, starting from a block boundary
+    class Cursor;
+
+    size_t size() const
+    {
+      return entryCount;
+    }
+
+    size_t bytes() const
+    {
+      return data.size() + blocks.size() * sizeof( size_t );
+    }
+
+    /// Returns the index of the block where the given key is, or would be
+    size_t findBlock( std::string_view key ) const;
+
+  private:
+
+    std::string data;
+    std::vector< size_t > blocks;
+    size_t entryCount = 0;
+
+    std::string_view blockHead( size_t block ) const;
+  };
+
+  /// The index as it was at some point. Searches keep using the snapshot they
+  /// started with, even if the index gets rebuilt meanwhile.
+  class Snapshot: public std::enable_shared_from_this< Snapshot >
+  {
+  public:
+
+    /// Returns true if the index has all the headwords of the given dictionary
+    bool covers( std::string const & dictionaryId ) const;
+
+    /// Searches for the words starting with the given one in the dictionaries
+    /// given, all of which must be covered. Like Dictionary::Class::prefixMatch()
+    /// does, returns up to maxResults matches per dictionary, including the
+    /// middle matches of phrases.
+    sptr< Dictionary::WordSearchRequest > prefixMatch( std::u32string const & word,
+                                                       std::vector< std::string > const & dictionaryIds,
+                                                       unsigned long maxResults ) const;
+
+  private:
+
+    friend class GlobalHeadwordIndex;
+    friend class GlobalHeadwordIndexRequest;
+
+    struct IndexedDictionary
+    {
+      std::string id;
+      uint64_t fingerprint; // Tells whether it changed since it was indexed
+    };
+
+    std::vector< IndexedDictionary > dictionaries;
+    std::unordered_map< std::string, uint32_t > dictionaryIndices;
+    HeadwordArray headwords;
+  };
+
+  static GlobalHeadwordIndex & instance();
+
+  ~GlobalHeadwordIndex();
+
+  /// Starts updating the index in the background to cover exactly the given
+  /// dictionaries. An update already underway gets cancelled.
+  void update( std::vector< sptr< Dictionary::Class > > const & );
+
+  /// Cancels the update underway, if any. Doesn't wait for it to exit: it
+  /// won't change the index anymore, and the dictionaries it reads are held
+  /// through Dictionary::holdForWorker() until it does.
+  void stop();
+
+  /// Stops any update and drops the index
+  void clear();
+
+  /// Returns the current state of the index, never nullptr
+  std::shared_ptr< Snapshot const > snapshot() const;
+
+  /// Wildcard patterns can't be served from the index, they need the
+  /// per-dictionary search
+  static bool canMatch( std::u32string const & word );
+
+private:
+
+  GlobalHeadwordIndex();
+
+  mutable QMutex mutex;
+  std::shared_ptr< Snapshot const > current;
+
+  /// The cancel flag of the update underway. Guarded by mutex, as is the below.
+  std::shared_ptr< QAtomicInt > updateCancelled;
+
+  /// Bumped by each stop(), so that an update stopped can't publish its snapshot
+  uint64_t generation = 0;
+
+  /// The updates started. Only the last one may be underway, the others may
+  /// still be finishing after being stopped.
+  QList< QFuture< void > > updates;
+
+  /// Builds a snapshot covering the given dictionaries out of the previous one.
+  /// Returns nullptr if cancelled, or if there's nothing to change.
+  std::shared_ptr< Snapshot const > build( std::shared_ptr< Snapshot const > previous,
+                                           std::vector< sptr< Dictionary::Class > > const &,
+                                           QAtomicInt & isCancelled );
+
+  Q_DISABLE_COPY_MOVE( GlobalHeadwordIndex )
+};
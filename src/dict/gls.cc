@@ -14,6 +14,7 @@
 #include "dictzip.hh"
 #include "indexedzip.hh"
 #include "ftshelpers.hh"
+#include "scheduler.hh"
 #include "htmlescape.hh"
 #include "filetype.hh"
 #include "tiff.hh"
@@ -255,9 +256,8 @@ bool GlsScanner::readNextLine( std::u32string & out, size_t & offset )
       return false;
     }
 
-    QString line = Iconv::toQString( Text::getEncodingNameFor( encoding ), readBufferPtr, pos );
-
-    line = Utils::rstrip( line );
+    Iconv::toWstring( encoding, readBufferPtr, pos, out );
+    Utils::rstrip( out );
 
     if ( pos > readBufferLeft ) {
       pos = readBufferLeft;
@@ -266,7 +266,6 @@ bool GlsScanner::readNextLine( std::u32string & out, size_t & offset )
     readBufferPtr += pos;
     linesRead++;
 
-    out = line.toStdU32String();
     return true;
   }
 }
@@ -580,8 +579,9 @@ void GlsDictionary::loadArticleText( uint32_t address, vector< string > & headwo
     articleText = string( "\n\tDICTZIP error: " ) + dict_error_str( dz );
   }
   else {
-    string articleData =
-      Iconv::toUtf8( Text::getEncodingNameFor( Encoding( idxHeader.glsEncoding ) ), articleBody, articleSize );
+    std::u32string decoded;
+    Iconv::toWstring( Encoding( idxHeader.glsEncoding ), articleBody, articleSize, decoded );
+    string articleData = Text::toUtf8( decoded );
     string::size_type start_pos = 0, end_pos = 0;
 
     for ( ;; ) {
@@ -797,7 +797,6 @@ class GlsHeadwordsRequest: public Dictionary::WordSearchRequest
   GlsDictionary & dict;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -805,9 +804,6 @@ public:
     word( word_ ),
     dict( dict_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -816,12 +812,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~GlsHeadwordsRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void GlsHeadwordsRequest::run()
@@ -868,8 +858,11 @@ void GlsHeadwordsRequest::run()
 sptr< Dictionary::WordSearchRequest > GlsDictionary::findHeadwordsForSynonym( std::u32string const & word )
 
 {
-  return synonymSearchEnabled ? std::make_shared< GlsHeadwordsRequest >( word, *this ) :
-                                Class::findHeadwordsForSynonym( word );
+  if ( !synonymSearchEnabled ) {
+    return Class::findHeadwordsForSynonym( word );
+  }
+
+  return Dictionary::runRequest< GlsHeadwordsRequest >( Scheduler::Priority::Lookup, this, word, *this );
 }
 
 
@@ -884,7 +877,6 @@ class GlsArticleRequest: public Dictionary::DataRequest
   bool ignoreDiacritics;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -897,9 +889,6 @@ public:
     dict( dict_ ),
     ignoreDiacritics( ignoreDiacritics_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -908,12 +897,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~GlsArticleRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void GlsArticleRequest::run()
@@ -1014,7 +997,16 @@ sptr< Dictionary::DataRequest > GlsDictionary::getArticle( std::u32string const
                                                            bool ignoreDiacritics )
 
 {
-  return std::make_shared< GlsArticleRequest >( word, alts, *this, ignoreDiacritics );
+  if ( !mayContainAny( word, alts ) ) {
+    return std::make_shared< Dictionary::DataRequestInstant >( false ); // No such word
+  }
+
+  return Dictionary::runRequest< GlsArticleRequest >( Scheduler::Priority::Lookup,
+                                                      this,
+                                                      word,
+                                                      alts,
+                                                      *this,
+                                                      ignoreDiacritics );
 }
 
 //////////////// GlsDictionary::getResource()
@@ -1027,7 +1019,6 @@ class GlsResourceRequest: public Dictionary::DataRequest
   string resourceName;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -1035,9 +1026,6 @@ public:
     dict( dict_ ),
     resourceName( resourceName_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -1046,12 +1034,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~GlsResourceRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void GlsResourceRequest::run()
@@ -1163,7 +1145,7 @@ void GlsResourceRequest::run()
 sptr< Dictionary::DataRequest > GlsDictionary::getResource( string const & name )
 
 {
-  return std::make_shared< GlsResourceRequest >( *this, name );
+  return Dictionary::runRequest< GlsResourceRequest >( Scheduler::Priority::Resource, this, *this, name );
 }
 
 sptr< Dictionary::DataRequest > GlsDictionary::getSearchResults( QString const & searchString,
@@ -1172,11 +1154,13 @@ sptr< Dictionary::DataRequest > GlsDictionary::getSearchResults( QString const &
 
                                                                  bool ignoreDiacritics )
 {
-  return std::make_shared< FtsHelpers::FTSResultsRequest >( *this,
-                                                            searchString,
-                                                            searchMode,
-                                                            matchCase,
-                                                            ignoreDiacritics );
+  return Dictionary::runRequest< FtsHelpers::FTSResultsRequest >( Scheduler::Priority::Lookup,
+                                                                  this,
+                                                                  *this,
+                                                                  searchString,
+                                                                  searchMode,
+                                                                  matchCase,
+                                                                  ignoreDiacritics );
 }
 
 } // anonymous namespace
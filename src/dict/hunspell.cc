@@ -14,7 +14,10 @@
 #include <QFileInfo>
 #include <set>
 #include "utils.hh"
-#include <QtConcurrentRun>
+#include "scheduler.hh"
+#include <QCache>
+#include <QMutex>
+#include <memory>
 #include <hunspell/hunspell.hxx>
 
 namespace HunspellMorpho {
@@ -24,9 +27,48 @@ using namespace Dictionary;
 
 namespace {
 
+/// The Hunspell instance of one dictionary, plus the memoized results of the
+/// lookups done with it, so repeated lookups skip hunspell entirely.
+class HunspellChecker
+{
+public:
+
+  HunspellChecker( string const & affFile, string const & dicFile );
+
+  /// Returns true if the word is spelled correctly.
+  bool spell( std::u32string const & word );
+
+  /// Returns the spelling suggestions for the word.
+  vector< std::u32string > suggestSpelling( std::u32string const & word );
+
+  /// Returns the stems of the word found by the morphological analysis.
+  QList< std::u32string > stems( std::u32string const & word );
+
+private:
+
+  // We used to have a separate mutex for each Hunspell instance, assuming
+  // that its code was reentrant (though probably not thread-safe). However,
+  // crashes were discovered later when using several Hunspell dictionaries
+  // simultaneously, and we've switched to have a single mutex for all hunspell
+  // calls - evidently it's not really reentrant.
+  static QMutex & getHunspellMutex()
+  {
+    static QMutex mutex;
+    return mutex;
+  }
+
+  std::unique_ptr< Hunspell > hunspell;
+
+  // Memoized results, keyed by the word looked up
+  QMutex cacheMutex;
+  QCache< QString, bool > spellCache;
+  QCache< QString, vector< std::u32string > > suggestionCache;
+  QCache< QString, QList< std::u32string > > stemCache;
+};
+
 class HunspellDictionary: public Dictionary::Class
 {
-  Hunspell hunspell;
+  HunspellChecker hunspell;
 
 #ifdef Q_OS_WIN32
   static string Utf8ToLocal8Bit( string const & name )
@@ -41,9 +83,9 @@ public:
   HunspellDictionary( string const & id, string const & name_, vector< string > const & files ):
     Dictionary::Class( id, files ),
 #ifdef Q_OS_WIN32
-    hunspell( Utf8ToLocal8Bit( files[ 0 ] ).c_str(), Utf8ToLocal8Bit( files[ 1 ] ).c_str() )
+    hunspell( Utf8ToLocal8Bit( files[ 0 ] ), Utf8ToLocal8Bit( files[ 1 ] ) )
 #else
-    hunspell( files[ 0 ].c_str(), files[ 1 ].c_str() )
+    hunspell( files[ 0 ], files[ 1 ] )
 #endif
   {
     dictionaryName = name_;
@@ -76,34 +118,16 @@ public:
 protected:
 
   void loadIcon() noexcept override;
-
-private:
-
-  // We used to have a separate mutex for each Hunspell instance, assuming
-  // that its code was reentrant (though probably not thread-safe). However,
-  // crashes were discovered later when using several Hunspell dictionaries
-  // simultaneously, and we've switched to have a single mutex for all hunspell
-  // calls - evidently it's not really reentrant.
-  static QMutex & getHunspellMutex()
-  {
-    static QMutex mutex;
-    return mutex;
-  }
-  //  QMutex hunspellMutex;
 };
 
 /// Decodes the given string returned by the hunspell object. May throw
 /// Iconv::Ex
 std::u32string decodeFromHunspell( Hunspell &, char const * );
 
-/// Generates suggestions via hunspell
-QList< std::u32string > suggest( std::u32string & word, QMutex & hunspellMutex, Hunspell & hunspell );
-
 /// Generates suggestions for compound expression
 void getSuggestionsForExpression( std::u32string const & expression,
                                   vector< std::u32string > & suggestions,
-                                  QMutex & hunspellMutex,
-                                  Hunspell & hunspell );
+                                  HunspellChecker & hunspell );
 
 /// Returns true if the string contains whitespace, false otherwise
 bool containsWhitespace( std::u32string const & str )
@@ -119,6 +143,124 @@ bool containsWhitespace( std::u32string const & str )
   return false;
 }
 
+/// HunspellChecker
+
+HunspellChecker::HunspellChecker( string const & affFile, string const & dicFile ):
+  spellCache( 4096 ),
+  suggestionCache( 1024 ),
+  stemCache( 4096 )
+{
+  QMutexLocker _( &getHunspellMutex() );
+  hunspell = std::make_unique< Hunspell >( affFile.c_str(), dicFile.c_str() );
+}
+
+bool HunspellChecker::spell( std::u32string const & word )
+{
+  QString const key = QString::fromStdU32String( word );
+
+  {
+    QMutexLocker _( &cacheMutex );
+    if ( bool const * cached = spellCache.object( key ) ) {
+      return *cached;
+    }
+  }
+
+  bool result;
+  {
+    QMutexLocker _( &getHunspellMutex() );
+    result = hunspell->spell( Iconv::toUtf8( Text::utf32_le, word ) );
+  }
+
+  QMutexLocker _( &cacheMutex );
+  spellCache.insert( key, new bool( result ) );
+
+  return result;
+}
+
+vector< std::u32string > HunspellChecker::suggestSpelling( std::u32string const & word )
+{
+  QString const key = QString::fromStdU32String( word );
+
+  {
+    QMutexLocker _( &cacheMutex );
+    if ( auto const * cached = suggestionCache.object( key ) ) {
+      return *cached;
+    }
+  }
+
+  vector< std::u32string > result;
+  {
+    QMutexLocker _( &getHunspellMutex() );
+
+    for ( auto const & suggestion : hunspell->suggest( Iconv::toUtf8( Text::utf32_le, word ) ) ) {
+      result.push_back( decodeFromHunspell( *hunspell, suggestion.c_str() ) );
+    }
+  }
+
+  QMutexLocker _( &cacheMutex );
+  suggestionCache.insert( key, new vector< std::u32string >( result ) );
+
+  return result;
+}
+
+QList< std::u32string > HunspellChecker::stems( std::u32string const & word )
+{
+  QString const key = QString::fromStdU32String( word );
+
+  {
+    QMutexLocker _( &cacheMutex );
+    if ( auto const * cached = stemCache.object( key ) ) {
+      return *cached;
+    }
+  }
+
+  QList< std::u32string > result;
+
+  try {
+    QMutexLocker _( &getHunspellMutex() );
+
+    auto suggestions = hunspell->analyze( Iconv::toUtf8( Text::utf32_le, word ) );
+    if ( !suggestions.empty() ) {
+      // There were some suggestions made for us. Make an appropriate output.
+
+      std::u32string lowercasedWord = Folding::applySimpleCaseOnly( word );
+
+      static QRegularExpression cutStem( R"(^\s*st:(((\s+(?!\w{2}:)(?!-)(?!\+))|\S+)+))" );
+
+      for ( const auto & x : suggestions ) {
+        QString suggestion = QString::fromStdU32String( decodeFromHunspell( *hunspell, x.c_str() ) );
+
+        // Strip comments
+        int n = suggestion.indexOf( '#' );
+        if ( n >= 0 ) {
+          suggestion.chop( suggestion.length() - n );
+        }
+
+        qDebug( ">>>Sugg: %s", suggestion.toLocal8Bit().data() );
+
+        auto match = cutStem.match( suggestion.trimmed() );
+        if ( match.hasMatch() ) {
+          std::u32string alt = match.captured( 1 ).toStdU32String();
+
+          if ( Folding::applySimpleCaseOnly( alt ) != lowercasedWord ) // No point in providing same word
+          {
+            result.append( alt );
+          }
+        }
+      }
+    }
+  }
+  catch ( Iconv::Ex & e ) {
+    qWarning( "Hunspell: charset conversion error, no processing's done: %s", e.what() );
+    return result;
+  }
+
+  QMutexLocker _( &cacheMutex );
+  stemCache.insert( key, new QList< std::u32string >( result ) );
+
+  return result;
+}
+
 void HunspellDictionary::loadIcon() noexcept
 {
   if ( dictionaryIconLoaded ) {
@@ -140,7 +282,12 @@ vector< std::u32string > HunspellDictionary::getAlternateWritings( std::u32strin
   vector< std::u32string > results;
 
   if ( containsWhitespace( word ) ) {
-    getSuggestionsForExpression( word, results, getHunspellMutex(), hunspell );
+    try {
+      getSuggestionsForExpression( word, results, hunspell );
+    }
+    catch ( std::exception & e ) {
+      qWarning( "Hunspell: error: %s", e.what() );
+    }
   }
 
   return results;
@@ -151,23 +298,17 @@ vector< std::u32string > HunspellDictionary::getAlternateWritings( std::u32strin
 class HunspellArticleRequest: public Dictionary::DataRequest
 {
 
-  QMutex & hunspellMutex;
-  Hunspell & hunspell;
+  HunspellChecker & hunspell;
   std::u32string word;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
-  HunspellArticleRequest( std::u32string const & word_, QMutex & hunspellMutex_, Hunspell & hunspell_ ):
-    hunspellMutex( hunspellMutex_ ),
+  HunspellArticleRequest( std::u32string const & word_, HunspellChecker & hunspell_ ):
     hunspell( hunspell_ ),
     word( word_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -176,12 +317,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~HunspellArticleRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void HunspellArticleRequest::run()
@@ -191,8 +326,6 @@ void HunspellArticleRequest::run()
     return;
   }
 
-  vector< string > suggestions;
-
   try {
     std::u32string trimmedWord = Folding::trimWhitespaceOrPunct( word );
 
@@ -202,17 +335,13 @@ void HunspellArticleRequest::run()
       return;
     }
 
-    QMutexLocker _( &hunspellMutex );
-
-    string trimmedWord_utf8 = Iconv::toUtf8( Text::utf32_le, trimmedWord );
-
-    if ( hunspell.spell( trimmedWord_utf8 ) ) {
+    if ( hunspell.spell( trimmedWord ) ) {
       // Good word -- no spelling suggestions then.
       finish();
       return;
     }
 
-    suggestions = hunspell.suggest( trimmedWord_utf8 );
+    vector< std::u32string > suggestions = hunspell.suggestSpelling( trimmedWord );
     if ( !suggestions.empty() ) {
       // There were some suggestions made for us. Make an appropriate output.
 
@@ -221,8 +350,8 @@ void HunspellArticleRequest::run()
 
       std::u32string lowercasedWord = Folding::applySimpleCaseOnly( word );
 
-      for ( vector< string >::size_type x = 0; x < suggestions.size(); ++x ) {
-        std::u32string suggestion = decodeFromHunspell( hunspell, suggestions[ x ].c_str() );
+      for ( vector< std::u32string >::size_type x = 0; x < suggestions.size(); ++x ) {
+        std::u32string const & suggestion = suggestions[ x ];
 
         if ( Folding::applySimpleCaseOnly( suggestion ) == lowercasedWord ) {
           // If among suggestions we see the same word just with the different
@@ -267,7 +396,7 @@ sptr< DataRequest > HunspellDictionary::getArticle( std::u32string const & word,
                                                     bool )
 
 {
-  return std::make_shared< HunspellArticleRequest >( word, getHunspellMutex(), hunspell );
+  return Dictionary::runRequest< HunspellArticleRequest >( Scheduler::Priority::Lookup, this, word, hunspell );
 }
 
 /// HunspellDictionary::findHeadwordsForSynonym()
@@ -275,24 +404,18 @@ sptr< DataRequest > HunspellDictionary::getArticle( std::u32string const & word,
 class HunspellHeadwordsRequest: public Dictionary::WordSearchRequest
 {
 
-  QMutex & hunspellMutex;
-  Hunspell & hunspell;
+  HunspellChecker & hunspell;
   std::u32string word;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 
 public:
 
-  HunspellHeadwordsRequest( std::u32string const & word_, QMutex & hunspellMutex_, Hunspell & hunspell_ ):
-    hunspellMutex( hunspellMutex_ ),
+  HunspellHeadwordsRequest( std::u32string const & word_, HunspellChecker & hunspell_ ):
     hunspell( hunspell_ ),
     word( word_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -301,12 +424,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~HunspellHeadwordsRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 
@@ -326,81 +443,40 @@ void HunspellHeadwordsRequest::run()
     return;
   }
 
-  if ( containsWhitespace( trimmedWord ) ) {
-    vector< std::u32string > results;
-
-    getSuggestionsForExpression( trimmedWord, results, hunspellMutex, hunspell );
+  try {
+    if ( containsWhitespace( trimmedWord ) ) {
+      vector< std::u32string > results;
 
-    QMutexLocker _( &dataMutex );
-    for ( const auto & result : results ) {
-      matches.push_back( result );
-    }
-  }
-  else {
-    QList< std::u32string > suggestions = suggest( trimmedWord, hunspellMutex, hunspell );
+      getSuggestionsForExpression( trimmedWord, results, hunspell );
 
-    if ( !suggestions.empty() ) {
       QMutexLocker _( &dataMutex );
-
-      for ( const auto & suggestion : std::as_const( suggestions ) ) {
-        matches.push_back( suggestion );
+      for ( const auto & result : results ) {
+        matches.push_back( result );
       }
     }
-  }
-
-  finish();
-}
-
-QList< std::u32string > suggest( std::u32string & word, QMutex & hunspellMutex, Hunspell & hunspell )
-{
-  QList< std::u32string > result;
-
-  try {
-    QMutexLocker _( &hunspellMutex );
-
-    auto suggestions = hunspell.analyze( Iconv::toUtf8( Text::utf32_le, word ) );
-    if ( !suggestions.empty() ) {
-      // There were some suggestions made for us. Make an appropriate output.
-
-      std::u32string lowercasedWord = Folding::applySimpleCaseOnly( word );
-
-      static QRegularExpression cutStem( R"(^\s*st:(((\s+(?!\w{2}:)(?!-)(?!\+))|\S+)+))" );
-
-      for ( const auto & x : suggestions ) {
-        QString suggestion = QString::fromStdU32String( decodeFromHunspell( hunspell, x.c_str() ) );
-
-        // Strip comments
-        int n = suggestion.indexOf( '#' );
-        if ( n >= 0 ) {
-          suggestion.chop( suggestion.length() - n );
-        }
-
-        qDebug( ">>>Sugg: %s", suggestion.toLocal8Bit().data() );
+    else {
+      QList< std::u32string > suggestions = hunspell.stems( trimmedWord );
 
-        auto match = cutStem.match( suggestion.trimmed() );
-        if ( match.hasMatch() ) {
-          std::u32string alt = match.captured( 1 ).toStdU32String();
+      if ( !suggestions.empty() ) {
+        QMutexLocker _( &dataMutex );
 
-          if ( Folding::applySimpleCaseOnly( alt ) != lowercasedWord ) // No point in providing same word
-          {
-            result.append( alt );
-          }
+        for ( const auto & suggestion : std::as_const( suggestions ) ) {
+          matches.push_back( suggestion );
         }
       }
     }
   }
-  catch ( Iconv::Ex & e ) {
-    qWarning( "Hunspell: charset conversion error, no processing's done: %s", e.what() );
+  catch ( std::exception & e ) {
+    qWarning( "Hunspell: error: %s", e.what() );
   }
 
-  return result;
+  finish();
 }
 
-
 sptr< WordSearchRequest > HunspellDictionary::findHeadwordsForSynonym( std::u32string const & word )
 
 {
-  return std::make_shared< HunspellHeadwordsRequest >( word, getHunspellMutex(), hunspell );
+  return Dictionary::runRequest< HunspellHeadwordsRequest >( Scheduler::Priority::Lookup, this, word, hunspell );
 }
 
 
@@ -409,23 +485,17 @@ sptr< WordSearchRequest > HunspellDictionary::findHeadwordsForSynonym( std::u32s
 class HunspellPrefixMatchRequest: public Dictionary::WordSearchRequest
 {
 
-  QMutex & hunspellMutex;
-  Hunspell & hunspell;
+  HunspellChecker & hunspell;
   std::u32string word;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
-  HunspellPrefixMatchRequest( std::u32string const & word_, QMutex & hunspellMutex_, Hunspell & hunspell_ ):
-    hunspellMutex( hunspellMutex_ ),
+  HunspellPrefixMatchRequest( std::u32string const & word_, HunspellChecker & hunspell_ ):
     hunspell( hunspell_ ),
     word( word_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -434,12 +504,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~HunspellPrefixMatchRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 
@@ -459,9 +523,7 @@ void HunspellPrefixMatchRequest::run()
       return;
     }
 
-    QMutexLocker _( &hunspellMutex );
-
-    if ( hunspell.spell( Iconv::toUtf8( Text::utf32_le, trimmedWord ) ) ) {
+    if ( hunspell.spell( trimmedWord ) ) {
       // Known word -- add it to the result
 
       QMutexLocker _( &dataMutex );
@@ -472,6 +534,9 @@ void HunspellPrefixMatchRequest::run()
   catch ( Iconv::Ex & e ) {
     qWarning( "Hunspell: charset conversion error, no processing's done: %s", e.what() );
   }
+  catch ( std::exception & e ) {
+    qWarning( "Hunspell: error: %s", e.what() );
+  }
 
   finish();
 }
@@ -479,13 +544,12 @@ void HunspellPrefixMatchRequest::run()
 sptr< WordSearchRequest > HunspellDictionary::prefixMatch( std::u32string const & word, unsigned long /*maxResults*/ )
 
 {
-  return std::make_shared< HunspellPrefixMatchRequest >( word, getHunspellMutex(), hunspell );
+  return Dictionary::runRequest< HunspellPrefixMatchRequest >( Scheduler::Priority::Lookup, this, word, hunspell );
 }
 
 void getSuggestionsForExpression( std::u32string const & expression,
                                   vector< std::u32string > & suggestions,
-                                  QMutex & hunspellMutex,
-                                  Hunspell & hunspell )
+                                  HunspellChecker & hunspell )
 {
   // Analyze each word separately and use the first two suggestions, if any.
   // This is useful for compound expressions where some words is
@@ -540,7 +604,7 @@ void getSuggestionsForExpression( std::u32string const & expression,
       }
     }
     else {
-      QList< std::u32string > sugg = suggest( word, hunspellMutex, hunspell );
+      QList< std::u32string > sugg = hunspell.stems( word );
       int suggNum                  = sugg.size() + 1;
       if ( suggNum > 3 ) {
         suggNum = 3;
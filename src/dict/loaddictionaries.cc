@@ -91,6 +91,11 @@ LoadDictionaries::LoadDictionaries( Config::Class const & cfg ):
 
 void LoadDictionaries::run()
 {
+  // No index may be rebuilt while the old dictionaries are still being read.
+  // Their workers are cancelled already, and the GUI thread releases them
+  // meanwhile, as it runs its event loop.
+  Dictionary::waitForDetachedWorkers();
+
   try {
     for ( const auto & path : paths ) {
       qDebug() << "handle path:" << path.path;
@@ -211,6 +216,10 @@ void loadDictionaries( QWidget * parent,
 {
   dictionaries.clear();
 
+  // The old dictionaries go away as soon as the requests still reading them
+  // notice the cancellation. The loading thread waits for that, not this one.
+  Dictionary::cancelRequestWorkers();
+
   ::Initializing init( parent );
 
   // Start a thread to load all the dictionaries
@@ -22,14 +22,13 @@
 #include "globalregex.hh"
 #include "tiff.hh"
 #include "utils.hh"
+#include "scheduler.hh"
 #include <QAtomicInt>
 #include <QCryptographicHash>
 #include <QDir>
 #include <QRegularExpression>
 #include <QString>
 #include <QStringBuilder>
-#include <QThreadPool>
-#include <QtConcurrentRun>
 
 namespace Mdx {
 
@@ -337,11 +336,9 @@ void MdxDictionary::deferredInit()
     }
 
     if ( !deferredInitRunnableStarted ) {
-      QThreadPool::globalInstance()->start(
-        [ this ]() {
-          this->doDeferredInit();
-        },
-        -1000 );
+      Scheduler::run( Scheduler::Priority::Background, [ this ]() {
+        this->doDeferredInit();
+      } );
       deferredInitRunnableStarted = true;
     }
   }
@@ -478,11 +475,13 @@ sptr< Dictionary::DataRequest > MdxDictionary::getSearchResults( QString const &
 
                                                                  bool ignoreDiacritics )
 {
-  return std::make_shared< FtsHelpers::FTSResultsRequest >( *this,
-                                                            searchString,
-                                                            searchMode,
-                                                            matchCase,
-                                                            ignoreDiacritics );
+  return Dictionary::runRequest< FtsHelpers::FTSResultsRequest >( Scheduler::Priority::Lookup,
+                                                                  this,
+                                                                  *this,
+                                                                  searchString,
+                                                                  searchMode,
+                                                                  matchCase,
+                                                                  ignoreDiacritics );
 }
 
 /// MdxDictionary::getArticle
@@ -495,7 +494,6 @@ class MdxArticleRequest: public Dictionary::DataRequest
   bool ignoreDiacritics;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -508,9 +506,6 @@ public:
     dict( dict_ ),
     ignoreDiacritics( ignoreDiacritics_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -519,12 +514,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~MdxArticleRequest() override
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 
@@ -632,7 +621,16 @@ sptr< Dictionary::DataRequest > MdxDictionary::getArticle( const std::u32string
                                                            const std::u32string &,
                                                            bool ignoreDiacritics )
 {
-  return std::make_shared< MdxArticleRequest >( word, alts, *this, ignoreDiacritics );
+  if ( !mayContainAny( word, alts ) ) {
+    return std::make_shared< Dictionary::DataRequestInstant >( false ); // No such word
+  }
+
+  return Dictionary::runRequest< MdxArticleRequest >( Scheduler::Priority::Lookup,
+                                                      this,
+                                                      word,
+                                                      alts,
+                                                      *this,
+                                                      ignoreDiacritics );
 }
 
 /// MdxDictionary::getResource
@@ -641,7 +639,6 @@ class MddResourceRequest: public Dictionary::DataRequest
   MdxDictionary & dict;
   std::u32string resourceName;
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -649,9 +646,6 @@ public:
     dict( dict_ ),
     resourceName( Text::toUtf32( resourceName_ ) )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   QByteArray isolate_css();
@@ -661,12 +655,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~MddResourceRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 QByteArray MddResourceRequest::isolate_css()
@@ -786,7 +774,7 @@ void MddResourceRequest::run()
 
 sptr< Dictionary::DataRequest > MdxDictionary::getResource( const string & name )
 {
-  return std::make_shared< MddResourceRequest >( *this, name );
+  return Dictionary::runRequest< MddResourceRequest >( Scheduler::Priority::Resource, this, *this, name );
 }
 
 const QString & MdxDictionary::getDescription()
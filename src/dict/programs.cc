@@ -9,6 +9,7 @@
 #include "utils.hh"
 #include "globalbroadcaster.hh"
 
+#include <QDateTime>
 #include <QDir>
 #include <QFileInfo>
 
@@ -18,9 +19,24 @@ using namespace Dictionary;
 
 namespace {
 
+/// How long a program server has to answer a word
+int const ServerTimeoutMs = 10000;
+
+/// A program server exiting sooner than this after being started is assumed
+/// to be unable to run at all
+int const QuickExitMs = 2000;
+
+/// How many times in a row a program server may exit right after being
+/// started before it's no longer restarted
+int const MaxQuickExits = 3;
+
+/// How much of a program server's standard error is kept for the errors
+int const KeptErrorsSize = 4096;
+
 class ProgramsDictionary: public Dictionary::Class
 {
   Config::Program prg;
+  sptr< ProgramServer > server; // If the program is run as a server
 
 public:
 
@@ -28,6 +44,10 @@ public:
     Dictionary::Class( prg_.id.toStdString(), vector< string >() ),
     prg( prg_ )
   {
+    // Audio is played from the article view, one run per click
+    if ( prg.server && prg.type != Config::Program::Audio ) {
+      server = std::make_shared< ProgramServer >( prg );
+    }
   }
 
   string getName() noexcept override
@@ -59,7 +79,7 @@ sptr< WordSearchRequest > ProgramsDictionary::prefixMatch( std::u32string const
 
 {
   if ( prg.type == Config::Program::PrefixMatch ) {
-    return std::make_shared< ProgramWordSearchRequest >( QString::fromStdU32String( word ), prg );
+    return std::make_shared< ProgramWordSearchRequest >( QString::fromStdU32String( word ), prg, server );
   }
   else {
     sptr< WordSearchRequestInstant > sr = std::make_shared< WordSearchRequestInstant >();
@@ -105,7 +125,7 @@ sptr< Dictionary::DataRequest > ProgramsDictionary::getArticle( std::u32string c
 
     case Config::Program::Html:
     case Config::Program::PlainText:
-      return std::make_shared< ProgramDataRequest >( QString::fromStdU32String( word ), prg );
+      return std::make_shared< ProgramDataRequest >( QString::fromStdU32String( word ), prg, server );
 
     default:
       return std::make_shared< DataRequestInstant >( false );
@@ -176,6 +196,13 @@ bool RunInstance::start( Config::Program const & prg, QString const & word, QStr
   }
 }
 
+void RunInstance::start( ProgramServer & server, QString const & word )
+{
+  server.query( word, this, [ this ]( QByteArray output, QString error ) {
+    emit finished( output, error );
+  } );
+}
+
 void RunInstance::handleProcessFinished()
 {
   // It seems that sometimes the process isn't finished yet despite being
@@ -204,13 +231,263 @@ void RunInstance::handleProcessFinished()
   emit finished( output, error );
 }
 
-ProgramDataRequest::ProgramDataRequest( QString const & word, Config::Program const & prg_ ):
-  prg( prg_ )
+ProgramServer::ProgramServer( Config::Program const & prg_ ):
+  prg( prg_ ),
+  process( new QProcess( this ) ),
+  timeoutTimer( this )
+{
+  timeoutTimer.setInterval( 1000 );
+
+  connect( &timeoutTimer, &QTimer::timeout, this, &ProgramServer::checkTimeouts );
+  connect( process, &QProcess::readyReadStandardOutput, this, &ProgramServer::readOutput );
+  connect( process, &QProcess::readyReadStandardError, this, &ProgramServer::readErrors );
+  connect( process, &QProcess::finished, this, &ProgramServer::processGone );
+  connect( process, &QProcess::errorOccurred, this, [ this ]( QProcess::ProcessError error ) {
+    // The other errors are followed by finished(), if they end the process
+    if ( error == QProcess::FailedToStart ) {
+      processGone();
+    }
+  } );
+}
+
+ProgramServer::~ProgramServer()
+{
+  if ( process->state() == QProcess::NotRunning ) {
+    return;
+  }
+
+  disconnect( process, nullptr, this, nullptr );
+
+  // Not waited for: the process outlives the server until it's reaped, and
+  // then deletes itself
+  process->setParent( nullptr );
+  connect( process, &QProcess::finished, process, &QObject::deleteLater );
+  process->kill();
+}
+
+void ProgramServer::query( QString const & word, QObject * context, Callback callback )
+{
+  qint64 const now = QDateTime::currentMSecsSinceEpoch();
+  Pending request{ context, std::move( callback ), now + ServerTimeoutMs };
+
+  QString error;
+
+  if ( !ensureStarted( error ) ) {
+    deliver( request, {}, error );
+    return;
+  }
+
+  if ( process->state() == QProcess::NotRunning ) {
+    // Failed to start right away
+    deliver( request, {}, tr( "The program couldn't be started: %1" ).arg( process->errorString() ) );
+    return;
+  }
+
+  quint64 const id = nextId++;
+
+  QByteArray line = word.toUtf8();
+  line.replace( '\n', ' ' ).replace( '\r', ' ' );
+
+  // Written once it has started, if it's still starting
+  process->write( QByteArray::number( id ) + ' ' + line + '\n' );
+
+  pending.emplace( id, std::move( request ) );
+
+  if ( !timeoutTimer.isActive() ) {
+    timeoutTimer.start();
+  }
+}
+
+bool ProgramServer::ensureStarted( QString & error )
+{
+  if ( process->state() != QProcess::NotRunning ) {
+    return true;
+  }
+
+  if ( quickExits >= MaxQuickExits ) {
+    error = tr( "The program keeps exiting right after being started." );
+    if ( !errors.isEmpty() ) {
+      error += "\n\n" + QString::fromUtf8( errors );
+    }
+    return false;
+  }
+
+  QStringList args = QProcess::splitCommand( prg.commandLine );
+
+  if ( args.empty() ) {
+    error = tr( "No program name was given." );
+    return false;
+  }
+
+  QString const programName = args.takeFirst();
+
+  output.clear();
+  errors.clear();
+  started = lastOutput = QDateTime::currentMSecsSinceEpoch();
+
+  process->start( programName, args );
+
+  return true;
+}
+
+void ProgramServer::readOutput()
+{
+  output += process->readAllStandardOutput();
+  lastOutput = QDateTime::currentMSecsSinceEpoch();
+
+  for ( ;; ) {
+    qsizetype const headerEnd = output.indexOf( '\n' );
+
+    if ( headerEnd < 0 ) {
+      return;
+    }
+
+    QList< QByteArray > const header = output.left( headerEnd ).simplified().split( ' ' );
+
+    bool idOk = false, lengthOk = false;
+    quint64 const id    = header.size() == 2 ? header[ 0 ].toULongLong( &idOk ) : 0;
+    qint64 const length = header.size() == 2 ? header[ 1 ].toLongLong( &lengthOk ) : 0;
+
+    if ( !idOk || !lengthOk || length < 0 ) {
+      qWarning( "Program \"%s\" gave a malformed answer header: %s",
+                prg.name.toUtf8().data(),
+                output.left( qMin( headerEnd, qsizetype( 80 ) ) ).data() );
+
+      // There's no telling where the next answer starts, so start it anew
+      output.clear();
+      failAll( tr( "The program gave a malformed answer." ) );
+      process->kill();
+      return;
+    }
+
+    if ( output.size() - headerEnd - 1 < length ) {
+      return; // The rest is yet to come
+    }
+
+    QByteArray const answer = output.mid( headerEnd + 1, length );
+    output.remove( 0, headerEnd + 1 + length );
+
+    quickExits = 0;
+
+    if ( auto i = pending.find( id ); i != pending.end() ) {
+      deliver( i->second, answer, {} );
+      pending.erase( i );
+    }
+    // Otherwise it has timed out already
+  }
+}
+
+void ProgramServer::readErrors()
+{
+  errors += process->readAllStandardError();
+
+  if ( errors.size() > KeptErrorsSize ) {
+    errors = errors.right( KeptErrorsSize );
+  }
+}
+
+void ProgramServer::processGone()
+{
+  timeoutTimer.stop();
+
+  QString error;
+
+  if ( process->error() == QProcess::FailedToStart ) {
+    error = tr( "The program couldn't be started: %1" ).arg( process->errorString() );
+  }
+  else if ( process->exitStatus() != QProcess::NormalExit ) {
+    error = tr( "The program has crashed." );
+  }
+  else {
+    error = tr( "The program has returned exit code %1." ).arg( process->exitCode() );
+  }
+
+  readErrors();
+
+  if ( !errors.isEmpty() ) {
+    error += "\n\n" + QString::fromUtf8( errors );
+  }
+
+  if ( QDateTime::currentMSecsSinceEpoch() - started < QuickExitMs ) {
+    ++quickExits;
+  }
+  else {
+    quickExits = 0;
+  }
+
+  qWarning( "Program \"%s\" has stopped, it will be restarted on the next request: %s",
+            prg.name.toUtf8().data(),
+            error.toUtf8().data() );
+
+  failAll( error );
+}
+
+void ProgramServer::checkTimeouts()
+{
+  qint64 const now = QDateTime::currentMSecsSinceEpoch();
+  bool stuck       = false;
+
+  for ( auto i = pending.begin(); i != pending.end(); ) {
+    if ( i->second.deadline > now ) {
+      ++i;
+      continue;
+    }
+
+    deliver( i->second, {}, tr( "The program didn't answer in time." ) );
+    i = pending.erase( i );
+
+    // It's only slow if it answers the others
+    stuck = stuck || now - lastOutput >= ServerTimeoutMs;
+  }
+
+  if ( pending.empty() ) {
+    timeoutTimer.stop();
+  }
+
+  if ( stuck ) {
+    qWarning( "Program \"%s\" doesn't answer, restarting it", prg.name.toUtf8().data() );
+    process->kill();
+  }
+}
+
+void ProgramServer::deliver( Pending const & request, QByteArray const & answer, QString const & error )
+{
+  if ( !request.context ) {
+    return;
+  }
+
+  // Never from within query(), and the context may go away in the meantime
+  QMetaObject::invokeMethod(
+    request.context.data(),
+    [ callback = request.callback, answer, error ]() {
+      callback( answer, error );
+    },
+    Qt::QueuedConnection );
+}
+
+void ProgramServer::failAll( QString const & error )
+{
+  auto const failed = std::move( pending );
+  pending.clear();
+
+  for ( auto const & [ id, request ] : failed ) {
+    deliver( request, {}, error );
+  }
+}
+
+ProgramDataRequest::ProgramDataRequest( QString const & word,
+                                        Config::Program const & prg_,
+                                        sptr< ProgramServer > const & server_ ):
+  prg( prg_ ),
+  server( server_ )
 {
   connect( &instance, &RunInstance::finished, this, &ProgramDataRequest::instanceFinished );
 
   QString error;
-  if ( !instance.start( prg, word, error ) ) {
+  if ( server ) {
+    instance.start( *server, word );
+  }
+  else if ( !instance.start( prg, word, error ) ) {
     setErrorString( error );
     finish();
   }
@@ -311,13 +588,19 @@ void ProgramDataRequest::cancel()
   finish();
 }
 
-ProgramWordSearchRequest::ProgramWordSearchRequest( QString const & word, Config::Program const & prg_ ):
-  prg( prg_ )
+ProgramWordSearchRequest::ProgramWordSearchRequest( QString const & word,
+                                                    Config::Program const & prg_,
+                                                    sptr< ProgramServer > const & server_ ):
+  prg( prg_ ),
+  server( server_ )
 {
   connect( &instance, &RunInstance::finished, this, &ProgramWordSearchRequest::instanceFinished );
 
   QString error;
-  if ( !instance.start( prg, word, error ) ) {
+  if ( server ) {
+    instance.start( *server, word );
+  }
+  else if ( !instance.start( prg, word, error ) ) {
     setErrorString( error );
     finish();
   }
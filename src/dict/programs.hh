@@ -3,7 +3,11 @@
 
 #pragma once
 
+#include <QPointer>
 #include <QProcess>
+#include <QTimer>
+#include <functional>
+#include <map>
 #include "dictionary.hh"
 #include "config.hh"
 #include "text.hh"
@@ -16,6 +20,8 @@ using std::string;
 
 vector< sptr< Dictionary::Class > > makeDictionaries( Config::Programs const & );
 
+class ProgramServer;
+
 class RunInstance: public QObject
 {
   Q_OBJECT
@@ -30,6 +36,10 @@ public:
   // description is saved to 'error'.
   bool start( Config::Program const &, QString const & word, QString & error );
 
+  // Sends the word to the program server instead. The finished() signal is
+  // emitted once it answers.
+  void start( ProgramServer &, QString const & word );
+
 signals:
   // Connect to this signal to get run results
   void finished( QByteArray output, QString error );
@@ -42,15 +52,77 @@ private slots:
   void handleProcessFinished();
 };
 
+/// A program which is kept running and answers the words one after another,
+/// so it doesn't have to start, and e.g. load its data, for each of them.
+/// Each request is written to its standard input as a line of
+/// "<id> <word>", and each answer is read from its standard output as a line
+/// of "<id> <length>" followed by that many bytes of output. The answers may
+/// come in any order. The program is started on the first request, and again
+/// after it exits or crashes.
+class ProgramServer: public QObject
+{
+  Q_OBJECT
+
+public:
+
+  /// Gets the output, or the description of what went wrong
+  using Callback = std::function< void( QByteArray output, QString error ) >;
+
+  explicit ProgramServer( Config::Program const & );
+
+  ~ProgramServer() override;
+
+  /// Sends the word to the program. The callback is called once it answers,
+  /// fails or doesn't answer in time, unless the context is gone by then.
+  void query( QString const & word, QObject * context, Callback );
+
+private:
+
+  struct Pending
+  {
+    QPointer< QObject > context;
+    Callback callback;
+    qint64 deadline; // In the msecs since epoch
+  };
+
+  Config::Program prg;
+  QProcess * process; // Owned, but left to finish on its own when the server is gone
+  QTimer timeoutTimer;
+  std::map< quint64, Pending > pending;
+  quint64 nextId = 1;
+  QByteArray output; // Read, but not yet answered
+  QByteArray errors; // The end of what it wrote to its standard error
+  qint64 started    = 0; // When it was last started, in the msecs since epoch
+  qint64 lastOutput = 0; // When it last wrote something, likewise
+  int quickExits    = 0; // How many times in a row it exited soon after being started
+
+  bool ensureStarted( QString & error );
+
+  void readOutput();
+
+  void readErrors();
+
+  void processGone();
+
+  void checkTimeouts();
+
+  /// Calls the callback of the request, from the event loop
+  void deliver( Pending const &, QByteArray const & answer, QString const & error );
+
+  /// Fails all the pending requests with the given error
+  void failAll( QString const & error );
+};
+
 class ProgramDataRequest: public Dictionary::DataRequest
 {
   Q_OBJECT
   Config::Program prg;
   RunInstance instance;
+  sptr< ProgramServer > server;
 
 public:
 
-  ProgramDataRequest( QString const & word, Config::Program const & );
+  ProgramDataRequest( QString const & word, Config::Program const &, sptr< ProgramServer > const & server = {} );
 
   virtual void cancel();
 
@@ -64,10 +136,13 @@ class ProgramWordSearchRequest: public Dictionary::WordSearchRequest
   Q_OBJECT
   Config::Program prg;
   RunInstance instance;
+  sptr< ProgramServer > server;
 
 public:
 
-  ProgramWordSearchRequest( QString const & word, Config::Program const & );
+  ProgramWordSearchRequest( QString const & word,
+                            Config::Program const &,
+                            sptr< ProgramServer > const & server = {} );
 
   virtual void cancel();
 
@@ -8,6 +8,7 @@
 #include "ftshelpers.hh"
 #include "htmlescape.hh"
 #include "langcoder.hh"
+#include "scheduler.hh"
 #include "sdict.hh"
 #include "text.hh"
 #include <map>
@@ -401,11 +402,13 @@ void SdictDictionary::getArticleText( uint32_t articleAddress, QString & headwor
 sptr< Dictionary::DataRequest >
 SdictDictionary::getSearchResults( QString const & searchString, int searchMode, bool matchCase, bool ignoreDiacritics )
 {
-  return std::make_shared< FtsHelpers::FTSResultsRequest >( *this,
-                                                            searchString,
-                                                            searchMode,
-                                                            matchCase,
-                                                            ignoreDiacritics );
+  return Dictionary::runRequest< FtsHelpers::FTSResultsRequest >( Scheduler::Priority::Lookup,
+                                                                  this,
+                                                                  *this,
+                                                                  searchString,
+                                                                  searchMode,
+                                                                  matchCase,
+                                                                  ignoreDiacritics );
 }
 
 /// SdictDictionary::getArticle()
@@ -421,7 +424,6 @@ class SdictArticleRequest: public Dictionary::DataRequest
 
   QAtomicInt isCancelled;
 
-  QFuture< void > f;
 
 public:
 
@@ -434,9 +436,6 @@ public:
     dict( dict_ ),
     ignoreDiacritics( ignoreDiacritics_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -445,12 +444,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~SdictArticleRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void SdictArticleRequest::run()
@@ -565,7 +558,16 @@ sptr< Dictionary::DataRequest > SdictDictionary::getArticle( std::u32string cons
                                                              bool ignoreDiacritics )
 
 {
-  return std::make_shared< SdictArticleRequest >( word, alts, *this, ignoreDiacritics );
+  if ( !mayContainAny( word, alts ) ) {
+    return std::make_shared< Dictionary::DataRequestInstant >( false ); // No such word
+  }
+
+  return Dictionary::runRequest< SdictArticleRequest >( Scheduler::Priority::Lookup,
+                                                        this,
+                                                        word,
+                                                        alts,
+                                                        *this,
+                                                        ignoreDiacritics );
 }
 
 QString const & SdictDictionary::getDescription()
@@ -14,6 +14,7 @@
 #include "filetype.hh"
 #include "tiff.hh"
 #include "utils.hh"
+#include "scheduler.hh"
 #include "iconv.hh"
 #include <QString>
 #include <QStringBuilder>
@@ -971,11 +972,13 @@ void SlobDictionary::getArticleText( uint32_t articleAddress, QString & headword
 sptr< Dictionary::DataRequest >
 SlobDictionary::getSearchResults( QString const & searchString, int searchMode, bool matchCase, bool ignoreDiacritics )
 {
-  return std::make_shared< FtsHelpers::FTSResultsRequest >( *this,
-                                                            searchString,
-                                                            searchMode,
-                                                            matchCase,
-                                                            ignoreDiacritics );
+  return Dictionary::runRequest< FtsHelpers::FTSResultsRequest >( Scheduler::Priority::Lookup,
+                                                                  this,
+                                                                  *this,
+                                                                  searchString,
+                                                                  searchMode,
+                                                                  matchCase,
+                                                                  ignoreDiacritics );
 }
 
 
@@ -991,7 +994,6 @@ class SlobArticleRequest: public Dictionary::DataRequest
   bool ignoreDiacritics;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -1004,9 +1006,6 @@ public:
     dict( dict_ ),
     ignoreDiacritics( ignoreDiacritics_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -1015,12 +1014,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~SlobArticleRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 
@@ -1130,7 +1123,16 @@ sptr< Dictionary::DataRequest > SlobDictionary::getArticle( std::u32string const
                                                             bool ignoreDiacritics )
 
 {
-  return std::make_shared< SlobArticleRequest >( word, alts, *this, ignoreDiacritics );
+  if ( !mayContainAny( word, alts ) ) {
+    return std::make_shared< Dictionary::DataRequestInstant >( false ); // No such word
+  }
+
+  return Dictionary::runRequest< SlobArticleRequest >( Scheduler::Priority::Lookup,
+                                                       this,
+                                                       word,
+                                                       alts,
+                                                       *this,
+                                                       ignoreDiacritics );
 }
 
 //// SlobDictionary::getResource()
@@ -1143,7 +1145,6 @@ class SlobResourceRequest: public Dictionary::DataRequest
   string resourceName;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -1151,9 +1152,6 @@ public:
     dict( dict_ ),
     resourceName( resourceName_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -1162,12 +1160,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~SlobResourceRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 
@@ -1224,7 +1216,7 @@ void SlobResourceRequest::run()
 sptr< Dictionary::DataRequest > SlobDictionary::getResource( string const & name )
 
 {
-  return std::make_shared< SlobResourceRequest >( *this, name );
+  return Dictionary::runRequest< SlobResourceRequest >( Scheduler::Priority::Resource, this, *this, name );
 }
 
 
@@ -24,6 +24,7 @@
 #include <QDomDocument>
 #include "ufile.hh"
 #include "utils.hh"
+#include "scheduler.hh"
 #include <QRegularExpression>
 #include "globalregex.hh"
 #include <QDir>
@@ -170,6 +171,13 @@ public:
   getSearchResults( QString const & searchString, int searchMode, bool matchCase, bool ignoreDiacritics ) override;
   void getArticleText( uint32_t articleAddress, QString & headword, QString & text ) override;
 
+  /// The index and the dictzip file are read under their own mutexes, the
+  /// rest works on its own copies
+  bool isArticleTextThreadSafe() const override
+  {
+    return true;
+  }
+
   void makeFTSIndex( QAtomicInt & isCancelled ) override;
 
   void setFTSParameters( Config::FullTextSearch const & fts ) override
@@ -1153,11 +1161,13 @@ sptr< Dictionary::DataRequest > StardictDictionary::getSearchResults( QString co
                                                                       bool matchCase,
                                                                       bool ignoreDiacritics )
 {
-  return std::make_shared< FtsHelpers::FTSResultsRequest >( *this,
-                                                            searchString,
-                                                            searchMode,
-                                                            matchCase,
-                                                            ignoreDiacritics );
+  return Dictionary::runRequest< FtsHelpers::FTSResultsRequest >( Scheduler::Priority::Lookup,
+                                                                  this,
+                                                                  *this,
+                                                                  searchString,
+                                                                  searchMode,
+                                                                  matchCase,
+                                                                  ignoreDiacritics );
 }
 
 /// StardictDictionary::findHeadwordsForSynonym()
@@ -1169,7 +1179,6 @@ class StardictHeadwordsRequest: public Dictionary::WordSearchRequest
   StardictDictionary & dict;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -1177,9 +1186,6 @@ public:
     word( word_ ),
     dict( dict_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -1188,12 +1194,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~StardictHeadwordsRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 
@@ -1240,8 +1240,11 @@ void StardictHeadwordsRequest::run()
 
 sptr< Dictionary::WordSearchRequest > StardictDictionary::findHeadwordsForSynonym( std::u32string const & word )
 {
-  return synonymSearchEnabled ? std::make_shared< StardictHeadwordsRequest >( word, *this ) :
-                                Class::findHeadwordsForSynonym( word );
+  if ( !synonymSearchEnabled ) {
+    return Class::findHeadwordsForSynonym( word );
+  }
+
+  return Dictionary::runRequest< StardictHeadwordsRequest >( Scheduler::Priority::Lookup, this, word, *this );
 }
 
 
@@ -1257,7 +1260,6 @@ class StardictArticleRequest: public Dictionary::DataRequest
   bool ignoreDiacritics;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 
 public:
@@ -1271,9 +1273,6 @@ public:
     dict( dict_ ),
     ignoreDiacritics( ignoreDiacritics_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -1282,12 +1281,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~StardictArticleRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void StardictArticleRequest::run()
@@ -1416,7 +1409,16 @@ sptr< Dictionary::DataRequest > StardictDictionary::getArticle( std::u32string c
                                                                 bool ignoreDiacritics )
 
 {
-  return std::make_shared< StardictArticleRequest >( word, alts, *this, ignoreDiacritics );
+  if ( !mayContainAny( word, alts ) ) {
+    return std::make_shared< Dictionary::DataRequestInstant >( false ); // No such word
+  }
+
+  return Dictionary::runRequest< StardictArticleRequest >( Scheduler::Priority::Lookup,
+                                                           this,
+                                                           word,
+                                                           alts,
+                                                           *this,
+                                                           ignoreDiacritics );
 }
 
 
@@ -1511,7 +1513,6 @@ class StardictResourceRequest: public Dictionary::DataRequest
   string resourceName;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -1519,9 +1520,6 @@ public:
     dict( dict_ ),
     resourceName( resourceName_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -1530,12 +1528,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~StardictResourceRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void StardictResourceRequest::run()
@@ -1649,7 +1641,7 @@ void StardictResourceRequest::run()
 sptr< Dictionary::DataRequest > StardictDictionary::getResource( string const & name )
 
 {
-  return std::make_shared< StardictResourceRequest >( *this, name );
+  return Dictionary::runRequest< StardictResourceRequest >( Scheduler::Priority::Resource, this, *this, name );
 }
 
 } // anonymous namespace
@@ -4,6 +4,7 @@
 #include "transliteration.hh"
 #include "text.hh"
 #include "folding.hh"
+#include <algorithm>
 
 namespace Transliteration {
 
@@ -77,6 +78,68 @@ void Table::ins( char const * from, char const * to )
   insert( std::pair< std::u32string, std::u32string >( fr, Text::toUtf32( std::string( to ) ) ) );
 }
 
+void Table::compile() const
+{
+  // Build the trie with per-node child maps first, so the edges of every
+  // node come out sorted by character
+  vector< map< char32_t, uint32_t > > children( 1 );
+  nodes.resize( 1 );
+
+  for ( auto const & [ from, to ] : *this ) {
+    uint32_t node = 0;
+    for ( char32_t ch : from ) {
+      auto [ i, inserted ] = children[ node ].try_emplace( ch, static_cast< uint32_t >( nodes.size() ) );
+      node                 = i->second;
+      if ( inserted ) {
+        nodes.emplace_back();
+        children.emplace_back();
+      }
+    }
+    nodes[ node ].value = &to;
+  }
+
+  // Lay the edges of each node out contiguously
+  for ( size_t x = 0; x < nodes.size(); ++x ) {
+    nodes[ x ].firstEdge = edges.size();
+    nodes[ x ].edgeCount = children[ x ].size();
+
+    for ( auto const & [ ch, node ] : children[ x ] ) {
+      edges.push_back( Edge{ ch, node } );
+    }
+  }
+}
+
+size_t Table::findLongestMatch( char32_t const * str, size_t size, std::u32string const *& replacement ) const
+{
+  std::call_once( compiled, [ this ]() {
+    compile();
+  } );
+
+  size_t matched    = 0;
+  Node const * node = &nodes.front();
+
+  for ( size_t x = 0; x < size && node->edgeCount; ++x ) {
+    auto const begin = edges.begin() + node->firstEdge;
+    auto const end   = begin + node->edgeCount;
+    auto const edge  = std::lower_bound( begin, end, str[ x ], []( Edge const & e, char32_t ch ) {
+      return e.ch < ch;
+    } );
+
+    if ( edge == end || edge->ch != str[ x ] ) {
+      break;
+    }
+
+    node = &nodes[ edge->node ];
+
+    if ( node->value ) {
+      matched     = x + 1;
+      replacement = node->value;
+    }
+  }
+
+  return matched;
+}
+
 
 TransliterationDictionary::TransliterationDictionary(
   string const & id, string const & name_, QIcon icon_, Table const & table_, bool caseSensitive_ ):
@@ -104,25 +167,15 @@ vector< std::u32string > TransliterationDictionary::getAlternateWritings( std::u
   char32_t const * ptr = target->c_str();
   size_t left          = target->size();
 
-  Table::const_iterator i;
+  std::u32string const * replacement = nullptr;
 
   while ( left ) {
-    unsigned x;
-
-    for ( x = table.getMaxEntrySize(); x >= 1; --x ) {
-      if ( left >= x ) {
-        i = table.find( std::u32string( ptr, x ) );
-
-        if ( i != table.end() ) {
-          result.append( i->second );
-          ptr += x;
-          left -= x;
-          break;
-        }
-      }
+    if ( size_t const x = table.findLongestMatch( ptr, left, replacement ) ) {
+      result.append( *replacement );
+      ptr += x;
+      left -= x;
     }
-
-    if ( !x ) {
+    else {
       // No matches -- add this char as it is
       result.push_back( *ptr++ );
       --left;
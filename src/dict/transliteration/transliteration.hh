@@ -5,6 +5,7 @@
 
 #include "dictionary.hh"
 #include <map>
+#include <mutex>
 
 namespace Transliteration {
 
@@ -42,10 +43,34 @@ public:
 };
 
 
+/// The transliteration table. Once filled by the derived class constructor,
+/// it is compiled into a trie on the first lookup, so the longest matching
+/// entry at a position is found in a single pass without any allocations.
+/// The tables are static objects shared by all the dictionaries using them.
 class Table: public map< std::u32string, std::u32string >
 {
   unsigned maxEntrySize;
 
+  struct Node
+  {
+    uint32_t firstEdge = 0;
+    uint32_t edgeCount = 0;
+    std::u32string const * value = nullptr; // Replacement if a key ends here
+  };
+
+  struct Edge
+  {
+    char32_t ch;
+    uint32_t node;
+  };
+
+  mutable std::once_flag compiled;
+  mutable vector< Node > nodes;
+  mutable vector< Edge > edges;
+
+  /// Builds the trie out of the map, with the edges of every node sorted
+  void compile() const;
+
 public:
 
   Table():
@@ -58,6 +83,11 @@ public:
     return maxEntrySize;
   }
 
+  /// Finds the longest entry which is a prefix of the given string. Returns
+  /// its length, and stores its replacement to 'replacement'. If there is no
+  /// such entry, 0 is returned. Thread-safe.
+  size_t findLongestMatch( char32_t const * str, size_t size, std::u32string const *& replacement ) const;
+
 protected:
 
   /// Inserts new entry into index. from and to are UTF8-encoded strings.
@@ -7,7 +7,6 @@
 #include "text.hh"
 #include "chunkedstorage.hh"
 #include "dictzip.hh"
-#include "htmlescape.hh"
 #include <map>
 #include <set>
 #include <string>
@@ -31,6 +30,7 @@
 #include <QAtomicInt>
 
 #include "utils.hh"
+#include "scheduler.hh"
 
 namespace Xdxf {
 
@@ -198,8 +198,12 @@ protected:
 
 private:
 
-  // Loads the article, storing its headword and formatting article's data into an html.
-  void loadArticle( uint32_t address, string & articleText, QString * headword = 0 );
+  // Loads the article, storing its headword and formatting article's data into an html,
+  // or into the text the html reads as.
+  void loadArticle( uint32_t address,
+                    string & articleText,
+                    QString * headword       = 0,
+                    Xdxf2Html::Output output = Xdxf2Html::Output::Html );
 
   friend class XdxfArticleRequest;
   friend class XdxfResourceRequest;
@@ -375,9 +379,9 @@ void XdxfDictionary::getArticleText( uint32_t articleAddress, QString & headword
 {
   try {
     string articleStr;
-    loadArticle( articleAddress, articleStr, &headword );
+    loadArticle( articleAddress, articleStr, &headword, Xdxf2Html::Output::Text );
 
-    text = Html::unescape( QString::fromStdString( articleStr ) );
+    text = QString::fromStdString( articleStr );
   }
   catch ( std::exception & ex ) {
     qWarning( "Xdxf: Failed retrieving article from \"%s\", reason: %s", getName().c_str(), ex.what() );
@@ -387,11 +391,13 @@ void XdxfDictionary::getArticleText( uint32_t articleAddress, QString & headword
 sptr< Dictionary::DataRequest >
 XdxfDictionary::getSearchResults( QString const & searchString, int searchMode, bool matchCase, bool ignoreDiacritics )
 {
-  return std::make_shared< FtsHelpers::FTSResultsRequest >( *this,
-                                                            searchString,
-                                                            searchMode,
-                                                            matchCase,
-                                                            ignoreDiacritics );
+  return Dictionary::runRequest< FtsHelpers::FTSResultsRequest >( Scheduler::Priority::Lookup,
+                                                                  this,
+                                                                  *this,
+                                                                  searchString,
+                                                                  searchMode,
+                                                                  matchCase,
+                                                                  ignoreDiacritics );
 }
 
 /// XdxfDictionary::getArticle()
@@ -406,7 +412,6 @@ class XdxfArticleRequest: public Dictionary::DataRequest
   bool ignoreDiacritics;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -419,9 +424,6 @@ public:
     dict( dict_ ),
     ignoreDiacritics( ignoreDiacritics_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -430,12 +432,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~XdxfArticleRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 
@@ -549,10 +545,22 @@ sptr< Dictionary::DataRequest > XdxfDictionary::getArticle( std::u32string const
                                                             bool ignoreDiacritics )
 
 {
-  return std::make_shared< XdxfArticleRequest >( word, alts, *this, ignoreDiacritics );
+  if ( !mayContainAny( word, alts ) ) {
+    return std::make_shared< Dictionary::DataRequestInstant >( false ); // No such word
+  }
+
+  return Dictionary::runRequest< XdxfArticleRequest >( Scheduler::Priority::Lookup,
+                                                       this,
+                                                       word,
+                                                       alts,
+                                                       *this,
+                                                       ignoreDiacritics );
 }
 
-void XdxfDictionary::loadArticle( uint32_t address, string & articleText, QString * headword )
+void XdxfDictionary::loadArticle( uint32_t address,
+                                  string & articleText,
+                                  QString * headword,
+                                  Xdxf2Html::Output output )
 {
   // Read the properties
 
@@ -601,7 +609,8 @@ void XdxfDictionary::loadArticle( uint32_t address, string & articleText, QStrin
                                     this,
                                     fType == Logical,
                                     idxHeader.revisionNumber,
-                                    headword );
+                                    headword,
+                                    output );
 
   free( articleBody );
 }
@@ -896,7 +905,6 @@ class XdxfResourceRequest: public Dictionary::DataRequest
   string resourceName;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -904,9 +912,6 @@ public:
     dict( dict_ ),
     resourceName( resourceName_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -915,12 +920,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~XdxfResourceRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 
@@ -996,7 +995,7 @@ void XdxfResourceRequest::run()
 sptr< Dictionary::DataRequest > XdxfDictionary::getResource( string const & name )
 
 {
-  return std::make_shared< XdxfResourceRequest >( *this, name );
+  return Dictionary::runRequest< XdxfResourceRequest >( Scheduler::Priority::Resource, this, *this, name );
 }
 
 } // namespace
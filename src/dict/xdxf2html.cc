@@ -2,7 +2,9 @@
  * Part of GoldenDict. Licensed under GPLv3 or later, see the LICENSE file */
 
 #include "xdxf2html.hh"
-#include <QtXml>
+#include <QStringEncoder>
+#include <QUrl>
+#include <QXmlStreamReader>
 #include "text.hh"
 #include "folding.hh"
 
@@ -10,24 +12,16 @@
 #include "dictfile.hh"
 #include "filetype.hh"
 #include "htmlescape.hh"
+#include "langcoder.hh"
 #include "utils.hh"
 #include "xdxf.hh"
 
-#include <QRegularExpression>
-
-#include "globalregex.hh"
+#include <utility>
+#include <vector>
 
 namespace Xdxf2Html {
 
-static void fixLink( QDomElement & el, string const & dictId, const char * attrName )
-{
-  QUrl url;
-  url.setScheme( "bres" );
-  url.setHost( QString::fromStdString( dictId ) );
-  url.setPath( Utils::Url::ensureLeadingSlash( el.attribute( attrName ) ) );
-
-  el.setAttribute( attrName, url.toEncoded().data() );
-}
+using std::vector;
 
 // converting a number into roman representation
 string convertToRoman( int input, int lower_case )
@@ -57,640 +51,1025 @@ string convertToRoman( int input, int lower_case )
   return romanvalue;
 }
 
-QDomElement fakeElement( QDomDocument & dom )
-{
-  // Create element which will be removed after
-  // We will insert it to empty elements to avoid output ones in <xxx/> form
-  return dom.createElement( "b" );
-}
+namespace {
 
-string convert( string const & in,
-                DICT_TYPE type,
-                map< string, string > const * pAbrv,
-                Dictionary::Class * dictPtr,
-                bool isLogicalFormat,
-                unsigned revisionNumber,
-                QString * headword )
+/// The attributes of an element, in their original order
+class Attributes
 {
-  // Convert spaces after each end of line to &nbsp;s, and then each end of
-  // line to a <br>
-
-  string inConverted;
-
-  inConverted.reserve( in.size() );
+  vector< std::pair< QString, QString > > list;
 
-  bool afterEol = false;
+public:
 
-  for ( char i : in ) {
-    switch ( i ) {
-      case '\n':
-        afterEol = true;
-        if ( !isLogicalFormat ) {
-          inConverted.append( "<br/>" );
-        }
-        break;
+  Attributes() = default;
 
-      case '\r':
-        break;
+  explicit Attributes( QXmlStreamAttributes const & attrs )
+  {
+    list.reserve( attrs.size() );
 
-      case ' ':
-        if ( afterEol ) {
-          if ( !isLogicalFormat ) {
-            inConverted.append( "&#160;" ); // xml don't have &nbsp;
-          }
-          break;
-        }
-        [[fallthrough]];
-      default:
-        inConverted.push_back( i );
-        afterEol = false;
+    for ( auto const & attr : attrs ) {
+      list.emplace_back( attr.qualifiedName().toString(), attr.value().toString() );
     }
   }
 
-  // We build a dom representation of the given xml, then do some transforms
-  QDomDocument dd;
-
-  QString errorStr;
-
-  string in_data;
-  if ( type == XDXF ) {
-    in_data = "<div class=\"xdxf\"";
-    if ( dictPtr->isToLanguageRTL() ) {
-      in_data += " dir=\"rtl\"";
+  bool has( QStringView name ) const
+  {
+    for ( auto const & attr : list ) {
+      if ( attr.first == name ) {
+        return true;
+      }
     }
-    in_data += ">";
-  }
-  else {
-    in_data = "<div class=\"sdct_x\">";
-  }
-  in_data += inConverted + "</div>";
-
-
-#if ( QT_VERSION < QT_VERSION_CHECK( 6, 5, 0 ) )
-  int errorLine, errorColumn;
-  if ( !dd.setContent( QByteArray( in_data.c_str() ), false, &errorStr, &errorLine, &errorColumn ) ) {
-    qWarning( "Xdxf2html error, xml parse failed: %s at %d,%d",
-              errorStr.toLocal8Bit().constData(),
-              errorLine,
-              errorColumn );
-    qWarning( "The input was: %s", in_data.c_str() );
-    return in;
+    return false;
   }
-#else
-  auto setContentResult = dd.setContent( QByteArray::fromStdString( in_data ) );
-  if ( !setContentResult ) {
-    qWarning( "Xdxf2html error, xml parse failed: %s at %lld,%lld",
-              setContentResult.errorMessage.toStdString().c_str(),
-              setContentResult.errorLine,
-              setContentResult.errorColumn );
-    qWarning( "The input was: %s", in_data.c_str() );
-    return in;
-  }
-#endif
-
-  QDomNodeList nodes = dd.elementsByTagName( "ex" ); // Example
-
-  while ( nodes.size() ) {
-    QString author, source;
-    QDomElement el = nodes.at( 0 ).toElement();
 
-    author = el.attribute( "author", QString() );
-    source = el.attribute( "source", QString() );
-
-    if ( el.hasChildNodes() ) {
-      QDomNodeList lst = el.childNodes();
-      for ( int i = 0; i < lst.count(); ++i ) {
-        QDomElement el2 = el.childNodes().at( i ).toElement();
-        if ( el2.tagName().compare( "ex_orig", Qt::CaseInsensitive ) == 0 ) {
-          el2.setTagName( "span" );
-          el2.setAttribute( "class", "xdxf_ex_orig" );
-        }
-        else if ( el2.tagName().compare( "ex_tran", Qt::CaseInsensitive ) == 0 ) {
-          el2.setTagName( "span" );
-          el2.setAttribute( "class", "xdxf_ex_tran" );
-        }
+  QString value( QStringView name ) const
+  {
+    for ( auto const & attr : list ) {
+      if ( attr.first == name ) {
+        return attr.second;
       }
     }
-    if ( ( !author.isEmpty() || !source.isEmpty() ) && ( !el.text().isEmpty() || !el.childNodes().isEmpty() ) ) {
-      QDomElement el2 = dd.createElement( "span" );
-      el2.setAttribute( "class", "xdxf_ex_source" );
-      QString text = author;
-      if ( !source.isEmpty() ) {
-        if ( !text.isEmpty() ) {
-          text += ", ";
-        }
-        text += source;
+    return {};
+  }
+
+  void set( QString const & name, QString const & value )
+  {
+    for ( auto & attr : list ) {
+      if ( attr.first == name ) {
+        attr.second = value;
+        return;
       }
-      QDomText txtNode = dd.createTextNode( text );
-      el2.appendChild( txtNode );
-      el.appendChild( el2 );
     }
+    list.emplace_back( name, value );
+  }
 
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
+  void remove( QStringView name )
+  {
+    for ( auto i = list.begin(); i != list.end(); ++i ) {
+      if ( i->first == name ) {
+        list.erase( i );
+        return;
+      }
     }
+  }
 
-    el.setTagName( "span" );
-    if ( isLogicalFormat ) {
-      el.setAttribute( "class", "xdxf_ex" );
-    }
-    else {
-      el.setAttribute( "class", "xdxf_ex_old" );
-    }
+  bool empty() const
+  {
+    return list.empty();
   }
 
-  nodes = dd.elementsByTagName( "mrkd" ); // marked out words in translations/examples of usage
+  auto begin() const
+  {
+    return list.begin();
+  }
 
-  while ( nodes.size() ) {
-    QDomElement el = nodes.at( 0 ).toElement();
+  auto end() const
+  {
+    return list.end();
+  }
+};
 
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
-    }
+/// Tells the names the empty tags were kept for
+bool isBrOrHr( QStringView name )
+{
+  if ( !name.startsWith( u"br" ) && !name.startsWith( u"hr" ) ) {
+    return false;
+  }
+  return name.size() == 2 || !( name[ 2 ].isLetterOrNumber() || name[ 2 ] == u'_' );
+}
 
-    el.setTagName( "span" );
-    el.setAttribute( "class", "xdxf_ex_markd" );
+/// Converts an article in one pass over its xml, writing the html as it goes.
+/// The articles used to be converted by building a QDomDocument, transforming
+/// it and saving it, so the html is laid out the way QDomDocument::toString()
+/// does it, and the transforms see the article the way they did there.
+class Converter
+{
+public:
+
+  Converter( DICT_TYPE type_,
+             map< string, string > const * pAbrv_,
+             Dictionary::Class * dictPtr_,
+             bool isLogicalFormat_,
+             unsigned revisionNumber,
+             QString * headword_,
+             Output output_ ):
+    type( type_ ),
+    pAbrv( pAbrv_ ),
+    dictPtr( dictPtr_ ),
+    isLogicalFormat( isLogicalFormat_ ),
+    headword( headword_ ),
+    output( output_ ),
+    abbrName( revisionNumber < 29 ? "abr" : "abbr" )
+  {
   }
 
-  nodes = dd.elementsByTagName( "k" ); // Key
+  /// Returns false if the xml is malformed
+  bool convert( QByteArray const & xml, size_t sizeHint );
 
-  if ( headword ) {
-    headword->clear();
+  string & result()
+  {
+    return out;
   }
 
-  while ( nodes.size() ) {
-    QDomElement el = nodes.at( 0 ).toElement();
+private:
+
+  /// The kinds of elements which need more than a new name, in the order the
+  /// transforms used to run in. The text an element has includes the text the
+  /// transforms of the earlier kinds generate.
+  enum class Kind {
+    Other,
+    Ex,
+    K,
+    Def,
+    Kref,
+    Iref,
+    Abbr,
+    Rref,
+  };
+
+  struct Element
+  {
+    Kind kind = Kind::Other;
+    QString tagName;
+    Attributes attrs;
+    size_t start            = 0;     // Where the start tag is, or goes
+    bool deferred           = false; // The start tag depends on the text and is written last
+    bool fillIfEmpty        = false; // Is given a child if empty, to never come out as <x/>
+    bool collectsText       = false;
+    bool hasChildren        = false;
+    bool lastChildIsText    = false;
+    int defDepth            = -1; // The number of defs it's nested in, if it's a def
+    QString text;
+  };
+
+  /// The number of a def, which can't be worded until all the defs are seen
+  struct DefNumber
+  {
+    size_t position;
+    int depth;
+    int count;
+  };
+
+  DICT_TYPE type;
+  map< string, string > const * pAbrv;
+  Dictionary::Class * dictPtr;
+  bool isLogicalFormat;
+  QString * headword;
+  Output output;
+  QString abbrName;
+
+  string out;
+  QStringEncoder encoder{ QStringEncoder::Utf8 };
+
+  vector< Element > stack; // The document comes first
+  int collecting = 0;      // The number of elements in the stack collecting their text
+
+  vector< DefNumber > defNumbers;
+  vector< int > defCounts; // The defs so far at each depth of nesting
+  int maxDefDepth = 1;
+
+  void startElement( QStringView name, QXmlStreamAttributes const & );
+  void endElement();
+
+  void open( QString const & tagName, Attributes attrs, Kind = Kind::Other, bool deferred = false );
+  void close();
+
+  /// Adds a text node. Generated text is seen by the transforms after the
+  /// one which generated it.
+  void text( QStringView, bool cdata = false, Kind generatedBy = Kind::Other );
+  void comment( QStringView );
+
+  /// Does the layout of the nodes the way QDomDocument did: a node other
+  /// than text goes on a line of its own, indented by its depth, unless it
+  /// is next to text
+  void beginChild( bool isText );
+  void indent( size_t depth );
+
+  void setLanguage( Attributes &, bool isLanguageRtl );
+  void finishRref( Element & );
+
+  // The writing itself. In the Output::Text mode only the text gets
+  // written, and whitespace in place of the layout.
+
+  void markup( char const * );
+  void markup( QStringView );
+  void layout( char const * );
+  enum class Escape {
+    None,
+    Text,
+    Attribute,
+  };
+  void write( QStringView, Escape );
+  void writeStartTag( Element const & );
+
+  void insert( size_t position, string const & );
+  void truncate( size_t position );
+  void writeDefNumbers();
+};
+
+void Converter::markup( char const * str )
+{
+  if ( output == Output::Html ) {
+    out += str;
+  }
+}
 
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
-    }
+void Converter::markup( QStringView str )
+{
+  if ( output == Output::Html ) {
+    write( str, Escape::None );
+  }
+}
 
-    if ( type == STARDICT ) {
-      el.setTagName( "span" );
-      el.setAttribute( "class", "xdxf_k" );
-    }
-    else {
-      if ( headword && headword->isEmpty() ) {
-        *headword = el.text();
-      }
+void Converter::layout( char const * str )
+{
+  if ( output == Output::Html ) {
+    out += str;
+  }
+  else if ( !out.empty() && !Text::isspace( (unsigned char)out.back() ) ) {
+    out.push_back( ' ' );
+  }
+}
 
-      el.setTagName( "div" );
-      el.setAttribute( "class", "xdxf_headwords" );
-      bool isLanguageRtl = dictPtr->isFromLanguageRTL();
-      if ( el.hasAttribute( "xml:lang" ) ) {
-        // Change xml-attribute "xml:lang" to html-attribute "lang"
-        QString lang = el.attribute( "xml:lang" );
-        el.removeAttribute( "xml:lang" );
-        el.setAttribute( "lang", lang );
-
-        quint32 langID = Xdxf::getLanguageId( lang );
-        if ( langID ) {
-          isLanguageRtl = LangCoder::isLanguageRTL( langID );
-        }
-      }
-      if ( isLanguageRtl != dictPtr->isToLanguageRTL() ) {
-        el.setAttribute( "dir", isLanguageRtl ? "rtl" : "ltr" );
-      }
-    }
+void Converter::indent( size_t depth )
+{
+  if ( output == Output::Html ) {
+    out.append( depth, ' ' );
+  }
+  else if ( depth ) {
+    layout( " " );
   }
+}
 
-  // processing of nested <def>s
-  if ( isLogicalFormat ) // in articles with visual format <def> tags do not effect the formatting.
-  {
-    nodes = dd.elementsByTagName( "def" );
-
-    // this is a logical type of XDXF, so we need to render proper numbering
-    // we will do it this way:
-
-    // 1. we compute the maximum nesting depth of the article
-    int maxNestingDepth = 1; // maximum nesting depth of the article
-    for ( int i = 0; i < nodes.size(); i++ ) {
-      QDomElement el          = nodes.at( i ).toElement();
-      QDomElement nestingNode = el;
-      int nestingCount        = 0;
-      while ( nestingNode.parentNode().toElement().tagName() == "def" ) {
-        nestingCount++;
-        nestingNode = nestingNode.parentNode().toElement();
-      }
-      if ( nestingCount > maxNestingDepth ) {
-        maxNestingDepth = nestingCount;
+void Converter::write( QStringView str, Escape escape )
+{
+  // Escapes the way QDomDocument::toString() does it
+  qsizetype run = 0; // The start of what isn't written yet
+
+  auto const flush = [ & ]( qsizetype end ) {
+    size_t const size = out.size();
+    out.resize( size + encoder.requiredSpace( end - run ) );
+    out.resize( encoder.appendToBuffer( out.data() + size, str.mid( run, end - run ) ) - out.data() );
+  };
+
+  for ( qsizetype x = 0; x < str.size(); ++x ) {
+    char const * replacement = nullptr;
+
+    if ( output == Output::Text ) {
+      if ( str[ x ] == QChar::Nbsp ) {
+        replacement = " ";
       }
     }
-    // 2. in this loop we go layer-by-layer through all <def> and insert proper numbers according to its structure
-    for ( int j = maxNestingDepth; j > 0; j-- ) // j symbolizes special depth to be processed at this iteration
-    {
-      int siblingCount   = 0;  // this  that counts the number of among all siblings of this depth
-      QString numberText = ""; // the number to be inserted into the beginning of <def> (I,II,IV,1,2,3,a),b),c)...)
-      for ( int i = 0; i < nodes.size(); i++ ) {
-        QDomElement el          = nodes.at( i ).toElement();
-        QDomElement nestingNode = el;
-        // computing the depth @nestingDepth of a current node @el
-        int nestingDepth = 0;
-        while ( nestingNode.parentNode().toElement().tagName() == "def" ) {
-          nestingDepth++;
-          nestingNode = nestingNode.parentNode().toElement();
-        }
-        // we process nodes on of current depth @j
-        // we do this in order not to break the numbering at this depth level
-        if ( nestingDepth == j ) {
-          siblingCount++;
-          if ( maxNestingDepth == 1 ) {
-            numberText = numberText.setNum( siblingCount ) + ". ";
+    else if ( escape != Escape::None ) {
+      switch ( str[ x ].unicode() ) {
+        case '<':
+          replacement = "&lt;";
+          break;
+        case '&':
+          replacement = "&amp;";
+          break;
+        case '>':
+          if ( x >= 2 && str[ x - 1 ] == u']' && str[ x - 2 ] == u']' ) {
+            replacement = "&gt;";
           }
-          else if ( maxNestingDepth == 2 ) {
-            if ( nestingDepth == 1 ) {
-              numberText = numberText.setNum( siblingCount ) + ". ";
-            }
-            if ( nestingDepth == 2 ) {
-              numberText = numberText.setNum( siblingCount ) + ") ";
-            }
+          break;
+        case '"':
+          if ( escape == Escape::Attribute ) {
+            replacement = "&quot;";
           }
-          else {
-            if ( nestingDepth == 1 ) {
-              numberText = QString::fromStdString( convertToRoman( siblingCount, 0 ) + ". " );
-            }
-            if ( nestingDepth == 2 ) {
-              numberText = numberText.setNum( siblingCount ) + ". ";
-            }
-            if ( nestingDepth == 3 ) {
-              numberText = numberText.setNum( siblingCount ) + ") ";
-            }
-            if ( nestingDepth == 4 ) {
-              numberText = QString::fromStdString( convertToRoman( siblingCount, 1 ) + ") " );
-            }
+          break;
+        case '\r':
+          replacement = "&#xd;";
+          break;
+        case '\n':
+          if ( escape == Escape::Attribute ) {
+            replacement = "&#xa;";
           }
-          QDomElement numberNode = dd.createElement( "span" );
-          numberNode.setAttribute( "class", "xdxf_num" );
-          QDomText text_num = dd.createTextNode( numberText );
-          numberNode.appendChild( text_num );
-          el.insertBefore( numberNode, el.firstChild() );
-
-          if ( el.hasAttribute( "cmt" ) ) {
-            QDomElement cmtNode = dd.createElement( "span" );
-            cmtNode.setAttribute( "class", "xdxf_co" );
-            QDomText text_num = dd.createTextNode( el.attribute( "cmt" ) );
-            cmtNode.appendChild( text_num );
-            el.insertAfter( cmtNode, el.firstChild() );
+          break;
+        case '\t':
+          if ( escape == Escape::Attribute ) {
+            replacement = "&#x9;";
           }
-        }
-        else if ( nestingDepth < j ) { // if it goes one level up @siblingCount needs to be reset
-          siblingCount = 0;
-        }
+          break;
+        default:
+          break;
       }
     }
-    // we finally change all <def> tags into 'xdxf_def' <span>s
-    while ( nodes.size() ) {
-      QDomElement el = nodes.at( 0 ).toElement();
-      el.setTagName( "span" );
-      el.setAttribute( "class", "xdxf_def" );
-      bool isLanguageRtl = dictPtr->isToLanguageRTL();
-      if ( el.hasAttribute( "xml:lang" ) ) {
-        // Change xml-attribute "xml:lang" to html-attribute "lang"
-        QString lang = el.attribute( "xml:lang" );
-        el.removeAttribute( "xml:lang" );
-        el.setAttribute( "lang", lang );
-
-        quint32 langID = Xdxf::getLanguageId( lang );
-        if ( langID ) {
-          isLanguageRtl = LangCoder::isLanguageRTL( langID );
-        }
-      }
-      if ( isLanguageRtl != dictPtr->isToLanguageRTL() ) {
-        el.setAttribute( "dir", isLanguageRtl ? "rtl" : "ltr" );
-      }
+
+    if ( replacement ) {
+      flush( x );
+      out += replacement;
+      run = x + 1;
     }
   }
 
-  nodes = dd.elementsByTagName( "opt" ); // Optional headword part
-
-  while ( nodes.size() ) {
-    QDomElement el = nodes.at( 0 ).toElement();
-
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
-    }
+  flush( str.size() );
+}
 
-    el.setTagName( "span" );
-    el.setAttribute( "class", "xdxf_opt" );
+void Converter::writeStartTag( Element const & e )
+{
+  markup( "<" );
+  markup( e.tagName );
+
+  for ( auto const & attr : e.attrs ) {
+    markup( " " );
+    markup( attr.first );
+    markup( "=\"" );
+    write( attr.second, Escape::Attribute );
+    markup( "\"" );
   }
+}
 
-  nodes = dd.elementsByTagName( "kref" ); // Reference to another word
+void Converter::insert( size_t position, string const & str )
+{
+  out.insert( position, str );
 
-  while ( nodes.size() ) {
-    QDomElement el = nodes.at( 0 ).toElement();
+  for ( auto i = defNumbers.rbegin(); i != defNumbers.rend() && i->position >= position; ++i ) {
+    i->position += str.size();
+  }
+}
 
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
-    }
+void Converter::truncate( size_t position )
+{
+  out.resize( position );
 
-    el.setTagName( "a" );
-    el.setAttribute( "href", QString( "bword:" ) + el.text() );
-    el.setAttribute( "class", "xdxf_kref" );
-    if ( el.hasAttribute( "idref" ) ) {
-      // todo implement support for referencing only specific parts of the article
-      el.setAttribute( "href", QString( "bword:" ) + el.text() + "#" + el.attribute( "idref" ) );
-    }
-    if ( el.hasAttribute( "kcmt" ) ) {
-      QDomText kcmtText = dd.createTextNode( " " + el.attribute( "kcmt" ) );
-      el.parentNode().insertAfter( kcmtText, el );
-    }
+  while ( !defNumbers.empty() && defNumbers.back().position >= position ) {
+    defNumbers.pop_back();
   }
+}
 
-  nodes = dd.elementsByTagName( "iref" ); // Reference to internet site
-
-  while ( nodes.size() ) {
-    QDomElement el = nodes.at( 0 ).toElement();
+void Converter::beginChild( bool isText )
+{
+  Element & parent = stack.back();
 
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
-    }
+  if ( !parent.hasChildren ) {
+    if ( stack.size() > 1 ) { // The document has no tag to close
+      markup( ">" );
 
-    QString ref = el.attribute( "href" );
-    if ( ref.isEmpty() ) {
-      ref = el.text();
+      if ( !isText ) {
+        layout( "\n" );
+      }
     }
-
-    el.setAttribute( "href", ref );
-    el.setTagName( "a" );
   }
-
-  // Abbreviations
-  if ( revisionNumber < 29 ) {
-    nodes = dd.elementsByTagName( "abr" );
+  else if ( !isText && !parent.lastChildIsText ) {
+    layout( "\n" ); // Ends the line of the previous sibling
   }
-  else {
-    nodes = dd.elementsByTagName( "abbr" );
+
+  if ( !isText && ( !parent.hasChildren || !parent.lastChildIsText ) ) {
+    indent( stack.size() - 1 );
   }
 
-  while ( nodes.size() ) {
-    QDomElement el = nodes.at( 0 ).toElement();
+  parent.hasChildren     = true;
+  parent.lastChildIsText = isText;
+}
 
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
-    }
+void Converter::open( QString const & tagName, Attributes attrs, Kind kind, bool deferred )
+{
+  beginChild( false );
 
-    el.setTagName( "span" );
-    el.setAttribute( "class", "xdxf_abbr" );
-    if ( type == XDXF && pAbrv != nullptr ) {
-      string val = Folding::trimWhitespace( el.text() ).toStdString();
+  Element & e = stack.emplace_back();
 
-      // If we have such a key, display a title
+  e.kind     = kind;
+  e.tagName  = tagName;
+  e.attrs    = std::move( attrs );
+  e.start    = out.size();
+  e.deferred = deferred;
 
-      auto i = pAbrv->find( val );
+  if ( !deferred ) {
+    writeStartTag( e );
+  }
 
-      if ( i != pAbrv->end() ) {
-        string title;
+  if ( output == Output::Text && tagName == u"br" ) {
+    out.push_back( '\n' );
+  }
+}
 
-        if ( Text::toUtf32( i->second ).size() < 70 ) {
-          // Replace all spaces with non-breakable ones, since that's how Lingvo shows tooltips
-          title.reserve( i->second.size() );
+void Converter::close()
+{
+  Element & e = stack.back();
 
-          for ( char const * c = i->second.c_str(); *c; ++c ) {
-            if ( *c == ' ' || *c == '\t' ) {
-              // u00A0 in utf8
-              title.push_back( 0xC2 );
-              title.push_back( 0xA0 );
-            }
-            else if ( *c == '-' ) // Change minus to non-breaking hyphen (uE28091 in utf8)
-            {
-              title.push_back( 0xE2 );
-              title.push_back( 0x80 );
-              title.push_back( 0x91 );
-            }
-            else {
-              title.push_back( *c );
-            }
-          }
-        }
-        else {
-          title = i->second;
-        }
-        el.setAttribute( "title", QString::fromStdU32String( Text::toUtf32( title ) ) );
-      }
-    }
+  if ( e.fillIfEmpty && !e.hasChildren ) {
+    // There used to be an empty <b/> added, which was stripped from the html
+    // afterwards along with all the other empty tags
+    beginChild( false );
   }
 
-  nodes = dd.elementsByTagName( "dtrn" ); // Direct translation
-
-  while ( nodes.size() ) {
-    QDomElement el = nodes.at( 0 ).toElement();
+  if ( e.deferred ) {
+    size_t const end = out.size();
+    writeStartTag( e );
+    string const tag = out.substr( end );
+    out.resize( end );
+    insert( e.start, tag );
+  }
 
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
+  if ( e.hasChildren ) {
+    if ( !e.lastChildIsText ) {
+      layout( "\n" );
+      indent( stack.size() - 2 );
     }
 
-    el.setTagName( "span" );
-    el.setAttribute( "class", "xdxf_dtrn" );
+    markup( u"</" );
+    markup( e.tagName );
+    markup( ">" );
+  }
+  else if ( e.attrs.empty() && !isBrOrHr( e.tagName ) ) {
+    // Empty tags without attributes used to be stripped, except <br/> and
+    // <hr/>. Html won't have <blockquote/> and the like, which xml allows.
+    truncate( e.start );
+  }
+  else {
+    markup( "/>" );
   }
 
-  nodes = dd.elementsByTagName( "c" ); // Color
+  if ( e.collectsText ) {
+    --collecting;
+  }
 
-  while ( nodes.size() ) {
-    QDomElement el = nodes.at( 0 ).toElement();
+  stack.pop_back();
+}
 
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
-    }
+void Converter::text( QStringView str, bool cdata, Kind generatedBy )
+{
+  beginChild( true );
 
-    el.setTagName( "span" );
+  if ( cdata ) {
+    markup( "<![CDATA[" );
+    write( str, Escape::None );
+    markup( "]]>" );
+  }
+  else {
+    write( str, Escape::Text );
+  }
 
-    if ( el.hasAttribute( "c" ) ) {
-      el.setAttribute( "style", "color:" + el.attribute( "c" ) );
-      el.removeAttribute( "c" );
-    }
-    else {
-      el.setAttribute( "style", "color:blue" );
+  if ( collecting ) {
+    for ( auto & e : stack ) {
+      if ( e.collectsText && generatedBy < e.kind ) {
+        e.text += str;
+      }
     }
   }
+}
 
-  nodes = dd.elementsByTagName( "co" ); // Editorial comment
+void Converter::comment( QStringView str )
+{
+  beginChild( false );
 
-  while ( nodes.size() ) {
-    QDomElement el = nodes.at( 0 ).toElement();
+  markup( "<!--" );
+  markup( str );
+  if ( str.endsWith( u'-' ) ) {
+    markup( " " ); // Ensures that the comment doesn't end with --->
+  }
+  markup( "-->" );
+}
 
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
+void Converter::setLanguage( Attributes & attrs, bool isLanguageRtl )
+{
+  if ( attrs.has( u"xml:lang" ) ) {
+    // Change xml-attribute "xml:lang" to html-attribute "lang"
+    QString lang = attrs.value( u"xml:lang" );
+    attrs.remove( u"xml:lang" );
+    attrs.set( "lang", lang );
+
+    quint32 langID = Xdxf::getLanguageId( lang );
+    if ( langID ) {
+      isLanguageRtl = LangCoder::isLanguageRTL( langID );
     }
+  }
+  if ( isLanguageRtl != dictPtr->isToLanguageRTL() ) {
+    attrs.set( "dir", isLanguageRtl ? "rtl" : "ltr" );
+  }
+}
 
-    el.setTagName( "span" );
-    if ( isLogicalFormat ) {
-      el.setAttribute( "class", "xdxf_co" );
+void Converter::startElement( QStringView name, QXmlStreamAttributes const & xmlAttrs )
+{
+  Element const & parent = stack.back();
+  Attributes attrs( xmlAttrs );
+  QString tagName = name.toString();
+  Kind kind       = Kind::Other;
+  bool deferred   = false;
+  bool fill       = true;
+  int defDepth    = -1;
+
+  if ( parent.kind == Kind::Ex
+       && ( name.compare( u"ex_orig", Qt::CaseInsensitive ) == 0
+            || name.compare( u"ex_tran", Qt::CaseInsensitive ) == 0 ) ) {
+    attrs.set( "class", name.compare( u"ex_orig", Qt::CaseInsensitive ) == 0 ? "xdxf_ex_orig" : "xdxf_ex_tran" );
+    tagName = "span";
+    fill    = false;
+  }
+  else if ( name == u"ex" ) // Example
+  {
+    kind    = Kind::Ex;
+    tagName = "span";
+    attrs.set( "class", isLogicalFormat ? "xdxf_ex" : "xdxf_ex_old" );
+  }
+  else if ( name == u"mrkd" ) // marked out words in translations/examples of usage
+  {
+    tagName = "span";
+    attrs.set( "class", "xdxf_ex_markd" );
+  }
+  else if ( name == u"k" ) // Key
+  {
+    if ( type == STARDICT ) {
+      tagName = "span";
+      attrs.set( "class", "xdxf_k" );
     }
     else {
-      el.setAttribute( "class", "xdxf_co_old" );
+      kind    = Kind::K;
+      tagName = "div";
+      attrs.set( "class", "xdxf_headwords" );
+      setLanguage( attrs, dictPtr->isFromLanguageRTL() );
     }
   }
+  // In articles with visual format <def> tags do not effect the formatting
+  else if ( name == u"def" && isLogicalFormat ) {
+    kind     = Kind::Def;
+    tagName  = "span";
+    fill     = false;
+    defDepth = parent.defDepth + 1;
+    attrs.set( "class", "xdxf_def" );
+    setLanguage( attrs, dictPtr->isToLanguageRTL() );
+  }
+  else if ( name == u"opt" ) // Optional headword part
+  {
+    tagName = "span";
+    attrs.set( "class", "xdxf_opt" );
+  }
+  else if ( name == u"kref" ) // Reference to another word
+  {
+    kind     = Kind::Kref;
+    tagName  = "a";
+    deferred = true;
+  }
+  else if ( name == u"iref" ) // Reference to internet site
+  {
+    kind     = Kind::Iref;
+    tagName  = "a";
+    deferred = attrs.value( u"href" ).isEmpty();
+  }
+  else if ( name == abbrName ) // Abbreviations
+  {
+    kind     = Kind::Abbr;
+    tagName  = "span";
+    deferred = type == XDXF && pAbrv != nullptr;
+    attrs.set( "class", "xdxf_abbr" );
+  }
+  else if ( name == u"dtrn" ) // Direct translation
+  {
+    tagName = "span";
+    attrs.set( "class", "xdxf_dtrn" );
+  }
+  else if ( name == u"c" ) // Color
+  {
+    tagName = "span";
 
-  /* grammar information */
-  nodes = dd.elementsByTagName( "gr" ); // proper grammar tag
-  while ( nodes.size() ) {
-    QDomElement el = nodes.at( 0 ).toElement();
-
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
-    }
-
-    el.setTagName( "span" );
-    if ( isLogicalFormat ) {
-      el.setAttribute( "class", "xdxf_gr" );
+    if ( attrs.has( u"c" ) ) {
+      attrs.set( "style", "color:" + attrs.value( u"c" ) );
+      attrs.remove( u"c" );
     }
     else {
-      el.setAttribute( "class", "xdxf_gr_old" );
+      attrs.set( "style", "color:blue" );
     }
   }
-  nodes = dd.elementsByTagName( "pos" ); // deprecated grammar tag
-  while ( nodes.size() ) {
-    QDomElement el = nodes.at( 0 ).toElement();
+  else if ( name == u"co" ) // Editorial comment
+  {
+    tagName = "span";
+    attrs.set( "class", isLogicalFormat ? "xdxf_co" : "xdxf_co_old" );
+  }
+  else if ( name == u"gr" || name == u"pos" || name == u"tense" ) // grammar information, the last two are deprecated
+  {
+    tagName = "span";
+    attrs.set( "class", isLogicalFormat ? "xdxf_gr" : "xdxf_gr_old" );
+  }
+  else if ( name == u"tr" ) // Transcription
+  {
+    tagName = "span";
+    attrs.set( "class", isLogicalFormat ? "xdxf_tr" : "xdxf_tr_old" );
+  }
+  else if ( name == u"img" ) {
+    // Ensure that ArticleNetworkAccessManager can deal with XDXF images.
+    // We modify the URL by using the dictionary ID as the hostname.
+    // This is necessary to determine from which dictionary a requested
+    // image originates.
+    for ( char16_t const * attrName : { u"src", u"losrc", u"hisrc" } ) {
+      if ( attrs.has( attrName ) ) {
+        QUrl url;
+        url.setScheme( "bres" );
+        url.setHost( QString::fromStdString( dictPtr->getId() ) );
+        url.setPath( Utils::Url::ensureLeadingSlash( attrs.value( attrName ) ) );
 
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
+        attrs.set( QString::fromUtf16( attrName ), url.toEncoded().data() );
+      }
     }
+  }
+  else if ( name == u"rref" ) // Resource reference
+  {
+    kind = Kind::Rref;
 
-    el.setTagName( "span" );
-    if ( isLogicalFormat ) {
-      el.setAttribute( "class", "xdxf_gr" );
+    //    if( type == XDXF && dictPtr != NULL && !el.hasAttribute( "start" ) )
+    if ( dictPtr != NULL && !attrs.has( u"start" ) ) {
+      // It may turn into something else, depending on the file it refers to
+      deferred = true;
     }
     else {
-      el.setAttribute( "class", "xdxf_gr_old" );
+      tagName = "span";
+      attrs.set( "class", "xdxf_rref" );
     }
   }
-  nodes = dd.elementsByTagName( "tense" ); // deprecated grammar tag
-  while ( nodes.size() ) {
-    QDomElement el = nodes.at( 0 ).toElement();
+  else {
+    fill = false;
+  }
 
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
+  open( tagName, std::move( attrs ), kind, deferred );
+
+  Element & e     = stack.back();
+  e.fillIfEmpty   = fill;
+  e.defDepth      = defDepth;
+  e.collectsText  = deferred || ( kind == Kind::K && headword );
+  collecting     += e.collectsText;
+
+  if ( defDepth > 0 ) {
+    // The nested defs get numbered, in a style depending on the deepest
+    // nesting of the article, which is known at the end
+
+    defCounts.resize( defDepth + 1 );
+    ++defCounts[ defDepth ];
+    maxDefDepth = std::max( maxDefDepth, defDepth );
+
+    Attributes numberAttrs;
+    numberAttrs.set( "class", "xdxf_num" );
+    open( "span", std::move( numberAttrs ) );
+    beginChild( true );
+    defNumbers.push_back( { out.size(), defDepth, defCounts[ defDepth ] } );
+    close();
+
+    if ( stack.back().attrs.has( u"cmt" ) ) {
+      Attributes cmtAttrs;
+      cmtAttrs.set( "class", "xdxf_co" );
+      QString const cmt = stack.back().attrs.value( u"cmt" );
+      open( "span", std::move( cmtAttrs ) );
+      text( cmt, false, Kind::Def );
+      close();
     }
+  }
+  else if ( defDepth == 0 ) {
+    defCounts.resize( 1 );
+  }
+}
+
+void Converter::endElement()
+{
+  Element & e = stack.back();
+
+  switch ( e.kind ) {
+    case Kind::Ex: {
+      QString const author = e.attrs.value( u"author" );
+      QString const source = e.attrs.value( u"source" );
+
+      if ( ( !author.isEmpty() || !source.isEmpty() ) && e.hasChildren ) {
+        QString sourceText = author;
+        if ( !source.isEmpty() ) {
+          if ( !sourceText.isEmpty() ) {
+            sourceText += ", ";
+          }
+          sourceText += source;
+        }
 
-    el.setTagName( "span" );
-    if ( isLogicalFormat ) {
-      el.setAttribute( "class", "xdxf_gr" );
+        Attributes attrs;
+        attrs.set( "class", "xdxf_ex_source" );
+        open( "span", std::move( attrs ) );
+        text( sourceText, false, Kind::Ex );
+        close();
+      }
+      break;
     }
-    else {
-      el.setAttribute( "class", "xdxf_gr_old" );
+
+    case Kind::K:
+      if ( headword && headword->isEmpty() ) {
+        *headword = e.text;
+      }
+      break;
+
+    case Kind::Kref: {
+      QString const kcmt = e.attrs.value( u"kcmt" );
+      bool const hasKcmt = e.attrs.has( u"kcmt" );
+
+      e.attrs.set( "href", QString( "bword:" ) + e.text );
+      e.attrs.set( "class", "xdxf_kref" );
+      if ( e.attrs.has( u"idref" ) ) {
+        // todo implement support for referencing only specific parts of the article
+        e.attrs.set( "href", QString( "bword:" ) + e.text + "#" + e.attrs.value( u"idref" ) );
+      }
+
+      close();
+
+      if ( hasKcmt ) {
+        text( QString( " " + kcmt ), false, Kind::Kref );
+      }
+      return;
     }
+
+    case Kind::Iref:
+      if ( e.deferred ) {
+        e.attrs.set( "href", e.text );
+      }
+      break;
+
+    case Kind::Abbr:
+      if ( e.deferred ) {
+        string val = Folding::trimWhitespace( e.text ).toStdString();
+
+        // If we have such a key, display a title
+
+        auto i = pAbrv->find( val );
+
+        if ( i != pAbrv->end() ) {
+          string title;
+
+          if ( Text::toUtf32( i->second ).size() < 70 ) {
+            // Replace all spaces with non-breakable ones, since that's how Lingvo shows tooltips
+            title.reserve( i->second.size() );
+
+            for ( char const * c = i->second.c_str(); *c; ++c ) {
+              if ( *c == ' ' || *c == '\t' ) {
+                // u00A0 in utf8
+                title.push_back( 0xC2 );
+                title.push_back( 0xA0 );
+              }
+              else if ( *c == '-' ) // Change minus to non-breaking hyphen (uE28091 in utf8)
+              {
+                title.push_back( 0xE2 );
+                title.push_back( 0x80 );
+                title.push_back( 0x91 );
+              }
+              else {
+                title.push_back( *c );
+              }
+            }
+          }
+          else {
+            title = i->second;
+          }
+          e.attrs.set( "title", QString::fromStdU32String( Text::toUtf32( title ) ) );
+        }
+      }
+      break;
+
+    case Kind::Rref:
+      if ( e.deferred ) {
+        finishRref( e );
+        return;
+      }
+      break;
+
+    default:
+      break;
   }
-  /* end of grammar generation */
 
-  nodes = dd.elementsByTagName( "tr" ); // Transcription
+  close();
+}
 
-  while ( nodes.size() ) {
-    QDomElement el = nodes.at( 0 ).toElement();
+void Converter::finishRref( Element & e )
+{
+  string filename = Text::toUtf8( e.text.toStdU32String() );
+
+  if ( Filetype::isNameOfPicture( filename ) || Filetype::isNameOfSound( filename ) ) {
+    // Replaced altogether
+    truncate( e.start );
+    e.hasChildren = false;
+    e.fillIfEmpty = false;
+    e.attrs       = Attributes();
+  }
 
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
-    }
+  if ( Filetype::isNameOfPicture( filename ) ) {
+    QUrl url;
+    url.setScheme( "bres" );
+    url.setHost( QString::fromUtf8( dictPtr->getId().c_str() ) );
+    url.setPath( Utils::Url::ensureLeadingSlash( QString::fromUtf8( filename.c_str() ) ) );
 
-    el.setTagName( "span" );
-    if ( isLogicalFormat ) {
-      el.setAttribute( "class", "xdxf_tr" );
-    }
-    else {
-      el.setAttribute( "class", "xdxf_tr_old" );
-    }
+    e.tagName = "img";
+    e.attrs.set( "src", url.toEncoded().data() );
+    e.attrs.set( "alt", Html::escape( filename ).c_str() );
+    close();
   }
+  else if ( Filetype::isNameOfSound( filename ) ) {
+    QUrl url;
+    url.setScheme( "gdau" );
+    url.setHost( QString::fromUtf8( dictPtr->getId().c_str() ) );
+    url.setPath( Utils::Url::ensureLeadingSlash( QString::fromUtf8( filename.c_str() ) ) );
+
+    e.tagName = "script";
+    e.attrs.set( "type", "text/javascript" );
+    e.deferred = false;
+    writeStartTag( e );
+    beginChild( true ); // An empty text
+    close();
+
+    addAudioLink( string( "\"" ) + url.toEncoded().data() + "\"", dictPtr->getId() );
+
+    Attributes spanAttrs;
+    spanAttrs.set( "class", "xdxf_wav" );
+    open( "span", std::move( spanAttrs ) );
+
+    Attributes aAttrs;
+    aAttrs.set( "href", url.toEncoded().data() );
+    open( "a", std::move( aAttrs ) );
+
+    Attributes imgAttrs;
+    imgAttrs.set( "src", "qrc:///icons/playsound.png" );
+    imgAttrs.set( "border", "0" );
+    imgAttrs.set( "align", "absmiddle" );
+    imgAttrs.set( "alt", "Play" );
+    open( "img", std::move( imgAttrs ) );
+
+    close();
+    close();
+    close();
+  }
+  else {
+    // We don't really know how to handle this at the moment, so we'll just
+    // convert it to a span and leave it as is for now.
 
-  // Ensure that ArticleNetworkAccessManager can deal with XDXF images.
-  // We modify the URL by using the dictionary ID as the hostname.
-  // This is necessary to determine from which dictionary a requested
-  // image originates.
-  nodes = dd.elementsByTagName( "img" );
+    e.tagName = "span";
+    e.attrs.set( "class", "xdxf_rref" );
+    close();
+  }
+}
 
-  for ( int i = 0; i < nodes.size(); i++ ) {
-    QDomElement el = nodes.at( i ).toElement();
+void Converter::writeDefNumbers()
+{
+  if ( defNumbers.empty() ) {
+    return;
+  }
 
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
-    }
+  string result;
+  result.reserve( out.size() + defNumbers.size() * 8 );
 
-    if ( el.hasAttribute( "src" ) ) {
-      fixLink( el, dictPtr->getId(), "src" );
-    }
+  size_t written = 0;
 
-    if ( el.hasAttribute( "losrc" ) ) {
-      fixLink( el, dictPtr->getId(), "losrc" );
-    }
+  for ( auto const & n : defNumbers ) {
+    result.append( out, written, n.position - written );
+    written = n.position;
+
+    // the number to be inserted into the beginning of <def> (I,II,IV,1,2,3,a),b),c)...)
+    string const count = std::to_string( n.count );
 
-    if ( el.hasAttribute( "hisrc" ) ) {
-      fixLink( el, dictPtr->getId(), "hisrc" );
+    if ( maxDefDepth == 1 ) {
+      result += count + ". ";
+    }
+    else if ( maxDefDepth == 2 ) {
+      result += count + ( n.depth == 1 ? ". " : ") " );
+    }
+    else if ( n.depth == 1 ) {
+      result += convertToRoman( n.count, 0 ) + ". ";
+    }
+    else if ( n.depth == 2 ) {
+      result += count + ". ";
+    }
+    else if ( n.depth == 3 ) {
+      result += count + ") ";
+    }
+    else if ( n.depth == 4 ) {
+      result += convertToRoman( n.count, 1 ) + ") ";
     }
   }
 
-  nodes = dd.elementsByTagName( "rref" ); // Resource reference
+  result.append( out, written, string::npos );
+  out.swap( result );
+}
+
+bool Converter::convert( QByteArray const & xml, size_t sizeHint )
+{
+  out.reserve( sizeHint + sizeHint / 2 );
 
-  while ( nodes.size() ) {
-    QDomElement el = nodes.at( 0 ).toElement();
+  if ( headword ) {
+    headword->clear();
+  }
 
-    if ( el.text().isEmpty() && el.childNodes().isEmpty() ) {
-      el.appendChild( fakeElement( dd ) );
-    }
+  stack.emplace_back(); // The document
 
-    //    if( type == XDXF && dictPtr != NULL && !el.hasAttribute( "start" ) )
-    if ( dictPtr != NULL && !el.hasAttribute( "start" ) ) {
-      string filename = Text::toUtf8( el.text().toStdU32String() );
+  QXmlStreamReader reader( xml );
+  reader.setNamespaceProcessing( false );
 
-      if ( Filetype::isNameOfPicture( filename ) ) {
-        QUrl url;
-        url.setScheme( "bres" );
-        url.setHost( QString::fromUtf8( dictPtr->getId().c_str() ) );
-        url.setPath( Utils::Url::ensureLeadingSlash( QString::fromUtf8( filename.c_str() ) ) );
+  while ( !reader.atEnd() ) {
+    switch ( reader.readNext() ) {
+      case QXmlStreamReader::StartElement:
+        startElement( reader.qualifiedName(), reader.attributes() );
+        break;
 
-        QDomElement newEl = dd.createElement( "img" );
-        newEl.setAttribute( "src", url.toEncoded().data() );
-        newEl.setAttribute( "alt", Html::escape( filename ).c_str() );
+      case QXmlStreamReader::EndElement:
+        endElement();
+        break;
 
-        QDomNode parent = el.parentNode();
-        if ( !parent.isNull() ) {
-          parent.replaceChild( newEl, el );
-          continue;
+      case QXmlStreamReader::Characters:
+        // Text consisting only of whitespace was skipped by QDomDocument
+        if ( !reader.isWhitespace() && ( reader.isCDATA() || !reader.text().trimmed().isEmpty() ) ) {
+          text( reader.text(), reader.isCDATA() );
         }
-      }
-      else if ( Filetype::isNameOfSound( filename ) ) {
+        break;
+
+      case QXmlStreamReader::Comment:
+        comment( reader.text() );
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  if ( reader.hasError() ) {
+    qWarning( "Xdxf2html error, xml parse failed: %s at %lld,%lld",
+              reader.errorString().toStdString().c_str(),
+              reader.lineNumber(),
+              reader.columnNumber() );
+    return false;
+  }
 
-        QDomElement el_script = dd.createElement( "script" );
-        QDomNode parent       = el.parentNode();
-        if ( !parent.isNull() ) {
-          QUrl url;
-          url.setScheme( "gdau" );
-          url.setHost( QString::fromUtf8( dictPtr->getId().c_str() ) );
-          url.setPath( Utils::Url::ensureLeadingSlash( QString::fromUtf8( filename.c_str() ) ) );
+  if ( stack.front().hasChildren && !stack.front().lastChildIsText ) {
+    layout( "\n" );
+  }
 
-          el_script.setAttribute( "type", "text/javascript" );
-          parent.replaceChild( el_script, el );
+  writeDefNumbers();
 
-          el_script.appendChild( dd.createTextNode( "" ) );
+  if ( output == Output::Text ) {
+    size_t const end = out.find_last_not_of( " \t\r\n" );
+    out.erase( end == string::npos ? 0 : end + 1 );
+    out.erase( 0, out.find_first_not_of( " \t\r\n" ) );
+  }
 
-          addAudioLink( string( "\"" ) + url.toEncoded().data() + "\"", dictPtr->getId() );
+  return true;
+}
 
-          QDomElement el_span = dd.createElement( "span" );
-          el_span.setAttribute( "class", "xdxf_wav" );
-          parent.insertAfter( el_span, el_script );
+} // namespace
 
-          QDomElement el_a = dd.createElement( "a" );
-          el_a.setAttribute( "href", url.toEncoded().data() );
-          el_span.appendChild( el_a );
+string convert( string const & in,
+                DICT_TYPE type,
+                map< string, string > const * pAbrv,
+                Dictionary::Class * dictPtr,
+                bool isLogicalFormat,
+                unsigned revisionNumber,
+                QString * headword,
+                Output output )
+{
+  // Convert spaces after each end of line to &nbsp;s, and then each end of
+  // line to a <br>
 
-          QDomElement el_img = dd.createElement( "img" );
-          el_img.setAttribute( "src", "qrc:///icons/playsound.png" );
-          el_img.setAttribute( "border", "0" );
-          el_img.setAttribute( "align", "absmiddle" );
-          el_img.setAttribute( "alt", "Play" );
-          el_a.appendChild( el_img );
+  string inConverted;
 
-          continue;
+  inConverted.reserve( in.size() );
+
+  bool afterEol = false;
+
+  for ( char i : in ) {
+    switch ( i ) {
+      case '\n':
+        afterEol = true;
+        if ( !isLogicalFormat ) {
+          inConverted.append( "<br/>" );
         }
-      }
+        break;
+
+      case '\r':
+        break;
+
+      case ' ':
+        if ( afterEol ) {
+          if ( !isLogicalFormat ) {
+            inConverted.append( "&#160;" ); // xml don't have &nbsp;
+          }
+          break;
+        }
+        [[fallthrough]];
+      default:
+        inConverted.push_back( i );
+        afterEol = false;
     }
+  }
 
-    // We don't really know how to handle this at the moment, so we'll just
-    // convert it to a span and leave it as is for now.
+  string in_data;
+  if ( type == XDXF ) {
+    in_data = "<div class=\"xdxf\"";
+    if ( dictPtr->isToLanguageRTL() ) {
+      in_data += " dir=\"rtl\"";
+    }
+    in_data += ">";
+  }
+  else {
+    in_data = "<div class=\"sdct_x\">";
+  }
+  in_data += inConverted + "</div>";
 
-    el.setTagName( "span" );
-    el.setAttribute( "class", "xdxf_rref" );
+  Converter converter( type, pAbrv, dictPtr, isLogicalFormat, revisionNumber, headword, output );
+
+  if ( !converter.convert( QByteArray::fromStdString( in_data ), in_data.size() ) ) {
+    qWarning( "The input was: %s", in_data.c_str() );
+
+    if ( output == Output::Text ) {
+      return Html::unescape( QString::fromStdString( in ) ).toStdString();
+    }
+    return in;
   }
 
-  //workaround,  the xml is not very suitable to process the html content.  such as <blockquote/> is valid in xml ,while invalid in html.
-  return dd.toString().remove( RX::Html::emptyXmlTag ).toUtf8().data();
+  return std::move( converter.result() );
 }
 
 } // namespace Xdxf2Html
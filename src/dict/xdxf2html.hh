@@ -17,17 +17,24 @@ enum DICT_TYPE {
   XDXF
 };
 
+enum class Output {
+  Html,
+  Text, // The text the html reads as, e.g. for the full-text search
+};
+
 using std::string;
 using std::map;
 
 /// Converts the given xdxf markup to an html one. This is currently used
-/// for Stardict's 'x' records.
+/// for Stardict's 'x' records. The conversion is done in one pass over the
+/// markup, without building its document tree.
 string convert( string const &,
                 DICT_TYPE type,
                 map< string, string > const * pAbrv,
                 Dictionary::Class * dictPtr,
                 bool isLogicalFormat    = false,
                 unsigned revisionNumber = 0,
-                QString * headword      = 0 );
+                QString * headword      = 0,
+                Output output           = Output::Html );
 
 } // namespace Xdxf2Html
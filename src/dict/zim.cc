@@ -11,9 +11,11 @@
   #include "filetype.hh"
   #include "dictfile.hh"
   #include "utils.hh"
+  #include "scheduler.hh"
   #include "tiff.hh"
   #include "ftshelpers.hh"
   #include "htmlescape.hh"
+  #include "metadata.hh"
 
   #include <QByteArray>
   #include <QFile>
@@ -26,7 +28,6 @@
   #include <set>
   #include <map>
   #include <algorithm>
-  #include <QtConcurrentRun>
   #include <utility>
   #include "globalregex.hh"
   #include <zim/zim.h>
@@ -57,6 +58,9 @@ DEF_EX( exUserAbort, "User abort", Dictionary::Ex )
 
 using ZimFile = zim::Archive;
 
+/// Upper bound of images prefetched for a single article
+constexpr int MaxPrefetchedResources = 64;
+
 
 enum {
   Signature            = 0x584D495A, // ZIMX on little-endian, XMIZ on big-endian
@@ -143,22 +147,62 @@ quint32 readArticleByPath( ZimFile const & file, const string & path, string & r
   }
 }
 
+/// Applies the libzim cache sizes from the metadata.toml beside the zim file, if any
+void applyCacheSettings( ZimFile & file, QString const & zimFileName )
+{
+  auto const metadata =
+    Metadata::load( Utils::Path::combine( QFileInfo( zimFileName ).absolutePath(), "metadata.toml" ).toStdString() );
+  if ( !metadata ) {
+    return;
+  }
+
+  #ifdef ZIM_CACHE_CONTROL
+  if ( metadata->zimClusterCacheMb ) {
+    size_t const bytes = static_cast< size_t >( *metadata->zimClusterCacheMb ) * 1024 * 1024;
+    #ifdef ZIM_GLOBAL_CLUSTER_CACHE
+    // The cluster cache is shared by all archives, never shrink it below what another dictionary asked for
+    if ( bytes > zim::getClusterCacheMaxSize() ) {
+      zim::setClusterCacheMaxSize( bytes );
+    }
+    #else
+    // The cache is counted in clusters here, libzim writes clusters of about 2MiB by default
+    file.setClusterCacheMaxSize( std::max< size_t >( 1, bytes / ( 2 * 1024 * 1024 ) ) );
+    #endif
+  }
+  if ( metadata->zimDirentCache ) {
+    file.setDirentCacheMaxSize( static_cast< size_t >( *metadata->zimDirentCache ) );
+  }
+  #else
+  Q_UNUSED( file )
+  if ( metadata->zimClusterCacheMb || metadata->zimDirentCache ) {
+    qWarning( "Zim: cache settings of %s are ignored, libzim is too old", zimFileName.toUtf8().constData() );
+  }
+  #endif
+}
+
 // ZimDictionary
 
+/// zim::Archive is safe to be read from multiple threads at once, and keeps
+/// its own caches of clusters and dirents, so the reads are not serialized here.
 class ZimDictionary: public BtreeIndexing::BtreeDictionary
 {
   QMutex idxMutex;
-  QMutex zimMutex;
   File::Index idx;
   IdxHeader idxHeader;
   ZimFile df;
   set< quint32 > articlesIndexedForFTS;
 
+  /// Warms libzim's cluster cache with the images of the articles being rendered.
+  /// The jobs are waited for before the archive goes away.
+  QMutex prefetchMutex;
+  QList< QFuture< void > > prefetches;
+  QAtomicInt prefetchCancelled;
+
 public:
 
   ZimDictionary( string const & id, string const & indexFile, vector< string > const & dictionaryFiles );
 
-  ~ZimDictionary() = default;
+  ~ZimDictionary();
 
 
   unsigned long getArticleCount() noexcept override
@@ -191,6 +235,10 @@ public:
   /// Loads the resource.
   void loadResource( std::string & resourceName, string & data );
 
+  /// Starts decoding the images referenced by the given article html in
+  /// background, so they are already cached when the article view asks for them.
+  void prefetchResources( string const & articleHtml );
+
   sptr< Dictionary::DataRequest >
   getSearchResults( QString const & searchString, int searchMode, bool matchCase, bool ignoreDiacritics ) override;
   void getArticleText( uint32_t articleAddress, QString & headword, QString & text ) override;
@@ -242,6 +290,18 @@ ZimDictionary::ZimDictionary( string const & id, string const & indexFile, vecto
   // Full-text search parameters
 
   ftsIdxName = indexFile + Dictionary::getFtsSuffix();
+
+  applyCacheSettings( df, QString::fromStdString( dictionaryFiles[ 0 ] ) );
+}
+
+ZimDictionary::~ZimDictionary()
+{
+  prefetchCancelled.ref();
+
+  QMutexLocker _( &prefetchMutex );
+  for ( auto & prefetch : prefetches ) {
+    prefetch.waitForFinished();
+  }
 }
 
 void ZimDictionary::loadIcon() noexcept
@@ -281,18 +341,57 @@ void ZimDictionary::loadIcon() noexcept
 
 quint32 ZimDictionary::loadArticle( quint32 address, string & articleText, bool rawText )
 {
-  quint32 ret = 0;
-  {
-    QMutexLocker _( &zimMutex );
-    ret = readArticle( df, address, articleText );
-  }
+  quint32 ret = readArticle( df, address, articleText );
   if ( !rawText ) {
+    // Let the images decode while the html is being converted
+    prefetchResources( articleText );
     articleText = convert( articleText );
   }
 
   return ret;
 }
 
+void ZimDictionary::prefetchResources( string const & articleHtml )
+{
+  vector< string > paths;
+  set< QString > seen;
+
+  QRegularExpressionMatchIterator it = RX::Zim::imgSrc.globalMatch( QString::fromUtf8( articleHtml.data(), articleHtml.size() ) );
+  while ( it.hasNext() && paths.size() < MaxPrefetchedResources ) {
+    QString url = it.next().captured( 1 );
+    if ( url.isEmpty() || url.startsWith( "//" ) || url.startsWith( "http://" ) || url.startsWith( "https://" )
+         || url.startsWith( "data:" ) ) {
+      continue;
+    }
+    // Same normalization as getResource() does for the bres:// links
+    url.remove( RX::Zim::leadingDotSlash );
+    if ( seen.insert( url ).second ) {
+      paths.push_back( url.toStdString() );
+    }
+  }
+
+  QMutexLocker _( &prefetchMutex );
+
+  prefetches.removeIf( []( QFuture< void > const & prefetch ) {
+    return prefetch.isFinished();
+  } );
+
+  for ( auto & path : paths ) {
+    prefetches.append( Scheduler::run( Scheduler::Priority::Prefetch, [ this, path ]() {
+      if ( Utils::AtomicInt::loadAcquire( prefetchCancelled ) ) {
+        return;
+      }
+      try {
+        // Fetching the blob decompresses its cluster into libzim's cache, the data itself is dropped
+        df.getEntryByPath( path ).getItem( true ).getData();
+      }
+      catch ( std::exception & ) {
+        // Missing resources are reported when they are actually requested
+      }
+    } ) );
+  }
+}
+
 string ZimDictionary::convert( const string & in )
 {
   QString text = QString::fromUtf8( in.c_str() );
@@ -448,7 +547,6 @@ void ZimDictionary::loadResource( std::string & resourceName, string & data )
   if ( resourceName.empty() ) {
     return;
   }
-  QMutexLocker _( &zimMutex );
   readArticleByPath( df, resourceName, data );
 }
 
@@ -505,11 +603,13 @@ void ZimDictionary::getArticleText( uint32_t articleAddress, QString & headword,
 sptr< Dictionary::DataRequest >
 ZimDictionary::getSearchResults( QString const & searchString, int searchMode, bool matchCase, bool ignoreDiacritics )
 {
-  return std::make_shared< FtsHelpers::FTSResultsRequest >( *this,
-                                                            searchString,
-                                                            searchMode,
-                                                            matchCase,
-                                                            ignoreDiacritics );
+  return Dictionary::runRequest< FtsHelpers::FTSResultsRequest >( Scheduler::Priority::Lookup,
+                                                                  this,
+                                                                  *this,
+                                                                  searchString,
+                                                                  searchMode,
+                                                                  matchCase,
+                                                                  ignoreDiacritics );
 }
 
 /// ZimDictionary::getArticle()
@@ -522,7 +622,6 @@ class ZimArticleRequest: public Dictionary::DataRequest
   bool ignoreDiacritics;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
 
@@ -535,9 +634,6 @@ public:
     dict( dict_ ),
     ignoreDiacritics( ignoreDiacritics_ )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -546,12 +642,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~ZimArticleRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void ZimArticleRequest::run()
@@ -672,7 +762,16 @@ sptr< Dictionary::DataRequest > ZimDictionary::getArticle( u32string const & wor
                                                            bool ignoreDiacritics )
 
 {
-  return std::make_shared< ZimArticleRequest >( word, alts, *this, ignoreDiacritics );
+  if ( !mayContainAny( word, alts ) ) {
+    return std::make_shared< Dictionary::DataRequestInstant >( false ); // No such word
+  }
+
+  return Dictionary::runRequest< ZimArticleRequest >( Scheduler::Priority::Lookup,
+                                                      this,
+                                                      word,
+                                                      alts,
+                                                      *this,
+                                                      ignoreDiacritics );
 }
 
 //// ZimDictionary::getResource()
@@ -685,16 +784,12 @@ class ZimResourceRequest: public Dictionary::DataRequest
   string resourceName;
 
   QAtomicInt isCancelled;
-  QFuture< void > f;
 
 public:
   ZimResourceRequest( ZimDictionary & dict_, string resourceName_ ):
     dict( dict_ ),
     resourceName( std::move( resourceName_ ) )
   {
-    f = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
   }
 
   void run();
@@ -703,12 +798,6 @@ public:
   {
     isCancelled.ref();
   }
-
-  ~ZimResourceRequest()
-  {
-    isCancelled.ref();
-    f.waitForFinished();
-  }
 };
 
 void ZimResourceRequest::run()
@@ -763,7 +852,10 @@ void ZimResourceRequest::run()
 sptr< Dictionary::DataRequest > ZimDictionary::getResource( string const & name )
 {
   auto noLeadingDot = QString::fromStdString( name ).remove( RX::Zim::leadingDotSlash );
-  return std::make_shared< ZimResourceRequest >( *this, noLeadingDot.toStdString() );
+  return Dictionary::runRequest< ZimResourceRequest >( Scheduler::Priority::Resource,
+                                                       this,
+                                                       *this,
+                                                       noLeadingDot.toStdString() );
 }
 
 u32string normalizeWord( const std::string & url );
@@ -0,0 +1,330 @@
+/* Licensed under GPLv3 or later, see the LICENSE file */
+
+#include "dict_netmgr.hh"
+#include <QAbstractNetworkCache>
+#include <QRegularExpression>
+#include <climits>
+#include <cstring>
+
+namespace {
+
+/// The memory the responses are kept in, in bytes
+qsizetype const MemoryCacheSize = 32 << 20;
+
+/// The attributes the dictionaries may look at
+QNetworkRequest::Attribute const KeptAttributes[] = {
+  QNetworkRequest::HttpStatusCodeAttribute,
+  QNetworkRequest::HttpReasonPhraseAttribute,
+  QNetworkRequest::RedirectionTargetAttribute,
+  QNetworkRequest::SourceIsFromCacheAttribute,
+};
+
+/// The reply the requests get. It gets the whole response at once, either
+/// from memory or once the request it waits for is done.
+class BufferedReply: public QNetworkReply
+{
+public:
+
+  BufferedReply( QObject * parent, QNetworkRequest const & request ):
+    QNetworkReply( parent )
+  {
+    setRequest( request );
+    setUrl( request.url() );
+    setOperation( QNetworkAccessManager::GetOperation );
+    setOpenMode( ReadOnly );
+  }
+
+  /// The request it waits for, which gets told to ignore the ssl errors
+  void setSource( QNetworkReply * source_ )
+  {
+    source = source_;
+  }
+
+  void deliver( DictNetworkAccessManager::Response const & response )
+  {
+    if ( isFinished() ) {
+      return; // Was aborted
+    }
+
+    setUrl( response.url );
+
+    for ( auto const & [ attribute, value ] : response.attributes ) {
+      setAttribute( attribute, value );
+    }
+
+    for ( auto const & [ name, value ] : response.headers ) {
+      setRawHeader( name, value );
+    }
+
+    body = response.body;
+
+    if ( response.error != NoError ) {
+      setError( response.error, response.errorString );
+    }
+
+    emit metaDataChanged();
+
+    if ( !body.isEmpty() ) {
+      emit readyRead();
+    }
+
+    if ( response.error != NoError ) {
+      emit errorOccurred( response.error );
+    }
+
+    setFinished( true );
+    emit finished();
+  }
+
+  void abort() override
+  {
+    if ( isFinished() ) {
+      return;
+    }
+
+    setError( OperationCanceledError, "Operation canceled" );
+    emit errorOccurred( OperationCanceledError );
+    setFinished( true );
+    emit finished();
+  }
+
+  void ignoreSslErrors() override
+  {
+    if ( source ) {
+      source->ignoreSslErrors();
+    }
+  }
+
+  qint64 bytesAvailable() const override
+  {
+    return body.size() - alreadyRead + QNetworkReply::bytesAvailable();
+  }
+
+protected:
+
+  qint64 readData( char * data, qint64 maxSize ) override
+  {
+    qint64 const toRead = qMin( maxSize, qint64( body.size() ) - alreadyRead );
+
+    if ( toRead <= 0 ) {
+      return isFinished() && maxSize ? -1 : 0;
+    }
+
+    memcpy( data, body.constData() + alreadyRead, toRead );
+    alreadyRead += toRead;
+
+    return toRead;
+  }
+
+private:
+
+  QPointer< QNetworkReply > source;
+  QByteArray body;
+  qint64 alreadyRead = 0;
+};
+
+} // namespace
+
+DictNetworkAccessManager::DictNetworkAccessManager( QObject * parent ):
+  QNetworkAccessManager( parent ),
+  memory( MemoryCacheSize )
+{
+}
+
+DictNetworkAccessManager::~DictNetworkAccessManager()
+{
+  quint64 const total = counters.memoryHits + counters.diskHits + counters.coalesced + counters.fetched;
+
+  if ( total ) {
+    qDebug( "Dictionary network cache: %llu requests, %llu from memory, %llu from disk, %llu coalesced (%.1f%% hits)",
+            total,
+            counters.memoryHits,
+            counters.diskHits,
+            counters.coalesced,
+            100.0 * ( total - counters.fetched ) / total );
+  }
+}
+
+void DictNetworkAccessManager::setCacheTtl( int seconds )
+{
+  if ( seconds != ttl ) {
+    ttl = seconds;
+    memory.clear(); // Kept for the old time
+  }
+}
+
+void DictNetworkAccessManager::clearCache()
+{
+  memory.clear();
+
+  if ( QAbstractNetworkCache * disk = cache() ) {
+    disk->clear();
+  }
+}
+
+QNetworkReply *
+DictNetworkAccessManager::createRequest( Operation op, QNetworkRequest const & request, QIODevice * outgoingData )
+{
+  QString const scheme = request.url().scheme();
+
+  if ( op != GetOperation || ( scheme != "http" && scheme != "https" )
+       || request.attribute( QNetworkRequest::CacheLoadControlAttribute ).toInt() == QNetworkRequest::AlwaysNetwork ) {
+    return QNetworkAccessManager::createRequest( op, request, outgoingData );
+  }
+
+  QByteArray const key = request.url().toEncoded();
+  auto * reply         = new BufferedReply( this, request );
+
+  if ( Response const * cached = memory.object( key );
+       cached && cached->expires > QDateTime::currentDateTimeUtc() ) {
+    ++counters.memoryHits;
+
+    Response response = *cached;
+    response.attributes.emplace_back( QNetworkRequest::SourceIsFromCacheAttribute, true );
+
+    // The caller connects to the reply once it's returned
+    QMetaObject::invokeMethod(
+      reply,
+      [ reply, response = std::move( response ) ]() {
+        reply->deliver( response );
+      },
+      Qt::QueuedConnection );
+
+    return reply;
+  }
+
+  if ( auto i = inFlight.find( key ); i != inFlight.end() ) {
+    ++counters.coalesced;
+
+    reply->setSource( i->reply );
+    i->waiters.emplace_back( reply );
+
+    return reply;
+  }
+
+  QNetworkRequest networkRequest( request );
+
+  if ( QAbstractNetworkCache * disk = cache(); disk && ttl > 0 ) {
+    // The expiration date of what's on disk was set to the ttl when stored
+    QNetworkCacheMetaData const metaData = disk->metaData( request.url() );
+
+    if ( metaData.isValid() && metaData.expirationDate() > QDateTime::currentDateTimeUtc() ) {
+      networkRequest.setAttribute( QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferCache );
+    }
+  }
+
+  QNetworkReply * source = QNetworkAccessManager::createRequest( op, networkRequest, outgoingData );
+
+  reply->setSource( source );
+  inFlight.insert( key, Fetch{ source, { reply } } );
+
+  connect( source, &QNetworkReply::finished, this, [ this, key, source ]() {
+    fetched( key, source );
+  } );
+
+#ifndef QT_NO_SSL
+  connect( source, &QNetworkReply::sslErrors, this, [ this, key ]( QList< QSslError > const & errors ) {
+    if ( auto i = inFlight.find( key ); i != inFlight.end() ) {
+      for ( auto const & waiter : std::as_const( i->waiters ) ) {
+        if ( waiter ) {
+          emit waiter->sslErrors( errors );
+        }
+      }
+    }
+  } );
+#endif
+
+  return reply;
+}
+
+void DictNetworkAccessManager::fetched( QByteArray const & key, QNetworkReply * source )
+{
+  source->deleteLater();
+
+  Fetch const fetch = inFlight.take( key );
+
+  bool const fromDisk = source->attribute( QNetworkRequest::SourceIsFromCacheAttribute ).toBool();
+
+  if ( fromDisk ) {
+    ++counters.diskHits;
+  }
+  else {
+    ++counters.fetched;
+  }
+
+  Response response;
+  response.url         = source->url();
+  response.error       = source->error();
+  response.errorString = source->errorString();
+  response.headers     = source->rawHeaderPairs();
+  response.body        = source->readAll();
+
+  for ( auto attribute : KeptAttributes ) {
+    QVariant const value = source->attribute( attribute );
+    if ( value.isValid() ) {
+      response.attributes.emplace_back( attribute, value );
+    }
+  }
+
+  int const status = source->attribute( QNetworkRequest::HttpStatusCodeAttribute ).toInt();
+
+  if ( response.error == QNetworkReply::NoError && status >= 200 && status < 300 ) {
+    int const freshness = ttl > 0 ? ttl : freshnessOf( *source );
+
+    if ( freshness > 0 ) {
+      auto * kept    = new Response( response );
+      kept->expires  = QDateTime::currentDateTimeUtc().addSecs( freshness );
+      qsizetype cost = kept->body.size() + 1024;
+
+      memory.insert( key, kept, cost );
+    }
+
+    QAbstractNetworkCache * disk = cache();
+
+    if ( disk && ttl > 0 && !fromDisk ) {
+      QNetworkCacheMetaData metaData = disk->metaData( source->request().url() );
+
+      if ( metaData.isValid() ) {
+        metaData.setExpirationDate( QDateTime::currentDateTimeUtc().addSecs( ttl ) );
+        disk->updateMetaData( metaData );
+      }
+    }
+  }
+
+  for ( auto const & waiter : fetch.waiters ) {
+    if ( waiter ) {
+      static_cast< BufferedReply * >( waiter.data() )->deliver( response );
+    }
+  }
+}
+
+int DictNetworkAccessManager::freshnessOf( QNetworkReply const & reply ) const
+{
+  QByteArray const cacheControl = reply.rawHeader( "Cache-Control" ).toLower();
+
+  if ( cacheControl.contains( "no-store" ) || cacheControl.contains( "no-cache" )
+       || reply.rawHeader( "Pragma" ).toLower().contains( "no-cache" ) ) {
+    return 0;
+  }
+
+  static QRegularExpression const maxAge( R"(\bmax-age\s*=\s*(\d+))" );
+
+  if ( QRegularExpressionMatch const match = maxAge.match( QString::fromLatin1( cacheControl ) ); match.hasMatch() ) {
+    return match.captured( 1 ).toInt();
+  }
+
+  QDateTime const expires =
+    QDateTime::fromString( QString::fromLatin1( reply.rawHeader( "Expires" ) ).trimmed(), Qt::RFC2822Date );
+
+  if ( !expires.isValid() ) {
+    return 0;
+  }
+
+  QDateTime date = QDateTime::fromString( QString::fromLatin1( reply.rawHeader( "Date" ) ).trimmed(), Qt::RFC2822Date );
+
+  if ( !date.isValid() ) {
+    date = QDateTime::currentDateTimeUtc();
+  }
+
+  return int( qBound( qint64( 0 ), date.secsTo( expires ), qint64( INT_MAX ) ) );
+}
@@ -0,0 +1,85 @@
+/* Licensed under GPLv3 or later, see the LICENSE file */
+
+#pragma once
+
+#include <QCache>
+#include <QDateTime>
+#include <QHash>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QPointer>
+#include <utility>
+#include <vector>
+
+/// The network access manager of the online dictionaries. The responses to
+/// their GET requests are kept in memory, and on disk if a disk cache is set,
+/// for as long as their cache headers allow, or for a fixed time if one is
+/// set. So a word looked up again, e.g. from the popup or the history, isn't
+/// fetched again. Identical requests made while one is on the way wait for
+/// its response instead of going to the network themselves.
+class DictNetworkAccessManager: public QNetworkAccessManager
+{
+  Q_OBJECT
+
+public:
+
+  struct Stats
+  {
+    quint64 memoryHits = 0; // Served from memory
+    quint64 diskHits   = 0; // Served from the disk cache
+    quint64 coalesced  = 0; // Got the response of an identical request
+    quint64 fetched    = 0; // Went to the network
+  };
+
+  explicit DictNetworkAccessManager( QObject * parent );
+
+  ~DictNetworkAccessManager() override;
+
+  /// Keeps the responses for the given number of seconds, whatever their
+  /// cache headers say. Zero goes back to following the headers.
+  void setCacheTtl( int seconds );
+
+  /// Drops the responses kept in memory and on disk
+  void clearCache();
+
+  Stats const & stats() const
+  {
+    return counters;
+  }
+
+  /// A response, as the requests get it
+  struct Response
+  {
+    QUrl url; // After the redirects
+    QNetworkReply::NetworkError error = QNetworkReply::NoError;
+    QString errorString;
+    QList< QNetworkReply::RawHeaderPair > headers;
+    std::vector< std::pair< QNetworkRequest::Attribute, QVariant > > attributes;
+    QByteArray body;
+    QDateTime expires; // Until when it may be served from memory
+  };
+
+protected:
+
+  QNetworkReply * createRequest( Operation, QNetworkRequest const &, QIODevice * outgoingData ) override;
+
+private:
+
+  /// A request on the way, along with the replies waiting for it
+  struct Fetch
+  {
+    QNetworkReply * reply;
+    std::vector< QPointer< QNetworkReply > > waiters;
+  };
+
+  QCache< QByteArray, Response > memory;
+  QHash< QByteArray, Fetch > inFlight;
+  int ttl = 0;
+  Stats counters;
+
+  void fetched( QByteArray const & key, QNetworkReply * );
+
+  /// Returns for how many seconds the response may be served without asking
+  /// the server again
+  int freshnessOf( QNetworkReply const & ) const;
+};
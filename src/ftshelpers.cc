@@ -8,7 +8,16 @@
 #include "dictfile.hh"
 #include "folding.hh"
 #include "utils.hh"
-
+#include "wildcard.hh"
+
+#include <QCryptographicHash>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QStringMatcher>
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 #include <string>
 
@@ -21,6 +30,295 @@ namespace FtsHelpers {
 // finished  reversed   dehsinif
 const static std::string finish_mark = std::string( "dehsinif" );
 
+namespace {
+
+enum {
+  ScanChunkSize  = 64, // Articles a scanning thread takes at once
+  MaxScanResults = 100 // As many as taken from the full-text index
+};
+
+/// Matches article texts against the search string, for when there's no
+/// full-text index to query. The cheap substring searches run first, and most
+/// of the articles never get to the regular expressions.
+class TextMatcher
+{
+public:
+
+  TextMatcher( QString const & searchString, int searchMode, bool matchCase )
+  {
+    Qt::CaseSensitivity const cs = matchCase ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    QRegularExpression::PatternOptions const options = QRegularExpression::UseUnicodePropertiesOption
+      | ( matchCase ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption );
+
+    switch ( searchMode ) {
+      case FTS::PlainText:
+        required.emplace_back( searchString, cs );
+        break;
+
+      case FTS::Wildcards:
+        regexp = QRegularExpression( wildcardsToRegexp( searchString ), options );
+        requireLongestLiteral( searchString, cs );
+        break;
+
+      case FTS::RegExp:
+        regexp = QRegularExpression( searchString, options );
+        break;
+
+      default: {
+        // Only the plain words of the query language are supported. Every one
+        // has to be there, except the ones negated with a minus.
+        for ( QString word : searchString.split( QRegularExpression( R"(\s+)" ), Qt::SkipEmptyParts ) ) {
+          word.remove( '"' );
+
+          bool const negated = word.startsWith( '-' );
+
+          if ( negated || word.startsWith( '+' ) ) {
+            word.remove( 0, 1 );
+          }
+
+          if ( word.isEmpty() || word == "AND" || word == "OR" || word == "NOT" ) {
+            continue;
+          }
+
+          QRegularExpression wholeWord( "(?<!\\w)" + QRegularExpression::escape( word ) + "(?!\\w)", options );
+
+          if ( negated ) {
+            excluded.push_back( wholeWord );
+          }
+          else {
+            required.emplace_back( word, cs );
+            wholeWords.push_back( wholeWord );
+          }
+        }
+      }
+    }
+  }
+
+  bool isValid() const
+  {
+    auto const valid = []( QRegularExpression const & r ) {
+      return r.isValid();
+    };
+
+    return regexp.isValid() && std::all_of( wholeWords.begin(), wholeWords.end(), valid )
+      && std::all_of( excluded.begin(), excluded.end(), valid );
+  }
+
+  bool matches( QString const & text ) const
+  {
+    for ( auto const & matcher : required ) {
+      if ( matcher.indexIn( text ) < 0 ) {
+        return false;
+      }
+    }
+
+    for ( auto const & wholeWord : wholeWords ) {
+      if ( !wholeWord.match( text ).hasMatch() ) {
+        return false;
+      }
+    }
+
+    for ( auto const & wholeWord : excluded ) {
+      if ( wholeWord.match( text ).hasMatch() ) {
+        return false;
+      }
+    }
+
+    return regexp.pattern().isEmpty() || regexp.match( text ).hasMatch();
+  }
+
+private:
+
+  vector< QStringMatcher > required;
+  vector< QRegularExpression > wholeWords, excluded;
+  QRegularExpression regexp;
+
+  /// Every match of a wildcard pattern has all its literal parts, the longest
+  /// one is the best to look for
+  void requireLongestLiteral( QString const & pattern, Qt::CaseSensitivity cs )
+  {
+    QString literal, longest;
+    bool inSet = false;
+
+    for ( QChar ch : pattern ) {
+      if ( inSet ) {
+        inSet = ch != ']';
+        continue;
+      }
+
+      if ( ch == '*' || ch == '?' || ch == '[' || ch == '\\' ) {
+        if ( literal.size() > longest.size() ) {
+          longest = literal;
+        }
+
+        literal.clear();
+        inSet = ch == '[';
+      }
+      else {
+        literal.append( ch );
+      }
+    }
+
+    if ( literal.size() > longest.size() ) {
+      longest = literal;
+    }
+
+    if ( !longest.isEmpty() ) {
+      required.emplace_back( longest, cs );
+    }
+  }
+};
+
+/// Returns the boolean term identifying the contents of an article. When the
+/// dictionary changes, the documents with the same term are kept as they are.
+string contentTerm( QString const & headword, QString const & articleStr )
+{
+  QCryptographicHash hash( QCryptographicHash::Md5 );
+  hash.addData( headword.toUtf8() );
+  hash.addData( QByteArrayView( "\0", 1 ) );
+  hash.addData( articleStr.toUtf8() );
+
+  return "H" + hash.result().toHex().toStdString();
+}
+
+void indexArticle( Xapian::TermGenerator & indexer,
+                   Xapian::Document & doc,
+                   QString const & headword,
+                   QString const & articleStr )
+{
+  indexer.set_document( doc );
+
+  indexer.index_text( articleStr.toStdString() );
+  indexer.index_text( headword.toStdString() );
+
+  doc.add_boolean_term( contentTerm( headword, articleStr ) );
+}
+
+/// Does the update described below on the opened index
+bool updateFTSIndex( Xapian::WritableDatabase & db, BtreeIndexing::BtreeDictionary * dict, QAtomicInt & isCancelled )
+{
+  // The index is incomplete until the finish mark is added back, so that an
+  // interrupted update is resumed the next time
+  Xapian::docid const lastDocId = db.get_lastdocid();
+  if ( lastDocId > 0 && db.get_document( lastDocId ).get_data() == finish_mark ) {
+    db.delete_document( lastDocId );
+    db.commit();
+  }
+
+  // Documents not claimed by any article are deleted in the end
+  vector< char > stale( db.get_lastdocid() + 1, 0 );
+  for ( auto i = db.postlist_begin( "" ); i != db.postlist_end( "" ); ++i ) {
+    stale[ *i ] = 1;
+  }
+
+  std::unordered_map< string, vector< Xapian::docid > > documents;
+  for ( auto term = db.allterms_begin( "H" ); term != db.allterms_end( "H" ); ++term ) {
+    auto & ids = documents[ *term ];
+    for ( auto i = db.postlist_begin( *term ); i != db.postlist_end( *term ); ++i ) {
+      ids.push_back( *i );
+    }
+  }
+
+  Xapian::TermGenerator indexer;
+  indexer.set_flags( Xapian::TermGenerator::FLAG_CJK_NGRAM );
+
+  QList< uint32_t > offsets;
+
+  dict->getArticleOffsets( offsets, &isCancelled );
+
+  long indexedDoc = 0L;
+  long reused     = 0L;
+
+  for ( auto const & address : offsets ) {
+    Scheduler::yieldToInteractive();
+
+    if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
+      throw exUserAbort();
+    }
+
+    indexedDoc++;
+
+    QString headword, articleStr;
+
+    {
+      QMutexLocker _( &dict->getArticleTextMutex() );
+      dict->getArticleText( address, headword, articleStr );
+    }
+
+    string const data = std::to_string( address );
+
+    auto found = documents.find( contentTerm( headword, articleStr ) );
+    if ( found != documents.end() && !found->second.empty() ) {
+      Xapian::docid const id = found->second.back();
+      found->second.pop_back();
+      stale[ id ] = 0;
+      ++reused;
+
+      // The article may have moved within the dictionary
+      Xapian::Document doc = db.get_document( id );
+      if ( doc.get_data() != data ) {
+        doc.set_data( data );
+        db.replace_document( id, doc );
+      }
+    }
+    else {
+      Xapian::Document doc;
+      indexArticle( indexer, doc, headword, articleStr );
+      doc.set_data( data );
+      db.add_document( doc );
+    }
+
+    dict->setIndexedFtsDoc( indexedDoc );
+  }
+
+  for ( Xapian::docid id = 1; id < stale.size(); ++id ) {
+    if ( stale[ id ] ) {
+      db.delete_document( id );
+    }
+  }
+
+  Xapian::Document doc;
+  doc.set_data( finish_mark );
+  db.add_document( doc );
+
+  db.commit();
+  db.close();
+
+  // The index is as fresh as a newly built one now
+  std::error_code ec;
+  std::filesystem::last_write_time( std::filesystem::u8path( dict->ftsIndexName() ),
+                                    std::filesystem::file_time_type::clock::now(),
+                                    ec );
+
+  qDebug() << "updated the full-text index of" << QString::fromStdString( dict->getName() ) << "," << reused
+           << "of" << offsets.size() << "articles unchanged";
+
+  return true;
+}
+
+/// Brings the existing full-text index up to date with the changed dictionary.
+/// The articles are still read, but only the new or changed ones are
+/// tokenized, the rest keep their documents, and the documents of the articles
+/// which are gone get deleted. Returns false if there's no usable index to
+/// update, in which case it has to be built from scratch. Throws exUserAbort
+/// if cancelled, leaving the index incomplete to be updated again next time.
+bool updateFTSIndex( BtreeIndexing::BtreeDictionary * dict, QAtomicInt & isCancelled )
+{
+  try {
+    Xapian::WritableDatabase db( dict->ftsIndexName(), Xapian::DB_OPEN );
+    return updateFTSIndex( db, dict, isCancelled );
+  }
+  catch ( Xapian::Error & e ) {
+    qWarning() << "update xapian index:" << QString::fromStdString( e.get_description() );
+  }
+
+  // Whatever is left of the index is of no use to the full build
+  Utils::Fs::removeDirectory( dict->ftsIndexName() );
+  return false;
+}
+
+} // namespace
+
 bool ftsIndexIsOldOrBad( BtreeIndexing::BtreeDictionary * dict )
 {
   try {
@@ -57,6 +355,13 @@ void makeFTSIndex( BtreeIndexing::BtreeDictionary * dict, QAtomicInt & isCancell
       throw exUserAbort();
     }
 
+    // An index left over from before the dictionary changed is updated in
+    // place, unless a full build is already underway
+    if ( !QFileInfo::exists( QString::fromStdString( dict->ftsIndexName() + "_temp" ) )
+         && QFileInfo::exists( QString::fromStdString( dict->ftsIndexName() ) ) && updateFTSIndex( dict, isCancelled ) ) {
+      return;
+    }
+
     // Open the database for update, creating a new database if necessary.
     Xapian::WritableDatabase db( dict->ftsIndexName() + "_temp", Xapian::DB_CREATE_OR_OPEN );
 
@@ -68,26 +373,9 @@ void makeFTSIndex( BtreeIndexing::BtreeDictionary * dict, QAtomicInt & isCancell
 
     BtreeIndexing::IndexedWords indexedWords;
 
-    QSet< uint32_t > setOfOffsets;
-    setOfOffsets.reserve( dict->getArticleCount() );
-
-    dict->findArticleLinks( nullptr, &setOfOffsets, nullptr, &isCancelled );
-
-    if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
-      throw exUserAbort();
-    }
-
     QList< uint32_t > offsets;
-    offsets.resize( setOfOffsets.size() );
-    uint32_t * ptr = offsets.data();
 
-    for ( QSet< uint32_t >::ConstIterator it = setOfOffsets.constBegin(); it != setOfOffsets.constEnd(); ++it ) {
-      *ptr = *it;
-      ptr++;
-    }
-
-    // Free memory
-    setOfOffsets.clear();
+    dict->getArticleOffsets( offsets, &isCancelled );
 
     if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
       throw exUserAbort();
@@ -125,20 +413,22 @@ void makeFTSIndex( BtreeIndexing::BtreeDictionary * dict, QAtomicInt & isCancell
         continue;
       }
 
+      Scheduler::yieldToInteractive();
+
       if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
         return;
       }
 
       QString headword, articleStr;
 
-      dict->getArticleText( address, headword, articleStr );
+      {
+        QMutexLocker _( &dict->getArticleTextMutex() );
+        dict->getArticleText( address, headword, articleStr );
+      }
 
       Xapian::Document doc;
 
-      indexer.set_document( doc );
-
-      indexer.index_text( articleStr.toStdString() );
-      indexer.index_text( headword.toStdString() );
+      indexArticle( indexer, doc, headword, articleStr );
 
       doc.set_data( std::to_string( address ) );
       // Add the document to the database.
@@ -170,6 +460,11 @@ void makeFTSIndex( BtreeIndexing::BtreeDictionary * dict, QAtomicInt & isCancell
 
 void FTSResultsRequest::run()
 {
+  if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
+    finish();
+    return;
+  }
+
   if ( !dict.ensureInitDone().empty() ) {
     setErrorString( QString::fromUtf8( dict.ensureInitDone().c_str() ) );
     finish();
@@ -208,6 +503,11 @@ void FTSResultsRequest::run()
       enquire.set_query( query );
       Xapian::MSet matches = enquire.get_mset( 0, 100 );
 
+      if ( Utils::AtomicInt::loadAcquire( isCancelled ) ) {
+        finish();
+        return;
+      }
+
       emit matchCount( matches.get_matches_estimated() );
       // Display the results.
       qDebug() << matches.get_matches_estimated() << " results found.\n";
@@ -224,27 +524,22 @@ void FTSResultsRequest::run()
 
       if ( !offsetsForHeadwords.isEmpty() ) {
         QList< QString > headwords;
-        QMutexLocker _( &dataMutex );
         QString id = QString::fromUtf8( dict.getId().c_str() );
         dict.getHeadwordsFromOffsets( offsetsForHeadwords, headwords, &isCancelled );
+
+        QList< FTS::FtsHeadword > found;
         for ( const auto & headword : std::as_const( headwords ) ) {
-          foundHeadwords->append( FTS::FtsHeadword( headword, id, QStringList(), matchCase ) );
+          found.append( FTS::FtsHeadword( headword, id, QStringList(), matchCase ) );
+        }
+
+        if ( !found.empty() ) {
+          publish( std::move( found ) );
         }
       }
     }
-    else {
-      //if no fulltext index,just returned.
-      qWarning() << "There is no fulltext index right now.";
-      finish();
-      return;
-    }
-
-    if ( foundHeadwords && !foundHeadwords->empty() ) {
-      QMutexLocker _( &dataMutex );
-      data.resize( sizeof( foundHeadwords ) );
-      memcpy( &data.front(), &foundHeadwords, sizeof( foundHeadwords ) );
-      foundHeadwords = nullptr;
-      hasAnyData     = true;
+    else if ( dict.canFTS() ) {
+      // No full-text index yet, so go through the articles themselves
+      scanArticles();
     }
   }
   catch ( const Xapian::Error & e ) {
@@ -258,4 +553,118 @@ void FTSResultsRequest::run()
   finish();
 }
 
+void FTSResultsRequest::publish( QList< FTS::FtsHeadword > && headwords )
+{
+  QMutexLocker _( &dataMutex );
+
+  batches.push_back( std::make_unique< QList< FTS::FtsHeadword > >( std::move( headwords ) ) );
+
+  QList< FTS::FtsHeadword > * const batch = batches.back().get();
+
+  size_t const size = data.size();
+  data.resize( size + sizeof( batch ) );
+  memcpy( &data[ size ], &batch, sizeof( batch ) );
+  hasAnyData = true;
+}
+
+void FTSResultsRequest::scanArticles()
+{
+  TextMatcher const matcher( searchString, searchMode, matchCase );
+
+  if ( !matcher.isValid() ) {
+    qWarning( "FTS: Invalid search pattern \"%s\"", searchString.toUtf8().data() );
+    return;
+  }
+
+  QList< uint32_t > offsets;
+
+  dict.getArticleOffsets( offsets, &isCancelled );
+
+  QString const id = QString::fromUtf8( dict.getId().c_str() );
+
+  // Each batch of hits is published as soon as it's found
+  auto const publishHits = [ & ]( QList< uint32_t > & hits ) {
+    int const before = results.fetchAndAddOrdered( int( hits.size() ) );
+
+    if ( before >= MaxScanResults ) {
+      return;
+    }
+
+    if ( before + hits.size() > MaxScanResults ) {
+      hits.resize( MaxScanResults - before );
+    }
+
+    int const count = hits.size();
+
+    QList< QString > headwords;
+    dict.getHeadwordsFromOffsets( hits, headwords, &isCancelled );
+
+    QList< FTS::FtsHeadword > batch;
+
+    for ( auto const & headword : std::as_const( headwords ) ) {
+      batch.append( FTS::FtsHeadword( headword, id, QStringList(), matchCase ) );
+    }
+
+    publish( std::move( batch ) );
+
+    emit matchCount( count );
+    update();
+  };
+
+  QAtomicInt nextChunk;
+
+  // Unless the format allows otherwise, only the matching runs in parallel,
+  // and the text is extracted one article at a time
+  bool const serialized = !dict.isArticleTextThreadSafe();
+
+  // Runs on the pool's threads too, so nothing may be thrown out of it
+  auto const scan = [ & ]() {
+    QList< uint32_t > hits;
+    QString headword, text;
+
+    try {
+      for ( ;; ) {
+        qsizetype const first = qsizetype( nextChunk.fetchAndAddRelaxed( 1 ) ) * ScanChunkSize;
+
+        if ( first >= offsets.size() || Utils::AtomicInt::loadAcquire( isCancelled )
+             || Utils::AtomicInt::loadAcquire( results ) >= MaxScanResults ) {
+          return;
+        }
+
+        hits.clear();
+
+        for ( qsizetype x = first; x < std::min( first + ScanChunkSize, offsets.size() ); ++x ) {
+          if ( serialized ) {
+            QMutexLocker _( &dict.getArticleTextMutex() );
+            dict.getArticleText( offsets[ x ], headword, text );
+          }
+          else {
+            dict.getArticleText( offsets[ x ], headword, text );
+          }
+
+          if ( matcher.matches( text ) ) {
+            hits.append( offsets[ x ] );
+          }
+        }
+
+        if ( !hits.isEmpty() ) {
+          publishHits( hits );
+        }
+      }
+    }
+    catch ( std::exception & e ) {
+      qWarning( "FTS: Failed scanning \"%s\", reason: %s", dict.getName().c_str(), e.what() );
+
+      // The other threads stop as well
+      isCancelled.ref();
+    }
+  };
+
+  // This thread takes part as well, so the scan goes on even when the pool is
+  // busy
+  Scheduler::runParallel( Scheduler::Priority::Lookup,
+                          Scheduler::maxThreadCount( Scheduler::Priority::Lookup ) / 2 - 1,
+                          scan );
+}
+
 } // namespace FtsHelpers
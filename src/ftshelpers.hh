@@ -2,7 +2,9 @@
 
 #include <QString>
 #include <QList>
-#include <QtConcurrentRun>
+#include <list>
+#include <memory>
+#include "scheduler.hh"
 #include "dict/dictionary.hh"
 #include "btreeidx.hh"
 #include "fulltextsearch.hh"
@@ -25,9 +27,13 @@ class FTSResultsRequest: public Dictionary::DataRequest
   QAtomicInt isCancelled;
 
   QAtomicInt results;
-  QFuture< void > f;
 
-  QList< FTS::FtsHeadword > * foundHeadwords;
+  /// The batches of the headwords found. The data holds a pointer to each,
+  /// which stays valid for as long as the request does. Guarded by dataMutex.
+  std::list< std::unique_ptr< QList< FTS::FtsHeadword > > > batches;
+
+  /// Keeps the batch and appends its pointer to the data
+  void publish( QList< FTS::FtsHeadword > && );
 
 public:
 
@@ -45,25 +51,18 @@ public:
       searchString =
         QString::fromStdU32String( Folding::applyDiacriticsOnly( Text::removeTrailingZero( searchString_ ) ) );
 
-    foundHeadwords = new QList< FTS::FtsHeadword >;
-    results        = 0;
-    f              = QtConcurrent::run( [ this ]() {
-      this->run();
-    } );
+    results = 0;
   }
 
   void run();
-  virtual void cancel()
-  {
-    isCancelled.ref();
-  }
 
-  ~FTSResultsRequest()
+  /// Searches by going through all the article texts, for the dictionaries
+  /// which have no full-text index yet. The hits are published as they come.
+  void scanArticles();
+
+  virtual void cancel()
   {
     isCancelled.ref();
-    f.waitForFinished();
-
-    delete foundHeadwords;
   }
 };
 
@@ -8,6 +8,7 @@
 #include <QFutureSynchronizer>
 #include <QMessageBox>
 #include <QThreadPool>
+#include "scheduler.hh"
 
 namespace FTS {
 
@@ -28,7 +29,7 @@ void Indexing::run()
 
       if ( dictionary->canFTS() && !dictionary->haveFTSIndex() ) {
         sem.acquire();
-        QFuture< void > const f = QtConcurrent::run( [ this, &sem, &dictionary ]() {
+        QFuture< void > const f = Scheduler::run( Scheduler::Priority::Background, [ this, &sem, &dictionary ]() {
           QSemaphoreReleaser const _( sem );
           const QString & dictionaryName = QString::fromUtf8( dictionary->getName().c_str() );
           qDebug() << "[FULLTEXT] checking fts for the dictionary:" << dictionaryName;
@@ -97,6 +98,8 @@ void FtsIndexing::doIndexing()
 
     connect( idx, &Indexing::sendNowIndexingName, this, &FtsIndexing::setNowIndexedName );
 
+    // Only waits for the jobs it starts, so it's kept out of the pool they
+    // run in, not to take a thread from them
     QThreadPool::globalInstance()->start( idx );
 
     started = true;
@@ -355,9 +358,10 @@ void FullTextSearchDialog::accept()
   ui.OKButton->setEnabled( false );
   ui.searchProgressBar->show();
 
-  // Make search requests
+  // Make search requests. The dictionaries not indexed yet get scanned instead,
+  // as long as full-text search is enabled for them.
   for ( unsigned x = 0; x < activeDicts.size(); ++x ) {
-    if ( !activeDicts[ x ]->haveFTSIndex() ) {
+    if ( !activeDicts[ x ]->canFTS() ) {
       continue;
     }
     //max results=100
@@ -369,6 +373,12 @@ void FullTextSearchDialog::accept()
              &FullTextSearchDialog::searchReqFinished,
              Qt::QueuedConnection );
 
+    connect( req.get(),
+             &Dictionary::Request::updated,
+             this,
+             &FullTextSearchDialog::searchReqUpdated,
+             Qt::QueuedConnection );
+
     connect( req.get(),
              &Dictionary::Request::matchCount,
              this,
@@ -390,28 +400,12 @@ void FullTextSearchDialog::searchReqFinished()
       if ( ( *it )->isFinished() ) {
         qDebug( "one finished." );
 
-        QString errorString = ( *it )->getErrorString();
-
-        if ( ( *it )->dataSize() >= 0 || errorString.size() ) {
-          QList< FtsHeadword > * headwords;
-          if ( (unsigned)( *it )->dataSize() >= sizeof( headwords ) ) {
-            QList< FtsHeadword > hws;
-            try {
-              ( *it )->getDataSlice( 0, sizeof( headwords ), &headwords );
-              hws.swap( *headwords );
-              std::sort( hws.begin(), hws.end() );
-              delete headwords;
-              addSortedHeadwords( allHeadwords, hws );
-            }
-            catch ( std::exception & e ) {
-              qWarning( "getDataSlice error: %s", e.what() );
-            }
-          }
-        }
+        takeResults( **it, allHeadwords );
         break;
       }
     }
     if ( it != searchReqs.end() ) {
+      searchReqsTaken.erase( it->get() );
       searchReqs.erase( it );
       continue;
     }
@@ -420,12 +414,7 @@ void FullTextSearchDialog::searchReqFinished()
     }
   }
 
-  if ( !allHeadwords.isEmpty() ) {
-    model->addResults( QModelIndex(), allHeadwords );
-    if ( results.size() > matchedCount ) {
-      ui.articlesFoundLabel->setText( tr( "Articles found: " ) + QString::number( results.size() ) );
-    }
-  }
+  showResults( allHeadwords );
 
   if ( searchReqs.empty() ) {
     ui.searchProgressBar->hide();
@@ -434,6 +423,49 @@ void FullTextSearchDialog::searchReqFinished()
   }
 }
 
+void FullTextSearchDialog::searchReqUpdated()
+{
+  QList< FtsHeadword > allHeadwords;
+
+  for ( auto const & req : searchReqs ) {
+    if ( !req->isFinished() ) {
+      takeResults( *req, allHeadwords );
+    }
+  }
+
+  showResults( allHeadwords );
+}
+
+void FullTextSearchDialog::takeResults( Dictionary::DataRequest & req, QList< FtsHeadword > & allHeadwords )
+{
+  long & taken = searchReqsTaken[ &req ];
+
+  QList< FtsHeadword > * headwords;
+
+  for ( long const size = req.dataSize(); taken + (long)sizeof( headwords ) <= size; taken += sizeof( headwords ) ) {
+    QList< FtsHeadword > hws;
+    try {
+      req.getDataSlice( taken, sizeof( headwords ), &headwords );
+      hws.swap( *headwords ); // The request owns the list, which is left empty
+      std::sort( hws.begin(), hws.end() );
+      addSortedHeadwords( allHeadwords, hws );
+    }
+    catch ( std::exception & e ) {
+      qWarning( "getDataSlice error: %s", e.what() );
+    }
+  }
+}
+
+void FullTextSearchDialog::showResults( QList< FtsHeadword > const & allHeadwords )
+{
+  if ( !allHeadwords.isEmpty() ) {
+    model->addResults( QModelIndex(), allHeadwords );
+    if ( results.size() > matchedCount ) {
+      ui.articlesFoundLabel->setText( tr( "Articles found: " ) + QString::number( results.size() ) );
+    }
+  }
+}
+
 void FullTextSearchDialog::matchCount( int _matchCount )
 {
   matchedCount += _matchCount;
@@ -3,6 +3,7 @@
 #include <QTimer>
 #include <QRunnable>
 #include <QSemaphore>
+#include <map>
 #include "dict/dictionary.hh"
 #include "ui_fulltextsearch.h"
 #include "config.hh"
@@ -194,6 +195,10 @@ class FullTextSearchDialog: public QDialog
 
   std::list< sptr< Dictionary::DataRequest > > searchReqs;
 
+  /// How much of each request's data was taken already. The data holds one
+  /// pointer for each batch of the headwords found, owned by the request.
+  std::map< Dictionary::DataRequest const *, long > searchReqsTaken;
+
   FtsIndexing & ftsIdx;
 
   QRegularExpression searchRegExp;
@@ -229,11 +234,17 @@ private:
 
   void showDictNumbers();
 
+  /// Takes the batches of headwords not taken from the request yet
+  void takeResults( Dictionary::DataRequest &, QList< FtsHeadword > & );
+
+  void showResults( QList< FtsHeadword > const & );
+
 private slots:
   void setNewIndexingName( QString );
   void saveData();
   void accept();
   void searchReqFinished();
+  void searchReqUpdated();
   void matchCount( int );
   void reject();
   void itemClicked( QModelIndex const & idx );
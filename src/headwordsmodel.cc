@@ -1,15 +1,176 @@
 #include "headwordsmodel.hh"
+#include "scheduler.hh"
+#include <climits>
+
+namespace {
+
+/// A literal part every match of a regex has. It's checked before the regex,
+/// as it's much cheaper, and if it's a prefix, only the range of the index
+/// it's in is gone through.
+struct Prefilter
+{
+  QString literal; // Empty if there's no telling
+  bool isPrefix                       = false;
+  Qt::CaseSensitivity caseSensitivity = Qt::CaseSensitive;
+
+  bool admits( QString const & word ) const
+  {
+    if ( literal.isEmpty() ) {
+      return true;
+    }
+
+    return isPrefix ? word.startsWith( literal, caseSensitivity ) : word.contains( literal, caseSensitivity );
+  }
+};
+
+bool isQuantifier( QChar ch )
+{
+  return ch == '*' || ch == '+' || ch == '?' || ch == '{';
+}
+
+/// Finds the longest run of literal characters outside of any group, or the
+/// one right after the ^ anchor, if any. Only the patterns the headwords
+/// dialog makes are looked into closely, anything unusual gives no prefilter.
+Prefilter prefilterOf( QRegularExpression const & regex )
+{
+  Prefilter result;
+
+  QString const pattern = regex.pattern();
+
+  // The alternatives, inline options and quoting may change what's required
+  if ( !regex.isValid() || ( regex.patternOptions() & QRegularExpression::ExtendedPatternSyntaxOption )
+       || pattern.contains( '|' ) || pattern.contains( "(?" ) || pattern.contains( "\\Q" ) ) {
+    return result;
+  }
+
+  if ( regex.patternOptions() & QRegularExpression::CaseInsensitiveOption ) {
+    result.caseSensitivity = Qt::CaseInsensitive;
+  }
+
+  qsizetype i = 0;
+
+  if ( pattern.startsWith( '^' ) ) {
+    i = 1;
+  }
+  else if ( pattern.startsWith( "\\A" ) ) {
+    i = 2;
+  }
+
+  QString run;
+  bool runIsPrefix = i > 0;
+  int depth        = 0;
+
+  auto const endRun = [ & ]() {
+    if ( runIsPrefix && !run.isEmpty() ) {
+      result.literal  = run;
+      result.isPrefix = true;
+    }
+    else if ( !result.isPrefix && run.size() > result.literal.size() ) {
+      result.literal = run;
+    }
+
+    run.clear();
+    runIsPrefix = false;
+  };
+
+  while ( i < pattern.size() ) {
+    QChar const ch = pattern[ i ];
+    QString literal; // The character it stands for, if it's a literal one
+    qsizetype next = i + 1;
+
+    if ( ch == '\\' && i + 1 < pattern.size() ) {
+      QChar const escaped = pattern[ i + 1 ];
+      next                = i + 2;
+
+      // An escaped ASCII letter or digit is a class, an anchor or the like
+      if ( escaped.unicode() >= 128 || !escaped.isLetterOrNumber() ) {
+        literal = escaped;
+      }
+    }
+    else if ( ch == '[' ) {
+      // Skip the class, minding the escapes, a leading ] and the [:name:] ones
+      next = i + 1;
+
+      if ( next < pattern.size() && pattern[ next ] == '^' ) {
+        ++next;
+      }
+      if ( next < pattern.size() && pattern[ next ] == ']' ) {
+        ++next;
+      }
+
+      while ( next < pattern.size() && pattern[ next ] != ']' ) {
+        if ( pattern[ next ] == '\\' ) {
+          next += 2;
+        }
+        else if ( pattern.mid( next, 2 ) == "[:" ) {
+          qsizetype const end = pattern.indexOf( ":]", next + 2 );
+          next                = end < 0 ? pattern.size() : end + 2;
+        }
+        else {
+          ++next;
+        }
+      }
+
+      ++next;
+    }
+    else if ( ch == '{' && pattern.indexOf( '}', i ) > i ) {
+      // A {n,m} quantifier is skipped as a whole, anything else is taken literally
+      qsizetype const end = pattern.indexOf( '}', i );
+      static QRegularExpression const counts( "^\\{\\d*(,\\d*)?\\}$" );
+
+      if ( counts.match( pattern.mid( i, end - i + 1 ) ).hasMatch() ) {
+        next = end + 1;
+      }
+    }
+    else if ( ch == '(' ) {
+      ++depth;
+    }
+    else if ( ch == ')' ) {
+      --depth;
+    }
+    else if ( !QStringView( u".^$*+?{}" ).contains( ch ) ) {
+      literal = ch;
+    }
+
+    if ( !literal.isEmpty() && literal[ 0 ].isHighSurrogate() && next < pattern.size() ) {
+      literal += pattern[ next++ ];
+    }
+
+    if ( literal.isEmpty() || depth > 0 || ( next < pattern.size() && isQuantifier( pattern[ next ] ) ) ) {
+      endRun(); // Something else, or a character which may not be there
+    }
+    else {
+      run += literal;
+    }
+
+    i = next;
+  }
+
+  endRun();
+
+  return result;
+}
+
+} // namespace
 
 HeadwordListModel::HeadwordListModel( QObject * parent ):
   QAbstractListModel( parent ),
   filtering( false ),
   totalSize( 0 ),
-  finished( false ),
-  index( 0 ),
-  ptr( nullptr )
+  finished( false )
 {
 }
 
+HeadwordListModel::~HeadwordListModel()
+{
+  stopFiltering();
+
+  // They stop at the next page, and mustn't post anything to a deleted model
+  for ( auto & worker : filterWorkers ) {
+    worker.waitForFinished();
+  }
+}
+
 int HeadwordListModel::rowCount( const QModelIndex & parent ) const
 {
   return parent.isValid() ? 0 : words.size();
@@ -37,14 +198,10 @@ QString HeadwordListModel::getRow( int row )
 
 void HeadwordListModel::setFilter( const QRegularExpression & reg )
 {
-  //if the headword is already finished loaded, do nothing。
-  if ( finished ) {
-    return;
-  }
+  stopFiltering();
+
   //back to normal state ,restore the original model;
   if ( reg.pattern().isEmpty() ) {
-    QMutexLocker _( &lock );
-    //race condition.
     if ( !filtering ) {
       return;
     }
@@ -52,61 +209,114 @@ void HeadwordListModel::setFilter( const QRegularExpression & reg )
 
     //reset to previous models
     beginResetModel();
-    words = QStringList( original_words );
+    words = original_words;
+    original_words.clear();
+    fileSortedList.clear();
     endResetModel();
 
+    emit numberPopulated( words.size() );
     return;
   }
-  else {
-    QMutexLocker _( &lock );
-    //the first time to enter filtering mode.
-    if ( !filtering ) {
-      filtering      = true;
-      original_words = QStringList( words );
-    }
+
+  //the first time to enter filtering mode.
+  if ( !filtering ) {
+    filtering      = true;
+    original_words = words;
   }
-  filterWords.clear();
-  auto sr = _dict->prefixMatch( Text::removeTrailingZero( reg.pattern() ), maxFilterResults );
-  connect( sr.get(), &Dictionary::Request::finished, this, &HeadwordListModel::requestFinished, Qt::QueuedConnection );
-  queuedRequests.push_back( sr );
-}
 
-void HeadwordListModel::appendWord( const QString & word )
-{
-  hashedWords.insert( word );
-  words.append( word );
-}
+  beginResetModel();
+  words.clear();
+  fileSortedList.clear();
+  endResetModel();
 
-void HeadwordListModel::requestFinished()
-{
-  // See how many new requests have finished, and if we have any new results
-  for ( auto i = queuedRequests.begin(); i != queuedRequests.end(); ) {
-    if ( ( *i )->isFinished() ) {
-      if ( !( *i )->getErrorString().isEmpty() ) {
-        qDebug() << "error:" << ( *i )->getErrorString();
-      }
-      else if ( ( *i )->matchesCount() ) {
-        auto allmatches = ( *i )->getAllMatches();
-        for ( auto & match : allmatches ) {
-          filterWords.append( QString::fromStdU32String( match.word ) );
+  emit numberPopulated( 0 );
+
+  // The small dictionaries used to be filtered in memory, with no limit
+  int const limit = totalSize < HEADWORDS_MAX_LIMIT ? INT_MAX : maxFilterResults;
+
+  auto const cancelled = std::make_shared< QAtomicInt >( 0 );
+  filterCancelled      = cancelled;
+
+  // Held, as the workers stopped aren't waited for, and the dictionary mustn't
+  // be reloaded while one of them still reads it
+  sptr< Dictionary::Class > const dict = Dictionary::holdForWorker( _dict->shared_from_this() );
+
+  // The workers stopped earlier may still be finishing their last page
+  filterWorkers.removeIf( []( QFuture< void > const & worker ) {
+    return worker.isFinished();
+  } );
+
+  filterWorkers.append( Scheduler::run( Scheduler::Priority::Lookup, [ this, dict, reg, limit, cancelled ]() {
+    Prefilter const prefilter = prefilterOf( reg );
+    Dictionary::HeadwordCursor cursor;
+
+    if ( prefilter.isPrefix ) {
+      // Only the range of the index the prefix is in is read
+      dict->seekHeadwords( cursor, prefilter.literal );
+    }
+
+    QStringList page;
+    QStringList matches;
+    int found = 0;
+    bool more = true;
+
+    while ( more && found < limit && !cancelled->loadAcquire() ) {
+      page.clear();
+      more = dict->getHeadwordPage( cursor, page, HEADWORDS_PAGE_SIZE * 10 );
+
+      for ( auto const & word : std::as_const( page ) ) {
+        if ( prefilter.admits( word ) && reg.match( word ).hasMatch() ) {
+          matches.append( word );
+
+          if ( ++found >= limit ) {
+            break;
+          }
         }
       }
-      queuedRequests.erase( i++ );
-    }
-    else {
-      ++i;
-    }
-  }
 
-  if ( queuedRequests.empty() ) {
-    if ( filterWords.isEmpty() ) {
-      return;
+      if ( !matches.isEmpty() ) {
+        QMetaObject::invokeMethod(
+          this,
+          [ this, cancelled, batch = std::move( matches ) ]() {
+            if ( !cancelled->loadAcquire() ) {
+              appendMatches( batch );
+            }
+          },
+          Qt::QueuedConnection );
+        matches.clear();
+      }
     }
-    beginResetModel();
-    words = QStringList( filterWords );
-    endResetModel();
-    emit numberPopulated( words.size() );
+
+    QMetaObject::invokeMethod(
+      this,
+      [ this, cancelled ]() {
+        if ( !cancelled->loadAcquire() ) {
+          emit filterFinished();
+        }
+      },
+      Qt::QueuedConnection );
+  } ) );
+}
+
+void HeadwordListModel::stopFiltering()
+{
+  if ( filterCancelled ) {
+    filterCancelled->storeRelease( 1 );
+    filterCancelled.reset();
   }
+
+  // Not waited for: the worker stops at its next page, and whatever it posts
+  // until then is dropped as it's cancelled
+}
+
+void HeadwordListModel::appendMatches( QStringList const & matches )
+{
+  beginInsertRows( QModelIndex(), words.size(), words.size() + matches.size() - 1 );
+  words.append( matches );
+  fileSortedList.clear();
+  endInsertRows();
+
+  emit numberPopulated( words.size() );
 }
 
 int HeadwordListModel::wordCount() const
@@ -120,7 +330,7 @@ QVariant HeadwordListModel::data( const QModelIndex & index, int role ) const
     return {};
   }
 
-  if ( index.row() >= totalSize || index.row() < 0 || index.row() >= words.size() ) {
+  if ( index.row() < 0 || index.row() >= words.size() ) {
     return {};
   }
 
@@ -132,10 +342,8 @@ QVariant HeadwordListModel::data( const QModelIndex & index, int role ) const
 
 bool HeadwordListModel::canFetchMore( const QModelIndex & parent ) const
 {
-  if ( parent.isValid() || filtering || finished ) {
-    return false;
-  }
-  return ( words.size() < totalSize );
+  // The cursor tells when there are no more, as the word count may be off
+  return !parent.isValid() && !filtering && !finished;
 }
 
 void HeadwordListModel::fetchMore( const QModelIndex & parent )
@@ -144,68 +352,40 @@ void HeadwordListModel::fetchMore( const QModelIndex & parent )
     return;
   }
 
+  QMutexLocker _( &lock );
+
+  QStringList page;
+
   //arbitrary number
   if ( totalSize < HEADWORDS_MAX_LIMIT ) {
+    // Small enough to be filtered in memory, so it's read in full
+    while ( _dict->getHeadwordPage( cursor, page, HEADWORDS_PAGE_SIZE * 100 ) ) {}
     finished = true;
-
-    beginInsertRows( QModelIndex(), 0, totalSize - 1 );
-    _dict->getHeadwords( words );
-
-    endInsertRows();
-    emit numberPopulated( words.size() );
-    return;
+  }
+  else {
+    finished = !_dict->getHeadwordPage( cursor, page, HEADWORDS_PAGE_SIZE );
   }
 
-
-  QSet< QString > headword;
-  QMutexLocker _( &lock );
-
-  _dict->findHeadWordsWithLenth( index, &headword, 1000 );
-  if ( headword.isEmpty() ) {
+  if ( page.isEmpty() ) {
     return;
   }
 
-  beginInsertRows( QModelIndex(), words.size(), words.size() + headword.count() - 1 );
-  for ( const auto & word : std::as_const( headword ) ) {
-    words << word;
-  }
+  beginInsertRows( QModelIndex(), words.size(), words.size() + page.size() - 1 );
+  words.append( page );
+  fileSortedList.clear();
   endInsertRows();
 
   emit numberPopulated( words.size() );
 }
 
-int HeadwordListModel::getCurrentIndex() const
-{
-  return index;
-}
-
-bool HeadwordListModel::containWord( const QString & word )
-{
-  return hashedWords.contains( word );
-}
-
 void HeadwordListModel::setMaxFilterResults( int _maxFilterResults )
 {
   this->maxFilterResults = _maxFilterResults;
 }
 
-QSet< QString > HeadwordListModel::getRemainRows( int & nodeIndex )
-{
-  QSet< QString > headword;
-  QMutexLocker _( &lock );
-  _dict->findHeadWordsWithLenth( nodeIndex, &headword, 10000 );
-
-  QSet< QString > filtered;
-  for ( const auto & word : std::as_const( headword ) ) {
-    if ( !containWord( word ) ) {
-      filtered.insert( word );
-    }
-  }
-  return filtered;
-}
-
 void HeadwordListModel::setDict( Dictionary::Class * dict )
 {
   _dict     = dict;
   totalSize = _dict->getWordCount();
+  cursor    = {};
 }
@@ -3,15 +3,19 @@
 #include "dict/dictionary.hh"
 
 #include <QAbstractListModel>
+#include <QFuture>
 #include <QStringList>
 
 static const int HEADWORDS_MAX_LIMIT = 500000;
+/// How many headwords are read at a time when the list is scrolled
+static const int HEADWORDS_PAGE_SIZE = 1000;
 class HeadwordListModel: public QAbstractListModel
 {
   Q_OBJECT
 
 public:
   HeadwordListModel( QObject * parent = nullptr );
+  ~HeadwordListModel() override;
 
   int rowCount( const QModelIndex & parent = QModelIndex() ) const override;
   int totalCount() const;
@@ -20,17 +24,14 @@ public:
   QVariant data( const QModelIndex & index, int role = Qt::DisplayRole ) const override;
   QString getRow( int row );
   void setFilter( const QRegularExpression & );
-  void appendWord( const QString & word );
-  int getCurrentIndex() const;
-  bool containWord( const QString & word );
-  QSet< QString > getRemainRows( int & nodeIndex );
   void setMaxFilterResults( int _maxFilterResults );
 signals:
   void numberPopulated( int number );
+  /// All the matches of the filter have been added
+  void filterFinished();
 
 public slots:
   void setDict( Dictionary::Class * dict );
-  void requestFinished();
 
 protected:
   bool canFetchMore( const QModelIndex & parent ) const override;
@@ -39,16 +40,20 @@ protected:
 private:
   QStringList words;
   QStringList original_words;
-  QSet< QString > hashedWords;
-  QStringList filterWords;
   bool filtering;
   QStringList fileSortedList;
   long totalSize;
   int maxFilterResults;
   bool finished;
   Dictionary::Class * _dict;
-  int index;
-  char * ptr;
+  Dictionary::HeadwordCursor cursor;
   QMutex lock;
-  std::list< sptr< Dictionary::WordSearchRequest > > queuedRequests;
+  /// Go through the headwords for the filter, see setFilter(). Only the last
+  /// one isn't cancelled, the others may still be finishing.
+  QList< QFuture< void > > filterWorkers;
+  std::shared_ptr< QAtomicInt > filterCancelled;
+
+  /// Has the filter worker stop, without waiting for it
+  void stopFiltering();
+  void appendMatches( QStringList const & matches );
 };
@@ -48,5 +48,13 @@ std::optional< Metadata::result > Metadata::load( std::string_view filepath )
     const auto value = fullindex.as_integer()->get();
     result.fullindex = value > 0;
   }
+
+  const auto zim = tbl[ "zim" ];
+  if ( const auto value = zim[ "cluster_cache_mb" ].value< std::int64_t >(); value && *value > 0 ) {
+    result.zimClusterCacheMb = value;
+  }
+  if ( const auto value = zim[ "dirent_cache" ].value< std::int64_t >(); value && *value > 0 ) {
+    result.zimDirentCache = value;
+  }
   return result;
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include <QStringView>
+#include <cstdint>
 #include <optional>
 #include <vector>
 
@@ -13,6 +14,10 @@ struct result
   std::optional< std::vector< std::string > > categories;
   std::optional< std::string > name;
   std::optional< bool > fullindex;
+  /// [zim] cluster_cache_mb -- libzim cluster cache size, in MiB
+  std::optional< std::int64_t > zimClusterCacheMb;
+  /// [zim] dirent_cache -- libzim dirent cache size, in entries
+  std::optional< std::int64_t > zimDirentCache;
 };
 
 [[nodiscard]] std::optional< Metadata::result > load( std::string_view filepath );
@@ -100,6 +100,26 @@ function gdExpandArticle(id) {
     nm.style.cursor = "default";
     nm.title = "";
     articleview.collapseInHtml(id, false);
+    if (elem.dataset.gdlazy) {
+      // The body was left out of the page, load it now
+      elem.dataset.gdloading = elem.dataset.gdlazy;
+      delete elem.dataset.gdlazy;
+      articleview.loadCollapsedArticle(id, elem.dataset.gdloading);
+    }
+  }
+}
+
+function gdSetCollapsedArticleBody(id, url, html) {
+  elem = document.getElementById("gdarticlefrom-" + id);
+  if (!elem || elem.dataset.gdloading !== url) return;
+  delete elem.dataset.gdloading;
+  elem.innerHTML = html;
+  // Scripts put in with innerHTML don't run, so put in their copies instead
+  for (const old of elem.querySelectorAll("script")) {
+    const script = document.createElement("script");
+    for (const attr of old.attributes) script.setAttribute(attr.name, attr.value);
+    script.text = old.text;
+    old.replaceWith(script);
   }
 }
 
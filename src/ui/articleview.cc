@@ -6,6 +6,7 @@
 #include "folding.hh"
 #include "gestures.hh"
 #include "globalbroadcaster.hh"
+#include "htmlescape.hh"
 #include "speechclient.hh"
 #include "utils.hh"
 #include "webmultimediadownload.hh"
@@ -16,6 +17,8 @@
 #include <QDebug>
 #include <QDesktopServices>
 #include <QFileDialog>
+#include <QJsonArray>
+#include <QJsonDocument>
 #include <QKeyEvent>
 #include <QMenu>
 #include <QMessageBox>
@@ -915,12 +918,77 @@ void ArticleView::linkClickedInHtml( QUrl const & url_ )
 
 void ArticleView::makeAnkiCardFromArticle( QString const & article_id )
 {
-  auto const js_code = QString( R"EOF(document.getElementById("gdarticlefrom-%1").innerText)EOF" ).arg( article_id );
-  webview->page()->runJavaScript( js_code, [ this ]( const QVariant & article_text ) {
-    sendToAnki( webview->title(), article_text.toString(), translateLine->text() );
+  // An article collapsed without its body has only an empty stub in the page,
+  // and the url of the body instead
+  QString const js_template = R"EOF((function() {
+  const elem = document.getElementById("gdarticlefrom-%1");
+  if (!elem) return ["", ""];
+  return [elem.dataset.gdlazy || elem.dataset.gdloading || "", elem.innerText];
+})())EOF";
+
+  auto const js_code = js_template.arg( article_id );
+  webview->page()->runJavaScript( js_code, [ this, article_id ]( const QVariant & result ) {
+    QVariantList const values = result.toList();
+    QString const bodyUrl     = values.value( 0 ).toString();
+
+    if ( bodyUrl.isEmpty() ) {
+      sendToAnki( webview->title(), values.value( 1 ).toString(), translateLine->text() );
+    }
+    else {
+      makeAnkiCardFromArticleBody( article_id, bodyUrl );
+    }
   } );
 }
 
+void ArticleView::makeAnkiCardFromArticleBody( QString const & dictId, QString const & url )
+{
+  QUrl const bodyUrl( url );
+
+  if ( bodyUrl.scheme() != "gdlookup" || Utils::Url::queryItemValue( bodyUrl, "articlebody" ) != dictId ) {
+    return; // Not an article body
+  }
+
+  QString contentType;
+  sptr< Dictionary::DataRequest > req = articleNetMgr.getResource( bodyUrl, contentType );
+
+  if ( !req ) {
+    return;
+  }
+
+  // A newer card replaces the one still being loaded
+  ankiBodyRequest = req;
+
+  auto const loaded = [ this, req = req.get() ]() {
+    if ( ankiBodyRequest.get() != req ) {
+      return;
+    }
+
+    sptr< Dictionary::DataRequest > const body = std::move( ankiBodyRequest );
+
+    QString text;
+
+    try {
+      if ( body->dataSize() > 0 ) {
+        vector< char > const & data = body->getFullData();
+
+        text = Html::unescape( QString::fromUtf8( data.data(), data.size() ), Html::HtmlOption::Keep );
+      }
+    }
+    catch ( std::exception & e ) {
+      qWarning( "getFullData error: %s", e.what() );
+    }
+
+    sendToAnki( webview->title(), text, translateLine->text() );
+  };
+
+  if ( req->isFinished() ) {
+    loaded();
+  }
+  else {
+    connect( req.get(), &Dictionary::Request::finished, this, loaded );
+  }
+}
+
 void ArticleView::openLink( QUrl const & url, QUrl const & ref, QString const & scrollTo, Contexts const & contexts_ )
 {
   audioPlayer->stop();
@@ -1097,6 +1165,67 @@ void ArticleView::playAudio( QUrl const & url )
   }
 }
 
+void ArticleView::loadCollapsedArticle( QString const & dictId, QString const & url )
+{
+  QUrl const bodyUrl( url );
+
+  if ( bodyUrl.scheme() != "gdlookup" || Utils::Url::queryItemValue( bodyUrl, "articlebody" ) != dictId ) {
+    return; // Not an article body
+  }
+
+  QString contentType;
+  sptr< Dictionary::DataRequest > req = articleNetMgr.getResource( bodyUrl, contentType );
+
+  if ( !req ) {
+    return;
+  }
+
+  collapsedBodyRequests.insert( url, req );
+
+  if ( req->isFinished() ) {
+    collapsedArticleLoaded( dictId, url );
+  }
+  else {
+    connect( req.get(), &Dictionary::Request::finished, this, [ this, dictId, url ]() {
+      collapsedArticleLoaded( dictId, url );
+    } );
+  }
+}
+
+void ArticleView::collapsedArticleLoaded( QString const & dictId, QString const & url )
+{
+  auto i = collapsedBodyRequests.find( url );
+
+  if ( i == collapsedBodyRequests.end() || !i.value()->isFinished() ) {
+    return;
+  }
+
+  sptr< Dictionary::DataRequest > const req = i.value();
+  collapsedBodyRequests.erase( i );
+
+  QString html;
+
+  try {
+    if ( req->dataSize() > 0 ) {
+      vector< char > const & data = req->getFullData();
+      html                        = QString::fromUtf8( data.data(), data.size() );
+    }
+    else if ( !req->getErrorString().isEmpty() ) {
+      html = R"(<div class="gderrordesc">)" + tr( "Query error: %1" ).arg( req->getErrorString() ).toHtmlEscaped()
+        + "</div>";
+    }
+  }
+  catch ( std::exception & e ) {
+    qWarning( "getFullData error: %s", e.what() );
+  }
+
+  // The arguments go as a json array, so they need no further escaping
+  QString const arguments =
+    QString::fromUtf8( QJsonDocument( QJsonArray{ dictId, url, html } ).toJson( QJsonDocument::Compact ) );
+
+  webview->page()->runJavaScript( QString( "gdSetCollapsedArticleBody.apply( null, %1 );" ).arg( arguments ) );
+}
+
 ResourceToSaveHandler * ArticleView::saveResource( const QUrl & url, const QString & fileName )
 {
   ResourceToSaveHandler * handler = new ResourceToSaveHandler( this, fileName );
@@ -2202,3 +2331,8 @@ void ArticleViewAgent::collapseInHtml( QString const & dictId, bool on ) const
     }
   }
 }
+
+void ArticleViewAgent::loadCollapsedArticle( QString const & dictId, QString const & url )
+{
+  articleView->loadCollapsedArticle( dictId, url );
+}
@@ -78,6 +78,12 @@ class ArticleView: public QWidget
 
   QString delayedHighlightText;
 
+  /// The bodies of the collapsed articles being loaded, by their urls
+  QMap< QString, sptr< Dictionary::DataRequest > > collapsedBodyRequests;
+
+  /// The body of the collapsed article an Anki card is being made from
+  sptr< Dictionary::DataRequest > ankiBodyRequest;
+
   void highlightFTSResults();
   void performFtsFindOperation( bool backwards );
 
@@ -139,6 +145,10 @@ public:
   /// This function will call QWebEnginePage::runJavaScript() to fetch the corresponding HTML.
   void makeAnkiCardFromArticle( QString const & article_id );
 
+  /// Same, for an article collapsed without its body: loads the body from the
+  /// given gdlookup url first, as loadCollapsedArticle() does.
+  void makeAnkiCardFromArticleBody( QString const & dictId, QString const & url );
+
   /// Opens the given link. Supposed to be used in response to
   /// openLinkInNewTab() signal. The link scheme is therefore supposed to be
   /// one of the internal ones.
@@ -328,6 +338,10 @@ public slots:
   void linkClicked( QUrl const & );
   //aim to receive signal from html. the fragment url click to  navigation through page wil not be intecepted by weburlinteceptor
   Q_INVOKABLE void linkClickedInHtml( QUrl const & );
+
+  /// Loads the body of an article which was collapsed without it, from the
+  /// given gdlookup url, and puts it into the page once it's there.
+  void loadCollapsedArticle( QString const & dictId, QString const & url );
 private slots:
   void inspectElement();
   void loadFinished( bool ok );
@@ -409,6 +423,9 @@ private:
 
   void performFindOperation( bool backwards );
 
+  /// Puts the body loaded by loadCollapsedArticle() into the page
+  void collapsedArticleLoaded( QString const & dictId, QString const & url );
+
   /// Returns the comma-separated list of dictionary ids which should be muted
   /// for the given group. If there are none, returns empty string.
   QString getMutedForGroup( unsigned group );
@@ -454,4 +471,5 @@ public slots:
   Q_INVOKABLE void onJsActiveArticleChanged( QString const & id );
   Q_INVOKABLE void linkClickedInHtml( QUrl const & );
   Q_INVOKABLE void collapseInHtml( QString const & dictId, bool on = true ) const;
+  Q_INVOKABLE void loadCollapsedArticle( QString const & dictId, QString const & url );
 };
@@ -157,6 +157,10 @@ void DictHeadwords::setup( Dictionary::Class * dict_ )
   connect( model.get(), &HeadwordListModel::numberPopulated, this, [ this ]( int _ ) {
     showHeadwordsNumber();
   } );
+  connect( model.get(), &HeadwordListModel::filterFinished, this, [ this ]() {
+    proxy->sort( 0 );
+    showHeadwordsNumber();
+  } );
   connect( proxy, &QAbstractItemModel::dataChanged, this, &DictHeadwords::showHeadwordsNumber );
   connect( ui.filterMaxResult, &QSpinBox::valueChanged, this, [ this ]( int _value ) {
     model->setMaxFilterResults( _value );
@@ -260,17 +264,11 @@ QRegularExpression DictHeadwords::getFilterRegex() const
 
 void DictHeadwords::filterChanged()
 {
-  const QRegularExpression regExp = getFilterRegex();
-
-  QApplication::setOverrideCursor( Qt::WaitCursor );
+  // The matches are streamed into the model in the background
+  model->setFilter( getFilterRegex() );
 
-  model->setFilter( regExp );
-
-  proxy->setFilterRegularExpression( regExp );
   proxy->sort( 0 );
 
-  QApplication::restoreOverrideCursor();
-
   showHeadwordsNumber();
 }
 
@@ -306,47 +304,24 @@ void DictHeadwords::exportAllWords( QProgressDialog & progress, QTextStream & ou
     return;
   }
 
-  const int headwordsNumber = model->totalCount();
-
   QMutexLocker const _( &mutex );
-  QSet< QString > allHeadwords;
 
+  // Streamed from the index a page at a time, whatever has been loaded into the list
+  Dictionary::HeadwordCursor cursor;
+  QStringList headwords;
   int totalCount = 0;
-  for ( int i = 0; i < headwordsNumber && i < model->wordCount(); ++i ) {
-    if ( progress.wasCanceled() ) {
-      break;
-    }
-
-    QVariant value = model->getRow( i );
-    if ( !value.canConvert< QString >() ) {
-      continue;
-    }
-
-    allHeadwords.insert( value.toString() );
-  }
-
-  for ( const auto & item : allHeadwords ) {
-    progress.setValue( totalCount++ );
+  bool more      = true;
 
-    writeWordToFile( out, item );
-  }
-
-  // continue to write the remaining headword
-  int nodeIndex  = model->getCurrentIndex();
-  auto headwords = model->getRemainRows( nodeIndex );
-  while ( !headwords.isEmpty() ) {
-    if ( progress.wasCanceled() ) {
-      break;
-    }
+  while ( more && !progress.wasCanceled() ) {
+    headwords.clear();
+    more = dict->getHeadwordPage( cursor, headwords, HEADWORDS_PAGE_SIZE * 10 );
 
     for ( const auto & item : std::as_const( headwords ) ) {
-      progress.setValue( totalCount++ );
-
       writeWordToFile( out, item );
     }
 
-
-    headwords = model->getRemainRows( nodeIndex );
+    totalCount += headwords.size();
+    progress.setValue( qMin( totalCount, progress.maximum() - 1 ) ); // The maximum closes it
   }
 }
 
@@ -933,7 +933,7 @@ Qt::ItemFlags ProgramsModel::flags( QModelIndex const & index ) const
   Qt::ItemFlags result = QAbstractTableModel::flags( index );
 
   if ( index.isValid() ) {
-    if ( !index.column() ) {
+    if ( !index.column() || index.column() == 5 ) {
       result |= Qt::ItemIsUserCheckable;
     }
     else {
@@ -960,7 +960,7 @@ int ProgramsModel::columnCount( QModelIndex const & parent ) const
     return 0;
   }
   else {
-    return 5;
+    return 6;
   }
 }
 
@@ -978,6 +978,8 @@ QVariant ProgramsModel::headerData( int section, Qt::Orientation /*orientation*/
         return tr( "Command Line" );
       case 4:
         return tr( "Icon" );
+      case 5:
+        return tr( "Server" );
       default:
         return QVariant();
     }
@@ -1016,6 +1018,14 @@ QVariant ProgramsModel::data( QModelIndex const & index, int role ) const
     return programs[ index.row() ].enabled ? Qt::Checked : Qt::Unchecked;
   }
 
+  if ( role == Qt::CheckStateRole && index.column() == 5 ) {
+    return programs[ index.row() ].server ? Qt::Checked : Qt::Unchecked;
+  }
+
+  if ( role == Qt::ToolTipRole && index.column() == 5 ) {
+    return tr( "Keep the program running instead of starting it for each word" );
+  }
+
   return QVariant();
 }
 
@@ -1032,6 +1042,13 @@ bool ProgramsModel::setData( QModelIndex const & index, const QVariant & value,
     return true;
   }
 
+  if ( role == Qt::CheckStateRole && index.column() == 5 ) {
+    programs[ index.row() ].server = !programs[ index.row() ].server;
+
+    dataChanged( index, index );
+    return true;
+  }
+
   if ( role == Qt::DisplayRole || role == Qt::EditRole ) {
     switch ( index.column() ) {
       case 1:
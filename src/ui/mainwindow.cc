@@ -47,8 +47,10 @@
 #include <map>
 
 #include "dictinfo.hh"
+#include "globalheadwordindex.hh"
 #include "historypanewidget.hh"
 #include "utils.hh"
+#include "scheduler.hh"
 #include "help.hh"
 #include "resourceschemehandler.hh"
 #include <QListWidgetItem>
@@ -184,7 +186,7 @@ MainWindow::MainWindow( Config::Class & cfg_ ):
   }
 
 #ifndef QT_NO_SSL
-  QThreadPool::globalInstance()->start( new InitSSLRunnable );
+  Scheduler::start( Scheduler::Priority::Background, new InitSSLRunnable );
 #endif
 
   GlobalBroadcaster::instance()->setPreference( &cfg.preferences );
@@ -745,6 +747,7 @@ MainWindow::MainWindow( Config::Class & cfg_ ):
            &MainWindow::proxyAuthentication );
 
   setupNetworkCache( cfg.preferences.maxNetworkCacheSize );
+  dictNetMgr.setCacheTtl( cfg.preferences.dictionaryCacheTtl * 60 );
 
   makeDictionaries();
 
@@ -1151,6 +1154,12 @@ MainWindow::~MainWindow()
   closeHeadwordsDialog();
 
   ftsIndexing.stopIndexing();
+  GlobalHeadwordIndex::instance().stop();
+
+  qDebug() << "Tasks still queued on exit: lookup" << Scheduler::queueDepth( Scheduler::Priority::Lookup )
+           << "resource" << Scheduler::queueDepth( Scheduler::Priority::Resource ) << "prefetch"
+           << Scheduler::queueDepth( Scheduler::Priority::Prefetch ) << "background"
+           << Scheduler::queueDepth( Scheduler::Priority::Background );
 #ifndef Q_OS_MACOS
   ui.centralWidget->ungrabGesture( Gestures::GDPinchGestureType );
   ui.centralWidget->ungrabGesture( Gestures::GDSwipeGestureType );
@@ -1218,6 +1227,7 @@ void MainWindow::commitData()
     if ( QAbstractNetworkCache * cache = articleNetMgr.cache() ) {
       cache->clear();
     }
+    dictNetMgr.clearCache();
   }
 
   //if the dictionaries is empty ,large chance that the config has corrupt.
@@ -1550,10 +1560,17 @@ void MainWindow::setupNetworkCache( int maxSize )
   // x << 20 == x * 2^20 converts mebibytes to bytes.
   qint64 const maxCacheSizeInBytes = maxSize <= 0 ? qint64( 0 ) : static_cast< qint64 >( maxSize ) << 20;
 
-  if ( QAbstractNetworkCache * abstractCache = articleNetMgr.cache() ) {
-    QNetworkDiskCache * const diskCache = qobject_cast< QNetworkDiskCache * >( abstractCache );
-    Q_ASSERT_X( diskCache, Q_FUNC_INFO, "Unexpected network cache type." );
-    diskCache->setMaximumCacheSize( maxCacheSizeInBytes );
+  // The online dictionaries' responses have a cache of their own, and the two
+  // caches share the configured size
+  qint64 const maxDictCacheSizeInBytes    = maxCacheSizeInBytes / 2;
+  qint64 const maxArticleCacheSizeInBytes = maxCacheSizeInBytes - maxDictCacheSizeInBytes;
+
+  if ( articleNetMgr.cache() ) {
+    QNetworkDiskCache * const diskCache     = qobject_cast< QNetworkDiskCache * >( articleNetMgr.cache() );
+    QNetworkDiskCache * const dictDiskCache = qobject_cast< QNetworkDiskCache * >( dictNetMgr.cache() );
+    Q_ASSERT_X( diskCache && dictDiskCache, Q_FUNC_INFO, "Unexpected network cache type." );
+    diskCache->setMaximumCacheSize( maxArticleCacheSizeInBytes );
+    dictDiskCache->setMaximumCacheSize( maxDictCacheSizeInBytes );
     return;
   }
   if ( maxCacheSizeInBytes == 0 ) {
@@ -1567,9 +1584,14 @@ void MainWindow::setupNetworkCache( int maxSize )
   }
 
   QNetworkDiskCache * const diskCache = new QNetworkDiskCache( this );
-  diskCache->setMaximumCacheSize( maxCacheSizeInBytes );
+  diskCache->setMaximumCacheSize( maxArticleCacheSizeInBytes );
   diskCache->setCacheDirectory( cacheDirectory );
   articleNetMgr.setCache( diskCache );
+
+  QNetworkDiskCache * const dictDiskCache = new QNetworkDiskCache( this );
+  dictDiskCache->setMaximumCacheSize( maxDictCacheSizeInBytes );
+  dictDiskCache->setCacheDirectory( cacheDirectory + "/dictionaries" );
+  dictNetMgr.setCache( dictDiskCache );
 }
 
 void MainWindow::makeDictionaries()
@@ -1580,6 +1602,7 @@ void MainWindow::makeDictionaries()
   dictionariesUnmuted.clear();
 
   ftsIndexing.stopIndexing();
+  GlobalHeadwordIndex::instance().stop();
   ftsIndexing.clearDictionaries();
 
   loadDictionaries( this, cfg, dictionaries, dictNetMgr, false );
@@ -1594,6 +1617,7 @@ void MainWindow::makeDictionaries()
 
   ftsIndexing.setDictionaries( dictionaries );
   ftsIndexing.doIndexing();
+  updateGlobalHeadwordIndex();
 
   updateStatusLine();
   updateGroupList( false );
@@ -2199,6 +2223,7 @@ void MainWindow::editDictionaries( unsigned editDictionaryGroup )
 
     if ( dicts.areDictionariesChanged() || dicts.areGroupsChanged() ) {
       ftsIndexing.stopIndexing();
+      GlobalHeadwordIndex::instance().stop();
       ftsIndexing.clearDictionaries();
       // Set muted dictionaries from old groups
       for ( auto & group : newCfg.groups ) {
@@ -2227,6 +2252,7 @@ void MainWindow::editDictionaries( unsigned editDictionaryGroup )
 
       ftsIndexing.setDictionaries( dictionaries );
       ftsIndexing.doIndexing();
+      updateGlobalHeadwordIndex();
     }
   }
 
@@ -2246,6 +2272,7 @@ void MainWindow::editPreferences()
   closeFullTextSearchDialog();
 
   ftsIndexing.stopIndexing();
+  GlobalHeadwordIndex::instance().stop();
   ftsIndexing.clearDictionaries();
 
   Preferences preferences( this, cfg );
@@ -2295,6 +2322,8 @@ void MainWindow::editPreferences()
       setupNetworkCache( p.maxNetworkCacheSize );
     }
 
+    dictNetMgr.setCacheTtl( p.dictionaryCacheTtl * 60 );
+
     bool needReload =
       ( cfg.preferences.displayStyle != p.displayStyle || cfg.preferences.addonStyle != p.addonStyle
         || cfg.preferences.darkReaderMode != p.darkReaderMode
@@ -2360,6 +2389,17 @@ void MainWindow::editPreferences()
 
   ftsIndexing.setDictionaries( dictionaries );
   ftsIndexing.doIndexing();
+  updateGlobalHeadwordIndex();
+}
+
+void MainWindow::updateGlobalHeadwordIndex()
+{
+  if ( cfg.preferences.globalHeadwordIndex ) {
+    GlobalHeadwordIndex::instance().update( dictionaries );
+  }
+  else {
+    GlobalHeadwordIndex::instance().clear();
+  }
 }
 
 void MainWindow::currentGroupChanged( int )
@@ -3483,6 +3523,7 @@ void MainWindow::on_rescanFiles_triggered()
   closeFullTextSearchDialog();
 
   ftsIndexing.stopIndexing();
+  GlobalHeadwordIndex::instance().stop();
   ftsIndexing.clearDictionaries();
 
   groupInstances.clear(); // Release all the dictionaries they hold
@@ -3500,6 +3541,7 @@ void MainWindow::on_rescanFiles_triggered()
 
   ftsIndexing.setDictionaries( dictionaries );
   ftsIndexing.doIndexing();
+  updateGlobalHeadwordIndex();
 
   updateGroupList();
 
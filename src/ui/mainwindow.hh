@@ -14,6 +14,7 @@
 #include "config.hh"
 #include "dict/dictionary.hh"
 #include "article_netmgr.hh"
+#include "dict_netmgr.hh"
 #include "audio/audioplayerfactory.hh"
 #include "instances.hh"
 #include "article_maker.hh"
@@ -139,9 +140,9 @@ private:
   Instances::Groups groupInstances;
   ArticleMaker articleMaker;
   ArticleNetworkAccessManager articleNetMgr;
-  QNetworkAccessManager dictNetMgr; // We give dictionaries a separate manager,
-                                    // since their requests can be destroyed
-                                    // in a separate thread
+  DictNetworkAccessManager dictNetMgr; // We give dictionaries a separate manager,
+                                       // since their requests can be destroyed
+                                       // in a separate thread
   AudioPlayerFactory audioPlayerFactory;
 
   //current active translateLine;
@@ -205,6 +206,8 @@ private:
   void applyProxySettings();
   void setupNetworkCache( int maxSize );
   void makeDictionaries();
+  /// Brings the global headword index in line with the dictionaries and the preferences
+  void updateGlobalHeadwordIndex();
   void updateStatusLine();
   void updateGroupList( bool reload = true );
   void updateDictionaryBar();
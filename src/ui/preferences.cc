@@ -261,6 +261,7 @@ Preferences::Preferences( QWidget * parent, Config::Class & cfg_ ):
   ui.collapseBigArticles->setChecked( p.collapseBigArticles );
   on_collapseBigArticles_toggled( ui.collapseBigArticles->isChecked() );
   ui.articleSizeLimit->setValue( p.articleSizeLimit );
+  ui.lazyCollapsedArticles->setChecked( p.lazyCollapsedArticles );
 
   ui.limitInputPhraseLength->setChecked( p.limitInputPhraseLength );
   on_limitInputPhraseLength_toggled( ui.limitInputPhraseLength->isChecked() );
@@ -381,10 +382,12 @@ Preferences::Preferences( QWidget * parent, Config::Class & cfg_ ):
   ui.hideGoldenDictHeader->setChecked( p.hideGoldenDictHeader );
   ui.maxNetworkCacheSize->setValue( p.maxNetworkCacheSize );
   ui.clearNetworkCacheOnExit->setChecked( p.clearNetworkCacheOnExit );
+  ui.dictionaryCacheTtl->setValue( p.dictionaryCacheTtl );
 
   //Misc
   ui.removeInvalidIndexOnExit->setChecked( p.removeInvalidIndexOnExit );
   ui.enableApplicationLog->setChecked( p.enableApplicationLog );
+  ui.globalHeadwordIndex->setChecked( p.globalHeadwordIndex );
 
   // Add-on styles
   ui.addonStylesLabel->setVisible( ui.addonStyles->count() > 1 );
@@ -505,6 +508,7 @@ Config::Preferences Preferences::getPreferences()
 
   p.collapseBigArticles    = ui.collapseBigArticles->isChecked();
   p.articleSizeLimit       = ui.articleSizeLimit->value();
+  p.lazyCollapsedArticles  = ui.lazyCollapsedArticles->isChecked();
   p.limitInputPhraseLength = ui.limitInputPhraseLength->isChecked();
   p.inputPhraseLengthLimit = ui.inputPhraseLengthLimit->value();
   p.ignoreDiacritics       = ui.ignoreDiacritics->isChecked();
@@ -550,9 +554,11 @@ Config::Preferences Preferences::getPreferences()
   p.hideGoldenDictHeader          = ui.hideGoldenDictHeader->isChecked();
   p.maxNetworkCacheSize           = ui.maxNetworkCacheSize->value();
   p.clearNetworkCacheOnExit       = ui.clearNetworkCacheOnExit->isChecked();
+  p.dictionaryCacheTtl            = ui.dictionaryCacheTtl->value();
 
   p.removeInvalidIndexOnExit = ui.removeInvalidIndexOnExit->isChecked();
   p.enableApplicationLog     = ui.enableApplicationLog->isChecked();
+  p.globalHeadwordIndex      = ui.globalHeadwordIndex->isChecked();
 
   p.addonStyle = ui.addonStyles->getCurrentStyle();
 
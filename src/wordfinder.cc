@@ -3,14 +3,28 @@
 
 #include "wordfinder.hh"
 #include "folding.hh"
-#include <map>
+#include "globalheadwordindex.hh"
+#include <algorithm>
 #include <QMutexLocker>
 
 
 using std::vector;
 using std::list;
-using std::map;
-using std::pair;
+
+namespace {
+
+/// How many typos are looked for in a word of the given size. Allowing any in
+/// the short words would only bring in noise.
+unsigned typoDistance( std::u32string const & word )
+{
+  if ( word.size() < 4 ) {
+    return 0;
+  }
+
+  return word.size() < 8 ? 1 : 2;
+}
+
+} // namespace
 
 WordFinder::WordFinder( QObject * parent ):
   QObject( parent ),
@@ -126,6 +140,31 @@ void WordFinder::startSearch()
     allWordWritings.insert( allWordWritings.end(), writings.begin(), writings.end() );
   }
 
+  // Fold them once for the whole search, the results are ranked against these
+
+  writingsForms.clear();
+
+  for ( const auto & allWordWriting : allWordWritings ) {
+    FoldedForms forms = foldForRanking( Folding::applySimpleCaseOnly( allWordWriting ) );
+
+    if ( searchType == StemmedMatch ) {
+      forms.folded = Folding::apply( allWordWriting );
+    }
+
+    writingsForms.push_back( std::move( forms ) );
+  }
+
+  // The prefix matches of the dictionaries in the global headword index are
+  // looked up there, all at once
+
+  std::shared_ptr< GlobalHeadwordIndex::Snapshot const > headwordIndex;
+  std::vector< std::string > indexedDicts;
+
+  if ( ( searchType == PrefixMatch || searchType == ExpressionMatch )
+       && std::all_of( allWordWritings.begin(), allWordWritings.end(), &GlobalHeadwordIndex::canMatch ) ) {
+    headwordIndex = GlobalHeadwordIndex::instance().snapshot();
+  }
+
   // Query each dictionary for all word writings
 
   for ( const auto & inputDict : *inputDicts ) {
@@ -133,19 +172,37 @@ void WordFinder::startSearch()
       continue;
     }
 
+    if ( headwordIndex && headwordIndex->covers( inputDict->getId() ) ) {
+      indexedDicts.push_back( inputDict->getId() );
+      continue;
+    }
+
     for ( const auto & allWordWriting : allWordWritings ) {
       try {
-        sptr< Dictionary::WordSearchRequest > sr = ( searchType == PrefixMatch || searchType == ExpressionMatch ) ?
-          inputDict->prefixMatch( allWordWriting, requestedMaxResults ) :
-          inputDict->stemmedMatch( allWordWriting, stemmedMinLength, stemmedMaxSuffixVariation, requestedMaxResults );
+        std::vector< sptr< Dictionary::WordSearchRequest > > requests;
+
+        if ( searchType == PrefixMatch || searchType == ExpressionMatch ) {
+          requests.push_back( inputDict->prefixMatch( allWordWriting, requestedMaxResults ) );
+        }
+        else {
+          requests.push_back(
+            inputDict->stemmedMatch( allWordWriting, stemmedMinLength, stemmedMaxSuffixVariation, requestedMaxResults ) );
+
+          // Typos are looked for along with the other forms of the word
+          if ( unsigned const distance = typoDistance( allWordWriting ) ) {
+            requests.push_back( inputDict->fuzzyMatch( allWordWriting, distance, requestedMaxResults ) );
+          }
+        }
 
-        connect( sr.get(), &Dictionary::Request::finished, this, [ this, sr ]() {
-          requestFinished( sr );
-        } );
+        for ( auto const & sr : requests ) {
+          connect( sr.get(), &Dictionary::Request::finished, this, [ this, sr ]() {
+            requestFinished( sr );
+          } );
 
-        {
-          QMutexLocker locker( &mutex );
-          queuedRequests.push_back( sr );
+          {
+            QMutexLocker locker( &mutex );
+            queuedRequests.push_back( sr );
+          }
         }
       }
       catch ( std::exception & e ) {
@@ -157,6 +214,22 @@ void WordFinder::startSearch()
     }
   }
 
+  if ( !indexedDicts.empty() ) {
+    for ( const auto & allWordWriting : allWordWritings ) {
+      sptr< Dictionary::WordSearchRequest > sr =
+        headwordIndex->prefixMatch( allWordWriting, indexedDicts, requestedMaxResults );
+
+      connect( sr.get(), &Dictionary::Request::finished, this, [ this, sr ]() {
+        requestFinished( sr );
+      } );
+
+      {
+        QMutexLocker locker( &mutex );
+        queuedRequests.push_back( sr );
+      }
+    }
+  }
+
   // Handle any requests finished already
 
   requestFinished();
@@ -214,6 +287,9 @@ void WordFinder::requestFinished()
     return;
   }
 
+  // Rank the new matches right away, so the timer only has to pick the best ones
+  mergeFinishedRequests();
+
   if ( queuedRequests.empty() ) {
     // Search is finished.
     updateResults();
@@ -249,6 +325,9 @@ void WordFinder::requestFinished( const sptr< Dictionary::WordSearchRequest > &
     return;
   }
 
+  // Rank the new matches right away, so the timer only has to pick the best ones
+  mergeFinishedRequests();
+
   if ( queuedRequests.empty() ) {
     // Search is finished.
     updateResults();
@@ -294,208 +373,237 @@ bool hasSurroundedWithWs( std::u32string const & haystack,
 
 } // namespace
 
-void WordFinder::updateResults()
+WordFinder::FoldedForms WordFinder::foldForRanking( std::u32string const & lowerCased ) const
 {
-  if ( !searchInProgress.load() ) {
-    return; // Old queued signal
+  FoldedForms forms;
+
+  forms.lowerCased = lowerCased;
+
+  if ( searchType == PrefixMatch ) {
+    forms.noFullCase = Folding::applyFullCaseOnly( forms.lowerCased );
+    forms.noDia      = Folding::applyDiacriticsOnly( forms.noFullCase );
+    forms.noPunct    = Folding::applyPunctOnly( forms.noDia );
+    forms.noWs       = Folding::applyWhitespaceOnly( forms.noPunct );
+  }
+  else if ( searchType == StemmedMatch ) {
+    forms.folded = Folding::apply( forms.lowerCased );
   }
 
-  if ( updateResultsTimer.isActive() ) {
-    updateResultsTimer.stop(); // Can happen when we were done before it'd expire
+  return forms;
+}
+
+int WordFinder::rankResult( FoldedForms const & result ) const
+{
+  int bestRank = INT_MAX;
+
+  if ( searchType == PrefixMatch ) {
+    /// Assign each result a category, storing it in the rank's field
+
+    enum Category {
+      ExactMatch,
+      ExactNoFullCaseMatch,
+      ExactNoDiaMatch,
+      ExactNoPunctMatch,
+      ExactNoWsMatch,
+      ExactInsideMatch,
+      ExactNoDiaInsideMatch,
+      ExactNoPunctInsideMatch,
+      PrefixMatch,
+      PrefixNoDiaMatch,
+      PrefixNoPunctMatch,
+      PrefixNoWsMatch,
+      WorstMatch,
+      Multiplier = 256 // Categories should be multiplied by Multiplier
+    };
+
+    for ( const auto & target : writingsForms ) {
+      std::u32string::size_type matchPos = 0;
+
+      int rank;
+
+      if ( result.lowerCased == target.lowerCased ) {
+        rank = ExactMatch * Multiplier;
+      }
+      else if ( result.noFullCase == target.noFullCase ) {
+        rank = ExactNoFullCaseMatch * Multiplier;
+      }
+      else if ( result.noDia == target.noDia ) {
+        rank = ExactNoDiaMatch * Multiplier;
+      }
+      else if ( result.noPunct == target.noPunct ) {
+        rank = ExactNoPunctMatch * Multiplier;
+      }
+      else if ( result.noWs == target.noWs ) {
+        rank = ExactNoWsMatch * Multiplier;
+      }
+      else if ( hasSurroundedWithWs( result.lowerCased, target.lowerCased, matchPos ) ) {
+        rank = ExactInsideMatch * Multiplier + matchPos;
+      }
+      else if ( hasSurroundedWithWs( result.noDia, target.noDia, matchPos ) ) {
+        rank = ExactNoDiaInsideMatch * Multiplier + matchPos;
+      }
+      else if ( hasSurroundedWithWs( result.noPunct, target.noPunct, matchPos ) ) {
+        rank = ExactNoPunctInsideMatch * Multiplier + matchPos;
+      }
+      else if ( result.lowerCased.size() > target.lowerCased.size()
+                && result.lowerCased.compare( 0, target.lowerCased.size(), target.lowerCased ) == 0 ) {
+        rank = PrefixMatch * Multiplier + saturated( result.lowerCased.size() );
+      }
+      else if ( result.noDia.size() > target.noDia.size()
+                && result.noDia.compare( 0, target.noDia.size(), target.noDia ) == 0 ) {
+        rank = PrefixNoDiaMatch * Multiplier + saturated( result.lowerCased.size() );
+      }
+      else if ( result.noPunct.size() > target.noPunct.size()
+                && result.noPunct.compare( 0, target.noPunct.size(), target.noPunct ) == 0 ) {
+        rank = PrefixNoPunctMatch * Multiplier + saturated( result.lowerCased.size() );
+      }
+      else if ( result.noWs.size() > target.noWs.size()
+                && result.noWs.compare( 0, target.noWs.size(), target.noWs ) == 0 ) {
+        rank = PrefixNoWsMatch * Multiplier + saturated( result.lowerCased.size() );
+      }
+      else {
+        rank = WorstMatch * Multiplier;
+      }
+
+      bestRank = std::min( bestRank, rank ); // We store the best rank of any writing
+    }
+  }
+  else if ( searchType == StemmedMatch ) {
+    // Handling stemmed matches
+
+    // We use two factors -- first is the number of characters strings share
+    // in their beginnings, and second, the length of the strings. Here we assign
+    // only the first one, storing it in rank. Then we sort the results using
+    // SortByRankAndLength.
+    for ( const auto & target : writingsForms ) {
+      int charsInCommon = 0;
+
+      for ( char32_t const *t = target.folded.c_str(), *r = result.folded.c_str(); *t && *t == *r;
+            ++t, ++r, ++charsInCommon ) {
+        ;
+      }
+
+      int rank = -charsInCommon; // Negated so the lesser-than
+                                 // comparison would yield right
+                                 // results.
+
+      bestRank = std::min( bestRank, rank ); // We store the best rank of any writing
+    }
+  }
+
+  return bestRank;
+}
+
+void WordFinder::mergeFinishedRequests()
+{
+  if ( writingsForms.empty() ) {
+    return; // No search was started yet
   }
 
-  std::u32string original = Folding::applySimpleCaseOnly( allWordWritings[ 0 ] );
+  std::list< sptr< Dictionary::WordSearchRequest > > requests;
+
   {
     QMutexLocker locker( &mutex );
+    requests.swap( finishedRequests );
+  }
 
-    for ( auto i = finishedRequests.begin(); i != finishedRequests.end(); ) {
-      for ( size_t count = ( *i )->matchesCount(), x = 0; x < count; ++x ) {
-        std::u32string match      = ( **i )[ x ].word;
-        int weight                = ( **i )[ x ].weight;
-        std::u32string lowerCased = Folding::applySimpleCaseOnly( match );
-
-        if ( searchType == ExpressionMatch ) {
-          unsigned ws;
-
-          for ( ws = 0; ws < allWordWritings.size(); ws++ ) {
-            if ( ws == 0 ) {
-              // Check for prefix match with original expression
-              if ( lowerCased.compare( 0, original.size(), original ) == 0 ) {
-                break;
-              }
-            }
-            else if ( lowerCased == Folding::applySimpleCaseOnly( allWordWritings[ ws ] ) ) {
+  std::u32string const & original = writingsForms[ 0 ].lowerCased;
+
+  for ( const auto & request : requests ) {
+    for ( size_t count = request->matchesCount(), x = 0; x < count; ++x ) {
+      Dictionary::WordMatch const wordMatch = ( *request )[ x ];
+      std::u32string const & match          = wordMatch.word;
+      int weight                            = wordMatch.weight;
+      std::u32string lowerCased             = Folding::applySimpleCaseOnly( match );
+
+      if ( searchType == ExpressionMatch ) {
+        unsigned ws;
+
+        for ( ws = 0; ws < writingsForms.size(); ws++ ) {
+          if ( ws == 0 ) {
+            // Check for prefix match with original expression
+            if ( lowerCased.compare( 0, original.size(), original ) == 0 ) {
               break;
             }
           }
-
-          if ( ws >= allWordWritings.size() ) {
-            // No exact matches found
-            continue;
-          }
-          weight = ws;
-        }
-        auto insertResult =
-          resultsIndex.insert( pair< std::u32string, ResultsArray::iterator >( lowerCased, resultsArray.end() ) );
-
-        if ( !insertResult.second ) {
-          // Wasn't inserted since there was already an item -- check the case
-          if ( insertResult.first->second->word != match ) {
-            // The case is different -- agree on a lowercase version
-            insertResult.first->second->word = lowerCased;
-          }
-          if ( !weight && insertResult.first->second->wasSuggested ) {
-            insertResult.first->second->wasSuggested = false;
+          else if ( lowerCased == writingsForms[ ws ].lowerCased ) {
+            break;
           }
         }
-        else {
-          resultsArray.emplace_back();
-
-          resultsArray.back().word         = match;
-          resultsArray.back().rank         = INT_MAX;
-          resultsArray.back().wasSuggested = ( weight != 0 );
 
-          insertResult.first->second = --resultsArray.end();
+        if ( ws >= writingsForms.size() ) {
+          // No exact matches found
+          continue;
         }
+        weight = ws;
       }
-      finishedRequests.erase( i++ );
-    }
-  }
 
-  size_t maxSearchResults = 500;
-
-  if ( !resultsArray.empty() ) {
-    if ( searchType == PrefixMatch ) {
-      /// Assign each result a category, storing it in the rank's field
-
-      enum Category {
-        ExactMatch,
-        ExactNoFullCaseMatch,
-        ExactNoDiaMatch,
-        ExactNoPunctMatch,
-        ExactNoWsMatch,
-        ExactInsideMatch,
-        ExactNoDiaInsideMatch,
-        ExactNoPunctInsideMatch,
-        PrefixMatch,
-        PrefixNoDiaMatch,
-        PrefixNoPunctMatch,
-        PrefixNoWsMatch,
-        WorstMatch,
-        Multiplier = 256 // Categories should be multiplied by Multiplier
-      };
-
-      for ( const auto & allWordWriting : allWordWritings ) {
-        std::u32string target           = Folding::applySimpleCaseOnly( allWordWriting );
-        std::u32string targetNoFullCase = Folding::applyFullCaseOnly( target );
-        std::u32string targetNoDia      = Folding::applyDiacriticsOnly( targetNoFullCase );
-        std::u32string targetNoPunct    = Folding::applyPunctOnly( targetNoDia );
-        std::u32string targetNoWs       = Folding::applyWhitespaceOnly( targetNoPunct );
-
-        std::u32string::size_type matchPos = 0;
-
-        for ( const auto & i : resultsIndex ) {
-          std::u32string resultNoFullCase, resultNoDia, resultNoPunct, resultNoWs;
-
-          int rank;
-
-          if ( i.first == target ) {
-            rank = ExactMatch * Multiplier;
-          }
-          else if ( ( resultNoFullCase = Folding::applyFullCaseOnly( i.first ) ) == targetNoFullCase ) {
-            rank = ExactNoFullCaseMatch * Multiplier;
-          }
-          else if ( ( resultNoDia = Folding::applyDiacriticsOnly( resultNoFullCase ) ) == targetNoDia ) {
-            rank = ExactNoDiaMatch * Multiplier;
-          }
-          else if ( ( resultNoPunct = Folding::applyPunctOnly( resultNoDia ) ) == targetNoPunct ) {
-            rank = ExactNoPunctMatch * Multiplier;
-          }
-          else if ( ( resultNoWs = Folding::applyWhitespaceOnly( resultNoPunct ) ) == targetNoWs ) {
-            rank = ExactNoWsMatch * Multiplier;
-          }
-          else if ( hasSurroundedWithWs( i.first, target, matchPos ) ) {
-            rank = ExactInsideMatch * Multiplier + matchPos;
-          }
-          else if ( hasSurroundedWithWs( resultNoDia, targetNoDia, matchPos ) ) {
-            rank = ExactNoDiaInsideMatch * Multiplier + matchPos;
-          }
-          else if ( hasSurroundedWithWs( resultNoPunct, targetNoPunct, matchPos ) ) {
-            rank = ExactNoPunctInsideMatch * Multiplier + matchPos;
-          }
-          else if ( i.first.size() > target.size() && i.first.compare( 0, target.size(), target ) == 0 ) {
-            rank = PrefixMatch * Multiplier + saturated( i.first.size() );
-          }
-          else if ( resultNoDia.size() > targetNoDia.size()
-                    && resultNoDia.compare( 0, targetNoDia.size(), targetNoDia ) == 0 ) {
-            rank = PrefixNoDiaMatch * Multiplier + saturated( i.first.size() );
-          }
-          else if ( resultNoPunct.size() > targetNoPunct.size()
-                    && resultNoPunct.compare( 0, targetNoPunct.size(), targetNoPunct ) == 0 ) {
-            rank = PrefixNoPunctMatch * Multiplier + saturated( i.first.size() );
-          }
-          else if ( resultNoWs.size() > targetNoWs.size()
-                    && resultNoWs.compare( 0, targetNoWs.size(), targetNoWs ) == 0 ) {
-            rank = PrefixNoWsMatch * Multiplier + saturated( i.first.size() );
-          }
-          else {
-            rank = WorstMatch * Multiplier;
-          }
+      auto insertResult = resultsIndex.try_emplace( lowerCased, resultsArray.size() );
 
-          if ( i.second->rank > rank ) {
-            i.second->rank = rank; // We store the best rank of any writing
-          }
+      if ( !insertResult.second ) {
+        OneResult & result = resultsArray[ insertResult.first->second ];
+
+        // Wasn't inserted since there was already an item -- check the case
+        if ( result.word != match ) {
+          // The case is different -- agree on a lowercase version
+          result.word = lowerCased;
+        }
+        if ( !weight && result.wasSuggested ) {
+          result.wasSuggested = false;
         }
       }
+      else {
+        OneResult & result = resultsArray.emplace_back();
 
-      resultsArray.sort( SortByRank() );
+        result.word         = match;
+        result.wasSuggested = ( weight != 0 );
+        result.forms        = foldForRanking( lowerCased );
+        result.rank         = rankResult( result.forms );
+      }
     }
-    else if ( searchType == StemmedMatch ) {
-      // Handling stemmed matches
+  }
+}
 
-      // We use two factors -- first is the number of characters strings share
-      // in their beginnings, and second, the length of the strings. Here we assign
-      // only the first one, storing it in rank. Then we sort the results using
-      // SortByRankAndLength.
-      for ( const auto & allWordWriting : allWordWritings ) {
-        std::u32string target = Folding::apply( allWordWriting );
+void WordFinder::updateResults()
+{
+  if ( !searchInProgress.load() ) {
+    return; // Old queued signal
+  }
 
-        for ( const auto & i : resultsIndex ) {
-          std::u32string resultFolded = Folding::apply( i.first );
+  if ( updateResultsTimer.isActive() ) {
+    updateResultsTimer.stop(); // Can happen when we were done before it'd expire
+  }
 
-          int charsInCommon = 0;
+  mergeFinishedRequests();
 
-          for ( char32_t const *t = target.c_str(), *r = resultFolded.c_str(); *t && *t == *r;
-                ++t, ++r, ++charsInCommon ) {
-            ;
-          }
+  size_t maxSearchResults = searchType == StemmedMatch ? 15 : 500;
 
-          int rank = -charsInCommon; // Negated so the lesser-than
-                                     // comparison would yield right
-                                     // results.
+  // Only the best results are shown, so only those get sorted
+  vector< OneResult const * > best;
+  best.reserve( resultsArray.size() );
 
-          if ( i.second->rank > rank ) {
-            i.second->rank = rank; // We store the best rank of any writing
-          }
-        }
-      }
+  for ( const auto & result : resultsArray ) {
+    best.push_back( &result );
+  }
 
-      resultsArray.sort( SortByRankAndLength() );
+  auto const bestEnd = best.begin() + std::min( maxSearchResults, best.size() );
 
-      maxSearchResults = 15;
-    }
+  if ( searchType == PrefixMatch ) {
+    std::partial_sort( best.begin(), bestEnd, best.end(), []( OneResult const * first, OneResult const * second ) {
+      return SortByRank()( *first, *second );
+    } );
+  }
+  else if ( searchType == StemmedMatch ) {
+    std::partial_sort( best.begin(), bestEnd, best.end(), []( OneResult const * first, OneResult const * second ) {
+      return SortByRankAndLength()( *first, *second );
+    } );
   }
 
   searchResults.clear();
-  searchResults.reserve( resultsArray.size() < maxSearchResults ? resultsArray.size() : maxSearchResults );
+  searchResults.reserve( bestEnd - best.begin() );
 
-  for ( const auto & i : resultsArray ) {
-    if ( searchResults.size() < maxSearchResults ) {
-      searchResults.emplace_back( QString::fromStdU32String( i.word ), i.wasSuggested );
-    }
-    else {
-      break;
-    }
+  for ( auto i = best.begin(); i != bestEnd; ++i ) {
+    searchResults.emplace_back( QString::fromStdU32String( ( *i )->word ), ( *i )->wasSuggested );
   }
 
   if ( !queuedRequests.empty() ) {
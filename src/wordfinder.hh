@@ -4,7 +4,7 @@
 #pragma once
 
 #include <list>
-#include <map>
+#include <unordered_map>
 #include <atomic>
 #include <QObject>
 #include <QTimer>
@@ -51,17 +51,30 @@ private:
 
   std::vector< std::u32string > allWordWritings; // All writings of the inputWord
 
+  /// A word in all the forms its rank is computed from. They are computed
+  /// once per word, see foldForRanking().
+  struct FoldedForms
+  {
+    std::u32string lowerCased, noFullCase, noDia, noPunct, noWs; // Prefix matches
+    std::u32string folded;                                       // Stemmed matches
+  };
+
+  std::vector< FoldedForms > writingsForms; // Same as allWordWritings, folded
+
   struct OneResult
   {
     std::u32string word;
     int rank;
     bool wasSuggested;
+    FoldedForms forms;
   };
 
   // Maps lowercased string to the original one. This catches all duplicates
-  // without case sensitivity. Made as an array and a map indexing that array.
-  using ResultsArray = std::list< OneResult >;
-  using ResultsIndex = std::map< std::u32string, ResultsArray::iterator >;
+  // without case sensitivity. Made as an array and a hash indexing that array.
+  // The rank of a result only depends on the word writings, so it is assigned
+  // once, when the result gets merged in.
+  using ResultsArray = std::vector< OneResult >;
+  using ResultsIndex = std::unordered_map< std::u32string, size_t >;
   ResultsArray resultsArray;
   ResultsIndex resultsIndex;
 
@@ -152,6 +165,15 @@ private:
   // Starts the previously queued search.
   void startSearch();
 
+  /// Merges the matches of the requests finished so far into resultsArray
+  void mergeFinishedRequests();
+
+  /// Computes the forms of the lowercased word needed by the current search type
+  FoldedForms foldForRanking( std::u32string const & lowerCased ) const;
+
+  /// Returns the best rank of the result among all the word writings
+  int rankResult( FoldedForms const & ) const;
+
   // Cancels all searches. Useful to do before destroying them all, since they
   // would cancel in parallel.
   void cancelSearches();
@@ -159,7 +181,7 @@ private:
   /// Compares results based on their ranks
   struct SortByRank
   {
-    bool operator()( OneResult const & first, OneResult const & second )
+    bool operator()( OneResult const & first, OneResult const & second ) const
     {
       if ( first.rank < second.rank )
         return true;
@@ -176,7 +198,7 @@ private:
   /// Compares results based on their ranks and lengths
   struct SortByRankAndLength
   {
-    bool operator()( OneResult const & first, OneResult const & second )
+    bool operator()( OneResult const & first, OneResult const & second ) const
     {
       if ( first.rank < second.rank )
         return true;
@@ -0,0 +1,428 @@
+/* Licensed under GPLv3 or later, see the LICENSE file */
+
+#include "current.hh"
+#include "filetype.hh"
+#include "htmlescape.hh"
+#include "langcoder.hh"
+#include "text.hh"
+#include "utils.hh"
+#include <wctype.h>
+#include <QFileInfo>
+#include <QUrl>
+
+// The code below is that of dsl.cc, only the DslDictionary members became
+// Renderer ones. Keep the two in step when changing the rendering there.
+
+namespace Current {
+
+using Dsl::Details::dslLanguageToId;
+using Dsl::Details::findCodeForDslId;
+using Dsl::Details::normalizeHeadword;
+using DslBenchmark::isDslWs;
+
+namespace {
+
+/// Appends the text escaped the same way Html::escape() does it. Its line
+/// breaks become paragraphs, unless it's the value of an attribute.
+void appendEscaped( string & out, std::u32string_view text, bool lineBreaks = true )
+{
+  size_t run = 0; // The start of the text not appended yet
+
+  for ( size_t x = 0; x < text.size(); ++x ) {
+    char const * replacement;
+
+    switch ( text[ x ] ) {
+      case '&':
+        replacement = "&amp;";
+        break;
+      case '<':
+        replacement = "&lt;";
+        break;
+      case '>':
+        replacement = "&gt;";
+        break;
+      case '"':
+        replacement = "&quot;";
+        break;
+      case '\r':
+        if ( !lineBreaks ) {
+          continue;
+        }
+        replacement = "";
+        break;
+      case '\n':
+        if ( !lineBreaks ) {
+          continue;
+        }
+        replacement = "<p></p>";
+        break;
+      default:
+        continue;
+    }
+
+    Text::appendUtf8( out, text.substr( run, x - run ) );
+    out += replacement;
+    run = x + 1;
+  }
+
+  Text::appendUtf8( out, text.substr( run ) );
+}
+
+} // namespace
+
+string Renderer::dslToHtml( std::u32string const & str, std::u32string const & headword )
+{
+  // Normalize the string
+  std::u32string normalizedStr = Text::normalize( str );
+  currentHeadword              = headword;
+
+  ArticleDom dom( normalizedStr, getName(), headword );
+
+  optionalPartNom = 0;
+
+  string html;
+  html.reserve( normalizedStr.size() * 2 );
+
+  processNodeChildren( dom, dom.root(), html );
+
+  return html;
+}
+
+void Renderer::processNodeChildren( ArticleDom const & dom, ArticleDom::Node const & node, string & out )
+{
+  for ( const auto & i : dom.children( node ) ) {
+    nodeToHtml( dom, i, out );
+  }
+}
+
+string Renderer::getNodeLink( ArticleDom const & dom, ArticleDom::Node const & node )
+{
+  string link;
+  std::u32string_view const tagAttrs = dom.tagAttrs( node );
+  if ( !tagAttrs.empty() ) {
+    QString attrs = QString::fromUcs4( tagAttrs.data(), tagAttrs.size() );
+    int n         = attrs.indexOf( "target=\"" );
+    if ( n >= 0 ) {
+      int n_end      = attrs.indexOf( '\"', n + 8 );
+      QString target = attrs.mid( n + 8, n_end > n + 8 ? n_end - ( n + 8 ) : -1 );
+      link           = Html::escape( Filetype::simplifyString( string( target.toUtf8().data() ), false ) );
+    }
+  }
+  if ( link.empty() ) {
+    link = Html::escape( Filetype::simplifyString( Text::toUtf8( dom.renderAsText( node ) ), false ) );
+  }
+
+  return link;
+}
+
+void Renderer::nodeToHtml( ArticleDom const & dom, ArticleDom::Node const & node, string & out )
+{
+  if ( !node.isTag ) {
+    appendEscaped( out, dom.text( node ) );
+    return;
+  }
+
+  std::u32string_view const tagName  = dom.tagName( node );
+  std::u32string_view const tagAttrs = dom.tagAttrs( node );
+
+  if ( tagName == U"b" ) {
+    out += "<b class=\"dsl_b\">";
+    processNodeChildren( dom, node, out );
+    out += "</b>";
+  }
+  else if ( tagName == U"i" ) {
+    out += "<i class=\"dsl_i\">";
+    processNodeChildren( dom, node, out );
+    out += "</i>";
+  }
+  else if ( tagName == U"u" ) {
+    size_t const start = out.size();
+
+    out += "<span class=\"dsl_u\">";
+
+    size_t const body = out.size();
+
+    processNodeChildren( dom, node, out );
+
+    if ( out.size() > body && isDslWs( out[ body ] ) ) {
+      out.insert( start, 1, ' ' ); // Fix a common problem where in "foo[i] bar[/i]"
+    }
+    // the space before "bar" gets underlined.
+
+    out += "</span>";
+  }
+  else if ( tagName == U"c" ) {
+    if ( tagAttrs.empty() ) {
+      out += "<span class=\"c_default_color\">";
+      processNodeChildren( dom, node, out );
+      out += "</span>";
+    }
+    else {
+      out += "<font color=\"";
+      appendEscaped( out, tagAttrs, false );
+      out += "\">";
+      processNodeChildren( dom, node, out );
+      out += "</font>";
+    }
+  }
+  else if ( tagName == U"*" ) {
+    string id = "O" + getId().substr( 0, 7 ) + "_" + QString::number( articleNom ).toStdString() + "_opt_"
+      + QString::number( optionalPartNom++ ).toStdString();
+    out += R"(<span class="dsl_opt" id=")" + id + "\">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
+  }
+  else if ( tagName == U"m" ) {
+    out += "<div class=\"dsl_m\">";
+    processNodeChildren( dom, node, out );
+    out += "</div>";
+  }
+  else if ( tagName.size() == 2 && tagName[ 0 ] == L'm' && iswdigit( tagName[ 1 ] ) ) {
+    out += "<div class=\"dsl_";
+    Text::appendUtf8( out, tagName );
+    out += "\">";
+    processNodeChildren( dom, node, out );
+    out += "</div>";
+  }
+  else if ( tagName == U"trn" ) {
+    out += "<span class=\"dsl_trn\">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
+  }
+  else if ( tagName == U"ex" ) {
+    out += "<span class=\"dsl_ex\">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
+  }
+  else if ( tagName == U"com" ) {
+    out += "<span class=\"dsl_com\">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
+  }
+  else if ( tagName == U"s" || tagName == U"video" ) {
+    string filename = Filetype::simplifyString( Text::toUtf8( dom.renderAsText( node ) ), false );
+    string n        = resourceDir1 + filename;
+
+    if ( Filetype::isNameOfSound( filename ) ) {
+      QUrl url;
+      url.setScheme( "gdau" );
+      url.setHost( QString::fromUtf8( getId().c_str() ) );
+      url.setPath( Utils::Url::ensureLeadingSlash( QString::fromUtf8( filename.c_str() ) ) );
+      if ( idxHeader.hasSoundDictionaryName ) {
+        Utils::Url::setFragment( url, QString::fromUtf8( preferredSoundDictionary.c_str() ) );
+      }
+
+      string ref = string( "\"" ) + url.toEncoded().data() + "\"";
+
+      out += addAudioLink( url.toEncoded(), getId() );
+
+      out += "<span class=\"dsl_s_wav\"><a href=" + ref
+        + R"(><img src="qrc:///icons/playsound.png" border="0" align="absmiddle" alt="Play"/></a></span>)";
+    }
+    else if ( Filetype::isNameOfPicture( filename ) ) {
+      QUrl url;
+      url.setScheme( "bres" );
+      url.setHost( QString::fromUtf8( getId().c_str() ) );
+      url.setPath( Utils::Url::ensureLeadingSlash( QString::fromUtf8( filename.c_str() ) ) );
+
+      string maxWidthStyle = " style=\"max-width:100%;\" ";
+
+      out += string( "<img src=\"" ) + url.toEncoded().data() + "\" " + maxWidthStyle + " alt=\""
+        + Html::escape( filename ) + "\"/>";
+    }
+    else if ( Filetype::isNameOfVideo( filename ) ) {
+      QUrl url;
+      url.setScheme( "gdvideo" );
+      url.setHost( QString::fromUtf8( getId().c_str() ) );
+      url.setPath( Utils::Url::ensureLeadingSlash( QString::fromUtf8( filename.c_str() ) ) );
+
+      out += string( R"(<a class="dsl_s dsl_video" href=")" ) + url.toEncoded().data() + "\">"
+        + "<span class=\"img\"></span>" + "<span class=\"filename\">";
+      processNodeChildren( dom, node, out );
+      out += "</span></a>";
+    }
+    else {
+      // Unknown file type, downgrade to a hyperlink
+
+      QUrl url;
+      url.setScheme( "bres" );
+      url.setHost( QString::fromUtf8( getId().c_str() ) );
+      url.setPath( Utils::Url::ensureLeadingSlash( QString::fromUtf8( filename.c_str() ) ) );
+
+      out += string( R"(<a class="dsl_s" href=")" ) + url.toEncoded().data() + "\">";
+      processNodeChildren( dom, node, out );
+      out += "</a>";
+    }
+  }
+  else if ( tagName == U"url" ) {
+    string link = getNodeLink( dom, node );
+    if ( QUrl::fromEncoded( link.c_str() ).scheme().isEmpty() ) {
+      link = "http://" + link;
+    }
+
+    QUrl url( QString::fromUtf8( link.c_str() ) );
+    if ( url.isLocalFile() && url.host().isEmpty() ) {
+      // Convert relative links to local files to absolute ones
+      QString name = QFileInfo( getMainFilename() ).absolutePath();
+      name += url.toLocalFile();
+      QFileInfo info( name );
+      if ( info.isFile() ) {
+        name = info.canonicalFilePath();
+        url.setPath( Utils::Url::ensureLeadingSlash( QUrl::fromLocalFile( name ).path() ) );
+        link = string( url.toEncoded().data() );
+      }
+    }
+
+    out += R"(<a class="dsl_url" href=")" + link + "\">";
+    processNodeChildren( dom, node, out );
+    out += "</a>";
+  }
+  else if ( tagName == U"!trs" ) {
+    out += "<span class=\"dsl_trs\">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
+  }
+  else if ( tagName == U"p" ) {
+    out += "<span class=\"dsl_p\"";
+
+    string val = Text::toUtf8( dom.renderAsText( node ) );
+
+    // If we have such a key, display a title
+
+    auto i = abrv.find( val );
+
+    if ( i != abrv.end() ) {
+      string title = i->second;
+
+      out += " title=\"" + Html::escape( title ) + "\"";
+    }
+
+    out += ">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
+  }
+  else if ( tagName == U"'" ) {
+    // There are two ways to display the stress: by adding an accent sign or via font styles.
+    // We generate two spans, one with accented data and another one without it, so the
+    // user could pick up the best suitable option.
+    out += R"(<span class="dsl_stress"><span class="dsl_stress_without_accent">)";
+
+    size_t const data = out.size();
+
+    processNodeChildren( dom, node, out );
+
+    size_t const dataSize = out.size() - data;
+
+    out += "</span><span class=\"dsl_stress_with_accent\">";
+    out.append( out, data, dataSize );
+    Text::appendUtf8( out, U"\u0301" ); // The combining acute accent
+    out += "</span></span>";
+  }
+  else if ( tagName == U"lang" ) {
+    out += "<span class=\"dsl_lang\"";
+    if ( !tagAttrs.empty() ) {
+      // Find ISO 639-1 code
+      string langcode;
+      QString attr = QString::fromUcs4( tagAttrs.data(), tagAttrs.size() );
+      int n        = attr.indexOf( "id=" );
+      if ( n >= 0 ) {
+        int id = attr.mid( n + 3 ).toInt();
+        if ( id ) {
+          langcode = findCodeForDslId( id );
+        }
+      }
+      else {
+        n = attr.indexOf( "name=\"" );
+        if ( n >= 0 ) {
+          int n2 = attr.indexOf( '\"', n + 6 );
+          if ( n2 > 0 ) {
+            quint32 id = dslLanguageToId( attr.mid( n + 6, n2 - n - 6 ).toStdU32String() );
+            langcode   = LangCoder::intToCode2( id ).toStdString();
+          }
+        }
+      }
+      if ( !langcode.empty() ) {
+        out += " lang=\"" + langcode + "\"";
+      }
+    }
+    out += ">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
+  }
+  else if ( tagName == U"ref" ) {
+    QUrl url;
+
+    url.setScheme( "gdlookup" );
+    url.setHost( "localhost" );
+    auto nodeStr = Text::toUtf32( getNodeLink( dom, node ) );
+
+    normalizeHeadword( nodeStr );
+    url.setPath( Utils::Url::ensureLeadingSlash( QString::fromStdU32String( nodeStr ) ) );
+    if ( !tagAttrs.empty() ) {
+      QString attr = QString::fromUcs4( tagAttrs.data(), tagAttrs.size() ).remove( '\"' );
+      int n        = attr.indexOf( '=' );
+      if ( n > 0 ) {
+        QList< std::pair< QString, QString > > query;
+        query.append( std::pair< QString, QString >( attr.left( n ), attr.mid( n + 1 ) ) );
+        Utils::Url::setQueryItems( url, query );
+      }
+    }
+
+    out += string( R"(<a class="dsl_ref" href=")" ) + url.toEncoded().data() + "\">";
+    processNodeChildren( dom, node, out );
+    out += "</a>";
+  }
+  else if ( tagName == U"@" ) {
+    // Special case - insided card header was not parsed
+
+    QUrl url;
+
+    url.setScheme( "gdlookup" );
+    url.setHost( "localhost" );
+    std::u32string nodeStr = dom.renderAsText( node );
+    normalizeHeadword( nodeStr );
+    url.setPath( Utils::Url::ensureLeadingSlash( QString::fromStdU32String( nodeStr ) ) );
+
+    out += string( R"(<a class="dsl_ref" href=")" ) + url.toEncoded().data() + "\">";
+    processNodeChildren( dom, node, out );
+    out += "</a>";
+  }
+  else if ( tagName == U"sub" ) {
+    out += "<sub>";
+    processNodeChildren( dom, node, out );
+    out += "</sub>";
+  }
+  else if ( tagName == U"sup" ) {
+    out += "<sup>";
+    processNodeChildren( dom, node, out );
+    out += "</sup>";
+  }
+  else if ( tagName == U"t" ) {
+    out += "<span class=\"dsl_t\">";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
+  }
+  else if ( tagName == U"br" ) {
+    out += "<br />";
+  }
+  else {
+    QByteArray const name  = QString::fromUcs4( tagName.data(), tagName.size() ).toUtf8();
+    QByteArray const attrs = QString::fromUcs4( tagAttrs.data(), tagAttrs.size() ).toUtf8();
+
+    qWarning( R"(DSL: Unknown tag "%s" with attributes "%s" found in "%s", article "%s".)",
+              name.data(),
+              attrs.data(),
+              getName().c_str(),
+              QString::fromStdU32String( currentHeadword ).toUtf8().data() );
+
+    out += "<span class=\"dsl_unknown\">[" + string( name.data() );
+    if ( !tagAttrs.empty() ) {
+      out += " " + string( attrs.data() );
+    }
+    out += "]";
+    processNodeChildren( dom, node, out );
+    out += "</span>";
+  }
+}
+
+} // namespace Current
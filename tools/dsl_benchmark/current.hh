@@ -0,0 +1,33 @@
+/* Licensed under GPLv3 or later, see the LICENSE file */
+
+#pragma once
+
+#include "renderer.hh"
+#include "dsl_details.hh"
+#include <string>
+
+/// The article rendering of the DSL dictionaries as it is now, over the
+/// ArticleDom of dsl_details.
+namespace Current {
+
+using Dsl::Details::ArticleDom;
+using std::string;
+
+/// DslDictionary::dslToHtml() and its parts, appending the html of every node
+/// to one string
+class Renderer: public DslBenchmark::Renderer
+{
+public:
+
+  using DslBenchmark::Renderer::Renderer;
+
+  string dslToHtml( std::u32string const &, std::u32string const & headword = std::u32string() ) override;
+
+private:
+
+  void nodeToHtml( ArticleDom const &, ArticleDom::Node const &, string & out );
+  void processNodeChildren( ArticleDom const &, ArticleDom::Node const & node, string & out );
+  string getNodeLink( ArticleDom const &, ArticleDom::Node const & node );
+};
+
+} // namespace Current
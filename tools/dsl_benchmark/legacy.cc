@@ -0,0 +1,1138 @@
+/* Licensed under GPLv3 or later, see the LICENSE file */
+
+#include "legacy.hh"
+#include "dsl_details.hh"
+#include "filetype.hh"
+#include "folding.hh"
+#include "htmlescape.hh"
+#include "langcoder.hh"
+#include "text.hh"
+#include "utils.hh"
+#include <algorithm>
+#include <wctype.h>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QUrl>
+
+// The code below is that of dsl_details.cc and dsl.cc as they were before the
+// flat ArticleDom, only the DslDictionary members became Renderer ones.
+
+namespace Legacy {
+
+using Dsl::Details::dslLanguageToId;
+using Dsl::Details::expandOptionalParts;
+using Dsl::Details::findCodeForDslId;
+using Dsl::Details::isAtSignFirst;
+using Dsl::Details::normalizeHeadword;
+using Dsl::Details::processUnsortedParts;
+using DslBenchmark::isDslWs;
+
+/////////////// ArticleDom
+
+std::u32string ArticleDom::Node::renderAsText( bool stripTrsTag ) const
+{
+  if ( !isTag ) {
+    return text;
+  }
+
+  std::u32string result;
+
+  for ( const auto & i : *this ) {
+    if ( !stripTrsTag || i.tagName != U"!trs" ) {
+      result += i.renderAsText( stripTrsTag );
+    }
+  }
+
+  return result;
+}
+
+namespace {
+
+/// @return true if @p tagName equals "mN" where N is a digit
+bool is_mN( std::u32string const & tagName )
+{
+  return tagName.size() == 2 && tagName[ 0 ] == U'm' && iswdigit( tagName[ 1 ] );
+}
+
+bool isAnyM( std::u32string const & tagName )
+{
+  return tagName == U"m" || is_mN( tagName );
+}
+
+bool checkM( std::u32string const & dest, std::u32string const & src )
+{
+  return src == U"m" && is_mN( dest );
+}
+
+/// Closing the [mN] tags is optional. Quote from https://documentation.help/ABBYY-Lingvo8/paragraph_form.htm:
+/// Any paragraph from this tag until the end of card or until system meets an «[/m]» (margin shift toggle off) tag
+struct MustTagBeClosed
+{
+  bool operator()( ArticleDom::Node const * tag ) const
+  {
+    Q_ASSERT( tag->isTag );
+    return !isAnyM( tag->tagName );
+  }
+};
+
+} // unnamed namespace
+
+ArticleDom::ArticleDom( std::u32string const & str, string const & dictName, std::u32string const & headword_ ):
+  root( Node::Tag(), std::u32string(), std::u32string() ),
+  stringPos( str.c_str() ),
+  lineStartPos( str.c_str() ),
+  transcriptionCount( 0 ),
+  mediaCount( 0 ),
+  dictionaryName( dictName ),
+  headword( headword_ )
+{
+  list< Node * > stack; // Currently opened tags
+
+  Node * textNode = 0; // A leaf node which currently accumulates text.
+
+  try {
+    for ( ;; ) {
+      nextChar();
+
+      if ( ch == L'@' && !escaped ) {
+        if ( !atSignFirstInLine() ) {
+          // Not insided card
+          if ( dictName.empty() ) {
+            qWarning( "Unescaped '@' symbol found" );
+          }
+          else {
+            qWarning( "Unescaped '@' symbol found in \"%s\"", dictName.c_str() );
+          }
+        }
+        else {
+          // Insided card
+          std::u32string linkTo;
+          nextChar();
+          for ( ;; nextChar() ) {
+            if ( ch == L'\n' ) {
+              break;
+            }
+            if ( ch != L'\r' ) {
+              if ( escaped && ( ch == L'(' || ch == ')' ) ) {
+                linkTo.push_back( L'\\' );
+              }
+              linkTo.push_back( ch );
+            }
+          }
+          linkTo = Folding::trimWhitespace( linkTo );
+
+          if ( !linkTo.empty() ) {
+            list< std::u32string > allLinkEntries;
+            processUnsortedParts( linkTo, true );
+            expandOptionalParts( linkTo, &allLinkEntries );
+
+            for ( auto entry = allLinkEntries.begin(); entry != allLinkEntries.end(); ) {
+              if ( !textNode ) {
+                Node text = Node( Node::Text(), std::u32string() );
+
+                if ( stack.empty() ) {
+                  root.push_back( text );
+                  stack.push_back( &root.back() );
+                }
+                else {
+                  stack.back()->push_back( text );
+                  stack.push_back( &stack.back()->back() );
+                }
+
+                textNode = stack.back();
+              }
+              textNode->text.push_back( L'-' );
+              textNode->text.push_back( L' ' );
+
+              // Close the currently opened text node
+              stack.pop_back();
+              textNode = 0;
+
+              std::u32string linkText = Folding::trimWhitespace( *entry );
+              ArticleDom nodeDom( linkText, dictName, headword_ );
+
+              Node link( Node::Tag(), U"@", std::u32string() );
+              for ( auto & n : nodeDom.root ) {
+                link.push_back( n );
+              }
+
+              ++entry;
+
+              if ( stack.empty() ) {
+                root.push_back( link );
+                if ( entry != allLinkEntries.end() ) { // Add line break before next entry
+                  root.push_back( Node( Node::Tag(), U"br", std::u32string() ) );
+                }
+              }
+              else {
+                stack.back()->push_back( link );
+                if ( entry != allLinkEntries.end() ) {
+                  stack.back()->push_back( Node( Node::Tag(), U"br", std::u32string() ) );
+                }
+              }
+            }
+
+            // Skip to next '@'
+
+            while ( !( ch == L'@' && !escaped && atSignFirstInLine() ) ) {
+              nextChar();
+            }
+
+            stringPos--;
+            ch      = L'\n';
+            escaped = false;
+          }
+        }
+      } // if ( ch == L'@' )
+
+      if ( ch == L'[' && !escaped ) {
+        // Beginning of a tag.
+        bool isClosing;
+        std::u32string name;
+        std::u32string attrs;
+
+        try {
+          do {
+            nextChar();
+          } while ( Folding::isWhitespace( ch ) );
+
+          if ( ch == L'/' && !escaped ) {
+            // A closing tag.
+            isClosing = true;
+            nextChar();
+          }
+          else {
+            isClosing = false;
+          }
+
+          // Read tag's name
+
+          while ( ( ch != L']' || escaped ) && !Folding::isWhitespace( ch ) ) {
+            name.push_back( ch );
+            nextChar();
+          }
+
+          while ( Folding::isWhitespace( ch ) ) {
+            nextChar();
+          }
+
+          // Read attrs
+
+          while ( ch != L']' || escaped ) {
+            attrs.push_back( ch );
+            nextChar();
+          }
+        }
+        catch ( std::exception & ex ) {
+          if ( !dictionaryName.empty() ) {
+            qWarning( R"(DSL: Unfinished tag "%s" with attributes "%s" found in "%s", article "%s".)",
+                      QString::fromStdU32String( name ).toUtf8().data(),
+                      QString::fromStdU32String( attrs ).toUtf8().data(),
+                      dictionaryName.c_str(),
+                      QString::fromStdU32String( headword ).toUtf8().data() );
+          }
+          else {
+            qWarning( R"(DSL: Unfinished tag "%s" with attributes "%s" found)",
+                      QString::fromStdU32String( name ).toUtf8().data(),
+                      QString::fromStdU32String( attrs ).toUtf8().data() );
+          }
+
+          throw ex;
+        }
+
+        // Add the tag, or close it
+
+        if ( textNode ) {
+          // Close the currently opened text node
+          stack.pop_back();
+          textNode = 0;
+        }
+
+        // If the tag is [t], we update the transcriptionCount
+        if ( name == U"t" ) {
+          if ( isClosing ) {
+            if ( transcriptionCount ) {
+              --transcriptionCount;
+            }
+          }
+          else {
+            ++transcriptionCount;
+          }
+        }
+
+        // If the tag is [s], we update the mediaCount
+        if ( name == U"s" ) {
+          if ( isClosing ) {
+            if ( mediaCount ) {
+              --mediaCount;
+            }
+          }
+          else {
+            ++mediaCount;
+          }
+        }
+
+        if ( !isClosing ) {
+          if ( isAnyM( name ) ) {
+            // Opening an 'mX' or 'm' tag closes any previous 'm' tag
+            closeTag( U"m", stack, false );
+          }
+          openTag( name, attrs, stack );
+          if ( name == U"br" ) {
+            // [br] tag don't have closing tag
+            closeTag( name, stack );
+          }
+        }
+        else {
+          closeTag( name, stack );
+        } // if ( isClosing )
+        continue;
+      } // if ( ch == '[' )
+
+      if ( ch == L'<' && !escaped ) {
+        // Special case: the <<name>> link
+
+        nextChar();
+
+        if ( ch != L'<' || escaped ) {
+          // Ok, it's not it.
+          --stringPos;
+
+          if ( escaped ) {
+            --stringPos;
+            escaped = false;
+          }
+          ch = L'<';
+        }
+        else {
+          // Get the link's body
+          do {
+            nextChar();
+          } while ( Folding::isWhitespace( ch ) );
+
+          std::u32string linkTo, linkText;
+
+          for ( ;; nextChar() ) {
+            // Is it the end?
+            if ( ch == L'>' && !escaped ) {
+              nextChar();
+
+              if ( ch == L'>' && !escaped ) {
+                break;
+              }
+              else {
+                linkTo.push_back( L'>' );
+                linkTo.push_back( ch );
+
+                linkText.push_back( L'>' );
+                if ( escaped ) {
+                  linkText.push_back( L'\\' );
+                }
+                linkText.push_back( ch );
+              }
+            }
+            else {
+              linkTo.push_back( ch );
+
+              if ( escaped ) {
+                linkText.push_back( L'\\' );
+              }
+              linkText.push_back( ch );
+            }
+          }
+
+          // Add the corresponding node
+
+          if ( textNode ) {
+            // Close the currently opened text node
+            stack.pop_back();
+            textNode = 0;
+          }
+
+          linkText = Folding::trimWhitespace( linkText );
+          processUnsortedParts( linkText, true );
+          ArticleDom nodeDom( linkText, dictName, headword_ );
+
+          Node link( Node::Tag(), U"ref", std::u32string() );
+          for ( auto & n : nodeDom.root ) {
+            link.push_back( n );
+          }
+
+          if ( stack.empty() ) {
+            root.push_back( link );
+          }
+          else {
+            stack.back()->push_back( link );
+          }
+
+          continue;
+        }
+      } // if ( ch == '<' )
+
+      if ( ch == L'{' && !escaped ) {
+        // Special case: {{comment}}
+
+        nextChar();
+
+        if ( ch != L'{' || escaped ) {
+          // Ok, it's not it.
+          --stringPos;
+
+          if ( escaped ) {
+            --stringPos;
+            escaped = false;
+          }
+          ch = L'{';
+        }
+        else {
+          // Skip the comment's body
+          for ( ;; ) {
+            nextChar();
+
+            // Is it the end?
+            if ( ch == L'}' && !escaped ) {
+              nextChar();
+
+              if ( ch == L'}' && !escaped ) {
+                break;
+              }
+            }
+          }
+
+          continue;
+        }
+      } // if ( ch == '{' )
+
+      // If we're here, we've got a normal symbol, to be saved as text.
+
+      // If there's currently no text node, open one
+      if ( !textNode ) {
+        Node text = Node( Node::Text(), std::u32string() );
+
+        if ( stack.empty() ) {
+          root.push_back( text );
+          stack.push_back( &root.back() );
+        }
+        else {
+          stack.back()->push_back( text );
+          stack.push_back( &stack.back()->back() );
+        }
+
+        textNode = stack.back();
+      }
+
+      // If we're inside the transcription, do old-encoding conversion
+      if ( transcriptionCount ) {
+        switch ( ch ) {
+          case 0x2021:
+            ch = 0xE6;
+            break;
+          case 0x407:
+            ch = 0x72;
+            break;
+          case 0xB0:
+            ch = 0x6B;
+            break;
+          case 0x20AC:
+            ch = 0x254;
+            break;
+          case 0x404:
+            ch = 0x7A;
+            break;
+          case 0x40F:
+            ch = 0x283;
+            break;
+          case 0xAB:
+            ch = 0x74;
+            break;
+          case 0xAC:
+            ch = 0x64;
+            break;
+          case 0x2020:
+            ch = 0x259;
+            break;
+          case 0x490:
+            ch = 0x6D;
+            break;
+          case 0xA7:
+            ch = 0x66;
+            break;
+          case 0xAE:
+            ch = 0x6C;
+            break;
+          case 0xB1:
+            ch = 0x67;
+            break;
+          case 0x45E:
+            ch = 0x65;
+            break;
+          case 0xAD:
+            ch = 0x6E;
+            break;
+          case 0xA9:
+            ch = 0x73;
+            break;
+          case 0xA6:
+            ch = 0x77;
+            break;
+          case 0x2026:
+            ch = 0x28C;
+            break;
+          case 0x452:
+            ch = 0x76;
+            break;
+          case 0x408:
+            ch = 0x70;
+            break;
+          case 0x40C:
+            ch = 0x75;
+            break;
+          case 0x406:
+            ch = 0x68;
+            break;
+          case 0xB5:
+            ch = 0x61;
+            break;
+          case 0x491:
+            ch = 0x25B;
+            break;
+          case 0x40A:
+            ch = 0x14B;
+            break;
+          case 0x2030:
+            ch = 0xF0;
+            break;
+          case 0x456:
+            ch = 0x6A;
+            break;
+          case 0xA4:
+            ch = 0x62;
+            break;
+          case 0x409:
+            ch = 0x292;
+            break;
+          case 0x40E:
+            ch = 0x69;
+            break;
+          //case 0x44D: ch = 0x131; break;
+          case 0x40B:
+            ch = 0x4E8;
+            break;
+          case 0xB6:
+            ch = 0x28A;
+            break;
+          case 0x2018:
+            ch = 0x251;
+            break;
+          case 0x457:
+            ch = 0x265;
+            break;
+          case 0x458:
+            ch = 0x153;
+            break;
+          case 0x405:
+            textNode->text.push_back( 0x153 );
+            ch = 0x303;
+            break;
+          case 0x441:
+            ch = 0x272;
+            break;
+          case 0x442:
+            textNode->text.push_back( 0x254 );
+            ch = 0x303;
+            break;
+          case 0x443:
+            ch = 0xF8;
+            break;
+          case 0x445:
+            textNode->text.push_back( 0x25B );
+            ch = 0x303;
+            break;
+          case 0x446:
+            ch = 0xE7;
+            break;
+          case 0x44C:
+            textNode->text.push_back( 0x251 );
+            ch = 0x303;
+            break;
+          case 0x44D:
+            ch = 0x26A;
+            break;
+          case 0x44F:
+            ch = 0x252;
+            break;
+          case 0x30:
+            ch = 0x3B2;
+            break;
+          case 0x31:
+            textNode->text.push_back( 0x65 );
+            ch = 0x303;
+            break;
+          case 0x32:
+            ch = 0x25C;
+            break;
+          case 0x33:
+            ch = 0x129;
+            break;
+          case 0x34:
+            ch = 0xF5;
+            break;
+          case 0x36:
+            ch = 0x28E;
+            break;
+          case 0x37:
+            ch = 0x263;
+            break;
+          case 0x38:
+            ch = 0x1DD;
+            break;
+          case 0x3A:
+            ch = 0x2D0;
+            break;
+          case 0x27:
+            ch = 0x2C8;
+            break;
+          case 0x455:
+            ch = 0x1D0;
+            break;
+          case 0xB7:
+            ch = 0xE3;
+            break;
+
+          case 0x00a0:
+            ch = 0x02A7;
+            break;
+          //case 0x00b1: ch = 0x0261; break;
+          case 0x0402:
+            textNode->text.push_back( 0x0069 );
+            ch = L':';
+            break;
+          case 0x0403:
+            textNode->text.push_back( 0x0251 );
+            ch = L':';
+            break;
+          //case 0x040b: ch = 0x03b8; break;
+          //case 0x040e: ch = 0x026a; break;
+          case 0x0428:
+            ch = 0x0061;
+            break;
+          case 0x0453:
+            textNode->text.push_back( 0x0075 );
+            ch = L':';
+            break;
+          case 0x201a:
+            ch = 0x0254;
+            break;
+          case 0x201e:
+            ch = 0x0259;
+            break;
+          case 0x2039:
+            textNode->text.push_back( 0x0064 );
+            ch = 0x0292;
+            break;
+        }
+      }
+
+      if ( escaped && ch == L' ' && mediaCount == 0 ) {
+        ch = 0xA0; // Escaped spaces turn into non-breakable ones in Lingvo
+      }
+
+      textNode->text.push_back( ch );
+    } // for( ; ; )
+  }
+  catch ( eot & ) {
+  }
+
+  if ( textNode ) {
+    stack.pop_back();
+  }
+
+  if ( !stack.empty() ) {
+    auto it = std::find_if( stack.begin(), stack.end(), MustTagBeClosed() );
+    if ( it == stack.end() ) {
+      return; // no unclosed tags that must be closed => nothing to warn about
+    }
+    QByteArray const firstTagName = QString::fromStdU32String( ( *it )->tagName ).toUtf8();
+    ++it;
+    unsigned const unclosedTagCount = 1 + std::count_if( it, stack.end(), MustTagBeClosed() );
+
+    if ( dictName.empty() ) {
+      qWarning( "Warning: %u tag(s) were unclosed, first tag name \"%s\".",
+                unclosedTagCount,
+                firstTagName.constData() );
+    }
+    else {
+      qWarning( "Warning: %u tag(s) were unclosed in \"%s\", article \"%s\", first tag name \"%s\".",
+                unclosedTagCount,
+                dictName.c_str(),
+                QString::fromStdU32String( headword ).toUtf8().constData(),
+                firstTagName.constData() );
+    }
+  }
+}
+
+void ArticleDom::openTag( std::u32string const & name, std::u32string const & attrs, list< Node * > & stack )
+{
+  list< Node > nodesToReopen;
+
+  if ( isAnyM( name ) ) {
+    // All tags above [m] tag will be closed and reopened after
+    // to avoid break this tag by closing some other tag.
+
+    while ( !stack.empty() ) {
+      nodesToReopen.emplace_back( Node::Tag(), stack.back()->tagName, stack.back()->tagAttrs );
+
+      if ( stack.back()->empty() ) {
+        // Empty nodes are deleted since they're no use
+
+        stack.pop_back();
+
+        Node * parent = !stack.empty() ? stack.back() : &root;
+
+        parent->pop_back();
+      }
+      else {
+        stack.pop_back();
+      }
+    }
+  }
+
+  // Add tag
+
+  Node node( Node::Tag(), name, attrs );
+
+  if ( stack.empty() ) {
+    root.push_back( node );
+    stack.push_back( &root.back() );
+  }
+  else {
+    stack.back()->push_back( node );
+    stack.push_back( &stack.back()->back() );
+  }
+
+  // Reopen tags if needed
+
+  while ( !nodesToReopen.empty() ) {
+    if ( stack.empty() ) {
+      root.push_back( nodesToReopen.back() );
+      stack.push_back( &root.back() );
+    }
+    else {
+      stack.back()->push_back( nodesToReopen.back() );
+      stack.push_back( &stack.back()->back() );
+    }
+
+    nodesToReopen.pop_back();
+  }
+}
+
+void ArticleDom::closeTag( std::u32string const & name, list< Node * > & stack, bool warn )
+{
+  // Find the tag which is to be closed
+
+  list< Node * >::reverse_iterator n;
+
+  for ( n = stack.rbegin(); n != stack.rend(); ++n ) {
+    if ( ( *n )->tagName == name || checkM( ( *n )->tagName, name ) ) {
+      // Found it
+      break;
+    }
+  }
+
+  if ( n != stack.rend() ) {
+    // If there is a corresponding tag, close all tags above it,
+    // then close the tag itself
+
+    while ( !stack.empty() ) {
+      bool found = stack.back()->tagName == name || checkM( stack.back()->tagName, name );
+
+      if ( stack.back()->empty() && stack.back()->tagName != U"br" ) {
+        // Empty nodes except [br] tag are deleted since they're no use
+
+        stack.pop_back();
+
+        Node * parent = !stack.empty() ? stack.back() : &root;
+
+        parent->pop_back();
+      }
+      else {
+        stack.pop_back();
+      }
+
+      if ( found ) {
+        break;
+      }
+    }
+  }
+  else if ( warn ) {
+    if ( !dictionaryName.empty() ) {
+      qWarning( R"(No corresponding opening tag for closing tag "%s" found in "%s", article "%s".)",
+                QString::fromStdU32String( name ).toUtf8().data(),
+                dictionaryName.c_str(),
+                QString::fromStdU32String( headword ).toUtf8().data() );
+    }
+    else {
+      qWarning( "No corresponding opening tag for closing tag \"%s\" found.",
+                QString::fromStdU32String( name ).toUtf8().data() );
+    }
+  }
+}
+
+void ArticleDom::nextChar()
+{
+  if ( !*stringPos ) {
+    throw eot();
+  }
+
+  ch = *stringPos++;
+
+  if ( ch == L'\\' ) {
+    if ( !*stringPos ) {
+      throw eot();
+    }
+
+    ch = *stringPos++;
+
+    escaped = true;
+  }
+  else if ( ch == L'[' && *stringPos == L'[' ) {
+    ++stringPos;
+    escaped = true;
+  }
+  else if ( ch == L']' && *stringPos == L']' ) {
+    ++stringPos;
+    escaped = true;
+  }
+  else {
+    escaped = false;
+  }
+
+  if ( ch == '\n' || ch == '\r' ) {
+    lineStartPos = stringPos;
+  }
+}
+
+bool ArticleDom::atSignFirstInLine()
+{
+  // Check if '@' sign is first after '\n', leading spaces and dsl tags
+  if ( stringPos <= lineStartPos ) {
+    return true;
+  }
+
+  return isAtSignFirst( std::u32string( lineStartPos ) );
+}
+
+/////////////// Renderer
+
+string Renderer::dslToHtml( std::u32string const & str, std::u32string const & headword )
+{
+  // Normalize the string
+  std::u32string normalizedStr = Text::normalize( str );
+  currentHeadword              = headword;
+
+  ArticleDom dom( normalizedStr, getName(), headword );
+
+  optionalPartNom = 0;
+
+  string html = processNodeChildren( dom.root );
+
+  return html;
+}
+
+string Renderer::processNodeChildren( ArticleDom::Node const & node )
+{
+  string result;
+
+  for ( const auto & i : node ) {
+    result += nodeToHtml( i );
+  }
+
+  return result;
+}
+
+string Renderer::getNodeLink( ArticleDom::Node const & node )
+{
+  string link;
+  if ( !node.tagAttrs.empty() ) {
+    QString attrs = QString::fromStdU32String( node.tagAttrs );
+    int n         = attrs.indexOf( "target=\"" );
+    if ( n >= 0 ) {
+      int n_end      = attrs.indexOf( '\"', n + 8 );
+      QString target = attrs.mid( n + 8, n_end > n + 8 ? n_end - ( n + 8 ) : -1 );
+      link           = Html::escape( Filetype::simplifyString( string( target.toUtf8().data() ), false ) );
+    }
+  }
+  if ( link.empty() ) {
+    link = Html::escape( Filetype::simplifyString( Text::toUtf8( node.renderAsText() ), false ) );
+  }
+
+  return link;
+}
+
+string Renderer::nodeToHtml( ArticleDom::Node const & node )
+{
+  string result;
+
+  if ( !node.isTag ) {
+    result = Html::escape( Text::toUtf8( node.text ) );
+
+    // Handle all end-of-line
+
+    string::size_type n;
+
+    // Strip all '\r'
+    while ( ( n = result.find( '\r' ) ) != string::npos ) {
+      result.erase( n, 1 );
+    }
+
+    // Replace all '\n'
+    while ( ( n = result.find( '\n' ) ) != string::npos ) {
+      result.replace( n, 1, "<p></p>" );
+    }
+
+    return result;
+  }
+
+  if ( node.tagName == U"b" ) {
+    result += "<b class=\"dsl_b\">" + processNodeChildren( node ) + "</b>";
+  }
+  else if ( node.tagName == U"i" ) {
+    result += "<i class=\"dsl_i\">" + processNodeChildren( node ) + "</i>";
+  }
+  else if ( node.tagName == U"u" ) {
+    string nodeText = processNodeChildren( node );
+
+    if ( nodeText.size() && isDslWs( nodeText[ 0 ] ) ) {
+      result.push_back( ' ' ); // Fix a common problem where in "foo[i] bar[/i]"
+    }
+    // the space before "bar" gets underlined.
+
+    result += "<span class=\"dsl_u\">" + nodeText + "</span>";
+  }
+  else if ( node.tagName == U"c" ) {
+    if ( node.tagAttrs.empty() ) {
+      result += "<span class=\"c_default_color\">" + processNodeChildren( node ) + "</span>";
+    }
+    else {
+      result += "<font color=\"" + Html::escape( Text::toUtf8( node.tagAttrs ) ) + "\">" + processNodeChildren( node )
+        + "</font>";
+    }
+  }
+  else if ( node.tagName == U"*" ) {
+    string id = "O" + getId().substr( 0, 7 ) + "_" + QString::number( articleNom ).toStdString() + "_opt_"
+      + QString::number( optionalPartNom++ ).toStdString();
+    result += R"(<span class="dsl_opt" id=")" + id + "\">" + processNodeChildren( node ) + "</span>";
+  }
+  else if ( node.tagName == U"m" ) {
+    result += "<div class=\"dsl_m\">" + processNodeChildren( node ) + "</div>";
+  }
+  else if ( node.tagName.size() == 2 && node.tagName[ 0 ] == L'm' && iswdigit( node.tagName[ 1 ] ) ) {
+    result += "<div class=\"dsl_" + Text::toUtf8( node.tagName ) + "\">" + processNodeChildren( node ) + "</div>";
+  }
+  else if ( node.tagName == U"trn" ) {
+    result += "<span class=\"dsl_trn\">" + processNodeChildren( node ) + "</span>";
+  }
+  else if ( node.tagName == U"ex" ) {
+    result += "<span class=\"dsl_ex\">" + processNodeChildren( node ) + "</span>";
+  }
+  else if ( node.tagName == U"com" ) {
+    result += "<span class=\"dsl_com\">" + processNodeChildren( node ) + "</span>";
+  }
+  else if ( node.tagName == U"s" || node.tagName == U"video" ) {
+    string filename = Filetype::simplifyString( Text::toUtf8( node.renderAsText() ), false );
+    string n        = resourceDir1 + filename;
+
+    if ( Filetype::isNameOfSound( filename ) ) {
+      QUrl url;
+      url.setScheme( "gdau" );
+      url.setHost( QString::fromUtf8( getId().c_str() ) );
+      url.setPath( Utils::Url::ensureLeadingSlash( QString::fromUtf8( filename.c_str() ) ) );
+      if ( idxHeader.hasSoundDictionaryName ) {
+        Utils::Url::setFragment( url, QString::fromUtf8( preferredSoundDictionary.c_str() ) );
+      }
+
+      string ref = string( "\"" ) + url.toEncoded().data() + "\"";
+
+      result += addAudioLink( url.toEncoded(), getId() );
+
+      result += "<span class=\"dsl_s_wav\"><a href=" + ref
+        + R"(><img src="qrc:///icons/playsound.png" border="0" align="absmiddle" alt="Play"/></a></span>)";
+    }
+    else if ( Filetype::isNameOfPicture( filename ) ) {
+      QUrl url;
+      url.setScheme( "bres" );
+      url.setHost( QString::fromUtf8( getId().c_str() ) );
+      url.setPath( Utils::Url::ensureLeadingSlash( QString::fromUtf8( filename.c_str() ) ) );
+
+      string maxWidthStyle = " style=\"max-width:100%;\" ";
+
+      result += string( "<img src=\"" ) + url.toEncoded().data() + "\" " + maxWidthStyle + " alt=\""
+        + Html::escape( filename ) + "\"/>";
+    }
+    else if ( Filetype::isNameOfVideo( filename ) ) {
+      QUrl url;
+      url.setScheme( "gdvideo" );
+      url.setHost( QString::fromUtf8( getId().c_str() ) );
+      url.setPath( Utils::Url::ensureLeadingSlash( QString::fromUtf8( filename.c_str() ) ) );
+
+      result += string( R"(<a class="dsl_s dsl_video" href=")" ) + url.toEncoded().data() + "\">"
+        + "<span class=\"img\"></span>" + "<span class=\"filename\">" + processNodeChildren( node ) + "</span>"
+        + "</a>";
+    }
+    else {
+      // Unknown file type, downgrade to a hyperlink
+
+      QUrl url;
+      url.setScheme( "bres" );
+      url.setHost( QString::fromUtf8( getId().c_str() ) );
+      url.setPath( Utils::Url::ensureLeadingSlash( QString::fromUtf8( filename.c_str() ) ) );
+
+      result +=
+        string( R"(<a class="dsl_s" href=")" ) + url.toEncoded().data() + "\">" + processNodeChildren( node ) + "</a>";
+    }
+  }
+  else if ( node.tagName == U"url" ) {
+    string link = getNodeLink( node );
+    if ( QUrl::fromEncoded( link.c_str() ).scheme().isEmpty() ) {
+      link = "http://" + link;
+    }
+
+    QUrl url( QString::fromUtf8( link.c_str() ) );
+    if ( url.isLocalFile() && url.host().isEmpty() ) {
+      // Convert relative links to local files to absolute ones
+      QString name = QFileInfo( getMainFilename() ).absolutePath();
+      name += url.toLocalFile();
+      QFileInfo info( name );
+      if ( info.isFile() ) {
+        name = info.canonicalFilePath();
+        url.setPath( Utils::Url::ensureLeadingSlash( QUrl::fromLocalFile( name ).path() ) );
+        link = string( url.toEncoded().data() );
+      }
+    }
+
+    result += R"(<a class="dsl_url" href=")" + link + "\">" + processNodeChildren( node ) + "</a>";
+  }
+  else if ( node.tagName == U"!trs" ) {
+    result += "<span class=\"dsl_trs\">" + processNodeChildren( node ) + "</span>";
+  }
+  else if ( node.tagName == U"p" ) {
+    result += "<span class=\"dsl_p\"";
+
+    string val = Text::toUtf8( node.renderAsText() );
+
+    // If we have such a key, display a title
+
+    auto i = abrv.find( val );
+
+    if ( i != abrv.end() ) {
+      string title = i->second;
+
+      result += " title=\"" + Html::escape( title ) + "\"";
+    }
+
+    result += ">" + processNodeChildren( node ) + "</span>";
+  }
+  else if ( node.tagName == U"'" ) {
+    // There are two ways to display the stress: by adding an accent sign or via font styles.
+    // We generate two spans, one with accented data and another one without it, so the
+    // user could pick up the best suitable option.
+    string data = processNodeChildren( node );
+    result += R"(<span class="dsl_stress"><span class="dsl_stress_without_accent">)" + data + "</span>"
+      + "<span class=\"dsl_stress_with_accent\">" + data + Text::toUtf8( std::u32string( 1, 0x301 ) )
+      + "</span></span>";
+  }
+  else if ( node.tagName == U"lang" ) {
+    result += "<span class=\"dsl_lang\"";
+    if ( !node.tagAttrs.empty() ) {
+      // Find ISO 639-1 code
+      string langcode;
+      QString attr = QString::fromStdU32String( node.tagAttrs );
+      int n        = attr.indexOf( "id=" );
+      if ( n >= 0 ) {
+        int id = attr.mid( n + 3 ).toInt();
+        if ( id ) {
+          langcode = findCodeForDslId( id );
+        }
+      }
+      else {
+        n = attr.indexOf( "name=\"" );
+        if ( n >= 0 ) {
+          int n2 = attr.indexOf( '\"', n + 6 );
+          if ( n2 > 0 ) {
+            quint32 id = dslLanguageToId( attr.mid( n + 6, n2 - n - 6 ).toStdU32String() );
+            langcode   = LangCoder::intToCode2( id ).toStdString();
+          }
+        }
+      }
+      if ( !langcode.empty() ) {
+        result += " lang=\"" + langcode + "\"";
+      }
+    }
+    result += ">" + processNodeChildren( node ) + "</span>";
+  }
+  else if ( node.tagName == U"ref" ) {
+    QUrl url;
+
+    url.setScheme( "gdlookup" );
+    url.setHost( "localhost" );
+    auto nodeStr = Text::toUtf32( getNodeLink( node ) );
+
+    normalizeHeadword( nodeStr );
+    url.setPath( Utils::Url::ensureLeadingSlash( QString::fromStdU32String( nodeStr ) ) );
+    if ( !node.tagAttrs.empty() ) {
+      QString attr = QString::fromStdU32String( node.tagAttrs ).remove( '\"' );
+      int n        = attr.indexOf( '=' );
+      if ( n > 0 ) {
+        QList< std::pair< QString, QString > > query;
+        query.append( std::pair< QString, QString >( attr.left( n ), attr.mid( n + 1 ) ) );
+        Utils::Url::setQueryItems( url, query );
+      }
+    }
+
+    result +=
+      string( R"(<a class="dsl_ref" href=")" ) + url.toEncoded().data() + "\">" + processNodeChildren( node ) + "</a>";
+  }
+  else if ( node.tagName == U"@" ) {
+    // Special case - insided card header was not parsed
+
+    QUrl url;
+
+    url.setScheme( "gdlookup" );
+    url.setHost( "localhost" );
+    std::u32string nodeStr = node.renderAsText();
+    normalizeHeadword( nodeStr );
+    url.setPath( Utils::Url::ensureLeadingSlash( QString::fromStdU32String( nodeStr ) ) );
+
+    result +=
+      string( R"(<a class="dsl_ref" href=")" ) + url.toEncoded().data() + "\">" + processNodeChildren( node ) + "</a>";
+  }
+  else if ( node.tagName == U"sub" ) {
+    result += "<sub>" + processNodeChildren( node ) + "</sub>";
+  }
+  else if ( node.tagName == U"sup" ) {
+    result += "<sup>" + processNodeChildren( node ) + "</sup>";
+  }
+  else if ( node.tagName == U"t" ) {
+    result += "<span class=\"dsl_t\">" + processNodeChildren( node ) + "</span>";
+  }
+  else if ( node.tagName == U"br" ) {
+    result += "<br />";
+  }
+  else {
+    qWarning( R"(DSL: Unknown tag "%s" with attributes "%s" found in "%s", article "%s".)",
+              QString::fromStdU32String( node.tagName ).toUtf8().data(),
+              QString::fromStdU32String( node.tagAttrs ).toUtf8().data(),
+              getName().c_str(),
+              QString::fromStdU32String( currentHeadword ).toUtf8().data() );
+
+    result += "<span class=\"dsl_unknown\">[" + string( QString::fromStdU32String( node.tagName ).toUtf8().data() );
+    if ( !node.tagAttrs.empty() ) {
+      result += " " + string( QString::fromStdU32String( node.tagAttrs ).toUtf8().data() );
+    }
+    result += "]" + processNodeChildren( node ) + "</span>";
+  }
+
+  return result;
+}
+
+} // namespace Legacy
@@ -0,0 +1,104 @@
+/* Licensed under GPLv3 or later, see the LICENSE file */
+
+#pragma once
+
+#include "renderer.hh"
+#include <exception>
+#include <list>
+#include <string>
+
+/// The article parsing and rendering of the DSL dictionaries as they were
+/// before the parse went into a flat node array and the rendering into one
+/// pass over it, kept to compare the current ones against.
+namespace Legacy {
+
+using std::list;
+using std::string;
+
+/// Parses the DSL language, representing it in its structural DOM form.
+struct ArticleDom
+{
+  struct Node: public list< Node >
+  {
+    bool isTag; // true if it is a tag with subnodes, false if it's a leaf text
+                // data.
+    // Those are only used if isTag is true
+    std::u32string tagName;
+    std::u32string tagAttrs;
+    std::u32string text; // This is only used if isTag is false
+
+    class Text
+    {};
+    class Tag
+    {};
+
+    Node( Tag, std::u32string const & name, std::u32string const & attrs ):
+      isTag( true ),
+      tagName( name ),
+      tagAttrs( attrs )
+    {
+    }
+
+    Node( Text, std::u32string const & text_ ):
+      isTag( false ),
+      text( text_ )
+    {
+    }
+
+    /// Concatenates all childen text nodes recursively to form all text
+    /// the node contains stripped of any markup.
+    std::u32string renderAsText( bool stripTrsTag = false ) const;
+  };
+
+  /// Does the parse at construction. Refer to the 'root' member variable
+  /// afterwards.
+  explicit ArticleDom( std::u32string const &,
+                       string const & dictName          = string(),
+                       std::u32string const & headword_ = std::u32string() );
+
+  /// Root of DOM's tree
+  Node root;
+
+private:
+
+  void openTag( std::u32string const & name, std::u32string const & attr, list< Node * > & stack );
+
+  void closeTag( std::u32string const & name, list< Node * > & stack, bool warn = true );
+
+  bool atSignFirstInLine();
+
+  char32_t const *stringPos, *lineStartPos;
+
+  class eot: std::exception
+  {};
+
+  char32_t ch;
+  bool escaped;
+  unsigned transcriptionCount; // >0 = inside a [t] tag
+  unsigned mediaCount;         // >0 = inside a [s] tag
+
+  void nextChar();
+
+  /// Information for diagnostic purposes
+  string dictionaryName;
+  std::u32string headword;
+};
+
+/// DslDictionary::dslToHtml() and its parts, building the html out of the
+/// strings the children of each node return
+class Renderer: public DslBenchmark::Renderer
+{
+public:
+
+  using DslBenchmark::Renderer::Renderer;
+
+  string dslToHtml( std::u32string const &, std::u32string const & headword = std::u32string() ) override;
+
+private:
+
+  string nodeToHtml( ArticleDom::Node const & );
+  string processNodeChildren( ArticleDom::Node const & node );
+  string getNodeLink( ArticleDom::Node const & node );
+};
+
+} // namespace Legacy
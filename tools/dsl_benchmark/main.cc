@@ -0,0 +1,242 @@
+/* Licensed under GPLv3 or later, see the LICENSE file */
+
+// This program parses and renders the articles of a .dsl file both the way
+// the DSL dictionaries did it before the flat ArticleDom and the way they do
+// it now, checks that the html comes out the same, and times the two.
+//
+//   dsl_benchmark [file.dsl] [iterations]
+//
+// Without arguments it goes through the bundled sample.dsl.
+
+#include "current.hh"
+#include "dsl_details.hh"
+#include "legacy.hh"
+#include "text.hh"
+#include <algorithm>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+using std::string;
+using std::vector;
+
+namespace {
+
+struct Article
+{
+  std::u32string headword; // As displayed
+  std::u32string body;     // With the tildes expanded
+};
+
+/// Reads the articles the way DslArticleRequest gets them, minus the index
+vector< Article > readArticles( string const & fileName )
+{
+  using namespace Dsl::Details;
+
+  DslScanner scanner( fileName );
+
+  vector< Article > articles;
+  std::u32string line;
+  size_t offset;
+  bool inBody = false;
+
+  while ( scanner.readNextLineWithoutComments( line, offset ) ) {
+    if ( line.empty() ) {
+      inBody = false;
+      continue;
+    }
+
+    if ( !DslBenchmark::isDslWs( line[ 0 ] ) ) {
+      if ( inBody || articles.empty() ) {
+        articles.emplace_back();
+        articles.back().headword = line;
+        inBody                   = false;
+      }
+      continue; // The other headwords of the article
+    }
+
+    if ( articles.empty() ) {
+      continue; // A body without a headword
+    }
+
+    Article & article = articles.back();
+    if ( !article.body.empty() ) {
+      article.body += U'\n';
+    }
+    article.body += line;
+    inBody = true;
+  }
+
+  for ( auto & article : articles ) {
+    std::u32string tildeValue = article.headword;
+    processUnsortedParts( tildeValue, false );
+    expandTildes( article.body, tildeValue );
+    processUnsortedParts( article.headword, false );
+  }
+
+  return articles;
+}
+
+/// Renders the headword and the body of every article, as html of an article
+/// request would have them
+void render( DslBenchmark::Renderer & renderer, vector< Article > const & articles, vector< string > & out )
+{
+  out.resize( articles.size() );
+
+  for ( size_t x = 0; x < articles.size(); ++x ) {
+    renderer.nextArticle();
+    out[ x ] = renderer.dslToHtml( articles[ x ].headword, articles[ x ].headword );
+    out[ x ] += renderer.dslToHtml( articles[ x ].body, articles[ x ].headword );
+  }
+}
+
+template< class Dom >
+size_t parse( vector< std::u32string > const & bodies )
+{
+  size_t parsed = 0;
+  for ( auto const & body : bodies ) {
+    Dom dom( body );
+    ++parsed;
+  }
+  return parsed;
+}
+
+void addAbbreviations( DslBenchmark::Renderer & renderer )
+{
+  renderer.addAbbreviation( "n", "noun" );
+  renderer.addAbbreviation( "v", "verb" );
+  renderer.addAbbreviation( "adj", "adjective" );
+  renderer.addAbbreviation( "pl", "plural" );
+}
+
+/// Both parsers warn about the same malformed markup, and printing it would
+/// only add the same time to both sides.
+void dropNoise( QtMsgType type, QMessageLogContext const &, QString const & message )
+{
+  if ( type == QtDebugMsg || type == QtWarningMsg || type == QtInfoMsg ) {
+    return;
+  }
+  fprintf( stderr, "%s\n", message.toLocal8Bit().constData() );
+}
+
+} // namespace
+
+int main( int argc, char ** argv )
+{
+  QCoreApplication app( argc, argv );
+
+  QStringList const args = app.arguments();
+  string const fileName  = args.size() > 1 ? args[ 1 ].toStdString() : string( DSL_BENCHMARK_CORPUS );
+  int const iterations   = args.size() > 2 ? qMax( args[ 2 ].toInt(), 1 ) : 200;
+
+  qInstallMessageHandler( dropNoise );
+
+  vector< Article > articles;
+  try {
+    articles = readArticles( fileName );
+  }
+  catch ( std::exception & e ) {
+    fprintf( stderr, "Can't read %s: %s\n", fileName.c_str(), e.what() );
+    return 2;
+  }
+
+  if ( articles.empty() ) {
+    fprintf( stderr, "No articles found in %s\n", fileName.c_str() );
+    return 2;
+  }
+
+  // The renderers parse what they get after normalizing it, so do the same
+  // for the parse timings
+  vector< std::u32string > bodies;
+  bodies.reserve( articles.size() );
+  for ( auto const & article : articles ) {
+    bodies.push_back( Text::normalize( article.body ) );
+  }
+
+  // Compare the html first
+
+  Legacy::Renderer legacy( "0123456789abcdef", "DSL benchmark", fileName );
+  Current::Renderer current( "0123456789abcdef", "DSL benchmark", fileName );
+  addAbbreviations( legacy );
+  addAbbreviations( current );
+
+  vector< string > legacyHtml, currentHtml;
+  render( legacy, articles, legacyHtml );
+  render( current, articles, currentHtml );
+
+  size_t mismatches = 0;
+  size_t htmlSize   = 0;
+  for ( size_t x = 0; x < articles.size(); ++x ) {
+    htmlSize += currentHtml[ x ].size();
+    if ( legacyHtml[ x ] == currentHtml[ x ] ) {
+      continue;
+    }
+
+    ++mismatches;
+
+    auto const diff = std::mismatch( legacyHtml[ x ].begin(),
+                                     legacyHtml[ x ].end(),
+                                     currentHtml[ x ].begin(),
+                                     currentHtml[ x ].end() );
+    size_t const at = diff.first - legacyHtml[ x ].begin();
+
+    fprintf( stderr,
+             "Mismatch in \"%s\" at byte %zu:\n  legacy:  %s\n  current: %s\n",
+             Text::toUtf8( articles[ x ].headword ).c_str(),
+             at,
+             legacyHtml[ x ].substr( at, 80 ).c_str(),
+             currentHtml[ x ].substr( at, 80 ).c_str() );
+  }
+
+  printf( "%zu articles, %zu bytes of html, %zu mismatches\n", articles.size(), htmlSize, mismatches );
+
+  // Then time them, each on its own
+
+  QElapsedTimer timer;
+  size_t sink = 0;
+
+  timer.start();
+  for ( int x = 0; x < iterations; ++x ) {
+    sink += parse< Legacy::ArticleDom >( bodies );
+  }
+  qint64 const legacyParse = timer.nsecsElapsed();
+
+  timer.start();
+  for ( int x = 0; x < iterations; ++x ) {
+    sink += parse< Dsl::Details::ArticleDom >( bodies );
+  }
+  qint64 const currentParse = timer.nsecsElapsed();
+
+  timer.start();
+  for ( int x = 0; x < iterations; ++x ) {
+    render( legacy, articles, legacyHtml );
+    sink += legacyHtml.size();
+  }
+  qint64 const legacyRender = timer.nsecsElapsed();
+
+  timer.start();
+  for ( int x = 0; x < iterations; ++x ) {
+    render( current, articles, currentHtml );
+    sink += currentHtml.size();
+  }
+  qint64 const currentRender = timer.nsecsElapsed();
+
+  double const perArticle = 1000.0 * iterations * articles.size(); // ns to us
+
+  printf( "%d iterations, checksum %zu\n", iterations, sink );
+  printf( "%-26s %12s %12s %8s\n", "", "legacy us", "current us", "speedup" );
+  printf( "%-26s %12.2f %12.2f %7.2fx\n",
+          "parse per article",
+          legacyParse / perArticle,
+          currentParse / perArticle,
+          double( legacyParse ) / qMax< qint64 >( currentParse, 1 ) );
+  printf( "%-26s %12.2f %12.2f %7.2fx\n",
+          "parse+render per article",
+          legacyRender / perArticle,
+          currentRender / perArticle,
+          double( legacyRender ) / qMax< qint64 >( currentRender, 1 ) );
+
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+/* Licensed under GPLv3 or later, see the LICENSE file */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <QByteArray>
+
+namespace DslBenchmark {
+
+using std::map;
+using std::string;
+
+/// The state of DslDictionary the article rendering reads. The benchmark has
+/// no index to load the dictionary from, so it sets these itself and lets the
+/// renderers below keep the code they were taken from as it is.
+class Renderer
+{
+public:
+
+  Renderer( string const & id_, string const & name_, string const & mainFilename_ ):
+    id( id_ ),
+    name( name_ ),
+    mainFilename( mainFilename_ )
+  {
+  }
+
+  virtual ~Renderer() = default;
+
+  /// Renders the article text the way DslDictionary::dslToHtml() does
+  virtual string dslToHtml( std::u32string const &, std::u32string const & headword = std::u32string() ) = 0;
+
+  /// Gives the [p] tags with this text the expansion as a title
+  void addAbbreviation( string const & key, string const & expansion )
+  {
+    abrv[ key ] = expansion;
+  }
+
+  /// Counts the articles rendered, which numbers the optional parts' ids
+  void nextArticle()
+  {
+    ++articleNom;
+  }
+
+protected:
+
+  struct IdxHeader
+  {
+    bool hasSoundDictionaryName = false;
+  };
+
+  string const & getId() const
+  {
+    return id;
+  }
+
+  string const & getName() const
+  {
+    return name;
+  }
+
+  string const & getMainFilename() const
+  {
+    return mainFilename;
+  }
+
+  /// The real one only hands the link over to the pronounce engine and never
+  /// adds anything to the html
+  static string addAudioLink( QByteArray const &, string const & )
+  {
+    return string();
+  }
+
+  string id, name, mainFilename;
+  string resourceDir1;
+  string preferredSoundDictionary;
+  IdxHeader idxHeader;
+  map< string, string > abrv;
+  std::u32string currentHeadword;
+  int optionalPartNom = 0;
+  quint8 articleNom   = 0;
+};
+
+/// Same as in dsl.cc
+inline bool isDslWs( char32_t ch )
+{
+  switch ( ch ) {
+    case ' ':
+    case '\t':
+      return true;
+    default:
+      return false;
+  }
+}
+
+} // namespace DslBenchmark